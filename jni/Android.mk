@@ -16,9 +16,128 @@ include $(PREBUILT_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
 LOCAL_MODULE := audioneex-jni
-LOCAL_SRC_FILES := audioneex-jni.cpp TCDataStore.cpp
+LOCAL_SRC_FILES := audioneex-jni.cpp TCDataStore.cpp Resampler.cpp \
+                   SampleConvert.cpp SampleConvertNeon.cpp.neon
 LOCAL_C_INCLUDES += $(MY_INCLUDES)
 LOCAL_CPPFLAGS += -std=c++11
 LOCAL_SHARED_LIBRARIES := audioneex tokyocabinet
+LOCAL_STATIC_LIBRARIES := cpufeatures
 LOCAL_LDLIBS := -llog
 include $(BUILD_SHARED_LIBRARY)
+
+# Command line tools
+
+MY_DATASTORES := TCDataStore.cpp SHMDataStore.cpp LSMDataStore.cpp \
+                 RemoteDataStore.cpp BlockProtocol.cpp
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := shm-publish
+LOCAL_SRC_FILES := tools/shm-publish.cpp TCDataStore.cpp SHMDataStore.cpp
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := tokyocabinet
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := blockserver
+LOCAL_SRC_FILES := tools/blockserver.cpp TCDataStore.cpp BlockProtocol.cpp BlockServer.cpp
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := tokyocabinet
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := reindex
+LOCAL_SRC_FILES := tools/reindex.cpp Reindexer.cpp TCDataStore.cpp MemoryGovernor.cpp
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := audioneex tokyocabinet
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := parallel-index
+LOCAL_SRC_FILES := tools/parallel-index.cpp ParallelIndexBuilder.cpp TCDataStore.cpp \
+                   WavAudioProvider.cpp MappedWavSource.cpp Resampler.cpp \
+                   SampleConvert.cpp SampleConvertNeon.cpp.neon
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := audioneex tokyocabinet
+LOCAL_STATIC_LIBRARIES := cpufeatures
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := replay
+LOCAL_SRC_FILES := tools/replay.cpp TracingDataStore.cpp $(MY_DATASTORES)
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := audioneex tokyocabinet
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gen-index
+LOCAL_SRC_FILES := tools/gen-index.cpp SyntheticIndex.cpp $(MY_DATASTORES)
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := audioneex tokyocabinet
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := storage-bench
+LOCAL_SRC_FILES := tools/storage-bench.cpp SyntheticIndex.cpp $(MY_DATASTORES)
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := audioneex tokyocabinet
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := audioblock-bench
+LOCAL_SRC_FILES := tools/audioblock-bench.cpp SampleConvert.cpp SampleConvertNeon.cpp.neon \
+                   $(MY_DATASTORES)
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_SHARED_LIBRARIES := audioneex tokyocabinet
+LOCAL_STATIC_LIBRARIES := cpufeatures
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := wavdecode-bench
+LOCAL_SRC_FILES := tools/wavdecode-bench.cpp MappedWavSource.cpp Resampler.cpp \
+                   SampleConvert.cpp SampleConvertNeon.cpp.neon
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_STATIC_LIBRARIES := cpufeatures
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := resampler-bench
+LOCAL_SRC_FILES := tools/resampler-bench.cpp Resampler.cpp \
+                   SampleConvert.cpp SampleConvertNeon.cpp.neon
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_STATIC_LIBRARIES := cpufeatures
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := channelmix-bench
+LOCAL_SRC_FILES := tools/channelmix-bench.cpp SampleConvert.cpp SampleConvertNeon.cpp.neon
+LOCAL_C_INCLUDES += $(MY_INCLUDES) $(LOCAL_PATH)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_STATIC_LIBRARIES := cpufeatures
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := samplekernel-test
+LOCAL_SRC_FILES := tools/samplekernel-test.cpp SampleConvert.cpp SampleConvertNeon.cpp.neon
+LOCAL_C_INCLUDES += $(MY_INCLUDES)
+LOCAL_CPPFLAGS += -std=c++11
+LOCAL_STATIC_LIBRARIES := cpufeatures
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := framequeue-test
+LOCAL_SRC_FILES := tools/framequeue-test.cpp
+LOCAL_C_INCLUDES += $(MY_INCLUDES)
+LOCAL_CPPFLAGS += -std=c++11
+include $(BUILD_EXECUTABLE)
+
+$(call import-module,android/cpufeatures)
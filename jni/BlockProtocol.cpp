@@ -0,0 +1,206 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/un.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "BlockProtocol.h"
+
+using namespace std;
+
+
+namespace {
+
+/// Split a "tcp:<host>:<port>" address into host and port
+void ParseTCPAddress(const string &address, string &host, string &port)
+{
+    size_t sep = address.rfind(':');
+    if(sep == string::npos || sep < 4)
+       throw invalid_argument("Invalid block server address "+address);
+    host = address.substr(4, sep - 4);
+    port = address.substr(sep + 1);
+}
+
+bool IsUnixAddress(const string &address)
+{
+    return address.compare(0, 5, "unix:") == 0;
+}
+
+bool IsTCPAddress(const string &address)
+{
+    return address.compare(0, 4, "tcp:") == 0;
+}
+
+/// Create a Unix domain socket address
+sockaddr_un MakeUnixAddress(const string &address)
+{
+    sockaddr_un addr = {};
+    string path = address.substr(5);
+    if(path.empty() || path.size() >= sizeof(addr.sun_path))
+       throw invalid_argument("Invalid block server socket path "+path);
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    return addr;
+}
+
+}// unnamed namespace
+
+
+// ----------------------------------------------------------------------------
+
+int BSConnect(const string &address)
+{
+    int fd = -1;
+
+    if(IsUnixAddress(address))
+    {
+       sockaddr_un addr = MakeUnixAddress(address);
+       fd = socket(AF_UNIX, SOCK_STREAM, 0);
+       if(fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0){
+          close(fd);
+          fd = -1;
+       }
+    }
+    else if(IsTCPAddress(address))
+    {
+       string host, port;
+       ParseTCPAddress(address, host, port);
+
+       addrinfo hints = {}, *res = nullptr;
+       hints.ai_family = AF_UNSPEC;
+       hints.ai_socktype = SOCK_STREAM;
+
+       if(getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+          throw runtime_error("Couldn't resolve "+address);
+
+       for(addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next){
+           fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+           if(fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0){
+              close(fd);
+              fd = -1;
+           }
+       }
+       freeaddrinfo(res);
+
+       // Requests are small and latency bound
+       int flag = 1;
+       if(fd >= 0)
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+    else
+       throw invalid_argument("Invalid block server address "+address);
+
+    if(fd < 0)
+       throw runtime_error("Couldn't connect to "+address);
+
+    return fd;
+}
+
+// ----------------------------------------------------------------------------
+
+int BSListen(const string &address)
+{
+    int fd = -1;
+
+    if(IsUnixAddress(address))
+    {
+       sockaddr_un addr = MakeUnixAddress(address);
+       unlink(addr.sun_path);
+       fd = socket(AF_UNIX, SOCK_STREAM, 0);
+       if(fd >= 0 && bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0){
+          close(fd);
+          fd = -1;
+       }
+    }
+    else if(IsTCPAddress(address))
+    {
+       string host, port;
+       ParseTCPAddress(address, host, port);
+
+       addrinfo hints = {}, *res = nullptr;
+       hints.ai_family = AF_UNSPEC;
+       hints.ai_socktype = SOCK_STREAM;
+       hints.ai_flags = AI_PASSIVE;
+
+       const char *phost = host.empty() || host == "*" ? nullptr : host.c_str();
+
+       if(getaddrinfo(phost, port.c_str(), &hints, &res) != 0)
+          throw runtime_error("Couldn't resolve "+address);
+
+       for(addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next){
+           fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+           int flag = 1;
+           if(fd >= 0)
+              setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+           if(fd >= 0 && bind(fd, ai->ai_addr, ai->ai_addrlen) != 0){
+              close(fd);
+              fd = -1;
+           }
+       }
+       freeaddrinfo(res);
+    }
+    else
+       throw invalid_argument("Invalid block server address "+address);
+
+    if(fd < 0 || listen(fd, SOMAXCONN) != 0){
+       if(fd >= 0) close(fd);
+       throw runtime_error("Couldn't listen on "+address);
+    }
+
+    return fd;
+}
+
+// ----------------------------------------------------------------------------
+
+bool BSReadFull(int fd, void *data, size_t size)
+{
+    uint8_t *p = static_cast<uint8_t*>(data);
+    while(size > 0){
+        ssize_t n = recv(fd, p, size, 0);
+        if(n < 0 && errno == EINTR)
+           continue;
+        if(n <= 0)
+           return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+bool BSWriteFull(int fd, const void *data, size_t size)
+{
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+    while(size > 0){
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+           continue;
+        if(n <= 0)
+           return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
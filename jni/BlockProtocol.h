@@ -0,0 +1,84 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef BLOCKPROTOCOL_H
+#define BLOCKPROTOCOL_H
+
+/// Wire protocol spoken between the block server and RemoteDataStore.
+/// Clients send batches of requests and receive one response per request,
+/// in the same order. A batch is a BSBatchHeader followed by 'Count' BSRequest
+/// records. A response batch is a BSBatchHeader followed by 'Count' BSResponse
+/// records, each immediately followed by 'Size' bytes of data.
+/// All the fields are in host byte order, so client and server hosts must
+/// share the same endianness.
+
+#include <cstdint>
+#include <string>
+
+/// Request operations
+enum {
+    BS_GET_BLOCK = 1,          ///< Arg1: list id, Arg2: block id
+    BS_GET_FINGERPRINT,        ///< Arg1: FID, Arg2: offset, Arg3: bytes (0 = all)
+    BS_GET_FINGERPRINT_SIZE,   ///< Arg1: FID
+    BS_GET_FINGERPRINTS_COUNT,
+    BS_GET_METADATA,           ///< Arg1: FID
+    BS_GET_INFO,
+    BS_IS_DELETED,             ///< Arg1: FID
+    BS_IS_EMPTY
+};
+
+/// Response status codes
+enum {
+    BS_OK = 0,
+    BS_NOT_FOUND,
+    BS_ERROR
+};
+
+const uint32_t BS_MAGIC     = 0x41584253;  // "SBXA"
+const uint32_t BS_MAX_BATCH = 4096;
+
+struct BSBatchHeader
+{
+    uint32_t Magic;
+    uint32_t Count;
+};
+
+struct BSRequest
+{
+    uint32_t Op;
+    uint32_t Arg1;
+    uint32_t Arg2;
+    uint32_t Arg3;
+};
+
+struct BSResponse
+{
+    uint32_t Status;
+    uint32_t Size;
+};
+
+/// Connect to a block server. The address is either "unix:<socket path>"
+/// or "tcp:<host>:<port>". Return the connected socket descriptor.
+int BSConnect(const std::string &address);
+
+/// Create a listening socket for the given address (see BSConnect()).
+/// A host of '*' in TCP addresses binds all the interfaces.
+int BSListen(const std::string &address);
+
+/// Read exactly 'size' bytes from the socket. Return false on EOF or error.
+bool BSReadFull(int fd, void *data, size_t size);
+
+/// Write exactly 'size' bytes to the socket. Return false on error.
+bool BSWriteFull(int fd, const void *data, size_t size);
+
+
+#endif
@@ -0,0 +1,240 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "BlockServer.h"
+
+using namespace std;
+
+
+
+//=============================================================================
+//                                BlockServer
+//=============================================================================
+
+
+
+BlockServer::BlockServer(KVDataStore *dstore, const string &address) :
+    m_DataStore (dstore),
+    m_Address   (address),
+    m_ListenFD  (-1),
+    m_Running   (false)
+{
+    if(m_DataStore == nullptr)
+       throw invalid_argument("BlockServer: null datastore");
+
+    m_ListenFD = BSListen(m_Address);
+    m_Running = true;
+}
+
+// ----------------------------------------------------------------------------
+
+BlockServer::~BlockServer()
+{
+    Stop();
+}
+
+// ----------------------------------------------------------------------------
+
+void BlockServer::Run()
+{
+    while(m_Running)
+    {
+        int fd = accept(m_ListenFD.load(), nullptr, nullptr);
+
+        if(fd < 0){
+           if(errno == EINTR || errno == ECONNABORTED)
+              continue;
+           break;
+        }
+
+        std::lock_guard<std::mutex> lock(m_ClientsMutex);
+
+        // Stop() may have taken the clients while this one was accepted,
+        // in which case nobody would shut it down or join its thread
+        if(!m_Running){
+           close(fd);
+           break;
+        }
+
+        // Join the threads of the closed connections
+        for(size_t i=0; i<m_Finished.size(); i++){
+            std::map<int,std::thread>::iterator it = m_Clients.find(m_Finished[i]);
+            if(it != m_Clients.end()){
+               it->second.join();
+               close(it->first);
+               m_Clients.erase(it);
+            }
+        }
+        m_Finished.clear();
+
+        m_Clients[fd] = std::thread(&BlockServer::ServeClient, this, fd);
+    }
+
+    m_Running = false;
+}
+
+// ----------------------------------------------------------------------------
+
+void BlockServer::Stop()
+{
+    m_Running = false;
+
+    // Run() may be waiting on the socket in another thread. Only one
+    // caller gets to close it.
+    int lfd = m_ListenFD.exchange(-1);
+    if(lfd >= 0){
+       shutdown(lfd, SHUT_RDWR);
+       close(lfd);
+    }
+
+    std::map<int,std::thread> clients;
+    {
+        std::lock_guard<std::mutex> lock(m_ClientsMutex);
+        std::map<int,std::thread>::iterator it = m_Clients.begin();
+        for(; it != m_Clients.end(); ++it)
+            shutdown(it->first, SHUT_RDWR);
+        clients.swap(m_Clients);
+        m_Finished.clear();
+    }
+
+    std::map<int,std::thread>::iterator it = clients.begin();
+    for(; it != clients.end(); ++it){
+        it->second.join();
+        close(it->first);
+    }
+
+    if(m_Address.compare(0, 5, "unix:") == 0)
+       unlink(m_Address.substr(5).c_str());
+}
+
+// ----------------------------------------------------------------------------
+
+void BlockServer::ServeClient(int fd)
+{
+    std::vector<BSRequest> requests;
+    std::vector<uint8_t> response;
+
+    BSBatchHeader bhdr;
+
+    while(BSReadFull(fd, &bhdr, sizeof(bhdr)))
+    {
+        if(bhdr.Magic != BS_MAGIC || bhdr.Count == 0 || bhdr.Count > BS_MAX_BATCH)
+           break;
+
+        requests.resize(bhdr.Count);
+
+        if(!BSReadFull(fd, requests.data(), requests.size() * sizeof(BSRequest)))
+           break;
+
+        response.resize(sizeof(BSBatchHeader));
+        *reinterpret_cast<BSBatchHeader*>(response.data()) = bhdr;
+
+        // Serve the whole batch holding the datastore lock once
+        {
+            std::lock_guard<std::mutex> lock(m_DataStoreMutex);
+            for(size_t i=0; i<requests.size(); i++)
+                Process(requests[i], response);
+        }
+
+        if(!BSWriteFull(fd, response.data(), response.size()))
+           break;
+    }
+
+    // NOTE: The socket is closed when the thread is reaped, so that the
+    //       descriptor (the key in the connections map) can't be reused
+    //       by a new connection in the meantime.
+    std::lock_guard<std::mutex> lock(m_ClientsMutex);
+    m_Finished.push_back(fd);
+    shutdown(fd, SHUT_RDWR);
+}
+
+// ----------------------------------------------------------------------------
+
+void BlockServer::Process(const BSRequest &req, std::vector<uint8_t> &out)
+{
+    BSResponse res = {BS_OK, 0};
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    uint64_t value = 0;
+    std::string str;
+
+    try{
+       switch(req.Op)
+       {
+          case BS_GET_BLOCK:
+               data = m_DataStore->GetPListBlock(req.Arg1, req.Arg2, size, true);
+               break;
+          case BS_GET_FINGERPRINT:
+               if(m_DataStore->GetFingerprintSize(req.Arg1) > req.Arg2)
+                  data = m_DataStore->GetFingerprint(req.Arg1, size, req.Arg3, req.Arg2);
+               break;
+          case BS_GET_FINGERPRINT_SIZE:
+               value = m_DataStore->GetFingerprintSize(req.Arg1);
+               data = reinterpret_cast<const uint8_t*>(&value);
+               size = sizeof(value);
+               break;
+          case BS_GET_FINGERPRINTS_COUNT:
+               value = m_DataStore->GetFingerprintsCount();
+               data = reinterpret_cast<const uint8_t*>(&value);
+               size = sizeof(value);
+               break;
+          case BS_GET_METADATA:
+               str = m_DataStore->GetMetadata(req.Arg1);
+               data = reinterpret_cast<const uint8_t*>(str.data());
+               size = str.size();
+               break;
+          case BS_GET_INFO:
+               value = static_cast<uint32_t>(m_DataStore->GetInfo().MatchType);
+               data = reinterpret_cast<const uint8_t*>(&value);
+               size = sizeof(value);
+               break;
+          case BS_IS_DELETED:
+               value = m_DataStore->IsDeleted(req.Arg1) ? 1 : 0;
+               data = reinterpret_cast<const uint8_t*>(&value);
+               size = sizeof(value);
+               break;
+          case BS_IS_EMPTY:
+               value = m_DataStore->Empty() ? 1 : 0;
+               data = reinterpret_cast<const uint8_t*>(&value);
+               size = sizeof(value);
+               break;
+          default:
+               res.Status = BS_ERROR;
+       }
+    }
+    catch(const std::exception&){
+       res.Status = BS_ERROR;
+       data = nullptr;
+       size = 0;
+    }
+
+    if(res.Status == BS_OK && (data == nullptr || size == 0) &&
+       req.Op != BS_GET_METADATA)
+       res.Status = BS_NOT_FOUND;
+
+    res.Size = res.Status == BS_OK ? size : 0;
+
+    const uint8_t *pres = reinterpret_cast<const uint8_t*>(&res);
+    out.insert(out.end(), pres, pres + sizeof(res));
+    if(res.Size)
+       out.insert(out.end(), data, data + res.Size);
+}
+
@@ -0,0 +1,63 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef BLOCKSERVER_H
+#define BLOCKSERVER_H
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <map>
+
+#include "KVDataStore.h"
+#include "BlockProtocol.h"
+
+/// Serves the data of one opened datastore to many recognizer processes
+/// (see RemoteDataStore) over Unix domain or TCP sockets. Each connection is
+/// handled by its own thread, while the access to the datastore is serialized,
+/// so one RAM-resident copy of the index can back all the recognizers on a
+/// host (or on a LAN).
+
+class BlockServer
+{
+    KVDataStore*              m_DataStore;      ///< The served datastore (not owned)
+    std::string               m_Address;        ///< Listening address
+    std::atomic<int>          m_ListenFD;
+    std::atomic<bool>         m_Running;
+
+    std::mutex                m_DataStoreMutex;
+    std::mutex                m_ClientsMutex;
+    std::map<int,std::thread> m_Clients;        ///< Connection threads by socket
+    std::vector<int>          m_Finished;       ///< Connections to be reaped
+
+    void ServeClient(int fd);
+
+    /// Process a request appending the response to 'out'
+    void Process(const BSRequest &req, std::vector<uint8_t> &out);
+
+public:
+
+    /// Create a server listening on the given address (see BSConnect()).
+    BlockServer(KVDataStore *dstore, const std::string &address);
+    ~BlockServer();
+
+    /// Accept and serve connections until Stop() is called.
+    void Run();
+
+    /// Stop the server and close all the connections.
+    void Stop();
+
+    bool IsRunning() const { return m_Running; }
+};
+
+
+#endif
@@ -0,0 +1,174 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef DATASTORESTATS_H
+#define DATASTORESTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/// Snapshot of the read statistics of a datastore collection
+struct CollectionStats
+{
+    /// Number of latency histogram buckets. Bucket 0 counts the reads taking
+    /// less than 1 us, bucket i those taking [2^(i-1), 2^i) us, and the last
+    /// one all the slower reads.
+    static const int LATENCY_BUCKETS = 24;
+
+    uint64_t Calls;       ///< Number of reads
+    uint64_t Bytes;       ///< Bytes returned
+    uint64_t Hits;        ///< Reads served from memory without accessing the database
+    uint64_t Misses;      ///< Reads of missing records
+    uint64_t DBTime;      ///< Time spent in Tokyo Cabinet (ns)
+    uint64_t CopyTime;    ///< Time spent copying the records out (ns)
+    uint64_t Latency[LATENCY_BUCKETS];
+
+    /// Estimate the given latency percentile (0-1) from the histogram, as
+    /// the upper bound of the bucket it falls into (in us).
+    double GetPercentile(double p) const
+    {
+        uint64_t total = 0;
+        for(int i=0; i<LATENCY_BUCKETS; i++)
+            total += Latency[i];
+
+        if(total == 0)
+           return 0;
+
+        uint64_t rank = static_cast<uint64_t>(p * total + 0.5);
+        uint64_t count = 0;
+        for(int i=0; i<LATENCY_BUCKETS; i++){
+            count += Latency[i];
+            if(count >= rank && count > 0)
+               return static_cast<double>(uint64_t(1) << i);
+        }
+        return static_cast<double>(uint64_t(1) << (LATENCY_BUCKETS - 1));
+    }
+
+    /// Get the statistics accumulated since the given snapshot
+    CollectionStats operator-(const CollectionStats &prev) const
+    {
+        CollectionStats d;
+        d.Calls    = Calls - prev.Calls;
+        d.Bytes    = Bytes - prev.Bytes;
+        d.Hits     = Hits - prev.Hits;
+        d.Misses   = Misses - prev.Misses;
+        d.DBTime   = DBTime - prev.DBTime;
+        d.CopyTime = CopyTime - prev.CopyTime;
+        for(int i=0; i<LATENCY_BUCKETS; i++)
+            d.Latency[i] = Latency[i] - prev.Latency[i];
+        return d;
+    }
+};
+
+/// Snapshot of the read statistics of a datastore. Taking a snapshot before
+/// and after an identification gives its storage cost.
+struct DataStoreStats
+{
+    CollectionStats  Index;
+    CollectionStats  Fingerprints;
+    CollectionStats  Metadata;
+
+    DataStoreStats operator-(const DataStoreStats &prev) const
+    {
+        DataStoreStats d;
+        d.Index        = Index - prev.Index;
+        d.Fingerprints = Fingerprints - prev.Fingerprints;
+        d.Metadata     = Metadata - prev.Metadata;
+        return d;
+    }
+};
+
+// ----------------------------------------------------------------------------
+
+/// Read statistics counters. They are updated with relaxed atomic operations,
+/// so readers on several threads never contend on a lock. A snapshot taken
+/// while reads are in progress may count a read in some counters but not
+/// yet in others.
+
+class StatsCounters
+{
+    std::atomic<uint64_t>  m_Calls;
+    std::atomic<uint64_t>  m_Bytes;
+    std::atomic<uint64_t>  m_Hits;
+    std::atomic<uint64_t>  m_Misses;
+    std::atomic<uint64_t>  m_DBTime;
+    std::atomic<uint64_t>  m_CopyTime;
+    std::atomic<uint64_t>  m_Latency[CollectionStats::LATENCY_BUCKETS];
+
+public:
+
+    StatsCounters() { Reset(); }
+
+    /// Get a monotonic timestamp in ns for the time measurements
+    static uint64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// Record a read returning 'bytes' bytes, which spent 'db_time' ns in the
+    /// database and 'copy_time' ns copying the record out
+    void Record(size_t bytes, uint64_t db_time, uint64_t copy_time, bool hit, bool found)
+    {
+        const std::memory_order relaxed = std::memory_order_relaxed;
+
+        m_Calls.fetch_add(1, relaxed);
+        m_Bytes.fetch_add(bytes, relaxed);
+        m_DBTime.fetch_add(db_time, relaxed);
+        m_CopyTime.fetch_add(copy_time, relaxed);
+        if(hit)
+           m_Hits.fetch_add(1, relaxed);
+        if(!found)
+           m_Misses.fetch_add(1, relaxed);
+
+        uint64_t us = (db_time + copy_time) / 1000;
+        int bucket = 0;
+        while(us && bucket < CollectionStats::LATENCY_BUCKETS - 1){
+            us >>= 1;
+            bucket++;
+        }
+        m_Latency[bucket].fetch_add(1, relaxed);
+    }
+
+    CollectionStats Snapshot() const
+    {
+        const std::memory_order relaxed = std::memory_order_relaxed;
+
+        CollectionStats s;
+        s.Calls    = m_Calls.load(relaxed);
+        s.Bytes    = m_Bytes.load(relaxed);
+        s.Hits     = m_Hits.load(relaxed);
+        s.Misses   = m_Misses.load(relaxed);
+        s.DBTime   = m_DBTime.load(relaxed);
+        s.CopyTime = m_CopyTime.load(relaxed);
+        for(int i=0; i<CollectionStats::LATENCY_BUCKETS; i++)
+            s.Latency[i] = m_Latency[i].load(relaxed);
+        return s;
+    }
+
+    void Reset()
+    {
+        m_Calls = 0;
+        m_Bytes = 0;
+        m_Hits = 0;
+        m_Misses = 0;
+        m_DBTime = 0;
+        m_CopyTime = 0;
+        for(int i=0; i<CollectionStats::LATENCY_BUCKETS; i++)
+            m_Latency[i] = 0;
+    }
+};
+
+
+#endif
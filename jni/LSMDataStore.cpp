@@ -0,0 +1,1064 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "LSMDataStore.h"
+
+using namespace std;
+using namespace Audioneex;
+
+namespace {
+
+const char     LSM_MAGIC[8]   = {'A','N','X','L','S','M','0','1'};
+const uint32_t LSM_VERSION    = 1;
+const char     LSM_MANIFEST[] = "data.lsm";
+
+inline uint64_t EntryKey(const LSMSegmentEntry &e)
+{
+    return BlockKey(e.ListID, e.BlockID);
+}
+
+/// Append the block fragment 'frag' to the block (or fragment) of the given
+/// size held in 'block'. The headers are replaced with the fragment's ones
+/// and its body appended. 'size' is updated with the new block size.
+void AppendFragment(vector<uint8_t> &block, size_t &size,
+                    const uint8_t *frag, size_t fsize, bool first)
+{
+    size_t lhsize = first ? sizeof(PListHeader) : 0;
+    size_t hsize = lhsize + sizeof(PListBlockHeader);
+
+    assert(fsize >= lhsize);
+
+    // Skip the parts of the fragment already present in the block. If the
+    // block only consists of the list header the fragment's block header is
+    // appended along with the body.
+    size_t skip = size == 0      ? 0 :
+                  fsize <= lhsize ? fsize :
+                  size <= lhsize  ? lhsize : hsize;
+
+    if(size + fsize - skip > block.size())
+       block.resize(size + fsize - skip);
+
+    if(size > 0){
+       // Replace the list header
+       std::copy(frag, frag + lhsize, block.begin());
+       // Replace the block header
+       if(skip == hsize)
+          std::copy(frag + lhsize, frag + hsize, block.begin() + lhsize);
+    }
+
+    std::copy(frag + skip, frag + fsize, block.begin() + size);
+    size += fsize - skip;
+}
+
+/// Merge the given segments, calling 'out' with the merged fragment of every
+/// block found in the segments, in key order.
+void MergeSegments(const vector<LSMSegment::Ptr> &segs,
+                   const std::function<void(int,int,const uint8_t*,size_t)> &out)
+{
+    vector<size_t> pos(segs.size(), 0);
+    vector<uint8_t> block;
+
+    for(;;)
+    {
+        // Find the smallest key among the segments' current entries
+        bool found = false;
+        uint64_t key = 0;
+
+        for(size_t i=0; i<segs.size(); i++){
+            if(pos[i] < segs[i]->GetCount()){
+               uint64_t k = EntryKey(segs[i]->GetEntry(pos[i]));
+               if(!found || k < key){
+                  key = k;
+                  found = true;
+               }
+            }
+        }
+
+        if(!found)
+           break;
+
+        // Merge its fragments, oldest first
+        size_t size = 0;
+        int list_id = 0, block_id = 0;
+
+        for(size_t i=0; i<segs.size(); i++){
+            if(pos[i] < segs[i]->GetCount()){
+               const LSMSegmentEntry &e = segs[i]->GetEntry(pos[i]);
+               if(EntryKey(e) == key){
+                  AppendFragment(block, size, segs[i]->GetData(e), e.Size, e.BlockID==1);
+                  list_id = e.ListID;
+                  block_id = e.BlockID;
+                  pos[i]++;
+               }
+            }
+        }
+
+        out(list_id, block_id, block.data(), size);
+    }
+}
+
+} // namespace
+
+
+
+//=============================================================================
+//                                LSMSegment
+//=============================================================================
+
+
+
+LSMSegment::LSMSegment(const string &path) :
+    m_Path    (path),
+    m_Base    (nullptr),
+    m_Size    (0),
+    m_Header  (nullptr),
+    m_Entries (nullptr)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if(fd < 0)
+       throw runtime_error("Couldn't open segment " + path);
+
+    struct stat st;
+
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(LSMSegmentHeader)){
+       close(fd);
+       throw runtime_error("Invalid segment " + path);
+    }
+
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(addr == MAP_FAILED)
+       throw runtime_error("Couldn't map segment " + path);
+
+    m_Base = static_cast<const uint8_t*>(addr);
+    m_Size = st.st_size;
+    m_Header = reinterpret_cast<const LSMSegmentHeader*>(m_Base);
+
+    if(memcmp(m_Header->Magic, LSM_MAGIC, sizeof(LSM_MAGIC)) != 0 ||
+       m_Header->Version != LSM_VERSION ||
+       m_Header->Size != m_Size ||
+       m_Header->Table > m_Size ||
+       m_Header->Count > (m_Size - m_Header->Table) / sizeof(LSMSegmentEntry))
+    {
+       munmap(const_cast<uint8_t*>(m_Base), m_Size);
+       throw runtime_error("Invalid segment " + path);
+    }
+
+    m_Entries = reinterpret_cast<const LSMSegmentEntry*>(m_Base + m_Header->Table);
+}
+
+// ----------------------------------------------------------------------------
+
+LSMSegment::~LSMSegment()
+{
+    munmap(const_cast<uint8_t*>(m_Base), m_Size);
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* LSMSegment::Find(int list_id, int block_id, size_t &size) const
+{
+    uint64_t key = BlockKey(list_id, block_id);
+
+    const LSMSegmentEntry *end = m_Entries + m_Header->Count;
+    const LSMSegmentEntry *e = std::lower_bound(m_Entries, end, key,
+        [](const LSMSegmentEntry &entry, uint64_t k){ return EntryKey(entry) < k; });
+
+    if(e == end || EntryKey(*e) != key){
+       size = 0;
+       return nullptr;
+    }
+
+    size = e->Size;
+    return m_Base + e->Offset;
+}
+
+
+
+//=============================================================================
+//                             LSMSegmentWriter
+//=============================================================================
+
+
+
+LSMSegmentWriter::LSMSegmentWriter(const string &path) :
+    m_Path    (path),
+    m_TmpPath (path + ".tmp"),
+    m_File    (nullptr),
+    m_Offset  (sizeof(LSMSegmentHeader))
+{
+    m_File = fopen(m_TmpPath.c_str(), "wb");
+
+    if(m_File == nullptr)
+       throw runtime_error("Couldn't create segment " + m_TmpPath);
+
+    // Reserve space for the header, written on commit
+    LSMSegmentHeader hdr = {};
+    fwrite(&hdr, sizeof(hdr), 1, m_File);
+}
+
+// ----------------------------------------------------------------------------
+
+LSMSegmentWriter::~LSMSegmentWriter()
+{
+    // Discard uncommitted segments
+    if(m_File){
+       fclose(m_File);
+       std::remove(m_TmpPath.c_str());
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMSegmentWriter::Append(int list_id, int block_id, const uint8_t *data, size_t size)
+{
+    assert(m_File);
+    assert(data && size);
+    assert(m_Entries.empty() ||
+           EntryKey(m_Entries.back()) < BlockKey(list_id, block_id));
+
+    if(fwrite(data, 1, size, m_File) != size)
+       throw runtime_error("Couldn't write segment " + m_TmpPath);
+
+    LSMSegmentEntry e = {list_id, block_id, m_Offset, size};
+    m_Entries.push_back(e);
+    m_Offset += size;
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMSegmentWriter::Commit()
+{
+    assert(m_File);
+
+    LSMSegmentHeader hdr = {};
+    std::memcpy(hdr.Magic, LSM_MAGIC, sizeof(LSM_MAGIC));
+    hdr.Version = LSM_VERSION;
+    hdr.Count = m_Entries.size();
+    hdr.Table = m_Offset;
+    hdr.Size = m_Offset + m_Entries.size() * sizeof(LSMSegmentEntry);
+
+    bool ok = (m_Entries.empty() ||
+               fwrite(m_Entries.data(), sizeof(LSMSegmentEntry), m_Entries.size(), m_File)
+               == m_Entries.size()) &&
+              fseek(m_File, 0, SEEK_SET) == 0 &&
+              fwrite(&hdr, sizeof(hdr), 1, m_File) == 1 &&
+              fflush(m_File) == 0 &&
+              fsync(fileno(m_File)) == 0;
+
+    if(!ok)
+       throw runtime_error("Couldn't write segment " + m_TmpPath);
+
+    fclose(m_File);
+    m_File = nullptr;
+
+    if(std::rename(m_TmpPath.c_str(), m_Path.c_str()) != 0){
+       std::remove(m_TmpPath.c_str());
+       throw runtime_error("Couldn't create segment " + m_Path);
+    }
+}
+
+
+
+//=============================================================================
+//                               LSMDataStore
+//=============================================================================
+
+
+
+LSMDataStore::LSMDataStore(const string &url) :
+    m_DBURL         (url),
+    m_QFingerprints (nullptr),
+    m_Metadata      (nullptr),
+    m_Info          (nullptr),
+    m_Tombstones    (nullptr),
+    m_NextFile      (1),
+    m_MemTableSize  (0),
+    m_MemTableLimit (64*1024*1024),
+    m_MaxSegments   (8),
+    m_Compacting    (false),
+    m_Op            (GET),
+    m_IsOpen        (false),
+    m_ReadBuffer    (32768)
+{
+    m_QFingerprints.SetName("data.qfp");
+    m_Metadata.SetName("data.met");
+    m_Info.SetName("data.inf");
+    m_Tombstones.SetName("data.del");
+}
+
+// ----------------------------------------------------------------------------
+
+LSMDataStore::~LSMDataStore()
+{
+    StopCompaction();
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::Open(eOperation op, bool use_fing_db, bool use_meta_db, bool use_info_db)
+{
+    int open_mode = op == GET ? OPEN_READ : OPEN_READ_WRITE;
+
+    if(m_IsOpen)
+       Close();
+
+    // Append the path separator if missing (Windows accepts '/' as well)
+    m_DBURL += m_DBURL.empty() ? "" :
+              (m_DBURL.back()=='/' || m_DBURL.back()=='\\' ? "" : "/");
+
+    m_QFingerprints.SetURL(m_DBURL);
+    m_Metadata.SetURL(m_DBURL);
+    m_Info.SetURL(m_DBURL);
+    m_Tombstones.SetURL(m_DBURL);
+
+    string base;
+    vector<string> segments;
+    bool has_manifest = ReadManifest(base, segments, m_NextFile);
+
+    // Create the base index if we're building a new datastore
+    if(op != GET && !has_manifest){
+       TCIndex index(nullptr);
+       index.SetURL(m_DBURL);
+       index.SetName("data.idx");
+       index.Open(OPEN_READ_WRITE);
+       index.Close();
+    }
+
+    bool changed;
+    SnapshotPtr snap = LoadSnapshot(SnapshotPtr(), changed);
+
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        m_Snapshot = snap;
+        if(op != GET && !has_manifest)
+           WriteManifest(*snap);
+    }
+
+    if(use_fing_db)
+       m_QFingerprints.Open(open_mode);
+
+    if(use_meta_db)
+       m_Metadata.Open(open_mode);
+
+    if(use_info_db)
+       m_Info.Open(open_mode);
+
+    m_Tombstones.Load(open_mode);
+
+    m_Op = op;
+    m_IsOpen = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::Close()
+{
+    StopCompaction();
+
+    // NOTE: Any chunks still in the memtable belong to an unfinished indexer
+    //       flush and are discarded.
+    m_MemTable.clear();
+    m_MemTableSize = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        m_Snapshot.reset();
+    }
+
+    m_QFingerprints.Close();
+    m_Metadata.Close();
+    m_Info.Close();
+    m_Tombstones.Close();
+
+    m_IsOpen = false;
+
+    CheckCompaction();
+}
+
+// ----------------------------------------------------------------------------
+
+bool LSMDataStore::Empty()
+{
+    SnapshotPtr snap = GetSnapshot();
+
+    return (!snap || (snap->Base->GetRecordsCount() == 0 && snap->Segments.empty())) &&
+           m_MemTable.empty() &&
+           m_QFingerprints.GetRecordsCount() == 0 &&
+           m_Metadata.GetRecordsCount() == 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::Clear()
+{
+    if(m_Op == GET)
+       throw invalid_argument("Clear(): Invalid operation (GET)");
+
+    StopCompaction();
+    CheckCompaction();
+
+    std::lock_guard<std::mutex> clock(m_CompactionMutex);
+
+    SnapshotPtr old = GetSnapshot();
+
+    // Replace the index with a new empty base
+    std::shared_ptr<Snapshot> snap(new Snapshot);
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        snap->BaseName = NewFileName("data.base.");
+    }
+
+    snap->Base.reset(new TCIndex(nullptr));
+    snap->Base->SetURL(m_DBURL);
+    snap->Base->SetName(snap->BaseName);
+    snap->Base->Open(OPEN_READ_WRITE);
+    snap->Base->Close();
+    snap->Base->SetConcurrent(true);
+    snap->Base->Open(OPEN_READ);
+
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        WriteManifest(*snap);
+        m_Snapshot = snap;
+    }
+
+    if(old){
+       for(size_t i=0; i<old->Segments.size(); i++)
+           std::remove(old->Segments[i]->GetPath().c_str());
+       std::remove((m_DBURL + old->BaseName).c_str());
+    }
+
+    m_MemTable.clear();
+    m_MemTableSize = 0;
+
+    m_QFingerprints.Drop();
+    m_Metadata.Drop();
+    m_Info.Drop();
+    m_Tombstones.Clear();
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::SetOpMode(KVDataStore::eOperation mode)
+{
+    if(mode == m_Op) return;
+    Open(mode, m_QFingerprints.IsOpen(), m_Metadata.IsOpen(), m_Info.IsOpen());
+}
+
+// ----------------------------------------------------------------------------
+
+size_t LSMDataStore::GetSegmentsCount()
+{
+    SnapshotPtr snap = GetSnapshot();
+    return snap ? snap->Segments.size() : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+LSMDataStore::SnapshotPtr LSMDataStore::GetSnapshot()
+{
+    std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+    return m_Snapshot;
+}
+
+// ----------------------------------------------------------------------------
+
+bool LSMDataStore::ReadManifest(string &base, vector<string> &segments, uint32_t &next)
+{
+    std::ifstream in((m_DBURL + LSM_MANIFEST).c_str());
+
+    if(!in)
+       return false;
+
+    string tag, value;
+
+    base.clear();
+    segments.clear();
+
+    while(in >> tag >> value){
+       if(tag == "base")
+          base = value;
+       else if(tag == "segment")
+          segments.push_back(value);
+       else if(tag == "next")
+          next = std::strtoul(value.c_str(), nullptr, 10);
+    }
+
+    return !base.empty();
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::WriteManifest(const Snapshot &snap)
+{
+    string path = m_DBURL + LSM_MANIFEST;
+    string tmp = path + ".tmp";
+
+    FILE *file = fopen(tmp.c_str(), "w");
+
+    if(file == nullptr)
+       throw runtime_error("Couldn't write " + tmp);
+
+    fprintf(file, "base %s\n", snap.BaseName.c_str());
+    fprintf(file, "next %u\n", m_NextFile);
+
+    for(size_t i=0; i<snap.Segments.size(); i++)
+        fprintf(file, "segment %s\n", snap.Segments[i]->GetPath().substr(m_DBURL.size()).c_str());
+
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    fclose(file);
+
+    if(!ok || std::rename(tmp.c_str(), path.c_str()) != 0){
+       std::remove(tmp.c_str());
+       throw runtime_error("Couldn't write " + path);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+LSMDataStore::SnapshotPtr LSMDataStore::LoadSnapshot(const SnapshotPtr &current, bool &changed)
+{
+    // NOTE: The files listed in the manifest may be removed by a compaction
+    //       before we get to open them, in which case the manifest has been
+    //       updated in the meantime and we just need to read it again.
+
+    for(int attempt=0; ; attempt++)
+    {
+        string base = "data.idx";
+        vector<string> names;
+        uint32_t next = 1;
+
+        ReadManifest(base, names, next);
+
+        try{
+           std::shared_ptr<Snapshot> snap(new Snapshot);
+           snap->BaseName = base;
+
+           if(current && current->BaseName == base)
+              snap->Base = current->Base;
+           else{
+              snap->Base.reset(new TCIndex(nullptr));
+              snap->Base->SetURL(m_DBURL);
+              snap->Base->SetName(base);
+              snap->Base->SetConcurrent(true);
+              snap->Base->Open(OPEN_READ);
+           }
+
+           for(size_t i=0; i<names.size(); i++){
+               string path = m_DBURL + names[i];
+               LSMSegment::Ptr seg;
+               if(current){
+                  for(size_t j=0; j<current->Segments.size() && !seg; j++)
+                      if(current->Segments[j]->GetPath() == path)
+                         seg = current->Segments[j];
+               }
+               snap->Segments.push_back(seg ? seg : std::make_shared<LSMSegment>(path));
+           }
+
+           changed = !current || snap->Base != current->Base ||
+                     snap->Segments != current->Segments;
+
+           return snap;
+        }
+        catch(const std::exception&){
+           if(attempt == 2)
+              throw;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+string LSMDataStore::NewFileName(const string &prefix)
+{
+    std::stringstream name;
+    name << prefix << m_NextFile++;
+    return name.str();
+}
+
+// ----------------------------------------------------------------------------
+
+bool LSMDataStore::Refresh()
+{
+    if(!m_IsOpen)
+       return false;
+
+    bool changed;
+    SnapshotPtr snap = LoadSnapshot(GetSnapshot(), changed);
+
+    if(changed){
+       std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+       m_Snapshot = snap;
+    }
+    return changed;
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::Flush()
+{
+    // Don't add segments to a tree whose compaction failed
+    CheckCompaction();
+
+    if(m_MemTable.empty())
+       return;
+
+    string name;
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        name = NewFileName("data.seg.");
+    }
+
+    // The memtable is sorted by key, so it's written out as is
+    LSMSegmentWriter writer(m_DBURL + name);
+
+    memtable::const_iterator it = m_MemTable.begin();
+    for(; it != m_MemTable.end(); ++it)
+        writer.Append(static_cast<int>(it->first >> 32),
+                      static_cast<int>(it->first & 0xFFFFFFFF),
+                      it->second.data(), it->second.size());
+
+    writer.Commit();
+
+    LSMSegment::Ptr seg = std::make_shared<LSMSegment>(m_DBURL + name);
+
+    size_t nsegs;
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        std::shared_ptr<Snapshot> snap(new Snapshot(*m_Snapshot));
+        snap->Segments.push_back(seg);
+        WriteManifest(*snap);
+        m_Snapshot = snap;
+        nsegs = snap->Segments.size();
+    }
+
+    m_MemTable.clear();
+    m_MemTableSize = 0;
+
+    if(m_MaxSegments && nsegs > m_MaxSegments)
+       StartCompaction();
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::Compact(bool major)
+{
+    if(m_Op == GET)
+       throw invalid_argument("Compact(): Invalid operation (GET)");
+
+    std::lock_guard<std::mutex> clock(m_CompactionMutex);
+
+    SnapshotPtr snap = GetSnapshot();
+
+    if(!snap || snap->Segments.empty() || (!major && snap->Segments.size() < 2))
+       return;
+
+    string name;
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        name = NewFileName(major ? "data.base." : "data.seg.");
+    }
+
+    LSMSegment::Ptr seg;
+    std::shared_ptr<TCIndex> base;
+
+    if(!major){
+       LSMSegmentWriter writer(m_DBURL + name);
+       MergeSegments(snap->Segments,
+           [&writer](int list_id, int block_id, const uint8_t *data, size_t size){
+               writer.Append(list_id, block_id, data, size);
+           });
+       writer.Commit();
+       seg = std::make_shared<LSMSegment>(m_DBURL + name);
+    }
+    else{
+       base.reset(new TCIndex(nullptr));
+       base->SetURL(m_DBURL);
+       base->SetName(name);
+       base->Open(OPEN_READ_WRITE);
+
+       try{
+          // Copy the current base index
+          vector<uint8_t> key, value;
+          snap->Base->IterInit();
+          while(snap->Base->IterNext(key, value)){
+              assert(key.size() == sizeof(int)*2);
+              const int *pkey = reinterpret_cast<const int*>(key.data());
+              base->WriteBlock(pkey[0], pkey[1], value, value.size());
+          }
+
+          // and append the segments to it
+          vector<uint8_t> block;
+          MergeSegments(snap->Segments,
+              [&base, &block](int list_id, int block_id, const uint8_t *data, size_t size){
+                  size_t bsize = base->ReadBlock(list_id, block_id, block);
+                  AppendFragment(block, bsize, data, size, block_id==1);
+                  base->WriteBlock(list_id, block_id, block, bsize);
+              });
+
+          base->Close();
+       }
+       catch(...){
+          base->Close();
+          std::remove((m_DBURL + name).c_str());
+          throw;
+       }
+
+       base->SetConcurrent(true);
+       base->Open(OPEN_READ);
+    }
+
+    // Install the new snapshot, keeping the segments added in the meantime
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+
+        std::shared_ptr<Snapshot> nsnap(new Snapshot);
+        nsnap->BaseName = major ? name : m_Snapshot->BaseName;
+        nsnap->Base = major ? base : m_Snapshot->Base;
+        if(seg)
+           nsnap->Segments.push_back(seg);
+        nsnap->Segments.insert(nsnap->Segments.end(),
+                               m_Snapshot->Segments.begin() + snap->Segments.size(),
+                               m_Snapshot->Segments.end());
+        WriteManifest(*nsnap);
+        m_Snapshot = nsnap;
+    }
+
+    // Remove the replaced files. Readers still using them keep them
+    // open until they release their snapshot.
+    for(size_t i=0; i<snap->Segments.size(); i++)
+        std::remove(snap->Segments[i]->GetPath().c_str());
+
+    if(major)
+       std::remove((m_DBURL + snap->BaseName).c_str());
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::StartCompaction(bool major)
+{
+    if(m_Compacting.exchange(true))
+       return;
+
+    if(m_Compactor.joinable())
+       m_Compactor.join();
+
+    m_Compactor = std::thread([this, major](){
+        try{
+           Compact(major);
+        }
+        catch(...){
+           std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+           m_CompactionError = std::current_exception();
+        }
+        m_Compacting = false;
+    });
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::CheckCompaction()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        error.swap(m_CompactionError);
+    }
+    if(error)
+       std::rethrow_exception(error);
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::StopCompaction()
+{
+    if(m_Compactor.joinable())
+       m_Compactor.join();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t LSMDataStore::ReadBlock(const Snapshot &snap, int list_id, int block_id, vector<uint8_t> &buffer)
+{
+    size_t size = snap.Base->ReadBlock(list_id, block_id, buffer);
+
+    for(size_t i=0; i<snap.Segments.size(); i++){
+        size_t fsize;
+        const uint8_t *frag = snap.Segments[i]->Find(list_id, block_id, fsize);
+        if(frag)
+           AppendFragment(buffer, size, frag, fsize, block_id==1);
+    }
+
+    return size;
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* LSMDataStore::FindFragment(const Snapshot &snap, int list_id, int block_id, size_t &size)
+{
+    memtable::iterator it = m_MemTable.find(BlockKey(list_id, block_id));
+
+    if(it != m_MemTable.end()){
+       size = it->second.size();
+       return it->second.data();
+    }
+
+    for(size_t i=snap.Segments.size(); i-- > 0; ){
+        const uint8_t *frag = snap.Segments[i]->Find(list_id, block_id, size);
+        if(frag)
+           return frag;
+    }
+
+    size = 0;
+    return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::DeleteFingerprint(uint32_t FID)
+{
+    if(m_Op == GET)
+       throw invalid_argument("DeleteFingerprint(): Invalid operation (GET)");
+
+    m_Tombstones.Add(FID);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t LSMDataStore::GetFingerprintsCount()
+{
+    return m_QFingerprints.GetRecordsCount();
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* LSMDataStore::GetPListBlock(int list_id, int block, size_t &data_size, bool headers)
+{
+    SnapshotPtr snap = GetSnapshot();
+
+    if(!snap)
+       throw runtime_error("Datastore not open");
+
+    size_t size = ReadBlock(*snap, list_id, block, m_ReadBuffer);
+    size_t hsize = (block==1 ? sizeof(PListHeader) : 0) + sizeof(PListBlockHeader);
+
+    if(size < hsize){
+       data_size = 0;
+       return m_ReadBuffer.data();
+    }
+
+    const PListBlockHeader &hdr =
+        *reinterpret_cast<const PListBlockHeader*>(m_ReadBuffer.data() + hsize - sizeof(PListBlockHeader));
+
+    if(hdr.BodySize != size - hsize){
+       std::stringstream msg;
+       msg << "Inconsistent index block (list " << list_id << ", block " << block << ")";
+       throw runtime_error(msg.str());
+    }
+
+    data_size = headers ? size : size - hsize;
+    return m_ReadBuffer.data() + (headers ? 0 : hsize);
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::OnIndexerStart()
+{
+    if(m_Op == GET)
+       throw invalid_argument("OnIndexerStart(): Invalid operation (GET)");
+
+    CheckCompaction();
+
+    m_MemTable.clear();
+    m_MemTableSize = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::OnIndexerEnd()
+{
+    Flush();
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::OnIndexerFlushStart()
+{
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::OnIndexerFlushEnd()
+{
+    // Only complete flushes are written out, so that a segment never
+    // contains part of the chunks of an indexer run.
+    if(m_MemTableSize >= m_MemTableLimit)
+       Flush();
+}
+
+// ----------------------------------------------------------------------------
+
+PListHeader LSMDataStore::OnIndexerListHeader(int list_id)
+{
+    if(m_Op == GET)
+       throw invalid_argument("OnIndexerListHeader(): Invalid operation");
+
+    SnapshotPtr snap = GetSnapshot();
+
+    // The list header is at the start of every first block fragment
+    size_t size;
+    const uint8_t *frag = FindFragment(*snap, list_id, 1, size);
+
+    if(frag){
+       assert(size >= sizeof(PListHeader));
+       return *reinterpret_cast<const PListHeader*>(frag);
+    }
+
+    return snap->Base->GetPListHeader(list_id);
+}
+
+// ----------------------------------------------------------------------------
+
+PListBlockHeader LSMDataStore::OnIndexerBlockHeader(int list_id, int block)
+{
+    if(m_Op == GET)
+       throw invalid_argument("OnIndexerBlockHeader(): Invalid operation");
+
+    SnapshotPtr snap = GetSnapshot();
+
+    // NOTE: First block fragments may carry the list header only (they are
+    //       written when appending later blocks, after which the first block
+    //       doesn't change anymore), in which case the block header is found
+    //       in the older fragments or in the base block.
+    size_t size;
+    size_t hoff = block==1 ? sizeof(PListHeader) : 0;
+
+    memtable::iterator it = m_MemTable.find(BlockKey(list_id, block));
+
+    if(it != m_MemTable.end() && it->second.size() > hoff)
+       return *reinterpret_cast<const PListBlockHeader*>(it->second.data() + hoff);
+
+    for(size_t i=snap->Segments.size(); i-- > 0; ){
+        const uint8_t *frag = snap->Segments[i]->Find(list_id, block, size);
+        if(frag && size > hoff)
+           return *reinterpret_cast<const PListBlockHeader*>(frag + hoff);
+    }
+
+    return snap->Base->GetPListBlockHeader(list_id, block);
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::AppendChunk(int list_id,
+                               PListHeader &lhdr,
+                               PListBlockHeader &hdr,
+                               uint8_t* data, size_t data_size,
+                               bool new_block)
+{
+    if(m_Op == GET)
+       throw invalid_argument("OnIndexerChunk(): Invalid operation (GET)");
+
+    assert(data && data_size);
+    assert(!IsNull(hdr));
+
+    vector<uint8_t> &frag = m_MemTable[BlockKey(list_id, hdr.ID)];
+
+    size_t hoff = hdr.ID==1 ? sizeof(PListHeader) : 0;
+    size_t fsize = frag.size();
+
+    // Create the fragment headers if missing
+    if(frag.size() < hoff + sizeof(PListBlockHeader))
+       frag.resize(hoff + sizeof(PListBlockHeader));
+
+    if(hdr.ID==1){
+       assert(!IsNull(lhdr));
+       *reinterpret_cast<PListHeader*>(frag.data()) = lhdr;
+    }
+
+    *reinterpret_cast<PListBlockHeader*>(frag.data() + hoff) = hdr;
+
+    frag.insert(frag.end(), data, data + data_size);
+
+    m_MemTableSize += frag.size() - fsize;
+
+    // Appending a block other than the first updates the list header,
+    // which is stored in a (possibly header only) first block fragment.
+    if(new_block && hdr.ID!=1){
+       vector<uint8_t> &first = m_MemTable[BlockKey(list_id, 1)];
+       if(first.empty()){
+          first.resize(sizeof(PListHeader));
+          m_MemTableSize += sizeof(PListHeader);
+       }
+       *reinterpret_cast<PListHeader*>(first.data()) = lhdr;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::OnIndexerChunk(int list_id,
+                                  PListHeader &lhdr,
+                                  PListBlockHeader &hdr,
+                                  uint8_t* data, size_t data_size)
+{
+    AppendChunk(list_id, lhdr, hdr, data, data_size, false);
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::OnIndexerNewBlock(int list_id,
+                                     PListHeader &lhdr,
+                                     PListBlockHeader &hdr,
+                                     uint8_t* data, size_t data_size)
+{
+    AppendChunk(list_id, lhdr, hdr, data, data_size, true);
+}
+
+// ----------------------------------------------------------------------------
+
+void LSMDataStore::OnIndexerFingerprint(uint32_t FID, uint8_t *data, size_t size)
+{
+    m_QFingerprints.WriteFingerprint(FID, data, size);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t LSMDataStore::GetFingerprintSize(uint32_t FID)
+{
+    return m_QFingerprints.ReadFingerprintSize(FID);
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* LSMDataStore::GetFingerprint(uint32_t FID, size_t &read, size_t nbytes, uint32_t bo)
+{
+    read = m_QFingerprints.ReadFingerprint(FID, m_ReadBuffer, nbytes, bo);
+    return m_ReadBuffer.data();
+}
+
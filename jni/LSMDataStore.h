@@ -0,0 +1,318 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef LSMDATASTORE_H
+#define LSMDATASTORE_H
+
+#include <map>
+#include <mutex>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <exception>
+
+#include "TCDataStore.h"
+
+/// Layout of an index segment file. The file starts with this header,
+/// followed by the fragments data and by the fragments table, sorted by
+/// <ListID|BlockID>.
+
+struct LSMSegmentHeader
+{
+    char     Magic[8];      ///< Segment signature
+    uint32_t Version;       ///< Layout version
+    uint32_t Reserved;
+    uint64_t Count;         ///< Number of fragments
+    uint64_t Table;         ///< Offset of the fragments table
+    uint64_t Size;          ///< Total size of the file in bytes
+};
+
+/// Entry of the fragments table
+struct LSMSegmentEntry
+{
+    int32_t  ListID;
+    int32_t  BlockID;
+    uint64_t Offset;
+    uint64_t Size;
+};
+
+// ----------------------------------------------------------------------------
+
+/// An immutable, memory mapped, index segment. Its records are block fragments
+/// in the same format used by the BUILD_MERGE delta index, i.e. the list header
+/// (first blocks only), the block header as of the time the segment was written
+/// and the chunks appended to the block since the previous segment. A fragment
+/// of a first block may carry the updated list header only.
+
+class LSMSegment
+{
+    std::string              m_Path;
+    const uint8_t*           m_Base;
+    size_t                   m_Size;
+    const LSMSegmentHeader*  m_Header;
+    const LSMSegmentEntry*   m_Entries;
+
+    LSMSegment(const LSMSegment&);
+    LSMSegment& operator=(const LSMSegment&);
+
+public:
+
+    typedef std::shared_ptr<LSMSegment> Ptr;
+
+    /// Map the given segment file
+    explicit LSMSegment(const std::string &path);
+    ~LSMSegment();
+
+    const std::string& GetPath() const { return m_Path; }
+
+    /// Get the size of the segment file in bytes
+    size_t GetSize() const { return m_Size; }
+
+    /// Get the number of fragments in the segment
+    size_t GetCount() const { return m_Header->Count; }
+
+    /// Get the i-th entry of the (sorted) fragments table
+    const LSMSegmentEntry& GetEntry(size_t i) const { return m_Entries[i]; }
+
+    /// Get the data of the given fragment
+    const uint8_t* GetData(const LSMSegmentEntry &e) const { return m_Base + e.Offset; }
+
+    /// Find the fragment of the specified block. Return null if not found.
+    const uint8_t* Find(int list_id, int block_id, size_t &size) const;
+};
+
+// ----------------------------------------------------------------------------
+
+/// Writes a segment file. The fragments must be appended in key order. The
+/// file is written under a temporary name and moved into place on Commit(),
+/// so a segment is either complete or not there at all.
+
+class LSMSegmentWriter
+{
+    std::string                   m_Path;
+    std::string                   m_TmpPath;
+    FILE*                         m_File;
+    uint64_t                      m_Offset;
+    std::vector<LSMSegmentEntry>  m_Entries;
+
+public:
+
+    explicit LSMSegmentWriter(const std::string &path);
+    ~LSMSegmentWriter();
+
+    void Append(int list_id, int block_id, const uint8_t *data, size_t size);
+
+    void Commit();
+};
+
+// ----------------------------------------------------------------------------
+
+/// A datastore whose index is log-structured. The chunks produced by the
+/// indexer are accumulated in an in-memory table (memtable) that is written
+/// out as an immutable sorted segment once it grows past a given size, so
+/// adding to a catalog never rewrites the existing blocks. The blocks are
+/// reconstructed on read by concatenating the base index block with its
+/// fragments in the segments, oldest first. Segments are merged by a
+/// background compaction, which can also fold them into a new base index.
+///
+/// Readers work on immutable snapshots (base index + segments list), that are
+/// swapped atomically when segments are added or compacted, thus they never
+/// wait for a compaction to complete. The set of files making up the index is
+/// recorded in a manifest file (data.lsm), rewritten atomically on every change.
+/// Datastores opened for reading in other processes pick up the changes by
+/// calling Refresh(). An existing TCDataStore directory can be opened as is,
+/// its index becoming the initial base index.
+///
+/// The fingerprints, metadata and info collections are the same as TCDataStore's.
+/// BUILD and BUILD_MERGE are equivalent, both appending to the existing index.
+
+class LSMDataStore : public KVDataStore
+{
+    typedef std::map< uint64_t, std::vector<uint8_t> >  memtable;
+
+    /// The files making up the index at some point in time
+    struct Snapshot
+    {
+        std::string                  BaseName;
+        std::shared_ptr<TCIndex>     Base;
+        std::vector<LSMSegment::Ptr> Segments;   ///< Oldest first
+    };
+
+    typedef std::shared_ptr<const Snapshot> SnapshotPtr;
+
+    std::string               m_DBURL;          ///< URL to all database
+    TCFingerprints            m_QFingerprints;  ///< The fingerprints database
+    TCMetadata                m_Metadata;       ///< The metadata database
+    TCInfo                    m_Info;           ///< Datastore info
+    TCTombstones              m_Tombstones;     ///< Deleted fingerprints
+
+    std::mutex                m_SnapshotMutex;  ///< Guards the snapshot and the manifest
+    SnapshotPtr               m_Snapshot;
+    uint32_t                  m_NextFile;       ///< Sequence number of the next index file
+
+    memtable                  m_MemTable;
+    size_t                    m_MemTableSize;
+    size_t                    m_MemTableLimit;
+    size_t                    m_MaxSegments;
+
+    std::mutex                m_CompactionMutex;
+    std::thread               m_Compactor;
+    std::atomic<bool>         m_Compacting;
+    std::exception_ptr        m_CompactionError; ///< Guarded by m_SnapshotMutex
+
+    eOperation                m_Op;
+    bool                      m_IsOpen;
+
+    /// Buffer used to reconstruct the blocks read by the engine
+    std::vector<uint8_t>   m_ReadBuffer;
+
+    SnapshotPtr GetSnapshot();
+
+    /// Read the manifest. Return false if there is none.
+    bool ReadManifest(std::string &base, std::vector<std::string> &segments, uint32_t &next);
+
+    /// Write the manifest for the given snapshot (m_SnapshotMutex held)
+    void WriteManifest(const Snapshot &snap);
+
+    /// Open the files listed in the manifest, reusing the ones in 'current'
+    SnapshotPtr LoadSnapshot(const SnapshotPtr &current, bool &changed);
+
+    /// Get a name for a new index file (m_SnapshotMutex held)
+    std::string NewFileName(const std::string &prefix);
+
+    /// Read a block as stored in the given snapshot into 'buffer'.
+    /// Return the block size (headers included).
+    size_t ReadBlock(const Snapshot &snap, int list_id, int block_id, std::vector<uint8_t> &buffer);
+
+    /// Get the most recent fragment of the specified block written by the
+    /// indexer or stored in the segments. Return null if not found.
+    const uint8_t* FindFragment(const Snapshot &snap, int list_id, int block_id, size_t &size);
+
+    void AppendChunk(int list_id,
+                     Audioneex::PListHeader &lhdr,
+                     Audioneex::PListBlockHeader &hdr,
+                     uint8_t* data, size_t data_size,
+                     bool new_block);
+
+    void StopCompaction();
+
+public:
+
+    explicit LSMDataStore(const std::string &url = std::string());
+    ~LSMDataStore();
+
+    /// Set the memtable size (in bytes) past which it is written out as a new
+    /// segment. The memtable is only written at the end of an indexer flush.
+    void SetMemTableLimit(size_t bytes) { m_MemTableLimit = bytes; }
+
+    size_t GetMemTableLimit() const { return m_MemTableLimit; }
+
+    /// Set the number of segments past which a background compaction is started
+    void SetMaxSegments(size_t nsegs) { m_MaxSegments = nsegs; }
+
+    size_t GetMaxSegments() const { return m_MaxSegments; }
+
+    /// Get the number of segments in the current snapshot
+    size_t GetSegmentsCount();
+
+    /// Write the memtable out as a new segment
+    void Flush();
+
+    /// Merge all the segments into one. If 'major' is set, fold them into a new
+    /// base index instead. Readers keep using the previous snapshot until the
+    /// new one is installed.
+    void Compact(bool major=false);
+
+    /// Run Compact() in a background thread. Does nothing if a compaction is
+    /// already running. If it fails, the next indexing session, Flush() or
+    /// Close() fails with its error (see CheckCompaction()).
+    void StartCompaction(bool major=false);
+
+    bool IsCompacting() const { return m_Compacting; }
+
+    /// Rethrow the error of the last background compaction, if it failed, and
+    /// clear it
+    void CheckCompaction();
+
+    /// Reload the manifest to pick up the changes made by other processes.
+    /// Return true if the index files have changed.
+    bool Refresh();
+
+    void Open(eOperation op = GET,
+              bool use_fing_db=true,
+              bool use_meta_db=false,
+              bool use_info_db=false);
+
+    void Close();
+
+    void SetDatabaseURL(const std::string &url) { m_DBURL = url; }
+
+    std::string GetDatabaseURL()  { return m_DBURL; }
+
+    bool Empty();
+
+    void Clear();
+
+    bool IsOpen() { return m_IsOpen; }
+
+    eOperation GetOpMode() { return m_Op; }
+
+    void SetOpMode(eOperation mode);
+
+    void PutFingerprint(uint32_t FID, const uint8_t* data, size_t size){
+        m_QFingerprints.WriteFingerprint(FID, data, size);
+    }
+
+    void PutMetadata(uint32_t FID, const std::string& meta){
+        m_Metadata.Write(FID, meta);
+    }
+
+    std::string GetMetadata(uint32_t FID) { return m_Metadata.Read(FID); }
+
+    /// The deleted fingerprints are filtered at read time only, segments
+    /// and compactions keep their index data.
+    void DeleteFingerprint(uint32_t FID);
+
+    bool IsDeleted(uint32_t FID) { return m_Tombstones.Contains(FID); }
+
+    DBInfo_t GetInfo() { return m_Info.Read(); }
+
+    void PutInfo(const DBInfo_t& info) { m_Info.Write(info); }
+
+    // API Interface
+
+    const uint8_t* GetPListBlock(int list_id, int block, size_t& data_size, bool headers=true);
+    size_t GetFingerprintSize(uint32_t FID);
+    const uint8_t* GetFingerprint(uint32_t FID, size_t &read, size_t nbytes = 0, uint32_t bo = 0);
+    size_t GetFingerprintsCount();
+    void OnIndexerStart();
+    void OnIndexerEnd();
+    void OnIndexerFlushStart();
+    void OnIndexerFlushEnd();
+    Audioneex::PListHeader OnIndexerListHeader(int list_id);
+    Audioneex::PListBlockHeader OnIndexerBlockHeader(int list_id, int block);
+
+    void OnIndexerChunk(int list_id,
+                        Audioneex::PListHeader &lhdr,
+                        Audioneex::PListBlockHeader &hdr,
+                        uint8_t* data, size_t data_size);
+
+    void OnIndexerNewBlock (int list_id,
+                            Audioneex::PListHeader &lhdr,
+                            Audioneex::PListBlockHeader &hdr,
+                            uint8_t* data, size_t data_size);
+
+    void OnIndexerFingerprint(uint32_t FID, uint8_t* data, size_t size);
+};
+
+
+#endif
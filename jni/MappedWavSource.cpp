@@ -0,0 +1,269 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MappedWavSource.h"
+#include "AudioBlockView.h"
+#include "WavFormat.h"
+
+using namespace std;
+
+namespace {
+
+/// Number of frames decoded at a time. The decoded chunk stays in the
+/// cache while it's downmixed and resampled.
+const size_t CHUNK_FRAMES = 4096;
+
+}
+
+// ----------------------------------------------------------------------------
+
+MappedWavSource::MappedWavSource() :
+    m_Base          (nullptr),
+    m_Size          (0),
+    m_Data          (nullptr),
+    m_Frames        (0),
+    m_NextFrame     (0),
+    m_Format        (PCM),
+    m_Channels      (0),
+    m_SampleRate    (0),
+    m_BitsPerSample (0),
+    m_FrameSize     (0),
+    m_OutputPos     (0),
+    m_OutputSize    (0),
+    m_Flushed       (false)
+{
+}
+
+// ----------------------------------------------------------------------------
+
+MappedWavSource::~MappedWavSource()
+{
+    Close();
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedWavSource::Open(const string &filename)
+{
+    Close();
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+       throw runtime_error("Couldn't open "+filename);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+       close(fd);
+       throw runtime_error("Invalid WAV file "+filename);
+    }
+
+    // Files over 4 GB can't be mapped on 32 bit targets
+    if(static_cast<uint64_t>(st.st_size) > SIZE_MAX){
+       close(fd);
+       throw runtime_error("Couldn't map "+filename+" (file too large)");
+    }
+
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(addr == MAP_FAILED)
+       throw runtime_error("Couldn't map "+filename);
+
+    // The file is read once from start to end
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    m_Filename = filename;
+    m_Base = static_cast<const uint8_t*>(addr);
+    m_Size = st.st_size;
+
+    try{
+       ParseHeader();
+    }
+    catch(...){
+       Close();
+       throw;
+    }
+
+    m_Resampler.reset(new Resampler(m_SampleRate, OUTPUT_SAMPLE_RATE));
+    m_Mono.resize(CHUNK_FRAMES);
+    m_Output.resize(m_Resampler->GetMaxOutput(std::max(CHUNK_FRAMES, m_Resampler->GetFilterLength())));
+    m_Scratch.resize(CHUNK_FRAMES * m_Channels);
+
+    Rewind();
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedWavSource::Close()
+{
+    if(m_Base)
+       munmap(const_cast<uint8_t*>(m_Base), m_Size);
+
+    m_Base = nullptr;
+    m_Size = 0;
+    m_Data = nullptr;
+    m_Frames = 0;
+    m_NextFrame = 0;
+    m_Channels = 0;
+    m_SampleRate = 0;
+    m_BitsPerSample = 0;
+    m_FrameSize = 0;
+    m_OutputPos = 0;
+    m_OutputSize = 0;
+    m_Flushed = false;
+    m_Resampler.reset();
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedWavSource::ParseHeader()
+{
+    const uint8_t *base = m_Base;
+    size_t size = m_Size;
+
+    auto read = [base, size](uint64_t offset, uint8_t *buf, size_t n) -> size_t {
+        if(offset >= size)
+           return 0;
+        n = std::min<size_t>(n, size - offset);
+        memcpy(buf, base + offset, n);
+        return n;
+    };
+
+    WavFormat fmt;
+    try{
+       fmt = ParseWavFormat(read, m_Size);
+    }
+    catch(const runtime_error &ex){
+       throw runtime_error(string(ex.what())+" in "+m_Filename);
+    }
+
+    m_Format = fmt.FormatTag == WAVE_FORMAT_IEEE_FLOAT ? IEEE_FLOAT : PCM;
+    m_Channels = fmt.Channels;
+    m_SampleRate = fmt.SampleRate;
+    m_BitsPerSample = fmt.BitsPerSample;
+    m_FrameSize = fmt.BlockAlign;
+    m_Data = m_Base + fmt.DataOffset;
+    m_Frames = static_cast<size_t>(fmt.DataSize / m_FrameSize);
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedWavSource::Rewind()
+{
+    m_NextFrame = 0;
+    m_OutputPos = 0;
+    m_OutputSize = 0;
+    m_Flushed = false;
+    if(m_Resampler)
+       m_Resampler->Reset();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MappedWavSource::GetOutputLength() const
+{
+    if(!m_Resampler)
+       return 0;
+    uint64_t L = m_Resampler->GetInterpolation();
+    uint64_t M = m_Resampler->GetDecimation();
+    return static_cast<size_t>((m_Frames * L + M - 1) / M);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MappedWavSource::Read(float *buffer, size_t nsamples)
+{
+    size_t n = 0;
+
+    while(n < nsamples)
+    {
+        if(m_OutputPos == m_OutputSize){
+           if(m_Flushed)
+              break;
+           // Resample the next chunk, or the tail of the filter at the end
+           size_t nframes = DecodeChunk();
+           m_OutputPos = 0;
+           m_OutputSize = nframes ? m_Resampler->Process(m_Mono.data(), nframes, m_Output.data())
+                                  : m_Resampler->Flush(m_Output.data());
+           m_Flushed = nframes == 0;
+           continue;
+        }
+
+        size_t k = std::min(nsamples - n, m_OutputSize - m_OutputPos);
+        std::copy(m_Output.begin() + m_OutputPos, m_Output.begin() + m_OutputPos + k, buffer + n);
+        m_OutputPos += k;
+        n += k;
+    }
+    return n;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MappedWavSource::DecodeChunk()
+{
+    size_t nframes = std::min(CHUNK_FRAMES, m_Frames - m_NextFrame);
+    if(nframes == 0)
+       return 0;
+
+    const uint8_t *data = m_Data + m_NextFrame * m_FrameSize;
+    float *out = m_Mono.data();
+
+    if(m_Format == IEEE_FLOAT)       DownmixFrames<Sfloat>(data, nframes, out);
+    else if(m_BitsPerSample == 8)    DownmixFrames<U8bit>(data, nframes, out);
+    else if(m_BitsPerSample == 16)   DownmixFrames<S16bit>(data, nframes, out);
+    else if(m_BitsPerSample == 24)   Downmix24(data, nframes, out);
+    else                             DownmixFrames<S32bit>(data, nframes, out);
+
+    m_NextFrame += nframes;
+    return nframes;
+}
+
+// ----------------------------------------------------------------------------
+
+template <class T>
+void MappedWavSource::DownmixFrames(const uint8_t *data, size_t nframes, float *out)
+{
+    size_t nsamples = nframes * m_Channels;
+    const T *samples = reinterpret_cast<const T*>(data);
+
+    // The data chunk is misaligned if an odd sized chunk precedes it
+    if(reinterpret_cast<uintptr_t>(data) % sizeof(T)){
+       memcpy(m_Scratch.data(), data, nsamples * sizeof(T));
+       samples = reinterpret_cast<const T*>(m_Scratch.data());
+    }
+
+    AudioBlockView<T>(samples, nsamples, m_SampleRate, m_Channels).Downmix(out);
+}
+
+// ----------------------------------------------------------------------------
+
+void MappedWavSource::Downmix24(const uint8_t *data, size_t nframes, float *out)
+{
+    size_t nsamples = nframes * m_Channels;
+
+    // Unpack to the top 24 bits of 32 bit samples
+    for(size_t i=0; i<nsamples; i++, data+=3)
+        m_Scratch[i] = static_cast<int32_t>(static_cast<uint32_t>(data[0]) << 8  |
+                                            static_cast<uint32_t>(data[1]) << 16 |
+                                            static_cast<uint32_t>(data[2]) << 24);
+
+    AudioBlockView<S32bit>(m_Scratch.data(), nsamples, m_SampleRate, m_Channels).Downmix(out);
+}
@@ -0,0 +1,114 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef MAPPEDWAVSOURCE_H
+#define MAPPEDWAVSOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "Resampler.h"
+
+/// A WAV file source that maps the file in memory and decodes it straight into
+/// the format the engine works with: mono float samples normalized in [-1,1]
+/// at 11025 Hz. The conversion, the downmix and the resampling (see Resampler.h)
+/// are done in a single pass over the mapped audio, a cache-sized chunk at a
+/// time, and the output is written into the caller's buffers, so no audio goes
+/// through stream buffers or intermediate copies of the recording.
+///
+/// Supported formats are 8/16/24/32 bit PCM and 32 bit float, with any number
+/// of channels and any sample rate, in RIFF, RF64 and BWF files (see WavFormat.h).
+
+class MappedWavSource
+{
+public:
+
+    enum SampleFormat
+    {
+        PCM,
+        IEEE_FLOAT
+    };
+
+    /// Sample rate of the decoded audio
+    static const int OUTPUT_SAMPLE_RATE = 11025;
+
+private:
+
+    std::string          m_Filename;
+    const uint8_t*       m_Base;         ///< Mapped file
+    size_t               m_Size;
+
+    const uint8_t*       m_Data;         ///< Start of the audio data
+    size_t               m_Frames;       ///< Number of frames in the data chunk
+    size_t               m_NextFrame;    ///< Next frame to decode
+
+    SampleFormat         m_Format;
+    int                  m_Channels;
+    int                  m_SampleRate;
+    int                  m_BitsPerSample;
+    size_t               m_FrameSize;    ///< Bytes per frame
+
+    std::unique_ptr<Resampler> m_Resampler;
+    std::vector<float>   m_Mono;         ///< Decoded chunk
+    std::vector<float>   m_Output;       ///< Resampled chunk
+    size_t               m_OutputPos;    ///< Next sample of m_Output to be read
+    size_t               m_OutputSize;
+    bool                 m_Flushed;      ///< The resampler has been flushed
+
+    /// Scratch space for samples that can't be converted in place
+    std::vector<int32_t> m_Scratch;
+
+    void ParseHeader();
+
+    /// Decode the next chunk of frames to mono into m_Mono.
+    /// Return the number of decoded frames.
+    size_t DecodeChunk();
+
+    template <class T>
+    void DownmixFrames(const uint8_t *data, size_t nframes, float *out);
+
+    void Downmix24(const uint8_t *data, size_t nframes, float *out);
+
+    MappedWavSource(const MappedWavSource&);
+    MappedWavSource& operator=(const MappedWavSource&);
+
+public:
+
+    MappedWavSource();
+    ~MappedWavSource();
+
+    void Open(const std::string &filename);
+    void Close();
+    bool IsOpen() const { return m_Base != nullptr; }
+
+    /// Decode up to 'nsamples' output samples into the given buffer.
+    /// @return the number of samples written, 0 at the end of the file.
+    size_t Read(float *buffer, size_t nsamples);
+
+    /// Restart decoding from the beginning of the file
+    void Rewind();
+
+    SampleFormat GetSampleFormat() const { return m_Format; }
+    int    GetSampleRate() const { return m_SampleRate; }
+    int    GetChannels() const { return m_Channels; }
+    int    GetSampleResolution() const { return m_BitsPerSample; }
+    size_t GetLenFrames() const { return m_Frames; }
+    float  GetLenSeconds() const { return m_SampleRate ? static_cast<float>(m_Frames) / m_SampleRate : 0; }
+
+    /// Number of samples output for the whole file
+    size_t GetOutputLength() const;
+};
+
+
+#endif
@@ -0,0 +1,259 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "MemoryGovernor.h"
+#include "TCDataStore.h"
+
+using namespace std;
+using namespace Audioneex;
+
+const double MemoryGovernor::SAFE_FRACTION = 0.75;
+const double MemoryGovernor::MIN_INDEXER_SHARE = 0.25;
+
+namespace {
+
+/// The datastore limits are never shrunk below this size (in bytes)
+const size_t MIN_CACHE_LIMIT = 1024 * 1024;
+
+/// Read the value of the given field (in kB) from /proc/meminfo
+bool ReadMemInfo(const string &field, size_t &bytes)
+{
+    ifstream meminfo("/proc/meminfo");
+    string line;
+    while(std::getline(meminfo, line)){
+        if(line.compare(0, field.size(), field) == 0 && line[field.size()] == ':'){
+           istringstream value(line.substr(field.size() + 1));
+           size_t kb;
+           if(!(value >> kb))
+              return false;
+           bytes = kb * 1024;
+           return true;
+        }
+    }
+    return false;
+}
+
+/// Read a byte count from a control group file ("max" means no limit)
+bool ReadCGroupValue(const string &path, size_t &bytes)
+{
+    ifstream file(path.c_str());
+    string value;
+    if(!(file >> value) || value == "max")
+       return false;
+    istringstream in(value);
+    return static_cast<bool>(in >> bytes);
+}
+
+}
+
+// ----------------------------------------------------------------------------
+
+MemoryGovernor::MemoryGovernor(Indexer* indexer, TCDataStore* dstore, size_t budget) :
+    m_Indexer         (indexer),
+    m_DataStore       (dstore),
+    m_Budget          (budget ? budget : GetSafeBudget()),
+    m_Baseline        (0),
+    m_BlockCacheLimit (0),
+    m_PipelineLimit   (0),
+    m_CacheLimitMB    (0)
+{
+    if(!m_Indexer || !m_DataStore)
+       throw invalid_argument("MemoryGovernor: No indexer or datastore given");
+
+    m_Stats = Stats();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MemoryGovernor::GetResidentMemory()
+{
+    ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    if(!(statm >> size >> resident))
+       return 0;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MemoryGovernor::GetAvailableMemory()
+{
+    size_t avail = 0;
+
+    if(!ReadMemInfo("MemAvailable", avail)){
+       // Older kernels
+       size_t free = 0, cached = 0;
+       if(ReadMemInfo("MemFree", free) && ReadMemInfo("Cached", cached))
+          avail = free + cached;
+       else
+          avail = static_cast<size_t>(sysconf(_SC_AVPHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+    }
+
+    // If we're in a memory control group with a limit, that is where the
+    // OOM killer is going to look.
+    size_t limit, usage;
+    if((ReadCGroupValue("/sys/fs/cgroup/memory.max", limit) &&
+        ReadCGroupValue("/sys/fs/cgroup/memory.current", usage)) ||
+       (ReadCGroupValue("/sys/fs/cgroup/memory/memory.limit_in_bytes", limit) &&
+        ReadCGroupValue("/sys/fs/cgroup/memory/memory.usage_in_bytes", usage)))
+       avail = std::min(avail, limit > usage ? limit - usage : 0);
+
+    return avail + GetResidentMemory();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MemoryGovernor::GetSafeBudget()
+{
+    return static_cast<size_t>(GetAvailableMemory() * SAFE_FRACTION);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MemoryGovernor::GetIndexerShare(size_t dstore_used) const
+{
+    // A flush needs room for the block cache and the write queue on top
+    // of the indexer cache
+    size_t reserved = m_Baseline + dstore_used +
+                      m_DataStore->GetBlockCacheLimit() +
+                      m_DataStore->GetPipelined();
+
+    return m_Budget > reserved ? m_Budget - reserved : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t MemoryGovernor::GetUsed() const
+{
+    return m_Baseline +
+           m_Indexer->GetCacheUsed() +
+           m_DataStore->GetCacheUsed() +
+           m_DataStore->GetQueuedBytes();
+}
+
+// ----------------------------------------------------------------------------
+
+void MemoryGovernor::Start()
+{
+    m_Stats = Stats();
+    m_Baseline = GetResidentMemory();
+
+    if(m_Baseline >= m_Budget)
+       throw runtime_error("MemoryGovernor: The memory budget is smaller than the process memory");
+
+    // Give the datastore caches a share of the budget, keeping any smaller
+    // limits already set
+    size_t block_limit = m_DataStore->GetBlockCacheLimit();
+    size_t max_block_limit = std::max(m_Budget / 16, MIN_CACHE_LIMIT);
+    m_BlockCacheLimit = block_limit ? std::min(block_limit, max_block_limit) : max_block_limit;
+    m_DataStore->SetBlockCacheLimit(m_BlockCacheLimit);
+
+    size_t max_pipeline = std::max(m_Budget / 8, MIN_CACHE_LIMIT);
+    m_PipelineLimit = std::min(m_DataStore->GetPipelined(), max_pipeline);
+    m_DataStore->SetPipelined(m_PipelineLimit);
+
+    size_t delta_limit = m_DataStore->GetDeltaMemoryLimit();
+    if(delta_limit)
+       m_DataStore->SetDeltaMemoryLimit(std::min(delta_limit, m_Budget / 4));
+
+    // The indexer also flushes on its own if its cache grows past its
+    // share while indexing a recording
+    m_CacheLimitMB = std::max<size_t>(GetIndexerShare(0) >> 20, 1);
+    m_Indexer->SetCacheLimit(m_CacheLimitMB);
+}
+
+// ----------------------------------------------------------------------------
+
+void MemoryGovernor::Update()
+{
+    size_t dstore_used = m_DataStore->GetCacheUsed() + m_DataStore->GetQueuedBytes();
+    size_t share = GetIndexerShare(dstore_used);
+    size_t min_share = static_cast<size_t>(m_Budget * MIN_INDEXER_SHARE);
+
+    if(share < min_share){
+       Shrink();
+       dstore_used = m_DataStore->GetCacheUsed() + m_DataStore->GetQueuedBytes();
+       share = GetIndexerShare(dstore_used);
+    }
+    else if(share > 2 * min_share)
+       Grow();
+
+    size_t limit = std::max<size_t>(share >> 20, 1);
+    if(limit != m_CacheLimitMB){
+       m_Indexer->SetCacheLimit(limit);
+       m_CacheLimitMB = limit;
+    }
+
+    size_t cache_used = m_Indexer->GetCacheUsed();
+
+    if(cache_used > share){
+       m_Indexer->Flush();
+       m_Stats.Flushes ++;
+    }
+
+    m_Stats.PeakUsed = std::max(m_Stats.PeakUsed, m_Baseline + dstore_used + cache_used);
+}
+
+// ----------------------------------------------------------------------------
+
+void MemoryGovernor::Shrink()
+{
+    // The resident delta index is the largest and the cheapest to let go
+    if(m_DataStore->IsDeltaResident()){
+       m_DataStore->SpillDelta();
+       m_Stats.Spills ++;
+       return;
+    }
+
+    size_t block_limit = m_DataStore->GetBlockCacheLimit();
+    size_t pipeline = m_DataStore->GetPipelined();
+
+    bool shrunk = false;
+
+    if(block_limit > MIN_CACHE_LIMIT){
+       m_DataStore->SetBlockCacheLimit(std::max(block_limit / 2, MIN_CACHE_LIMIT));
+       shrunk = true;
+    }
+
+    // The write queue limit is read by the indexer thread, so it can be
+    // changed while the writer is running
+    if(pipeline > MIN_CACHE_LIMIT){
+       m_DataStore->SetPipelined(std::max(pipeline / 2, MIN_CACHE_LIMIT));
+       shrunk = true;
+    }
+
+    if(shrunk)
+       m_Stats.Shrinks ++;
+}
+
+// ----------------------------------------------------------------------------
+
+void MemoryGovernor::Grow()
+{
+    size_t block_limit = m_DataStore->GetBlockCacheLimit();
+    size_t pipeline = m_DataStore->GetPipelined();
+
+    if(block_limit < m_BlockCacheLimit)
+       m_DataStore->SetBlockCacheLimit(std::min(block_limit * 2, m_BlockCacheLimit));
+
+    if(pipeline < m_PipelineLimit)
+       m_DataStore->SetPipelined(std::min(pipeline * 2, m_PipelineLimit));
+}
+
@@ -0,0 +1,106 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <cstddef>
+
+#include "audioneex.h"
+
+class TCDataStore;
+
+/// Keeps the memory used by an indexing session under one global budget,
+/// rather than giving the indexer cache a fixed limit while the datastore
+/// caches grow independently. The governor accounts for the process memory at
+/// the start of the session, the indexer cache, the index block caches, the
+/// memory resident delta index and the writes queued in pipelined builds.
+///
+/// The indexer cache gets whatever is left of the budget once the datastore
+/// and the flush itself (block cache and write queue limits) are accounted
+/// for. When that share gets too small the datastore caches are shrunk: the
+/// resident delta index is moved to its file first, then the block cache and
+/// write queue limits are halved. They are grown back once the pressure is
+/// gone. Update() must be called by the indexing thread after every
+/// Indexer::Index(), and flushes the indexer if its cache is over its share.
+
+class MemoryGovernor
+{
+public:
+
+    struct Stats
+    {
+        size_t  Flushes;    ///< Flushes requested by the governor
+        size_t  Spills;     ///< Resident delta indexes moved to file
+        size_t  Shrinks;    ///< Times the datastore caches were shrunk
+        size_t  PeakUsed;   ///< Peak memory accounted for (in bytes)
+    };
+
+private:
+
+    Audioneex::Indexer*  m_Indexer;
+    TCDataStore*         m_DataStore;
+    size_t               m_Budget;
+    size_t               m_Baseline;
+    size_t               m_BlockCacheLimit;   ///< Initial block cache limit
+    size_t               m_PipelineLimit;     ///< Initial write queue limit
+    size_t               m_CacheLimitMB;      ///< Current indexer cache limit
+    Stats                m_Stats;
+
+    /// Get the indexer cache share, given the datastore memory usage
+    size_t GetIndexerShare(size_t dstore_used) const;
+
+    void Shrink();
+    void Grow();
+
+public:
+
+    /// Fraction of the available memory used by GetSafeBudget()
+    static const double SAFE_FRACTION;
+
+    /// The indexer never gets less than this fraction of the budget before
+    /// the datastore caches are shrunk
+    static const double MIN_INDEXER_SHARE;
+
+    /// Create a governor for the given indexer and datastore. A zero budget
+    /// uses GetSafeBudget().
+    MemoryGovernor(Audioneex::Indexer* indexer, TCDataStore* dstore, size_t budget = 0);
+
+    /// Get the memory this process can use (in bytes): the free memory on
+    /// the system, or in the memory control group if it has a limit, plus
+    /// the process resident set.
+    static size_t GetAvailableMemory();
+
+    /// Get the largest budget that is safe to use (in bytes). This leaves
+    /// some headroom for the engine's own allocations and the file system
+    /// caches.
+    static size_t GetSafeBudget();
+
+    /// Get the process resident set size (in bytes)
+    static size_t GetResidentMemory();
+
+    size_t GetBudget() const { return m_Budget; }
+
+    /// Get the memory currently accounted for (in bytes)
+    size_t GetUsed() const;
+
+    const Stats& GetStats() const { return m_Stats; }
+
+    /// Set the datastore and indexer limits. Call before Indexer::Start().
+    void Start();
+
+    /// Check the memory usage and act on it. Call after every Indexer::Index().
+    void Update();
+};
+
+
+#endif
@@ -0,0 +1,442 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <queue>
+#include <thread>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "ParallelIndexBuilder.h"
+#include "TCDataStore.h"
+
+using namespace std;
+using namespace Audioneex;
+
+
+ParallelIndexBuilder::ParallelIndexBuilder(const string &dburl) :
+    m_DBURL          (dburl),
+    m_Partitions     (1),
+    m_CacheLimit     (128),
+    m_MatchType      (MSCALE_MATCH),
+    m_KeepPartitions (false)
+{
+    SetPartitions(std::thread::hardware_concurrency());
+
+    // Append the path separator if missing
+    if(!m_DBURL.empty() && m_DBURL.back()!='/' && m_DBURL.back()!='\\')
+       m_DBURL += "/";
+}
+
+// ----------------------------------------------------------------------------
+
+void ParallelIndexBuilder::SetPartitions(size_t n)
+{
+    m_Partitions = n > 0 ? n : 1;
+}
+
+// ----------------------------------------------------------------------------
+
+string ParallelIndexBuilder::PartitionURL(size_t partition) const
+{
+    std::stringstream url;
+    url << m_DBURL << "part." << partition << "/";
+    return url.str();
+}
+
+// ----------------------------------------------------------------------------
+
+void ParallelIndexBuilder::Build(vector<uint32_t> fids)
+{
+    if(!m_ProviderFactory)
+       throw invalid_argument("ParallelIndexBuilder: No audio provider factory set");
+
+    // Indexers require strictly increasing FIDs
+    std::sort(fids.begin(), fids.end());
+    fids.erase(std::unique(fids.begin(), fids.end()), fids.end());
+
+    if(fids.empty())
+       throw invalid_argument("ParallelIndexBuilder: No fingerprints to index");
+
+    size_t nparts = std::min(m_Partitions, fids.size());
+
+    vector< unique_ptr<AudioProvider> > providers;
+    for(size_t i=0; i<nparts; i++){
+        providers.push_back(m_ProviderFactory(i));
+        if(!providers.back())
+           throw runtime_error("ParallelIndexBuilder: Couldn't create audio provider");
+    }
+
+    // Index the partitions
+    vector<std::thread> workers;
+    vector<std::exception_ptr> errors(nparts);
+
+    for(size_t i=0; i<nparts; i++)
+    {
+        size_t begin = fids.size() * i / nparts;
+        size_t end = fids.size() * (i + 1) / nparts;
+
+        workers.push_back(std::thread([=, &fids, &providers, &errors](){
+            try{
+               BuildDataStore(PartitionURL(i), fids.data() + begin, end - begin, providers[i].get());
+            }
+            catch(...){
+               errors[i] = std::current_exception();
+            }
+        }));
+    }
+
+    for(size_t i=0; i<workers.size(); i++)
+        workers[i].join();
+
+    for(size_t i=0; i<errors.size(); i++){
+        if(errors[i]){
+           if(!m_KeepPartitions)
+              RemovePartitions(nparts);
+           std::rethrow_exception(errors[i]);
+        }
+    }
+
+    Merge(nparts);
+
+    if(!m_KeepPartitions)
+       RemovePartitions(nparts);
+}
+
+// ----------------------------------------------------------------------------
+
+void ParallelIndexBuilder::BuildDataStore(const string &url,
+                                          const uint32_t* fids, size_t nfids,
+                                          AudioProvider* provider)
+{
+    if(mkdir(url.c_str(), 0755) != 0 && errno != EEXIST)
+       throw runtime_error("Couldn't create directory " + url);
+
+    TCDataStore dstore(url);
+    dstore.Open(KVDataStore::BUILD, true, false, false);
+    dstore.Clear();
+
+    unique_ptr<Indexer> indexer(Indexer::Create());
+    indexer->SetDataStore(&dstore);
+    indexer->SetAudioProvider(provider);
+    indexer->SetMatchType(m_MatchType);
+    indexer->SetCacheLimit(m_CacheLimit);
+
+    indexer->Start();
+
+    for(size_t i=0; i<nfids; i++)
+        indexer->Index(fids[i]);
+
+    indexer->End();
+
+    dstore.Close();
+}
+
+// ----------------------------------------------------------------------------
+
+void ParallelIndexBuilder::Merge(size_t nparts)
+{
+    // Open the partitions built by Build()
+    vector< unique_ptr<TCIndex> > parts;
+
+    for(size_t i=0; i<nparts; i++){
+        string url = PartitionURL(i);
+        parts.push_back(unique_ptr<TCIndex>(new TCIndex(nullptr)));
+        parts.back()->SetURL(url);
+        parts.back()->SetName("data.idx");
+        parts.back()->Open(OPEN_READ);
+    }
+
+    // Get the sorted list IDs of every partition (the first blocks keys)
+    vector< vector<int> > lists(parts.size());
+    vector<uint8_t> key, block, outblock;
+
+    for(size_t i=0; i<parts.size(); i++){
+        parts[i]->IterInit();
+        while(parts[i]->IterNext(key)){
+            const int *pkey = reinterpret_cast<const int*>(key.data());
+            if(key.size() == sizeof(int)*2 && pkey[1] == 1)
+               lists[i].push_back(pkey[0]);
+        }
+        std::sort(lists[i].begin(), lists[i].end());
+    }
+
+    TCIndex index(nullptr);
+    index.SetURL(m_DBURL);
+    index.SetName("data.idx");
+    index.Open(OPEN_READ_WRITE);
+    index.Drop();
+
+    // Visit the lists in ascending order across all partitions
+    typedef std::pair<int, size_t> list_ref;
+
+    std::priority_queue< list_ref, vector<list_ref>, std::greater<list_ref> > heap;
+    vector<size_t> pos(parts.size(), 0);
+
+    for(size_t i=0; i<parts.size(); i++)
+        if(!lists[i].empty())
+           heap.push(list_ref(lists[i][0], i));
+
+    vector<size_t> holders;
+
+    while(!heap.empty())
+    {
+        int list_id = heap.top().first;
+
+        // Get the partitions holding the list
+        holders.clear();
+        while(!heap.empty() && heap.top().first == list_id){
+            size_t p = heap.top().second;
+            heap.pop();
+            holders.push_back(p);
+            if(++pos[p] < lists[p].size())
+               heap.push(list_ref(lists[p][pos[p]], p));
+        }
+
+        // Append the list blocks in FID range order
+        std::sort(holders.begin(), holders.end());
+
+        PListHeader lhdr = {};
+        for(size_t i=0; i<holders.size(); i++)
+            lhdr.BlockCount += parts[holders[i]]->GetPListHeader(list_id).BlockCount;
+
+        uint32_t block_id = 0;
+
+        for(size_t i=0; i<holders.size(); i++)
+        {
+            TCIndex &part = *parts[holders[i]];
+            uint32_t nblocks = part.GetPListHeader(list_id).BlockCount;
+
+            for(uint32_t b=1; b<=nblocks; b++)
+            {
+                size_t size = part.ReadBlock(list_id, b, block, true);
+                size_t hoff = b==1 ? sizeof(PListHeader) : 0;
+
+                if(size < hoff + sizeof(PListBlockHeader)){
+                   std::stringstream msg;
+                   msg << "Missing block " << b << " of list " << list_id
+                       << " in partition " << holders[i];
+                   throw InvalidIndexDataException(msg.str());
+                }
+
+                // Renumber the block. FIDmax is left as is, as the FIDs
+                // are global and the ranges are appended in order.
+                PListBlockHeader hdr = *reinterpret_cast<PListBlockHeader*>(block.data() + hoff);
+                hdr.ID = ++block_id;
+
+                size_t ohoff = hdr.ID==1 ? sizeof(PListHeader) : 0;
+                size_t body = size - hoff - sizeof(PListBlockHeader);
+                size_t osize = ohoff + sizeof(PListBlockHeader) + body;
+
+                if(outblock.size() < osize)
+                   outblock.resize(osize);
+
+                if(hdr.ID==1)
+                   *reinterpret_cast<PListHeader*>(outblock.data()) = lhdr;
+
+                *reinterpret_cast<PListBlockHeader*>(outblock.data() + ohoff) = hdr;
+
+                std::copy(block.begin() + hoff + sizeof(PListBlockHeader),
+                          block.begin() + size,
+                          outblock.begin() + ohoff + sizeof(PListBlockHeader));
+
+                index.WriteBlock(list_id, hdr.ID, outblock, osize);
+            }
+        }
+    }
+
+    index.Close();
+
+    // Copy the fingerprints
+    TCFingerprints fingerprints(nullptr);
+    fingerprints.SetURL(m_DBURL);
+    fingerprints.SetName("data.qfp");
+    fingerprints.Open(OPEN_READ_WRITE);
+    fingerprints.Drop();
+
+    vector<uint8_t> value;
+
+    for(size_t i=0; i<parts.size(); i++){
+        TCFingerprints part(nullptr);
+        part.SetURL(PartitionURL(i));
+        part.SetName("data.qfp");
+        part.Open(OPEN_READ);
+        part.IterInit();
+        while(part.IterNext(key, value)){
+            if(key.size() == sizeof(uint32_t) && !value.empty())
+               fingerprints.WriteFingerprint(*reinterpret_cast<const uint32_t*>(key.data()),
+                                             value.data(), value.size());
+        }
+    }
+
+    fingerprints.Close();
+
+    // Reset the metadata and record the match type
+    TCMetadata metadata(nullptr);
+    metadata.SetURL(m_DBURL);
+    metadata.SetName("data.met");
+    metadata.Open(OPEN_READ_WRITE);
+    metadata.Drop();
+    metadata.Close();
+
+    TCInfo info(nullptr);
+    info.SetURL(m_DBURL);
+    info.SetName("data.inf");
+    info.Open(OPEN_READ_WRITE);
+    DBInfo_t dbinfo = { m_MatchType };
+    info.Write(dbinfo);
+    info.Close();
+}
+
+// ----------------------------------------------------------------------------
+
+void ParallelIndexBuilder::RemovePartitions(size_t nparts)
+{
+    for(size_t i=0; i<nparts; i++)
+        RemoveDataStore(PartitionURL(i));
+}
+
+// ----------------------------------------------------------------------------
+
+void ParallelIndexBuilder::RemoveDataStore(const string &url)
+{
+    // All the files, as the datastore may have more than the databases
+    // (journal, swap marker, ...)
+    DIR *dir = opendir(url.c_str());
+    if(dir){
+       while(struct dirent *entry = readdir(dir)){
+           string name = entry->d_name;
+           if(name != "." && name != "..")
+              std::remove((url + name).c_str());
+       }
+       closedir(dir);
+    }
+    rmdir(url.c_str());
+}
+
+// ----------------------------------------------------------------------------
+
+size_t ParallelIndexBuilder::Verify(vector<uint32_t> fids, size_t clip_secs)
+{
+    if(!m_ProviderFactory)
+       throw invalid_argument("ParallelIndexBuilder: No audio provider factory set");
+
+    std::sort(fids.begin(), fids.end());
+    fids.erase(std::unique(fids.begin(), fids.end()), fids.end());
+
+    if(fids.empty())
+       throw invalid_argument("ParallelIndexBuilder: No fingerprints to index");
+
+    unique_ptr<AudioProvider> provider(m_ProviderFactory(0));
+    if(!provider)
+       throw runtime_error("ParallelIndexBuilder: Couldn't create audio provider");
+
+    string serial_url = m_DBURL + "serial.tmp/";
+
+    size_t mismatches = 0;
+
+    try{
+       BuildDataStore(serial_url, fids.data(), fids.size(), provider.get());
+
+       // The serial build has drained the provider, so the clips are read
+       // from a fresh one
+       provider = m_ProviderFactory(0);
+       if(!provider)
+          throw runtime_error("ParallelIndexBuilder: Couldn't create audio provider");
+
+       TCDataStore parallel(m_DBURL), serial(serial_url);
+       parallel.Open(KVDataStore::GET, true, false, false);
+       serial.Open(KVDataStore::GET, true, false, false);
+
+       TCDataStore* dstores[] = { &parallel, &serial };
+       unique_ptr<Recognizer> recognizers[2];
+
+       for(int r=0; r<2; r++){
+           recognizers[r].reset(Recognizer::Create());
+           recognizers[r]->SetMatchType(m_MatchType);
+           recognizers[r]->SetDataStore(dstores[r]);
+       }
+
+       // The audio is fed in 1 second chunks, as for stream monitoring
+       const size_t chunk = 11025;
+       vector<float> audio(chunk);
+
+       for(size_t i=0; i<fids.size(); i++)
+       {
+           const IdMatch* results[2] = { nullptr, nullptr };
+           size_t nsamples = 0;
+
+           for(size_t s=0; s<clip_secs && !(results[0] && results[1]); s++)
+           {
+               int nread = provider->OnAudioData(fids[i], audio.data(), chunk);
+               if(nread < 0){
+                  std::stringstream msg;
+                  msg << "Couldn't read the audio of FID " << fids[i];
+                  throw runtime_error(msg.str());
+               }
+               if(nread == 0)
+                  break;
+
+               nsamples += nread;
+
+               for(int r=0; r<2; r++)
+                   if(!results[r]){
+                      recognizers[r]->Identify(audio.data(), nread);
+                      results[r] = recognizers[r]->GetResults();
+                   }
+           }
+
+           // Drain the provider so the next FID starts from the beginning
+           while(provider->OnAudioData(fids[i], audio.data(), chunk) > 0);
+
+           for(int r=0; r<2; r++)
+               if(!results[r]){
+                  recognizers[r]->Flush();
+                  results[r] = recognizers[r]->GetResults();
+               }
+
+           // Nothing was compared if no audio was read
+           bool same = nsamples > 0 &&
+                       (results[0] == nullptr) == (results[1] == nullptr);
+
+           for(size_t k=0; same && results[0]; k++){
+               const IdMatch &a = results[0][k], &b = results[1][k];
+               same = a.FID == b.FID && a.IdClass == b.IdClass &&
+                      a.Score == b.Score && a.Confidence == b.Confidence;
+               if(IsNull(a) || IsNull(b))
+                  break;
+           }
+
+           if(!same)
+              mismatches++;
+
+           recognizers[0]->Reset();
+           recognizers[1]->Reset();
+       }
+    }
+    catch(...){
+       RemoveDataStore(serial_url);
+       throw;
+    }
+
+    RemoveDataStore(serial_url);
+
+    return mismatches;
+}
+
@@ -0,0 +1,108 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef PARALLELINDEXBUILDER_H
+#define PARALLELINDEXBUILDER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "audioneex.h"
+
+/// Builds a datastore using several indexers in parallel. The fingerprint IDs
+/// are split into contiguous ranges (partitions), each indexed by its own
+/// Indexer into its own TCDataStore in a subdirectory of the target datastore.
+/// The partitions are then merged into the target: the index lists are visited
+/// in ascending order across all the partitions (k-way merge) and the blocks of
+/// every list are appended in ascending FID range order, renumbering the block
+/// IDs and updating the list's block count. The fingerprints are copied as is.
+///
+/// The audio providers are created through a user supplied factory, one per
+/// partition, as they are called concurrently by the indexers.
+
+class ParallelIndexBuilder
+{
+public:
+
+    typedef std::function<std::unique_ptr<Audioneex::AudioProvider>(size_t partition)> ProviderFactory;
+
+private:
+
+    std::string            m_DBURL;
+    size_t                 m_Partitions;
+    size_t                 m_CacheLimit;
+    Audioneex::eMatchType  m_MatchType;
+    ProviderFactory        m_ProviderFactory;
+    bool                   m_KeepPartitions;
+
+    std::string PartitionURL(size_t partition) const;
+
+    /// Index the given FIDs into a new datastore at the given URL
+    void BuildDataStore(const std::string &url,
+                        const uint32_t* fids, size_t nfids,
+                        Audioneex::AudioProvider* provider);
+
+    /// Merge the first 'nparts' partitions into the target datastore.
+    /// The blocks are copied without decoding their postings, which is only
+    /// correct if every block decodes on its own, i.e. the indexer doesn't
+    /// carry any state (e.g. the base of delta coded FIDs) from a block to
+    /// the next one of the same list. The postings format is private to the
+    /// engine, so this can't be checked here: use Verify() to compare the
+    /// results against a serial build whenever the engine is updated.
+    void Merge(size_t nparts);
+
+    void RemovePartitions(size_t nparts);
+
+    /// Remove the datastore directory and all the files in it
+    static void RemoveDataStore(const std::string &url);
+
+public:
+
+    explicit ParallelIndexBuilder(const std::string &dburl);
+
+    /// Set the number of partitions (indexing threads). Defaults to the
+    /// number of available cores.
+    void SetPartitions(size_t n);
+
+    size_t GetPartitions() const { return m_Partitions; }
+
+    /// Set the cache limit (in MB) of each indexer
+    void SetCacheLimit(size_t limit) { m_CacheLimit = limit; }
+
+    size_t GetCacheLimit() const { return m_CacheLimit; }
+
+    void SetMatchType(Audioneex::eMatchType type) { m_MatchType = type; }
+
+    Audioneex::eMatchType GetMatchType() const { return m_MatchType; }
+
+    void SetProviderFactory(const ProviderFactory &factory) { m_ProviderFactory = factory; }
+
+    /// Keep the partitions datastores after merging (for inspection)
+    void SetKeepPartitions(bool keep) { m_KeepPartitions = keep; }
+
+    /// Build the datastore from the recordings with the given FIDs. Any
+    /// existing content of the target datastore is discarded.
+    void Build(std::vector<uint32_t> fids);
+
+    /// Check the datastore made by Build() against a serial build of the same
+    /// recordings, made by a single indexer in a scratch subdirectory. The
+    /// first 'clip_secs' seconds of every recording are identified against
+    /// both, and the number of recordings whose results differ is returned
+    /// (zero if the parallel build is equivalent). Recordings with no audio
+    /// to identify count as differing.
+    size_t Verify(std::vector<uint32_t> fids, size_t clip_secs=10);
+};
+
+
+#endif
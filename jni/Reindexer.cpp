@@ -0,0 +1,305 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <condition_variable>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Reindexer.h"
+#include "TCDataStore.h"
+#include "MemoryGovernor.h"
+
+using namespace std;
+using namespace Audioneex;
+
+namespace {
+
+/// The staging datastore. The fingerprints are already in the live
+/// datastore, so the ones passed back by the indexer are dropped (only
+/// their IDs are tracked for the checkpoints).
+class StagingDataStore : public TCDataStore
+{
+public:
+    explicit StagingDataStore(const string &url) : TCDataStore(url) {}
+    void OnIndexerFingerprint(uint32_t FID, uint8_t* data, size_t size) { TrackFingerprint(FID); }
+};
+
+/// A fingerprint read ahead
+struct Fingerprint
+{
+    uint32_t         FID;
+    vector<uint8_t>  Data;
+};
+
+/// Bounded buffer between the fingerprints reader and the indexer
+class ReadaheadBuffer
+{
+    std::mutex               m_Mutex;
+    std::condition_variable  m_Cond;
+    std::deque<Fingerprint>  m_Items;
+    size_t                   m_Bytes;
+    size_t                   m_Limit;
+    bool                     m_Done;
+    bool                     m_Cancelled;
+    std::exception_ptr       m_Error;
+
+public:
+
+    explicit ReadaheadBuffer(size_t limit) :
+        m_Bytes     (0),
+        m_Limit     (limit),
+        m_Done      (false),
+        m_Cancelled (false)
+    {}
+
+    /// Add a fingerprint, waiting for room. Return false if cancelled.
+    bool Push(Fingerprint &fp)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Cond.wait(lock, [&](){
+            return m_Cancelled || m_Items.empty() || m_Bytes + fp.Data.size() <= m_Limit;
+        });
+        if(m_Cancelled)
+           return false;
+        m_Bytes += fp.Data.size();
+        m_Items.push_back(std::move(fp));
+        m_Cond.notify_all();
+        return true;
+    }
+
+    /// Get the next fingerprint. Return false at the end of the stream.
+    bool Pop(Fingerprint &fp)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Cond.wait(lock, [&](){ return m_Done || !m_Items.empty(); });
+        if(m_Items.empty()){
+           if(m_Error)
+              std::rethrow_exception(m_Error);
+           return false;
+        }
+        fp = std::move(m_Items.front());
+        m_Items.pop_front();
+        m_Bytes -= fp.Data.size();
+        m_Cond.notify_all();
+        return true;
+    }
+
+    /// Signal the end of the stream (producer)
+    void Finish(std::exception_ptr error = std::exception_ptr())
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Done = true;
+        m_Error = error;
+        m_Cond.notify_all();
+    }
+
+    /// Stop the producer (consumer)
+    void Cancel()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Cancelled = true;
+        m_Cond.notify_all();
+    }
+};
+
+const char* STAGING_FILES[] = { "data.idx", "data.inf", "data.qfp", "data.met", "data.tmp", "data.jnl", "data.del" };
+
+}
+
+// ----------------------------------------------------------------------------
+
+Reindexer::Reindexer(const string &dburl) :
+    m_DBURL            (dburl),
+    m_MatchType        (MSCALE_MATCH),
+    m_CacheLimit       (128),
+    m_Readahead        (64 * 1024 * 1024),
+    m_MemoryBudget     (0),
+    m_Governed         (false),
+    m_Resume           (false),
+    m_ProgressInterval (1000)
+{
+    // Append the path separator if missing
+    if(!m_DBURL.empty() && m_DBURL.back()!='/' && m_DBURL.back()!='\\')
+       m_DBURL += "/";
+}
+
+// ----------------------------------------------------------------------------
+
+string Reindexer::GetStagingURL() const
+{
+    return m_DBURL + "reindex.tmp/";
+}
+
+// ----------------------------------------------------------------------------
+
+Reindexer::Progress Reindexer::Run()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // A swap interrupted by a crash must be completed before the staging
+    // directory is reused
+    TCDataStore::RecoverSwap(m_DBURL);
+
+    TCFingerprints fingerprints(nullptr);
+    fingerprints.SetURL(m_DBURL);
+    fingerprints.SetName("data.qfp");
+    fingerprints.Open(OPEN_READ);
+
+    // Deleted fingerprints are left out of the new index
+    TCTombstones tombstones(nullptr);
+    tombstones.SetURL(m_DBURL);
+    tombstones.SetName("data.del");
+    tombstones.Load(OPEN_READ);
+
+    // Only the IDs are kept in memory, to visit the fingerprints in FID order
+    vector<uint32_t> fids;
+    vector<uint8_t> key;
+
+    fingerprints.IterInit();
+    while(fingerprints.IterNext(key))
+        if(key.size() == sizeof(uint32_t)){
+           uint32_t fid = *reinterpret_cast<const uint32_t*>(key.data());
+           if(!tombstones.Contains(fid))
+              fids.push_back(fid);
+        }
+
+    std::sort(fids.begin(), fids.end());
+
+    Progress progress = { 0, fids.size(), 0, 0 };
+
+    string staging = GetStagingURL();
+
+    if(mkdir(staging.c_str(), 0755) != 0 && errno != EEXIST)
+       throw runtime_error("Couldn't create directory " + staging);
+
+    StagingDataStore dstore(staging);
+    dstore.SetCheckpoints(true);
+    dstore.Open(KVDataStore::BUILD, false, false, true);
+
+    if(m_Resume){
+       // Skip the fingerprints indexed before the last checkpoint
+       uint32_t last = dstore.Resume();
+       fids.erase(fids.begin(), std::upper_bound(fids.begin(), fids.end(), last));
+       progress.Total = fids.size();
+    }
+    else
+       dstore.Clear();
+
+    unique_ptr<Indexer> indexer(Indexer::Create());
+    indexer->SetDataStore(&dstore);
+    indexer->SetMatchType(m_MatchType);
+    indexer->SetCacheLimit(m_CacheLimit);
+
+    // The readahead buffer comes out of the budget
+    unique_ptr<MemoryGovernor> governor;
+    if(m_Governed){
+       size_t budget = m_MemoryBudget ? m_MemoryBudget : MemoryGovernor::GetSafeBudget();
+       if(budget <= m_Readahead)
+          throw invalid_argument("Reindexer: The memory budget is smaller than the readahead");
+       governor.reset(new MemoryGovernor(indexer.get(), &dstore, budget - m_Readahead));
+       governor->Start();
+    }
+
+    ReadaheadBuffer readahead(m_Readahead);
+
+    std::thread reader([&](){
+        try{
+           vector<uint8_t> buffer;
+           for(size_t i=0; i<fids.size(); i++){
+               Fingerprint fp;
+               fp.FID = fids[i];
+               size_t size = fingerprints.ReadFingerprint(fids[i], buffer, 0, 0);
+               fp.Data.assign(buffer.begin(), buffer.begin() + size);
+               if(!readahead.Push(fp))
+                  return;
+           }
+           readahead.Finish();
+        }
+        catch(...){
+           readahead.Finish(std::current_exception());
+        }
+    });
+
+    try{
+       indexer->Start();
+
+       Fingerprint fp;
+       while(readahead.Pop(fp))
+       {
+           if(!fp.Data.empty())
+              indexer->Index(fp.FID, fp.Data.data(), fp.Data.size());
+
+           if(governor)
+              governor->Update();
+
+           progress.Done ++;
+           progress.Bytes += fp.Data.size();
+
+           if(m_Progress && progress.Done % m_ProgressInterval == 0){
+              progress.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+              m_Progress(progress);
+           }
+       }
+
+       indexer->End();
+    }
+    catch(...){
+       readahead.Cancel();
+       reader.join();
+       throw;
+    }
+
+    reader.join();
+
+    DBInfo_t info = { m_MatchType };
+    dstore.PutInfo(info);
+    dstore.Close();
+
+    progress.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(m_Progress)
+       m_Progress(progress);
+
+    return progress;
+}
+
+// ----------------------------------------------------------------------------
+
+void Reindexer::Swap()
+{
+    TCDataStore::SwapIndex(m_DBURL, GetStagingURL());
+    Discard();
+}
+
+// ----------------------------------------------------------------------------
+
+void Reindexer::Discard()
+{
+    string staging = GetStagingURL();
+
+    for(size_t i=0; i<sizeof(STAGING_FILES)/sizeof(STAGING_FILES[0]); i++)
+        std::remove((staging + STAGING_FILES[i]).c_str());
+
+    rmdir(staging.c_str());
+}
+
@@ -0,0 +1,110 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef REINDEXER_H
+#define REINDEXER_H
+
+#include <string>
+#include <functional>
+
+#include "audioneex.h"
+
+/// Rebuilds the index of a TCDataStore from its stored fingerprints, e.g. to
+/// change the match type or the index blocking. The fingerprints are read
+/// in FID order by a background thread into a bounded readahead buffer and
+/// fed to an indexer, so only their IDs and the readahead are kept in memory.
+/// The new index is written in a staging directory next to the live one and
+/// moved into place by Swap(). Processes that have the datastore open keep
+/// reading the old index until they reopen it. The staging datastore is
+/// checkpointed, so an interrupted run can be resumed (see SetResume()).
+
+class Reindexer
+{
+public:
+
+    struct Progress
+    {
+        size_t    Done;       ///< Fingerprints indexed so far
+        size_t    Total;      ///< Fingerprints to index
+        uint64_t  Bytes;      ///< Fingerprint data indexed so far
+        double    Seconds;    ///< Time elapsed since the start
+    };
+
+    typedef std::function<void(const Progress&)> ProgressCallback;
+
+private:
+
+    std::string            m_DBURL;
+    Audioneex::eMatchType  m_MatchType;
+    size_t                 m_CacheLimit;
+    size_t                 m_Readahead;
+    size_t                 m_MemoryBudget;
+    bool                   m_Governed;
+    bool                   m_Resume;
+    ProgressCallback       m_Progress;
+    size_t                 m_ProgressInterval;
+
+public:
+
+    explicit Reindexer(const std::string &dburl);
+
+    void SetMatchType(Audioneex::eMatchType type) { m_MatchType = type; }
+
+    Audioneex::eMatchType GetMatchType() const { return m_MatchType; }
+
+    /// Set the indexer cache limit (in MB)
+    void SetCacheLimit(size_t limit) { m_CacheLimit = limit; }
+
+    size_t GetCacheLimit() const { return m_CacheLimit; }
+
+    /// Keep the indexing memory under the given budget (in bytes) using a
+    /// MemoryGovernor instead of the fixed cache limit. A zero budget uses
+    /// the largest safe budget (see MemoryGovernor::GetSafeBudget()).
+    void SetMemoryBudget(size_t bytes) { m_MemoryBudget = bytes; m_Governed = true; }
+
+    size_t GetMemoryBudget() const { return m_MemoryBudget; }
+
+    /// Set the maximum amount of fingerprint data (in bytes) read ahead
+    void SetReadahead(size_t bytes) { m_Readahead = bytes; }
+
+    size_t GetReadahead() const { return m_Readahead; }
+
+    /// Continue an interrupted run from its last checkpoint rather than
+    /// starting over
+    void SetResume(bool resume) { m_Resume = resume; }
+
+    bool GetResume() const { return m_Resume; }
+
+    /// Set a function to be called every 'interval' indexed fingerprints,
+    /// and once at the end
+    void SetProgressCallback(const ProgressCallback &callback, size_t interval=1000) {
+        m_Progress = callback;
+        m_ProgressInterval = interval > 0 ? interval : 1;
+    }
+
+    /// Get the staging directory where the new index is built
+    std::string GetStagingURL() const;
+
+    /// Build the new index in the staging directory
+    Progress Run();
+
+    /// Replace the live index with the one built by Run(). If interrupted, the
+    /// swap is completed when the datastore is next opened (see
+    /// TCDataStore::SwapIndex()).
+    void Swap();
+
+    /// Remove the staging directory
+    void Discard();
+};
+
+
+#endif
@@ -0,0 +1,582 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <string>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "RemoteDataStore.h"
+
+using namespace std;
+using namespace Audioneex;
+
+
+namespace {
+
+/// Accounted overhead of a cache entry
+const size_t CACHE_ENTRY_OVERHEAD = 64;
+
+/// Default size of the blocks cache
+const size_t DEFAULT_CACHE_LIMIT = 32 * 1024 * 1024;
+
+}// unnamed namespace
+
+
+// ----------------------------------------------------------------------------
+
+RemoteDataStore::RemoteDataStore(const string &address) :
+    m_Address       (address),
+    m_Socket        (-1),
+    m_IsOpen        (false),
+    m_InFlight      (false),
+    m_CacheSize     (0),
+    m_CacheLimit    (DEFAULT_CACHE_LIMIT),
+    m_Prefetch      (2)
+{
+    if(pthread_key_create(&m_PinsKey, &RemoteDataStore::OnThreadExit) != 0)
+       throw runtime_error("Couldn't create the remote datastore thread key");
+}
+
+// ----------------------------------------------------------------------------
+
+RemoteDataStore::~RemoteDataStore()
+{
+    if(m_IsOpen) Close();
+
+    // No more thread exit callbacks from here on
+    pthread_key_delete(m_PinsKey);
+
+    for(size_t i=0; i<m_Pins.size(); i++)
+        delete m_Pins[i];
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::Open(eOperation op, bool use_fing_db, bool use_meta_db, bool use_info_db)
+{
+    if(op != GET)
+       throw invalid_argument("RemoteDataStore::Open(): Invalid operation (read-only datastore)");
+
+    if(m_IsOpen)
+       Close();
+
+    Connect();
+    m_IsOpen = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::Close()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+
+        // Let the batch in flight complete before tearing down the connection
+        // it's using. The calls still queued fail.
+        while(m_InFlight)
+           m_Cond.wait(lock);
+
+        Disconnect();
+
+        for(size_t i=0; i<m_Queue.size(); i++){
+            m_Queue[i]->Status = BS_ERROR;
+            m_Queue[i]->Done = true;
+        }
+        m_Queue.clear();
+
+        m_IsOpen = false;
+        m_Cond.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+    m_LRU.clear();
+    m_CacheMap.clear();
+    m_CacheSize = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::Connect()
+{
+    m_Socket = BSConnect(m_Address);
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::Disconnect()
+{
+    if(m_Socket >= 0)
+       close(m_Socket);
+    m_Socket = -1;
+}
+
+// ----------------------------------------------------------------------------
+
+RemoteDataStore::Pins* RemoteDataStore::GetPins()
+{
+    Pins *pins = static_cast<Pins*>(pthread_getspecific(m_PinsKey));
+
+    if(pins == nullptr){
+       pins = new Pins();
+       pins->Owner = this;
+       {
+           std::lock_guard<std::mutex> lock(m_Mutex);
+           m_Pins.push_back(pins);
+       }
+       pthread_setspecific(m_PinsKey, pins);
+    }
+    return pins;
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnThreadExit(void *data)
+{
+    Pins *pins = static_cast<Pins*>(data);
+    RemoteDataStore *dstore = pins->Owner;
+
+    std::lock_guard<std::mutex> lock(dstore->m_Mutex);
+
+    dstore->m_Pins.erase(std::find(dstore->m_Pins.begin(), dstore->m_Pins.end(), pins));
+    delete pins;
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::SetCacheLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+
+    m_CacheLimit = bytes;
+
+    while(m_CacheSize > m_CacheLimit && !m_LRU.empty()){
+        m_CacheSize -= m_LRU.back().second->size() + CACHE_ENTRY_OVERHEAD;
+        m_CacheMap.erase(m_LRU.back().first);
+        m_LRU.pop_back();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+RemoteDataStore::Blob RemoteDataStore::CacheGet(uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+
+    boost::unordered::unordered_map<uint64_t, lru_list::iterator>::iterator it = m_CacheMap.find(key);
+
+    if(it == m_CacheMap.end())
+       return Blob();
+
+    // Move to the front of the LRU list
+    m_LRU.splice(m_LRU.begin(), m_LRU, it->second);
+    return it->second->second;
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::CachePut(uint64_t key, const Blob &blob)
+{
+    std::lock_guard<std::mutex> lock(m_CacheMutex);
+
+    size_t esize = blob->size() + CACHE_ENTRY_OVERHEAD;
+
+    if(esize > m_CacheLimit || m_CacheMap.find(key) != m_CacheMap.end())
+       return;
+
+    while(m_CacheSize + esize > m_CacheLimit && !m_LRU.empty()){
+        m_CacheSize -= m_LRU.back().second->size() + CACHE_ENTRY_OVERHEAD;
+        m_CacheMap.erase(m_LRU.back().first);
+        m_LRU.pop_back();
+    }
+
+    m_LRU.push_front(std::make_pair(key, blob));
+    m_CacheMap[key] = m_LRU.begin();
+    m_CacheSize += esize;
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::Execute(Call* calls, size_t ncalls)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    if(!m_IsOpen)
+       throw runtime_error("Remote datastore not open");
+
+    for(size_t i=0; i<ncalls; i++){
+        calls[i].Done = false;
+        calls[i].Status = BS_ERROR;
+        m_Queue.push_back(&calls[i]);
+    }
+
+    for(;;)
+    {
+        bool done = true;
+        for(size_t i=0; i<ncalls && done; i++)
+            done = calls[i].Done;
+
+        if(done) break;
+
+        // Somebody else is talking to the server. Our calls are either in
+        // its batch or will be picked up by the next leader.
+        if(m_InFlight){
+           m_Cond.wait(lock);
+           continue;
+        }
+
+        std::vector<Call*> batch;
+        while(!m_Queue.empty() && batch.size() < BS_MAX_BATCH){
+            batch.push_back(m_Queue.front());
+            m_Queue.pop_front();
+        }
+
+        m_InFlight = true;
+        lock.unlock();
+
+        bool ok = false;
+        try{
+           ok = Transact(batch);
+           // Requests are idempotent, so retry once on a fresh connection
+           if(!ok){
+              Disconnect();
+              Connect();
+              ok = Transact(batch);
+           }
+        }
+        catch(const std::exception&){
+           ok = false;
+        }
+
+        lock.lock();
+
+        for(size_t i=0; i<batch.size(); i++){
+            if(!ok) batch[i]->Status = BS_ERROR;
+            batch[i]->Done = true;
+        }
+
+        m_InFlight = false;
+        m_Cond.notify_all();
+    }
+
+    for(size_t i=0; i<ncalls; i++)
+        if(calls[i].Status == BS_ERROR)
+           throw runtime_error("Block server request failed ("+m_Address+")");
+}
+
+// ----------------------------------------------------------------------------
+
+bool RemoteDataStore::Transact(std::vector<Call*> &batch)
+{
+    if(m_Socket < 0)
+       return false;
+
+    std::vector<uint8_t> msg(sizeof(BSBatchHeader) + batch.size() * sizeof(BSRequest));
+
+    BSBatchHeader *bhdr = reinterpret_cast<BSBatchHeader*>(msg.data());
+    bhdr->Magic = BS_MAGIC;
+    bhdr->Count = batch.size();
+
+    BSRequest *reqs = reinterpret_cast<BSRequest*>(msg.data() + sizeof(BSBatchHeader));
+    for(size_t i=0; i<batch.size(); i++)
+        reqs[i] = batch[i]->Request;
+
+    if(!BSWriteFull(m_Socket, msg.data(), msg.size()))
+       return false;
+
+    BSBatchHeader rhdr;
+
+    if(!BSReadFull(m_Socket, &rhdr, sizeof(rhdr)) ||
+       rhdr.Magic != BS_MAGIC || rhdr.Count != batch.size())
+       return false;
+
+    for(size_t i=0; i<batch.size(); i++)
+    {
+        BSResponse res;
+
+        if(!BSReadFull(m_Socket, &res, sizeof(res)))
+           return false;
+
+        std::shared_ptr<std::vector<uint8_t> > data =
+                std::make_shared<std::vector<uint8_t> >(res.Size);
+
+        if(res.Size && !BSReadFull(m_Socket, data->data(), res.Size))
+           return false;
+
+        batch[i]->Status = res.Status;
+        batch[i]->Result = data;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+RemoteDataStore::Blob RemoteDataStore::Request(uint32_t op, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    Call call = {};
+    call.Request.Op = op;
+    call.Request.Arg1 = arg1;
+    call.Request.Arg2 = arg2;
+    call.Request.Arg3 = arg3;
+
+    Execute(&call, 1);
+
+    return call.Status == BS_OK ? call.Result : std::make_shared<std::vector<uint8_t> >();
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* RemoteDataStore::GetPListBlock(int list_id, int block, size_t &data_size, bool headers)
+{
+    data_size = 0;
+
+    uint64_t key = BlockKey(list_id, block);
+    Blob blob = CacheGet(key);
+
+    if(!blob)
+    {
+        std::vector<Call> calls(1 + m_Prefetch);
+
+        calls[0].Request.Op = BS_GET_BLOCK;
+        calls[0].Request.Arg1 = list_id;
+        calls[0].Request.Arg2 = block;
+
+        // Don't prefetch past the end of the list if its length is known
+        size_t last = block + m_Prefetch;
+        Blob first = block==1 ? Blob() : CacheGet(BlockKey(list_id, 1));
+        if(first && first->size() >= sizeof(PListHeader))
+           last = std::min<size_t>(last, reinterpret_cast<const PListHeader*>(first->data())->BlockCount);
+
+        size_t ncalls = 1;
+        for(size_t b = block + 1; b <= last; b++){
+            if(CacheGet(BlockKey(list_id, b)))
+               continue;
+            calls[ncalls].Request.Op = BS_GET_BLOCK;
+            calls[ncalls].Request.Arg1 = list_id;
+            calls[ncalls].Request.Arg2 = b;
+            ncalls++;
+        }
+
+        Execute(calls.data(), ncalls);
+
+        // Missing blocks are not cached, as they may be added on the server
+        for(size_t i=0; i<ncalls; i++){
+            Blob res = calls[i].Status == BS_OK ? calls[i].Result
+                                                : std::make_shared<std::vector<uint8_t> >();
+            if(!res->empty())
+               CachePut(BlockKey(list_id, calls[i].Request.Arg2), res);
+            if(i == 0) blob = res;
+        }
+    }
+
+    GetPins()->Block = blob;
+
+    if(blob->empty())
+       return nullptr;
+
+    size_t off = 0;
+
+    if(!headers)
+       off = block==1 ? sizeof(PListHeader) +
+                        sizeof(PListBlockHeader)
+                      :
+                        sizeof(PListBlockHeader);
+
+    if(blob->size() < off)
+       throw InvalidIndexDataException("Invalid block received from block server");
+
+    data_size = blob->size() - off;
+    return blob->data() + off;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t RemoteDataStore::GetFingerprintSize(uint32_t FID)
+{
+    Blob blob = Request(BS_GET_FINGERPRINT_SIZE, FID);
+    return blob->size() == sizeof(uint64_t) ?
+           *reinterpret_cast<const uint64_t*>(blob->data()) : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* RemoteDataStore::GetFingerprint(uint32_t FID, size_t &read, size_t nbytes, uint32_t bo)
+{
+    Blob blob = Request(BS_GET_FINGERPRINT, FID, bo, nbytes);
+
+    GetPins()->Fingerprint = blob;
+
+    read = blob->size();
+    return blob->empty() ? nullptr : blob->data();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t RemoteDataStore::GetFingerprintsCount()
+{
+    Blob blob = Request(BS_GET_FINGERPRINTS_COUNT, 0);
+    return blob->size() == sizeof(uint64_t) ?
+           *reinterpret_cast<const uint64_t*>(blob->data()) : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+string RemoteDataStore::GetMetadata(uint32_t FID)
+{
+    Blob blob = Request(BS_GET_METADATA, FID);
+    return string(blob->begin(), blob->end());
+}
+
+// ----------------------------------------------------------------------------
+
+bool RemoteDataStore::Empty()
+{
+    Blob blob = Request(BS_IS_EMPTY, 0);
+    return blob->size() != sizeof(uint64_t) ||
+           *reinterpret_cast<const uint64_t*>(blob->data()) != 0;
+}
+
+// ----------------------------------------------------------------------------
+
+bool RemoteDataStore::IsDeleted(uint32_t FID)
+{
+    Blob blob = Request(BS_IS_DELETED, FID);
+    return blob->size() == sizeof(uint64_t) &&
+           *reinterpret_cast<const uint64_t*>(blob->data()) != 0;
+}
+
+// ----------------------------------------------------------------------------
+
+DBInfo_t RemoteDataStore::GetInfo()
+{
+    Blob blob = Request(BS_GET_INFO, 0);
+    DBInfo_t dbinfo = {-1};
+    if(blob->size() == sizeof(uint64_t))
+       dbinfo.MatchType = static_cast<int>(*reinterpret_cast<const uint64_t*>(blob->data()));
+    return dbinfo;
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::Clear()
+{
+    throw logic_error("RemoteDataStore::Clear(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::SetOpMode(KVDataStore::eOperation mode)
+{
+    if(mode != GET)
+       throw invalid_argument("RemoteDataStore::SetOpMode(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::PutFingerprint(uint32_t FID, const uint8_t* data, size_t size)
+{
+    throw logic_error("RemoteDataStore::PutFingerprint(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::PutMetadata(uint32_t FID, const std::string& meta)
+{
+    throw logic_error("RemoteDataStore::PutMetadata(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::DeleteFingerprint(uint32_t FID)
+{
+    throw logic_error("RemoteDataStore::DeleteFingerprint(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::PutInfo(const DBInfo_t& info)
+{
+    throw logic_error("RemoteDataStore::PutInfo(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnIndexerStart()
+{
+    throw invalid_argument("OnIndexerStart(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnIndexerEnd()
+{
+    throw invalid_argument("OnIndexerEnd(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnIndexerFlushStart()
+{
+    throw invalid_argument("OnIndexerFlushStart(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnIndexerFlushEnd()
+{
+    throw invalid_argument("OnIndexerFlushEnd(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+PListHeader RemoteDataStore::OnIndexerListHeader(int list_id)
+{
+    throw invalid_argument("OnIndexerListHeader(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+PListBlockHeader RemoteDataStore::OnIndexerBlockHeader(int list_id, int block)
+{
+    throw invalid_argument("OnIndexerBlockHeader(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnIndexerChunk(int list_id,
+                                     PListHeader &lhdr,
+                                     PListBlockHeader &hdr,
+                                     uint8_t* data, size_t data_size)
+{
+    throw invalid_argument("OnIndexerChunk(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnIndexerNewBlock(int list_id,
+                                        PListHeader &lhdr,
+                                        PListBlockHeader &hdr,
+                                        uint8_t* data, size_t data_size)
+{
+    throw invalid_argument("OnIndexerNewBlock(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void RemoteDataStore::OnIndexerFingerprint(uint32_t FID, uint8_t *data, size_t size)
+{
+    throw invalid_argument("OnIndexerFingerprint(): Invalid operation (read-only datastore)");
+}
+
@@ -0,0 +1,183 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef REMOTEDATASTORE_H
+#define REMOTEDATASTORE_H
+
+#include <vector>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include <pthread.h>
+
+#include "KVDataStore.h"
+#include "BlockProtocol.h"
+
+/// A read-only datastore reading its data from a block server (see BlockServer).
+/// Requests issued concurrently by the threads sharing an instance are coalesced
+/// into batches, so that only one request is in flight on the connection at any
+/// time. Index blocks are kept in a local LRU cache, and the blocks following the
+/// requested one may be prefetched in the same batch.
+///
+/// The datastore URL is the server address, either "unix:<socket path>" for
+/// a server running on the same host or "tcp:<host>:<port>" for a server on
+/// the network. A local Unix socket server can thus stand in for a LAN one.
+
+class RemoteDataStore : public KVDataStore
+{
+    typedef std::shared_ptr<const std::vector<uint8_t> > Blob;
+
+    /// A pending request
+    struct Call
+    {
+        BSRequest  Request;
+        uint32_t   Status;
+        Blob       Result;
+        bool       Done;
+    };
+
+    /// Data returned to a thread, kept alive until its next request
+    struct Pins
+    {
+        RemoteDataStore  *Owner;
+        Blob              Block;
+        Blob              Fingerprint;
+    };
+
+    typedef std::list< std::pair<uint64_t, Blob> >  lru_list;
+
+    std::string               m_Address;
+    int                       m_Socket;
+    bool                      m_IsOpen;
+
+    std::mutex                m_Mutex;          ///< Guards the requests queue and the pins list
+    std::condition_variable   m_Cond;
+    std::deque<Call*>         m_Queue;
+    bool                      m_InFlight;
+    pthread_key_t             m_PinsKey;        ///< Pins of the calling thread
+    std::vector<Pins*>        m_Pins;           ///< Pins of all the threads
+
+    std::mutex                m_CacheMutex;     ///< Guards the blocks cache
+    lru_list                  m_LRU;
+    boost::unordered::unordered_map<uint64_t, lru_list::iterator>  m_CacheMap;
+    size_t                    m_CacheSize;
+    size_t                    m_CacheLimit;
+    size_t                    m_Prefetch;
+
+    /// Queue the given calls and wait for their completion. The first thread
+    /// finding no batch in flight sends all the queued calls on behalf of the
+    /// others.
+    void Execute(Call* calls, size_t ncalls);
+
+    /// Send a batch and read the responses. Return false on I/O errors.
+    bool Transact(std::vector<Call*> &batch);
+
+    /// Execute a single request and return its result
+    Blob Request(uint32_t op, uint32_t arg1, uint32_t arg2=0, uint32_t arg3=0);
+
+    Blob CacheGet(uint64_t key);
+    void CachePut(uint64_t key, const Blob &blob);
+
+    void Connect();
+    void Disconnect();
+
+    /// Get the pins of the calling thread. They're released when the
+    /// thread exits.
+    Pins* GetPins();
+    static void OnThreadExit(void *pins);
+
+public:
+
+    explicit RemoteDataStore(const std::string &address = std::string());
+    ~RemoteDataStore();
+
+    /// Set the size (in bytes) of the local blocks cache. Zero disables caching.
+    void SetCacheLimit(size_t bytes);
+
+    size_t GetCacheLimit() const { return m_CacheLimit; }
+
+    /// Set the number of blocks to prefetch after a missed block. The blocks
+    /// are requested in the same batch as the missed one.
+    void SetPrefetch(size_t nblocks) { m_Prefetch = nblocks; }
+
+    size_t GetPrefetch() const { return m_Prefetch; }
+
+    /// Connect to the server. Only the GET operation is supported, the other
+    /// flags are ignored as it's up to the server to provide the collections.
+    void Open(eOperation op = GET,
+              bool use_fing_db=true,
+              bool use_meta_db=false,
+              bool use_info_db=false);
+
+    void Close();
+
+    void SetDatabaseURL(const std::string &url) { m_Address = url; }
+
+    std::string GetDatabaseURL()  { return m_Address; }
+
+    /// Ask the server whether the served datastore is empty
+    bool Empty();
+
+    void Clear();
+
+    bool IsOpen() { return m_IsOpen; }
+
+    eOperation GetOpMode() { return GET; }
+
+    void SetOpMode(eOperation mode);
+
+    void PutFingerprint(uint32_t FID, const uint8_t* data, size_t size);
+
+    void PutMetadata(uint32_t FID, const std::string& meta);
+
+    std::string GetMetadata(uint32_t FID);
+
+    /// Deletions are not supported. The fingerprints deleted from the
+    /// served datastore are reported by IsDeleted().
+    void DeleteFingerprint(uint32_t FID);
+
+    bool IsDeleted(uint32_t FID);
+
+    DBInfo_t GetInfo();
+
+    void PutInfo(const DBInfo_t& info);
+
+    // API Interface
+
+    const uint8_t* GetPListBlock(int list_id, int block, size_t& data_size, bool headers=true);
+    size_t GetFingerprintSize(uint32_t FID);
+    const uint8_t* GetFingerprint(uint32_t FID, size_t &read, size_t nbytes = 0, uint32_t bo = 0);
+    size_t GetFingerprintsCount();
+    void OnIndexerStart();
+    void OnIndexerEnd();
+    void OnIndexerFlushStart();
+    void OnIndexerFlushEnd();
+    Audioneex::PListHeader OnIndexerListHeader(int list_id);
+    Audioneex::PListBlockHeader OnIndexerBlockHeader(int list_id, int block);
+
+    void OnIndexerChunk(int list_id,
+                        Audioneex::PListHeader &lhdr,
+                        Audioneex::PListBlockHeader &hdr,
+                        uint8_t* data, size_t data_size);
+
+    void OnIndexerNewBlock (int list_id,
+                            Audioneex::PListHeader &lhdr,
+                            Audioneex::PListBlockHeader &hdr,
+                            uint8_t* data, size_t data_size);
+
+    void OnIndexerFingerprint(uint32_t FID, uint8_t* data, size_t size);
+};
+
+
+#endif
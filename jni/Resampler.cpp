@@ -0,0 +1,271 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <limits>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+
+#include "Resampler.h"
+#include "SampleConvert.h"
+
+using namespace std;
+
+namespace {
+
+/// Input samples buffered at a time
+const size_t CHUNK_SAMPLES = 1024;
+
+/// Stop band attenuation (dB) and width of the transition band, as a fraction
+/// of the lower Nyquist frequency
+const double STOPBAND_ATTENUATION = 80.0;
+const double TRANSITION_WIDTH     = 0.2;
+
+/// Extra attenuation (dB) the filter is designed for. Kaiser's estimates of
+/// the window are approximate, and without it the response at the edge of
+/// the stop band only just reaches STOPBAND_ATTENUATION.
+const double DESIGN_MARGIN = 6.0;
+
+size_t GCD(size_t a, size_t b)
+{
+    while(b){
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/// Zeroth order modified Bessel function of the first kind
+double BesselI0(double x)
+{
+    double sum = 1, term = 1;
+    for(int k=1; k<50 && term > sum * 1e-12; k++){
+        double t = x / (2 * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+const double PI = 3.14159265358979323846;
+
+}
+
+// ----------------------------------------------------------------------------
+
+/// The phases of the filter for a ratio L/M. Each phase holds the taps in
+/// reverse order, so it runs as a dot product with the input in time order.
+struct Resampler::FilterBank
+{
+    size_t              Taps;    ///< Taps per phase
+    std::vector<float>  Phases;  ///< L phases of 'Taps' taps
+};
+
+// ----------------------------------------------------------------------------
+
+shared_ptr<const Resampler::FilterBank> Resampler::GetFilterBank(size_t L, size_t M)
+{
+    static std::mutex mutex;
+    static std::map< std::pair<size_t,size_t>, shared_ptr<const FilterBank> > banks;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    shared_ptr<const FilterBank> &bank = banks[std::make_pair(L, M)];
+    if(bank)
+       return bank;
+
+    std::shared_ptr<FilterBank> fb = std::make_shared<FilterBank>();
+
+    // Same rates: pass through
+    if(L == M){
+       fb->Taps = 1;
+       fb->Phases.assign(1, 1.f);
+       bank = fb;
+       return bank;
+    }
+
+    // Normalized to the rate of the upsampled signal (L times the input rate),
+    // where the lower Nyquist frequency is 0.5 / max(L, M)
+    double nyquist = 0.5 / std::max(L, M);
+    double transition = TRANSITION_WIDTH * nyquist;
+    double cutoff = nyquist - transition / 2;
+
+    // Kaiser's estimates of the length and window shape
+    double A = STOPBAND_ATTENUATION + DESIGN_MARGIN;
+    double beta = 0.1102 * (A - 8.7);
+    size_t length = static_cast<size_t>(std::ceil((A - 7.95) / (14.36 * transition))) + 1;
+
+    // The same number of taps in all the phases, a multiple of the SIMD width
+    size_t taps = (length + L - 1) / L;
+    taps = (taps + 7) & ~static_cast<size_t>(7);
+    length = taps * L;
+
+    fb->Taps = taps;
+    fb->Phases.assign(length, 0.f);
+
+    // An odd length puts the center of the filter on a sample, so that its
+    // delay is a whole number of upsampled samples. The last tap is left
+    // at zero if needed.
+    size_t active = length % 2 ? length : length - 1;
+    double center = (active - 1) / 2.0;
+    double norm = BesselI0(beta);
+
+    for(size_t n=0; n<active; n++){
+        double t = n - center;
+        double r = t / center;
+        double sinc = t == 0 ? 2 * cutoff : std::sin(2 * PI * cutoff * t) / (PI * t);
+        double window = BesselI0(beta * std::sqrt(std::max(0.0, 1 - r * r))) / norm;
+        // The gain of L makes up for the zeros of the upsampling
+        float h = static_cast<float>(L * sinc * window);
+        size_t phase = n % L, k = n / L;
+        fb->Phases[phase * taps + (taps - 1 - k)] = h;
+    }
+
+    bank = fb;
+    return bank;
+}
+
+// ----------------------------------------------------------------------------
+
+Resampler::Resampler(int inRate, int outRate) :
+    m_InRate  (inRate),
+    m_OutRate (outRate),
+    m_L       (0),
+    m_M       (0),
+    m_Taps    (0),
+    m_Fill    (0),
+    m_Pos     (0),
+    m_Phase   (0),
+    m_Inputs  (0),
+    m_Outputs (0)
+{
+    if(inRate <= 0 || outRate <= 0)
+       throw invalid_argument("Resampler: Invalid sample rate");
+
+    size_t g = GCD(inRate, outRate);
+    m_L = outRate / g;
+    m_M = inRate / g;
+    m_Bank = GetFilterBank(m_L, m_M);
+    m_Taps = m_Bank->Taps;
+    m_History.resize(m_Taps - 1 + CHUNK_SAMPLES);
+
+    Reset();
+}
+
+// ----------------------------------------------------------------------------
+
+void Resampler::Reset()
+{
+    // The history starts with zeros. The first output is delayed by the filter
+    // delay (in upsampled samples), so that it falls on the first input.
+    size_t delay = (m_Taps * m_L - 1) / 2;
+
+    std::fill(m_History.begin(), m_History.begin() + m_Taps - 1, 0.f);
+    m_Fill = m_Taps - 1;
+    m_Pos = m_Taps - 1 + delay / m_L;
+    m_Phase = delay % m_L;
+    m_Inputs = 0;
+    m_Outputs = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t Resampler::GetMaxOutput(size_t nin) const
+{
+    return static_cast<size_t>((static_cast<uint64_t>(nin) * m_L + m_M - 1) / m_M) + 1;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t Resampler::Run(float *out, uint64_t limit)
+{
+    const float *phases = m_Bank->Phases.data();
+    const size_t taps = m_Taps;
+    size_t n = 0;
+
+    while(m_Pos < m_Fill && m_Outputs < limit){
+        out[n++] = DotProduct(phases + m_Phase * taps, &m_History[m_Pos + 1 - taps], taps);
+        m_Outputs++;
+        m_Phase += m_M;
+        m_Pos += m_Phase / m_L;
+        m_Phase %= m_L;
+    }
+    return n;
+}
+
+// ----------------------------------------------------------------------------
+
+void Resampler::Compact()
+{
+    size_t start = std::min(m_Pos + 1 - m_Taps, m_Fill);
+    std::copy(m_History.begin() + start, m_History.begin() + m_Fill, m_History.begin());
+    m_Fill -= start;
+    m_Pos -= start;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t Resampler::Process(const float *in, size_t nin, float *out)
+{
+    const uint64_t nolimit = std::numeric_limits<uint64_t>::max();
+    size_t nout = 0;
+
+    while(nin > 0){
+        size_t n = std::min(nin, m_History.size() - m_Fill);
+        std::copy(in, in + n, m_History.begin() + m_Fill);
+        m_Fill += n;
+        m_Inputs += n;
+        in += n;
+        nin -= n;
+
+        nout += Run(out + nout, nolimit);
+        Compact();
+    }
+    return nout;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t Resampler::Process(const AudioBlockView<Sfloat> &in, AudioBlock<Sfloat> &out)
+{
+    assert(in.Channels() == 1 && out.Channels() == 1);
+    assert(in.Empty() || in.SampleRate() == m_InRate);
+    assert(out.SampleRate() == m_OutRate);
+    assert(out.Capacity() >= GetMaxOutput(in.Size()));
+
+    out.Resize(out.Capacity());
+    out.Resize(Process(in.Data(), in.Size(), out.Data()));
+    out.SetTimestamp(in.Timestamp());
+    return out.Size();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t Resampler::Flush(float *out)
+{
+    // Feed zeros until the output covers the whole input
+    uint64_t total = (m_Inputs * m_L + m_M - 1) / m_M;
+    size_t nout = 0;
+
+    while(m_Outputs < total){
+        size_t n = std::min(m_Taps, m_History.size() - m_Fill);
+        std::fill(m_History.begin() + m_Fill, m_History.begin() + m_Fill + n, 0.f);
+        m_Fill += n;
+        nout += Run(out + nout, total);
+        Compact();
+    }
+    return nout;
+}
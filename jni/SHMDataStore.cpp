@@ -0,0 +1,692 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// This is an implementation of the DataStore interface serving the data from
+/// a shared memory segment. One loader process (see SHMDataStore::Publish())
+/// copies an existing Tokyo Cabinet datastore into the segment, then any number
+/// of recognizer processes attach to it read-only. Memory usage per host is thus
+/// independent of the number of recognizer processes.
+
+#include <string>
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SHMDataStore.h"
+#include "TCDataStore.h"
+
+using namespace std;
+using namespace Audioneex;
+
+
+namespace {
+
+const char     SHM_MAGIC[8] = {'A','N','X','S','H','M','0','1'};
+const uint32_t SHM_VERSION  = 2;
+
+/// Records in the segment are aligned to this boundary
+const uint64_t SHM_ALIGN = 8;
+
+inline uint64_t Align(uint64_t off) { return (off + SHM_ALIGN - 1) & ~(SHM_ALIGN - 1); }
+
+inline int OpenSegment(const string &name, int flags, mode_t mode = 0)
+{
+#ifdef __ANDROID__
+    return open(name.c_str(), flags, mode);
+#else
+    return shm_open(name.c_str(), flags, mode);
+#endif
+}
+
+inline int UnlinkSegment(const string &name)
+{
+#ifdef __ANDROID__
+    return unlink(name.c_str());
+#else
+    return shm_unlink(name.c_str());
+#endif
+}
+
+inline bool BlockEntryLess(const SHMBlockEntry &e1, const SHMBlockEntry &e2)
+{
+    return e1.ListID < e2.ListID ||
+          (e1.ListID == e2.ListID && e1.BlockID < e2.BlockID);
+}
+
+inline bool RecordEntryLess(const SHMRecordEntry &e1, const SHMRecordEntry &e2)
+{
+    return e1.FID < e2.FID;
+}
+
+/// Check whether the range [off, off+size) lies within a segment of the
+/// given size
+inline bool RangeFits(uint64_t off, uint64_t size, uint64_t total)
+{
+    return off <= total && size <= total - off;
+}
+
+/// Check whether a table of 'count' entries of the given size at offset
+/// 'off' lies within a segment of the given size
+inline bool TableFits(uint64_t off, uint64_t count, uint64_t esize, uint64_t total)
+{
+    return off % SHM_ALIGN == 0 &&
+           count <= total / esize &&
+           RangeFits(off, count * esize, total);
+}
+
+/// Check that all the tables of the segment and the records they point to
+/// lie within the segment, so that a stale, truncated or foreign segment
+/// can't make the readers access memory out of the mapping.
+bool CheckSegment(const uint8_t *base, uint64_t size)
+{
+    const SHMSegmentHeader *hdr = reinterpret_cast<const SHMSegmentHeader*>(base);
+
+    if(!TableFits(hdr->BlocksTable, hdr->BlocksCount, sizeof(SHMBlockEntry), size) ||
+       !TableFits(hdr->FingerprintsTable, hdr->FingerprintsCount, sizeof(SHMRecordEntry), size) ||
+       !TableFits(hdr->MetadataTable, hdr->MetadataCount, sizeof(SHMRecordEntry), size) ||
+       !TableFits(hdr->TombstonesTable, hdr->TombstonesCount, sizeof(uint32_t), size))
+       return false;
+
+    const SHMBlockEntry *blocks = reinterpret_cast<const SHMBlockEntry*>(base + hdr->BlocksTable);
+    for(uint64_t i=0; i<hdr->BlocksCount; i++)
+        if(!RangeFits(blocks[i].Offset, blocks[i].Size, size))
+           return false;
+
+    const SHMRecordEntry *fings = reinterpret_cast<const SHMRecordEntry*>(base + hdr->FingerprintsTable);
+    for(uint64_t i=0; i<hdr->FingerprintsCount; i++)
+        if(!RangeFits(fings[i].Offset, fings[i].Size, size))
+           return false;
+
+    const SHMRecordEntry *meta = reinterpret_cast<const SHMRecordEntry*>(base + hdr->MetadataTable);
+    for(uint64_t i=0; i<hdr->MetadataCount; i++)
+        if(!RangeFits(meta[i].Offset, meta[i].Size, size))
+           return false;
+
+    return true;
+}
+
+/// Open the given collection for reading if it exists in the datastore
+bool OpenIfExists(TCCollection &coll)
+{
+    try{
+       coll.Open(OPEN_READ);
+    }
+    catch(const std::runtime_error&){
+       return false;
+    }
+    return true;
+}
+
+}// unnamed namespace
+
+
+// ----------------------------------------------------------------------------
+
+SHMDataStore::SHMDataStore(const string &name) :
+    m_Name          (name),
+    m_Base          (nullptr),
+    m_Size          (0),
+    m_Header        (nullptr),
+    m_Blocks        (nullptr),
+    m_Fingerprints  (nullptr),
+    m_Metadata      (nullptr),
+    m_Tombstones    (nullptr),
+    m_IsOpen        (false)
+{
+}
+
+// ----------------------------------------------------------------------------
+
+SHMDataStore::~SHMDataStore()
+{
+    if(m_IsOpen) Close();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t SHMDataStore::Publish(const string &dburl, const string &name)
+{
+    string url = dburl;
+
+    url += url.empty() ? "" :
+          (url.back()=='/' || url.back()=='\\' ? "" : "/");
+
+    TCCollection index(nullptr), fings(nullptr), meta(nullptr), info(nullptr);
+    TCTombstones deleted(nullptr);
+
+    index.SetName("data.idx");
+    fings.SetName("data.qfp");
+    meta.SetName("data.met");
+    info.SetName("data.inf");
+    deleted.SetName("data.del");
+
+    index.SetURL(url);
+    fings.SetURL(url);
+    meta.SetURL(url);
+    info.SetURL(url);
+    deleted.SetURL(url);
+
+    // The index is mandatory, all the other collections are optional.
+    index.Open(OPEN_READ);
+    bool has_fings = OpenIfExists(fings);
+    bool has_meta = OpenIfExists(meta);
+    bool has_info = OpenIfExists(info);
+
+    // The readers suppress the matches of the deleted fingerprints, whose
+    // data may still be in the index
+    deleted.Load(OPEN_READ);
+    vector<uint32_t> tombstones = deleted.GetFIDs();
+
+    vector<uint8_t> key;
+    vector<SHMBlockEntry>  blocks;
+    vector<SHMRecordEntry> fptable, mdtable;
+
+    blocks.reserve(index.GetRecordsCount());
+
+    // First pass: collect the keys and the records sizes
+
+    index.IterInit();
+    while(index.IterNext(key)){
+        if(key.size() != sizeof(int)*2)
+           continue;
+        SHMBlockEntry e = {};
+        e.ListID  = *reinterpret_cast<int*>(key.data());
+        e.BlockID = *reinterpret_cast<int*>(key.data() + sizeof(int));
+        e.Size    = index.GetRecordSize(key);
+        blocks.push_back(e);
+    }
+
+    if(has_fings){
+       fptable.reserve(fings.GetRecordsCount());
+       fings.IterInit();
+       while(fings.IterNext(key)){
+           if(key.size() != sizeof(uint32_t))
+              continue;
+           SHMRecordEntry e = {};
+           e.FID  = *reinterpret_cast<uint32_t*>(key.data());
+           e.Size = fings.GetRecordSize(key);
+           fptable.push_back(e);
+       }
+    }
+
+    if(has_meta){
+       mdtable.reserve(meta.GetRecordsCount());
+       meta.IterInit();
+       while(meta.IterNext(key)){
+           // Metadata keys are the FIDs in text form
+           string skey(key.begin(), key.end());
+           SHMRecordEntry e = {};
+           e.FID  = strtoul(skey.c_str(), nullptr, 10);
+           e.Size = meta.GetRecordSize(key);
+           mdtable.push_back(e);
+       }
+    }
+
+    std::sort(blocks.begin(), blocks.end(), BlockEntryLess);
+    std::sort(fptable.begin(), fptable.end(), RecordEntryLess);
+    std::sort(mdtable.begin(), mdtable.end(), RecordEntryLess);
+
+    // Compute the segment layout
+
+    SHMSegmentHeader hdr = {};
+    std::copy(SHM_MAGIC, SHM_MAGIC + sizeof(SHM_MAGIC), hdr.Magic);
+    hdr.Version = SHM_VERSION;
+    hdr.MatchType = -1;
+
+    uint64_t off = Align(sizeof(SHMSegmentHeader));
+
+    hdr.BlocksCount = blocks.size();
+    hdr.BlocksTable = off;
+    off = Align(off + blocks.size() * sizeof(SHMBlockEntry));
+
+    hdr.FingerprintsCount = fptable.size();
+    hdr.FingerprintsTable = off;
+    off = Align(off + fptable.size() * sizeof(SHMRecordEntry));
+
+    hdr.MetadataCount = mdtable.size();
+    hdr.MetadataTable = off;
+    off = Align(off + mdtable.size() * sizeof(SHMRecordEntry));
+
+    hdr.TombstonesCount = tombstones.size();
+    hdr.TombstonesTable = off;
+    off = Align(off + tombstones.size() * sizeof(uint32_t));
+
+    for(size_t i=0; i<blocks.size(); i++){
+        blocks[i].Offset = off;
+        off = Align(off + blocks[i].Size);
+    }
+    for(size_t i=0; i<fptable.size(); i++){
+        fptable[i].Offset = off;
+        off = Align(off + fptable[i].Size);
+    }
+    for(size_t i=0; i<mdtable.size(); i++){
+        mdtable[i].Offset = off;
+        off = Align(off + mdtable[i].Size);
+    }
+
+    hdr.Size = off;
+
+    if(has_info){
+       DBInfo_t dbinfo = {-1};
+       vector<uint8_t> ikey(sizeof(int), 0);
+       if(info.ReadRecord(ikey, reinterpret_cast<uint8_t*>(&dbinfo), sizeof(DBInfo_t)))
+          hdr.MatchType = dbinfo.MatchType;
+    }
+
+    // Create the segment. Processes attached to a previous segment with the
+    // same name keep their mapping until they close the datastore.
+
+    UnlinkSegment(name);
+
+    int fd = OpenSegment(name, O_RDWR|O_CREAT|O_EXCL, 0644);
+    if(fd < 0)
+       throw runtime_error("Couldn't create shared memory segment "+name);
+
+    if(ftruncate(fd, hdr.Size) != 0){
+       close(fd);
+       UnlinkSegment(name);
+       throw runtime_error("Couldn't allocate shared memory segment "+name);
+    }
+
+    void *addr = mmap(nullptr, hdr.Size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(addr == MAP_FAILED){
+       UnlinkSegment(name);
+       throw runtime_error("Couldn't map shared memory segment "+name);
+    }
+
+    uint8_t *base = static_cast<uint8_t*>(addr);
+
+    // Second pass: copy the records into the segment in key order
+
+    try{
+       for(size_t i=0; i<blocks.size(); i++){
+           key.resize(sizeof(int)*2);
+           *reinterpret_cast<int*>(key.data()) = blocks[i].ListID;
+           *reinterpret_cast<int*>(key.data() + sizeof(int)) = blocks[i].BlockID;
+           if(index.ReadRecord(key, base + blocks[i].Offset, blocks[i].Size) != blocks[i].Size)
+              throw runtime_error("Index modified while publishing");
+       }
+
+       for(size_t i=0; i<fptable.size(); i++){
+           key.resize(sizeof(uint32_t));
+           *reinterpret_cast<uint32_t*>(key.data()) = fptable[i].FID;
+           if(fings.ReadRecord(key, base + fptable[i].Offset, fptable[i].Size) != fptable[i].Size)
+              throw runtime_error("Fingerprints modified while publishing");
+       }
+
+       for(size_t i=0; i<mdtable.size(); i++){
+           std::stringstream ss;
+           ss << mdtable[i].FID;
+           string skey = ss.str();
+           key.assign(skey.begin(), skey.end());
+           if(meta.ReadRecord(key, base + mdtable[i].Offset, mdtable[i].Size) != mdtable[i].Size)
+              throw runtime_error("Metadata modified while publishing");
+       }
+    }
+    catch(...){
+       munmap(addr, hdr.Size);
+       UnlinkSegment(name);
+       throw;
+    }
+
+    std::copy(blocks.begin(), blocks.end(),
+              reinterpret_cast<SHMBlockEntry*>(base + hdr.BlocksTable));
+    std::copy(fptable.begin(), fptable.end(),
+              reinterpret_cast<SHMRecordEntry*>(base + hdr.FingerprintsTable));
+    std::copy(mdtable.begin(), mdtable.end(),
+              reinterpret_cast<SHMRecordEntry*>(base + hdr.MetadataTable));
+    std::copy(tombstones.begin(), tombstones.end(),
+              reinterpret_cast<uint32_t*>(base + hdr.TombstonesTable));
+
+    // Write the header last and mark the segment as ready
+    SHMSegmentHeader *phdr = reinterpret_cast<SHMSegmentHeader*>(base);
+    *phdr = hdr;
+    __atomic_store_n(&phdr->Ready, 1, __ATOMIC_RELEASE);
+
+    munmap(addr, hdr.Size);
+
+    return hdr.Size;
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::Unpublish(const string &name)
+{
+    if(UnlinkSegment(name) != 0)
+       throw runtime_error("Couldn't remove shared memory segment "+name);
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::Open(eOperation op, bool use_fing_db, bool use_meta_db, bool use_info_db)
+{
+    if(op != GET)
+       throw invalid_argument("SHMDataStore::Open(): Invalid operation (read-only datastore)");
+
+    if(m_IsOpen)
+       Close();
+
+    int fd = OpenSegment(m_Name, O_RDONLY);
+    if(fd < 0)
+       throw runtime_error("Couldn't open shared memory segment "+m_Name);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SHMSegmentHeader)){
+       close(fd);
+       throw runtime_error("Invalid shared memory segment "+m_Name);
+    }
+
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(addr == MAP_FAILED)
+       throw runtime_error("Couldn't map shared memory segment "+m_Name);
+
+    const SHMSegmentHeader *hdr = static_cast<const SHMSegmentHeader*>(addr);
+
+    bool isvalid = std::equal(SHM_MAGIC, SHM_MAGIC + sizeof(SHM_MAGIC), hdr->Magic) &&
+                   hdr->Version == SHM_VERSION &&
+                   hdr->Size == static_cast<uint64_t>(st.st_size);
+
+    if(!isvalid || __atomic_load_n(&hdr->Ready, __ATOMIC_ACQUIRE) == 0){
+       munmap(addr, st.st_size);
+       throw runtime_error(isvalid ? "Shared memory segment "+m_Name+" not ready"
+                                   : "Invalid shared memory segment "+m_Name);
+    }
+
+    if(!CheckSegment(static_cast<const uint8_t*>(addr), st.st_size)){
+       munmap(addr, st.st_size);
+       throw runtime_error("Invalid shared memory segment "+m_Name+" (tables out of bounds)");
+    }
+
+    m_Base = static_cast<const uint8_t*>(addr);
+    m_Size = st.st_size;
+    m_Header = hdr;
+    m_Blocks = reinterpret_cast<const SHMBlockEntry*>(m_Base + hdr->BlocksTable);
+    m_Fingerprints = reinterpret_cast<const SHMRecordEntry*>(m_Base + hdr->FingerprintsTable);
+    m_Metadata = reinterpret_cast<const SHMRecordEntry*>(m_Base + hdr->MetadataTable);
+    m_Tombstones = reinterpret_cast<const uint32_t*>(m_Base + hdr->TombstonesTable);
+    m_IsOpen = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::Close()
+{
+    if(m_Base)
+       munmap(const_cast<uint8_t*>(m_Base), m_Size);
+
+    m_Base = nullptr;
+    m_Size = 0;
+    m_Header = nullptr;
+    m_Blocks = nullptr;
+    m_Fingerprints = nullptr;
+    m_Metadata = nullptr;
+    m_Tombstones = nullptr;
+    m_IsOpen = false;
+}
+
+// ----------------------------------------------------------------------------
+
+bool SHMDataStore::Empty()
+{
+    return m_Header == nullptr ||
+          (m_Header->BlocksCount == 0 &&
+           m_Header->FingerprintsCount == 0 &&
+           m_Header->MetadataCount == 0);
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::Clear()
+{
+    throw logic_error("SHMDataStore::Clear(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::SetOpMode(KVDataStore::eOperation mode)
+{
+    if(mode != GET)
+       throw invalid_argument("SHMDataStore::SetOpMode(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::PutFingerprint(uint32_t FID, const uint8_t* data, size_t size)
+{
+    throw logic_error("SHMDataStore::PutFingerprint(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::PutMetadata(uint32_t FID, const std::string& meta)
+{
+    throw logic_error("SHMDataStore::PutMetadata(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::DeleteFingerprint(uint32_t FID)
+{
+    throw logic_error("SHMDataStore::DeleteFingerprint(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+bool SHMDataStore::IsDeleted(uint32_t FID)
+{
+    if(m_Header==nullptr)
+       return false;
+
+    return std::binary_search(m_Tombstones, m_Tombstones + m_Header->TombstonesCount, FID);
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::PutInfo(const DBInfo_t& info)
+{
+    throw logic_error("SHMDataStore::PutInfo(): Read-only datastore");
+}
+
+// ----------------------------------------------------------------------------
+
+DBInfo_t SHMDataStore::GetInfo()
+{
+    if(m_Header==nullptr)
+       throw runtime_error("Shared memory segment not open");
+
+    DBInfo_t dbinfo = {m_Header->MatchType};
+    return dbinfo;
+}
+
+// ----------------------------------------------------------------------------
+
+const SHMRecordEntry* SHMDataStore::FindRecord(const SHMRecordEntry* table,
+                                               uint64_t count,
+                                               uint32_t FID) const
+{
+    SHMRecordEntry e = {};
+    e.FID = FID;
+    const SHMRecordEntry *end = table + count;
+    const SHMRecordEntry *it = std::lower_bound(table, end, e, RecordEntryLess);
+    return it != end && it->FID == FID ? it : nullptr;
+}
+
+// ----------------------------------------------------------------------------
+
+string SHMDataStore::GetMetadata(uint32_t FID)
+{
+    if(m_Header==nullptr)
+       return string();
+
+    const SHMRecordEntry *e = FindRecord(m_Metadata, m_Header->MetadataCount, FID);
+
+    if(e == nullptr)
+       return string();
+
+    const char *pstr = reinterpret_cast<const char*>(m_Base + e->Offset);
+    return string(pstr, e->Size);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t SHMDataStore::GetFingerprintsCount()
+{
+    return m_Header ? m_Header->FingerprintsCount : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* SHMDataStore::GetPListBlock(int list_id, int block, size_t &data_size, bool headers)
+{
+    data_size = 0;
+
+    if(m_Header==nullptr)
+       return nullptr;
+
+    SHMBlockEntry key = {};
+    key.ListID = list_id;
+    key.BlockID = block;
+
+    const SHMBlockEntry *end = m_Blocks + m_Header->BlocksCount;
+    const SHMBlockEntry *e = std::lower_bound(m_Blocks, end, key, BlockEntryLess);
+
+    if(e == end || e->ListID != list_id || e->BlockID != block)
+       return nullptr;
+
+    size_t off = 0;
+
+    if(!headers)
+       off = block==1 ? sizeof(PListHeader) +
+                        sizeof(PListBlockHeader)
+                      :
+                        sizeof(PListBlockHeader);
+
+    // Blocks too short for their headers are treated as missing
+    if(e->Size < off)
+       return nullptr;
+
+    // No copies here, the engine reads the block straight from the segment.
+    data_size = e->Size - off;
+    return m_Base + e->Offset + off;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t SHMDataStore::GetFingerprintSize(uint32_t FID)
+{
+    if(m_Header==nullptr)
+       return 0;
+
+    const SHMRecordEntry *e = FindRecord(m_Fingerprints, m_Header->FingerprintsCount, FID);
+    return e ? e->Size : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* SHMDataStore::GetFingerprint(uint32_t FID, size_t &read, size_t nbytes, uint32_t bo)
+{
+    read = 0;
+
+    if(m_Header==nullptr)
+       return nullptr;
+
+    const SHMRecordEntry *e = FindRecord(m_Fingerprints, m_Header->FingerprintsCount, FID);
+
+    if(e == nullptr || bo >= e->Size)
+       return nullptr;
+
+    size_t gsize = nbytes ? nbytes : e->Size - bo;
+    read = std::min<size_t>(gsize, e->Size - bo);
+
+    return m_Base + e->Offset + bo;
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::OnIndexerStart()
+{
+    throw invalid_argument("OnIndexerStart(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::OnIndexerEnd()
+{
+    throw invalid_argument("OnIndexerEnd(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::OnIndexerFlushStart()
+{
+    throw invalid_argument("OnIndexerFlushStart(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::OnIndexerFlushEnd()
+{
+    throw invalid_argument("OnIndexerFlushEnd(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+PListHeader SHMDataStore::OnIndexerListHeader(int list_id)
+{
+    throw invalid_argument("OnIndexerListHeader(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+PListBlockHeader SHMDataStore::OnIndexerBlockHeader(int list_id, int block)
+{
+    throw invalid_argument("OnIndexerBlockHeader(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::OnIndexerChunk(int list_id,
+                                  PListHeader &lhdr,
+                                  PListBlockHeader &hdr,
+                                  uint8_t* data, size_t data_size)
+{
+    throw invalid_argument("OnIndexerChunk(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::OnIndexerNewBlock(int list_id,
+                                     PListHeader &lhdr,
+                                     PListBlockHeader &hdr,
+                                     uint8_t* data, size_t data_size)
+{
+    throw invalid_argument("OnIndexerNewBlock(): Invalid operation (read-only datastore)");
+}
+
+// ----------------------------------------------------------------------------
+
+void SHMDataStore::OnIndexerFingerprint(uint32_t FID, uint8_t *data, size_t size)
+{
+    throw invalid_argument("OnIndexerFingerprint(): Invalid operation (read-only datastore)");
+}
+
@@ -0,0 +1,170 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef SHMDATASTORE_H
+#define SHMDATASTORE_H
+
+#include "KVDataStore.h"
+
+/// Layout of a shared memory segment hosting a datastore. The segment starts
+/// with this header, followed by three lookup tables sorted by key (index
+/// blocks, fingerprints and metadata), the sorted FIDs of the deleted
+/// fingerprints and then by the records data.
+
+struct SHMSegmentHeader
+{
+    char     Magic[8];           ///< Segment signature
+    uint32_t Version;            ///< Layout version
+    uint32_t Ready;              ///< Set by the loader once the segment is complete
+    uint64_t Size;               ///< Total size of the segment in bytes
+    int32_t  MatchType;          ///< Match type the index was built with (-1 if unknown)
+    uint32_t Reserved;
+    uint64_t BlocksCount;        ///< Number of index blocks
+    uint64_t BlocksTable;        ///< Offset of the blocks table
+    uint64_t FingerprintsCount;  ///< Number of fingerprints
+    uint64_t FingerprintsTable;  ///< Offset of the fingerprints table
+    uint64_t MetadataCount;      ///< Number of metadata records
+    uint64_t MetadataTable;      ///< Offset of the metadata table
+    uint64_t TombstonesCount;    ///< Number of deleted fingerprints
+    uint64_t TombstonesTable;    ///< Offset of the deleted FIDs (uint32_t)
+};
+
+/// Entry of the blocks table, sorted by <ListID|BlockID>
+struct SHMBlockEntry
+{
+    int32_t  ListID;
+    int32_t  BlockID;
+    uint64_t Offset;
+    uint64_t Size;
+};
+
+/// Entry of the fingerprints and metadata tables, sorted by FID
+struct SHMRecordEntry
+{
+    uint32_t FID;
+    uint32_t Reserved;
+    uint64_t Offset;
+    uint64_t Size;
+};
+
+// ----------------------------------------------------------------------------
+
+/// A read-only datastore attached to a shared memory segment created by
+/// SHMDataStore::Publish(). All the data returned to the engine points
+/// directly into the segment, so any number of recognizer processes on the
+/// same host share one copy of the index, fingerprints and metadata, and no
+/// per-connection read buffers are needed.
+///
+/// The segment name follows the POSIX shm_open() conventions ("/name").
+/// On Android, where POSIX shared memory is not available, the name is
+/// interpreted as the path of a file (e.g. on a tmpfs mount) to be mapped.
+
+class SHMDataStore : public KVDataStore
+{
+    std::string        m_Name;       ///< Name of the shared memory segment
+    const uint8_t*     m_Base;       ///< Base address of the mapped segment
+    size_t             m_Size;       ///< Size of the mapped segment
+
+    const SHMSegmentHeader*  m_Header;
+    const SHMBlockEntry*     m_Blocks;
+    const SHMRecordEntry*    m_Fingerprints;
+    const SHMRecordEntry*    m_Metadata;
+    const uint32_t*          m_Tombstones;
+
+    bool               m_IsOpen;
+
+    const SHMRecordEntry* FindRecord(const SHMRecordEntry* table,
+                                     uint64_t count,
+                                     uint32_t FID) const;
+
+public:
+
+    explicit SHMDataStore(const std::string &name = std::string());
+    ~SHMDataStore();
+
+    /// Load the datastore located at 'dburl' into the shared memory segment
+    /// 'name', along with its deleted fingerprints, so that their matches keep
+    /// being suppressed. Any existing segment with the same name is replaced.
+    /// Processes still attached to a replaced segment keep using the old data
+    /// until they reopen the datastore. Return the size of the segment in bytes.
+    static size_t Publish(const std::string &dburl, const std::string &name);
+
+    /// Remove the specified shared memory segment.
+    static void Unpublish(const std::string &name);
+
+    /// Attach to the segment. Only the GET operation is supported, the other
+    /// flags are ignored as all the collections are always available.
+    void Open(eOperation op = GET,
+              bool use_fing_db=true,
+              bool use_meta_db=false,
+              bool use_info_db=false);
+
+    void Close();
+
+    void SetDatabaseURL(const std::string &url) { m_Name = url; }
+
+    std::string GetDatabaseURL()  { return m_Name; }
+
+    bool Empty();
+
+    void Clear();
+
+    bool IsOpen() { return m_IsOpen; }
+
+    eOperation GetOpMode() { return GET; }
+
+    void SetOpMode(eOperation mode);
+
+    void PutFingerprint(uint32_t FID, const uint8_t* data, size_t size);
+
+    void PutMetadata(uint32_t FID, const std::string& meta);
+
+    std::string GetMetadata(uint32_t FID);
+
+    /// Deletions are not supported. The fingerprints deleted from the
+    /// published datastore are reported by IsDeleted().
+    void DeleteFingerprint(uint32_t FID);
+
+    bool IsDeleted(uint32_t FID);
+
+    DBInfo_t GetInfo();
+
+    void PutInfo(const DBInfo_t& info);
+
+    // API Interface
+
+    const uint8_t* GetPListBlock(int list_id, int block, size_t& data_size, bool headers=true);
+    size_t GetFingerprintSize(uint32_t FID);
+    const uint8_t* GetFingerprint(uint32_t FID, size_t &read, size_t nbytes = 0, uint32_t bo = 0);
+    size_t GetFingerprintsCount();
+    void OnIndexerStart();
+    void OnIndexerEnd();
+    void OnIndexerFlushStart();
+    void OnIndexerFlushEnd();
+    Audioneex::PListHeader OnIndexerListHeader(int list_id);
+    Audioneex::PListBlockHeader OnIndexerBlockHeader(int list_id, int block);
+
+    void OnIndexerChunk(int list_id,
+                        Audioneex::PListHeader &lhdr,
+                        Audioneex::PListBlockHeader &hdr,
+                        uint8_t* data, size_t data_size);
+
+    void OnIndexerNewBlock (int list_id,
+                            Audioneex::PListHeader &lhdr,
+                            Audioneex::PListBlockHeader &hdr,
+                            uint8_t* data, size_t data_size);
+
+    void OnIndexerFingerprint(uint32_t FID, uint8_t* data, size_t size);
+};
+
+
+#endif
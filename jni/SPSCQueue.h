@@ -0,0 +1,96 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+/// A bounded, lock-free, single-producer single-consumer queue. Push() must
+/// only be called by one thread and Pop() by one other thread. The capacity
+/// is rounded up to a power of two.
+
+template<class T>
+class SPSCQueue
+{
+    std::vector<T>        m_Slots;
+    size_t                m_Mask;
+
+    // Keep the producer and consumer indices on separate cache lines
+    char                  m_Pad0[64];
+    std::atomic<size_t>   m_Head;        ///< Next slot to be read (consumer)
+    char                  m_Pad1[64];
+    std::atomic<size_t>   m_Tail;        ///< Next slot to be written (producer)
+    char                  m_Pad2[64];
+
+    SPSCQueue(const SPSCQueue&);
+    SPSCQueue& operator=(const SPSCQueue&);
+
+public:
+
+    explicit SPSCQueue(size_t capacity) :
+        m_Head (0),
+        m_Tail (0)
+    {
+        size_t size = 1;
+        while(size < capacity)
+            size <<= 1;
+        m_Slots.resize(size);
+        m_Mask = size - 1;
+    }
+
+    /// Move the item into the queue. Return false (leaving the item
+    /// untouched) if the queue is full.
+    bool Push(T &item)
+    {
+        size_t tail = m_Tail.load(std::memory_order_relaxed);
+
+        if(tail - m_Head.load(std::memory_order_acquire) == m_Slots.size())
+           return false;
+
+        m_Slots[tail & m_Mask] = std::move(item);
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Move the oldest item out of the queue. Return false if it's empty.
+    bool Pop(T &item)
+    {
+        size_t head = m_Head.load(std::memory_order_relaxed);
+
+        if(head == m_Tail.load(std::memory_order_acquire))
+           return false;
+
+        item = std::move(m_Slots[head & m_Mask]);
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Empty() const
+    {
+        return m_Head.load(std::memory_order_acquire) ==
+               m_Tail.load(std::memory_order_acquire);
+    }
+
+    size_t Size() const
+    {
+        return m_Tail.load(std::memory_order_acquire) -
+               m_Head.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const { return m_Slots.size(); }
+};
+
+
+#endif
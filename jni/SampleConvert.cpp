@@ -0,0 +1,822 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "SampleConvert.h"
+#include "SampleKernels.h"
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#define SAMPLE_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// ----------------------------------------------------------------------------
+//                                   Scalar
+// ----------------------------------------------------------------------------
+
+void ScalarS8ToFloat(const int8_t *in, float *out, size_t n)
+{
+    for(size_t i=0; i<n; i++)
+        out[i] = in[i] * S8_NORM;
+}
+
+void ScalarU8ToFloat(const uint8_t *in, float *out, size_t n)
+{
+    for(size_t i=0; i<n; i++)
+        out[i] = (static_cast<int>(in[i]) - 128) * S8_NORM;
+}
+
+void ScalarS16ToFloat(const int16_t *in, float *out, size_t n)
+{
+    for(size_t i=0; i<n; i++)
+        out[i] = in[i] * S16_NORM;
+}
+
+void ScalarS32ToFloat(const int32_t *in, float *out, size_t n)
+{
+    for(size_t i=0; i<n; i++)
+        out[i] = in[i] * S32_NORM;
+}
+
+void ScalarFloatToS8(const float *in, int8_t *out, size_t n)
+{
+    for(size_t i=0; i<n; i++){
+        float x = std::min(std::max(in[i] * S8_SCALE, -128.f), 127.f);
+        out[i] = static_cast<int8_t>(lrintf(x));
+    }
+}
+
+void ScalarFloatToS16(const float *in, int16_t *out, size_t n)
+{
+    for(size_t i=0; i<n; i++){
+        float x = std::min(std::max(in[i] * S16_SCALE, -32768.f), 32767.f);
+        out[i] = static_cast<int16_t>(lrintf(x));
+    }
+}
+
+void ScalarFloatToS32(const float *in, int32_t *out, size_t n)
+{
+    for(size_t i=0; i<n; i++){
+        float x = std::min(std::max(in[i] * S32_SCALE, -S32_SCALE), S32_MAX_FLOAT);
+        out[i] = static_cast<int32_t>(lrintf(x));
+    }
+}
+
+float ScalarDot(const float *a, const float *b, size_t n)
+{
+    // Independent accumulators, so the additions can overlap
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for(; i+4<=n; i+=4){
+        s0 += a[i]   * b[i];
+        s1 += a[i+1] * b[i+1];
+        s2 += a[i+2] * b[i+2];
+        s3 += a[i+3] * b[i+3];
+    }
+    for(; i<n; i++)
+        s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+template <class T>
+void ScalarDownmix(const T *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    const float norm = SampleNorm<T>();
+    for(size_t i=0; i<nframes; i++, in+=nchans){
+        float sum = 0;
+        for(size_t c=0; c<nchans; c++)
+            sum += in[c] * weights[c];
+        out[i] = sum * norm;
+    }
+}
+
+template <class T>
+void ScalarExtract(const T *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    const float norm = SampleNorm<T>();
+    for(size_t i=0; i<nframes; i++)
+        out[i] = in[i*nchans + chan] * norm;
+}
+
+/// Deinterleave frames 'first' to 'last' (excluded)
+template <class T>
+void ScalarDeinterleaveFrames(const T *in, float *const *out, size_t first, size_t last, size_t nchans)
+{
+    const float norm = SampleNorm<T>();
+    for(size_t i=first; i<last; i++)
+        for(size_t c=0; c<nchans; c++)
+            out[c][i] = in[i*nchans + c] * norm;
+}
+
+template <class T>
+void ScalarDeinterleave(const T *in, float *const *out, size_t nframes, size_t nchans)
+{
+    ScalarDeinterleaveFrames(in, out, 0, nframes, nchans);
+}
+
+#ifdef SAMPLE_CONVERT_X86
+
+// ----------------------------------------------------------------------------
+//                                    SSE2
+// ----------------------------------------------------------------------------
+
+/// Convert 16 signed bytes to float
+__attribute__((target("sse2")))
+inline void SSE2S8x16(__m128i v, float *out, __m128 norm)
+{
+    __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+    __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+
+    _mm_storeu_ps(out,      _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), norm));
+    _mm_storeu_ps(out + 4,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), norm));
+    _mm_storeu_ps(out + 8,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), norm));
+    _mm_storeu_ps(out + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), norm));
+}
+
+__attribute__((target("sse2")))
+void SSE2S8ToFloat(const int8_t *in, float *out, size_t n)
+{
+    const __m128 norm = _mm_set1_ps(S8_NORM);
+    size_t i = 0;
+    for(; i+16<=n; i+=16)
+        SSE2S8x16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), out + i, norm);
+    ScalarS8ToFloat(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SSE2U8ToFloat(const uint8_t *in, float *out, size_t n)
+{
+    // Offset binary to two's complement
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128 norm = _mm_set1_ps(S8_NORM);
+    size_t i = 0;
+    for(; i+16<=n; i+=16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        SSE2S8x16(_mm_xor_si128(v, bias), out + i, norm);
+    }
+    ScalarU8ToFloat(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SSE2S16ToFloat(const int16_t *in, float *out, size_t n)
+{
+    const __m128 norm = _mm_set1_ps(S16_NORM);
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), norm));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), norm));
+    }
+    ScalarS16ToFloat(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SSE2S32ToFloat(const int32_t *in, float *out, size_t n)
+{
+    const __m128 norm = _mm_set1_ps(S32_NORM);
+    size_t i = 0;
+    for(; i+4<=n; i+=4){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), norm));
+    }
+    ScalarS32ToFloat(in + i, out + i, n - i);
+}
+
+/// Scale, clamp and round 4 floats to int32
+__attribute__((target("sse2")))
+inline __m128i SSE2Quantize(const float *in, __m128 scale, __m128 lo, __m128 hi)
+{
+    __m128 x = _mm_mul_ps(_mm_loadu_ps(in), scale);
+    return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(x, lo), hi));
+}
+
+__attribute__((target("sse2")))
+void SSE2FloatToS8(const float *in, int8_t *out, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(S8_SCALE);
+    const __m128 lo = _mm_set1_ps(-128.f);
+    const __m128 hi = _mm_set1_ps(127.f);
+    size_t i = 0;
+    for(; i+16<=n; i+=16){
+        __m128i a = _mm_packs_epi32(SSE2Quantize(in + i,      scale, lo, hi),
+                                    SSE2Quantize(in + i + 4,  scale, lo, hi));
+        __m128i b = _mm_packs_epi32(SSE2Quantize(in + i + 8,  scale, lo, hi),
+                                    SSE2Quantize(in + i + 12, scale, lo, hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi16(a, b));
+    }
+    ScalarFloatToS8(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SSE2FloatToS16(const float *in, int16_t *out, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    const __m128 lo = _mm_set1_ps(-32768.f);
+    const __m128 hi = _mm_set1_ps(32767.f);
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        __m128i v = _mm_packs_epi32(SSE2Quantize(in + i,     scale, lo, hi),
+                                    SSE2Quantize(in + i + 4, scale, lo, hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+    }
+    ScalarFloatToS16(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void SSE2FloatToS32(const float *in, int32_t *out, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(S32_SCALE);
+    const __m128 lo = _mm_set1_ps(-S32_SCALE);
+    const __m128 hi = _mm_set1_ps(S32_MAX_FLOAT);
+    size_t i = 0;
+    for(; i+4<=n; i+=4)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), SSE2Quantize(in + i, scale, lo, hi));
+    ScalarFloatToS32(in + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+float SSE2Dot(const float *a, const float *b, size_t n)
+{
+    __m128 s0 = _mm_setzero_ps();
+    __m128 s1 = _mm_setzero_ps();
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),     _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    s0 = _mm_add_ps(s0, s1);
+    s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+    s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+    return _mm_cvtss_f32(s0) + ScalarDot(a + i, b + i, n - i);
+}
+
+/// Load 4 samples as float
+__attribute__((target("sse2")))
+inline __m128 SSE2Load4(const float *in)
+{
+    return _mm_loadu_ps(in);
+}
+
+__attribute__((target("sse2")))
+inline __m128 SSE2Load4(const int16_t *in)
+{
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+/// Load a channel of 4 frames as float
+__attribute__((target("sse2")))
+inline __m128 SSE2Gather4(const float *in, size_t stride)
+{
+    return _mm_set_ps(in[3*stride], in[2*stride], in[stride], in[0]);
+}
+
+__attribute__((target("sse2")))
+inline __m128 SSE2Gather4(const int16_t *in, size_t stride)
+{
+    return _mm_cvtepi32_ps(_mm_set_epi32(in[3*stride], in[2*stride], in[stride], in[0]));
+}
+
+/// Load 4 frames of 2 channels, split into left and right
+template <class T>
+__attribute__((target("sse2")))
+inline void SSE2LoadStereo(const T *in, __m128 &left, __m128 &right)
+{
+    __m128 a = SSE2Load4(in);
+    __m128 b = SSE2Load4(in + 4);
+    left  = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+    right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+}
+
+/// Load channels c to c+3 of 4 frames, starting at in + c, transposed so that
+/// vk holds channel c+k. Past the last channel the loads run into the next
+/// frame, so there must be a frame after the 4 unless there are 4 channels.
+template <class T>
+__attribute__((target("sse2")))
+inline void SSE2LoadTransposed(const T *in, size_t nchans, __m128 &v0, __m128 &v1, __m128 &v2, __m128 &v3)
+{
+    v0 = SSE2Load4(in);
+    v1 = SSE2Load4(in + nchans);
+    v2 = SSE2Load4(in + 2*nchans);
+    v3 = SSE2Load4(in + 3*nchans);
+    _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+}
+
+/// Mix 4 channels into sum, with the given number of weights
+__attribute__((target("sse2")))
+inline __m128 SSE2Mix4(__m128 sum, __m128 v0, __m128 v1, __m128 v2, __m128 v3,
+                       const float *weights, size_t nweights)
+{
+    switch(nweights){
+    default: sum = _mm_add_ps(sum, _mm_mul_ps(v3, _mm_set1_ps(weights[3])));  // fall through
+    case 3:  sum = _mm_add_ps(sum, _mm_mul_ps(v2, _mm_set1_ps(weights[2])));  // fall through
+    case 2:  sum = _mm_add_ps(sum, _mm_mul_ps(v1, _mm_set1_ps(weights[1])));  // fall through
+    case 1:  sum = _mm_add_ps(sum, _mm_mul_ps(v0, _mm_set1_ps(weights[0])));
+    }
+    return sum;
+}
+
+template <class T>
+__attribute__((target("sse2")))
+void SSE2Downmix(const T *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    // Each iteration loads all of its frames before storing, so that the
+    // output can overwrite the input
+    const float norm = SampleNorm<T>();
+    size_t i = 0;
+    if(nchans == 1){
+       const __m128 w = _mm_set1_ps(weights[0] * norm);
+       for(; i+4<=nframes; i+=4)
+           _mm_storeu_ps(out + i, _mm_mul_ps(SSE2Load4(in + i), w));
+    }
+    else if(nchans == 2){
+       const __m128 wl = _mm_set1_ps(weights[0] * norm);
+       const __m128 wr = _mm_set1_ps(weights[1] * norm);
+       for(; i+4<=nframes; i+=4){
+           __m128 l, r;
+           SSE2LoadStereo(in + 2*i, l, r);
+           _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(l, wl), _mm_mul_ps(r, wr)));
+       }
+    }
+    else{
+       const __m128 vnorm = _mm_set1_ps(norm);
+       for(; i+5<=nframes; i+=4){
+           const T *frames = in + i*nchans;
+           __m128 sum = _mm_setzero_ps();
+           for(size_t c=0; c<nchans; c+=4){
+               __m128 v0, v1, v2, v3;
+               SSE2LoadTransposed(frames + c, nchans, v0, v1, v2, v3);
+               sum = SSE2Mix4(sum, v0, v1, v2, v3, weights + c, nchans - c);
+           }
+           _mm_storeu_ps(out + i, _mm_mul_ps(sum, vnorm));
+       }
+    }
+    ScalarDownmix(in + i*nchans, out + i, nframes - i, nchans, weights);
+}
+
+template <class T>
+__attribute__((target("sse2")))
+void SSE2Extract(const T *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    const __m128 norm = _mm_set1_ps(SampleNorm<T>());
+    size_t i = 0;
+    if(nchans == 2){
+       for(; i+4<=nframes; i+=4){
+           __m128 l, r;
+           SSE2LoadStereo(in + 2*i, l, r);
+           _mm_storeu_ps(out + i, _mm_mul_ps(chan ? r : l, norm));
+       }
+    }
+    else{
+       for(; i+4<=nframes; i+=4)
+           _mm_storeu_ps(out + i, _mm_mul_ps(SSE2Gather4(in + i*nchans + chan, nchans), norm));
+    }
+    ScalarExtract(in + i*nchans, out + i, nframes - i, nchans, chan);
+}
+
+template <class T>
+__attribute__((target("sse2")))
+void SSE2Deinterleave(const T *in, float *const *out, size_t nframes, size_t nchans)
+{
+    const __m128 norm = _mm_set1_ps(SampleNorm<T>());
+    size_t i = 0;
+    if(nchans == 1){
+       for(; i+4<=nframes; i+=4)
+           _mm_storeu_ps(out[0] + i, _mm_mul_ps(SSE2Load4(in + i), norm));
+    }
+    else if(nchans == 2){
+       for(; i+4<=nframes; i+=4){
+           __m128 l, r;
+           SSE2LoadStereo(in + 2*i, l, r);
+           _mm_storeu_ps(out[0] + i, _mm_mul_ps(l, norm));
+           _mm_storeu_ps(out[1] + i, _mm_mul_ps(r, norm));
+       }
+    }
+    else{
+       for(; i+5<=nframes; i+=4){
+           const T *frames = in + i*nchans;
+           for(size_t c=0; c<nchans; c+=4){
+               __m128 v0, v1, v2, v3;
+               SSE2LoadTransposed(frames + c, nchans, v0, v1, v2, v3);
+               switch(nchans - c){
+               default: _mm_storeu_ps(out[c+3] + i, _mm_mul_ps(v3, norm));  // fall through
+               case 3:  _mm_storeu_ps(out[c+2] + i, _mm_mul_ps(v2, norm));  // fall through
+               case 2:  _mm_storeu_ps(out[c+1] + i, _mm_mul_ps(v1, norm));  // fall through
+               case 1:  _mm_storeu_ps(out[c]   + i, _mm_mul_ps(v0, norm));
+               }
+           }
+       }
+    }
+    ScalarDeinterleaveFrames(in, out, i, nframes, nchans);
+}
+
+const SampleKernels SSE2_SAMPLE_KERNELS = {
+    "sse2",
+    SSE2S8ToFloat, SSE2U8ToFloat, SSE2S16ToFloat, SSE2S32ToFloat,
+    SSE2FloatToS8, SSE2FloatToS16, SSE2FloatToS32,
+    SSE2Dot,
+    SSE2Downmix<float>, SSE2Downmix<int16_t>,
+    SSE2Extract<float>, SSE2Extract<int16_t>,
+    SSE2Deinterleave<float>, SSE2Deinterleave<int16_t>
+};
+
+// ----------------------------------------------------------------------------
+//                                    AVX2
+// ----------------------------------------------------------------------------
+
+/// Convert 16 signed bytes to float
+__attribute__((target("avx2")))
+inline void AVX2S8x16(__m128i v, float *out, __m256 norm)
+{
+    _mm256_storeu_ps(out,     _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(v)), norm));
+    _mm256_storeu_ps(out + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(v, 8))), norm));
+}
+
+__attribute__((target("avx2")))
+void AVX2S8ToFloat(const int8_t *in, float *out, size_t n)
+{
+    const __m256 norm = _mm256_set1_ps(S8_NORM);
+    size_t i = 0;
+    for(; i+16<=n; i+=16)
+        AVX2S8x16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), out + i, norm);
+    ScalarS8ToFloat(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void AVX2U8ToFloat(const uint8_t *in, float *out, size_t n)
+{
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m256 norm = _mm256_set1_ps(S8_NORM);
+    size_t i = 0;
+    for(; i+16<=n; i+=16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        AVX2S8x16(_mm_xor_si128(v, bias), out + i, norm);
+    }
+    ScalarU8ToFloat(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void AVX2S16ToFloat(const int16_t *in, float *out, size_t n)
+{
+    const __m256 norm = _mm256_set1_ps(S16_NORM);
+    size_t i = 0;
+    for(; i+16<=n; i+=16){
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8));
+        _mm256_storeu_ps(out + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)), norm));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)), norm));
+    }
+    ScalarS16ToFloat(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void AVX2S32ToFloat(const int32_t *in, float *out, size_t n)
+{
+    const __m256 norm = _mm256_set1_ps(S32_NORM);
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), norm));
+    }
+    ScalarS32ToFloat(in + i, out + i, n - i);
+}
+
+/// Scale, clamp and round 8 floats to int32
+__attribute__((target("avx2")))
+inline __m256i AVX2Quantize(const float *in, __m256 scale, __m256 lo, __m256 hi)
+{
+    __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in), scale);
+    return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(x, lo), hi));
+}
+
+__attribute__((target("avx2")))
+void AVX2FloatToS16(const float *in, int16_t *out, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    const __m256 lo = _mm256_set1_ps(-32768.f);
+    const __m256 hi = _mm256_set1_ps(32767.f);
+    size_t i = 0;
+    for(; i+16<=n; i+=16){
+        // The pack works within 128 bit lanes, so the quadwords come out
+        // in the order 0 2 1 3
+        __m256i v = _mm256_packs_epi32(AVX2Quantize(in + i,     scale, lo, hi),
+                                       AVX2Quantize(in + i + 8, scale, lo, hi));
+        v = _mm256_permute4x64_epi64(v, 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+    }
+    ScalarFloatToS16(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void AVX2FloatToS32(const float *in, int32_t *out, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(S32_SCALE);
+    const __m256 lo = _mm256_set1_ps(-S32_SCALE);
+    const __m256 hi = _mm256_set1_ps(S32_MAX_FLOAT);
+    size_t i = 0;
+    for(; i+8<=n; i+=8)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), AVX2Quantize(in + i, scale, lo, hi));
+    ScalarFloatToS32(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+float AVX2Dot(const float *a, const float *b, size_t n)
+{
+    // No FMA, which AVX2 doesn't imply
+    __m256 s0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for(; i+16<=n; i+=16){
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),     _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s) + ScalarDot(a + i, b + i, n - i);
+}
+
+/// Load 8 samples as float
+__attribute__((target("avx2")))
+inline __m256 AVX2Load8(const float *in)
+{
+    return _mm256_loadu_ps(in);
+}
+
+__attribute__((target("avx2")))
+inline __m256 AVX2Load8(const int16_t *in)
+{
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+}
+
+/// Load 8 frames of 2 channels, split into left and right. The shuffles work
+/// within 128 bit lanes, so the frames come out in the order 0 1 4 5 2 3 6 7
+/// (see AVX2Unshuffle).
+template <class T>
+__attribute__((target("avx2")))
+inline void AVX2LoadStereo(const T *in, __m256 &left, __m256 &right)
+{
+    __m256 a = AVX2Load8(in);
+    __m256 b = AVX2Load8(in + 8);
+    left  = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+    right = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+}
+
+__attribute__((target("avx2")))
+inline __m256 AVX2Unshuffle(__m256 v)
+{
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(v), 0xD8));
+}
+
+template <class T>
+__attribute__((target("avx2")))
+void AVX2Downmix(const T *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    const float norm = SampleNorm<T>();
+    size_t i = 0;
+    if(nchans == 1){
+       const __m256 w = _mm256_set1_ps(weights[0] * norm);
+       for(; i+8<=nframes; i+=8)
+           _mm256_storeu_ps(out + i, _mm256_mul_ps(AVX2Load8(in + i), w));
+    }
+    else if(nchans == 2){
+       const __m256 wl = _mm256_set1_ps(weights[0] * norm);
+       const __m256 wr = _mm256_set1_ps(weights[1] * norm);
+       for(; i+8<=nframes; i+=8){
+           __m256 l, r;
+           AVX2LoadStereo(in + 2*i, l, r);
+           __m256 mix = _mm256_add_ps(_mm256_mul_ps(l, wl), _mm256_mul_ps(r, wr));
+           _mm256_storeu_ps(out + i, AVX2Unshuffle(mix));
+       }
+    }
+    else
+       return SSE2Downmix(in, out, nframes, nchans, weights);
+
+    ScalarDownmix(in + i*nchans, out + i, nframes - i, nchans, weights);
+}
+
+template <class T>
+__attribute__((target("avx2")))
+void AVX2Extract(const T *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    if(nchans != 2)
+       return SSE2Extract(in, out, nframes, nchans, chan);
+
+    const __m256 norm = _mm256_set1_ps(SampleNorm<T>());
+    size_t i = 0;
+    for(; i+8<=nframes; i+=8){
+        __m256 l, r;
+        AVX2LoadStereo(in + 2*i, l, r);
+        _mm256_storeu_ps(out + i, AVX2Unshuffle(_mm256_mul_ps(chan ? r : l, norm)));
+    }
+    ScalarExtract(in + i*nchans, out + i, nframes - i, nchans, chan);
+}
+
+template <class T>
+__attribute__((target("avx2")))
+void AVX2Deinterleave(const T *in, float *const *out, size_t nframes, size_t nchans)
+{
+    if(nchans != 2)
+       return SSE2Deinterleave(in, out, nframes, nchans);
+
+    const __m256 norm = _mm256_set1_ps(SampleNorm<T>());
+    size_t i = 0;
+    for(; i+8<=nframes; i+=8){
+        __m256 l, r;
+        AVX2LoadStereo(in + 2*i, l, r);
+        _mm256_storeu_ps(out[0] + i, AVX2Unshuffle(_mm256_mul_ps(l, norm)));
+        _mm256_storeu_ps(out[1] + i, AVX2Unshuffle(_mm256_mul_ps(r, norm)));
+    }
+    ScalarDeinterleaveFrames(in, out, i, nframes, nchans);
+}
+
+// 8 bit output is rare enough not to need its own AVX2 kernel
+const SampleKernels AVX2_SAMPLE_KERNELS = {
+    "avx2",
+    AVX2S8ToFloat, AVX2U8ToFloat, AVX2S16ToFloat, AVX2S32ToFloat,
+    SSE2FloatToS8, AVX2FloatToS16, AVX2FloatToS32,
+    AVX2Dot,
+    AVX2Downmix<float>, AVX2Downmix<int16_t>,
+    AVX2Extract<float>, AVX2Extract<int16_t>,
+    AVX2Deinterleave<float>, AVX2Deinterleave<int16_t>
+};
+
+#endif // SAMPLE_CONVERT_X86
+
+// ----------------------------------------------------------------------------
+//                                  Dispatch
+// ----------------------------------------------------------------------------
+
+/// Get the kernels for the given instruction set, if available on this CPU
+const SampleKernels* FindKernels(const char *isa)
+{
+    if(std::strcmp(isa, "scalar") == 0)
+       return &SCALAR_SAMPLE_KERNELS;
+
+#ifdef SAMPLE_CONVERT_X86
+    __builtin_cpu_init();
+    if(std::strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+       return &AVX2_SAMPLE_KERNELS;
+    if(std::strcmp(isa, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+       return &SSE2_SAMPLE_KERNELS;
+#endif
+
+    const SampleKernels *neon = GetNeonSampleKernels();
+    if(neon && std::strcmp(isa, "neon") == 0)
+       return neon;
+
+    return nullptr;
+}
+
+const SampleKernels* SelectKernels()
+{
+    const char* isas[] = { "avx2", "sse2", "neon" };
+
+    for(size_t i=0; i<sizeof(isas)/sizeof(isas[0]); i++)
+        if(const SampleKernels *kernels = FindKernels(isas[i]))
+           return kernels;
+
+    return &SCALAR_SAMPLE_KERNELS;
+}
+
+std::atomic<const SampleKernels*> g_Kernels(nullptr);
+
+/// The weights of a downmix, or equal weights if none are given. Up to 8
+/// channels (7.1) they are kept on the stack.
+class MixWeights
+{
+    float               m_Fixed[8];
+    std::vector<float>  m_Vector;
+    const float*        m_Data;
+
+public:
+
+    MixWeights(const float *weights, size_t nchans) : m_Data(weights)
+    {
+        assert(nchans > 0);
+        if(weights)
+           return;
+        float *w = m_Fixed;
+        if(nchans > sizeof(m_Fixed)/sizeof(m_Fixed[0])){
+           m_Vector.resize(nchans);
+           w = m_Vector.data();
+        }
+        std::fill(w, w + nchans, 1.f / nchans);
+        m_Data = w;
+    }
+
+    const float* Data() const { return m_Data; }
+};
+
+inline const SampleKernels& Kernels()
+{
+    const SampleKernels *kernels = g_Kernels.load(std::memory_order_acquire);
+    if(!kernels){
+       // Racing threads select the same kernels
+       kernels = SelectKernels();
+       g_Kernels.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+}
+
+// ----------------------------------------------------------------------------
+
+const SampleKernels SCALAR_SAMPLE_KERNELS = {
+    "scalar",
+    ScalarS8ToFloat, ScalarU8ToFloat, ScalarS16ToFloat, ScalarS32ToFloat,
+    ScalarFloatToS8, ScalarFloatToS16, ScalarFloatToS32,
+    ScalarDot,
+    ScalarDownmix<float>, ScalarDownmix<int16_t>,
+    ScalarExtract<float>, ScalarExtract<int16_t>,
+    ScalarDeinterleave<float>, ScalarDeinterleave<int16_t>
+};
+
+// ----------------------------------------------------------------------------
+
+void SamplesToFloat(const int8_t *in, float *out, size_t n)   { Kernels().S8ToFloat(in, out, n); }
+void SamplesToFloat(const uint8_t *in, float *out, size_t n)  { Kernels().U8ToFloat(in, out, n); }
+void SamplesToFloat(const int16_t *in, float *out, size_t n)  { Kernels().S16ToFloat(in, out, n); }
+void SamplesToFloat(const int32_t *in, float *out, size_t n)  { Kernels().S32ToFloat(in, out, n); }
+
+void FloatToSamples(const float *in, int8_t *out, size_t n)   { Kernels().FloatToS8(in, out, n); }
+void FloatToSamples(const float *in, int16_t *out, size_t n)  { Kernels().FloatToS16(in, out, n); }
+void FloatToSamples(const float *in, int32_t *out, size_t n)  { Kernels().FloatToS32(in, out, n); }
+
+float DotProduct(const float *a, const float *b, size_t n)    { return Kernels().Dot(a, b, n); }
+
+// ----------------------------------------------------------------------------
+
+void DownmixSamples(const float *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    MixWeights w(weights, nchans);
+    Kernels().DownmixFloat(in, out, nframes, nchans, w.Data());
+}
+
+void DownmixSamples(const int16_t *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    MixWeights w(weights, nchans);
+    Kernels().DownmixS16(in, out, nframes, nchans, w.Data());
+}
+
+void ExtractChannel(const float *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    assert(chan < nchans);
+    Kernels().ExtractFloat(in, out, nframes, nchans, chan);
+}
+
+void ExtractChannel(const int16_t *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    assert(chan < nchans);
+    Kernels().ExtractS16(in, out, nframes, nchans, chan);
+}
+
+void DeinterleaveSamples(const float *in, float *const *out, size_t nframes, size_t nchans)
+{
+    Kernels().DeinterleaveFloat(in, out, nframes, nchans);
+}
+
+void DeinterleaveSamples(const int16_t *in, float *const *out, size_t nframes, size_t nchans)
+{
+    Kernels().DeinterleaveS16(in, out, nframes, nchans);
+}
+
+// ----------------------------------------------------------------------------
+
+const char* GetSampleConvertISA()
+{
+    return Kernels().ISA;
+}
+
+// ----------------------------------------------------------------------------
+
+bool SetSampleConvertISA(const char *isa)
+{
+    const SampleKernels *kernels = FindKernels(isa);
+    if(!kernels)
+       return false;
+    g_Kernels.store(kernels, std::memory_order_release);
+    return true;
+}
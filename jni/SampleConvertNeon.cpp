@@ -0,0 +1,344 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+// NEON sample conversion kernels. On armeabi-v7a this file must be built with
+// NEON enabled (the .neon suffix in Android.mk), and the kernels are only used
+// if the CPU supports it.
+
+#include "SampleKernels.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+#if defined(__ANDROID__) && !defined(__aarch64__)
+#include <cpu-features.h>
+#endif
+
+namespace {
+
+/// Round to nearest, ties to even as lrintf() does, saturating
+inline int32x4_t RoundToInt(float32x4_t x)
+{
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(x);
+#else
+    // ARMv7 only truncates. Adding and subtracting 2^23 to |x| rounds it to an
+    // integer (NEON always rounds to nearest even), and from 2^23 up all the
+    // floats are integers already. The sign is put back afterwards.
+    const float32x4_t magic = vdupq_n_f32(8388608.f);
+    float32x4_t ax = vabsq_f32(x);
+    float32x4_t r = vsubq_f32(vaddq_f32(ax, magic), magic);
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000));
+    r = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(r), sign));
+    return vcvtq_s32_f32(vbslq_f32(vcltq_f32(ax, magic), r, x));
+#endif
+}
+
+/// Convert 16 signed bytes to float
+inline void NeonS8x16(int8x16_t v, float *out)
+{
+    int16x8_t lo = vmovl_s8(vget_low_s8(v));
+    int16x8_t hi = vmovl_s8(vget_high_s8(v));
+
+    vst1q_f32(out,      vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))),  S8_NORM));
+    vst1q_f32(out + 4,  vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), S8_NORM));
+    vst1q_f32(out + 8,  vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))),  S8_NORM));
+    vst1q_f32(out + 12, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), S8_NORM));
+}
+
+void NeonS8ToFloat(const int8_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for(; i+16<=n; i+=16)
+        NeonS8x16(vld1q_s8(in + i), out + i);
+    SCALAR_SAMPLE_KERNELS.S8ToFloat(in + i, out + i, n - i);
+}
+
+void NeonU8ToFloat(const uint8_t *in, float *out, size_t n)
+{
+    // Offset binary to two's complement
+    const uint8x16_t bias = vdupq_n_u8(0x80);
+    size_t i = 0;
+    for(; i+16<=n; i+=16)
+        NeonS8x16(vreinterpretq_s8_u8(veorq_u8(vld1q_u8(in + i), bias)), out + i);
+    SCALAR_SAMPLE_KERNELS.U8ToFloat(in + i, out + i, n - i);
+}
+
+void NeonS16ToFloat(const int16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),  S16_NORM));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), S16_NORM));
+    }
+    SCALAR_SAMPLE_KERNELS.S16ToFloat(in + i, out + i, n - i);
+}
+
+void NeonS32ToFloat(const int32_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    for(; i+4<=n; i+=4)
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(in + i)), S32_NORM));
+    SCALAR_SAMPLE_KERNELS.S32ToFloat(in + i, out + i, n - i);
+}
+
+// The float to int conversions and the narrowing saturate, so no clamping
+// is needed, except at the top of the 32 bit range, which is clamped to the
+// largest float below 2^31 as in the other kernels
+
+void NeonFloatToS8(const float *in, int8_t *out, size_t n)
+{
+    size_t i = 0;
+    for(; i+16<=n; i+=16){
+        int16x8_t a = vcombine_s16(vqmovn_s32(RoundToInt(vmulq_n_f32(vld1q_f32(in + i),      S8_SCALE))),
+                                   vqmovn_s32(RoundToInt(vmulq_n_f32(vld1q_f32(in + i + 4),  S8_SCALE))));
+        int16x8_t b = vcombine_s16(vqmovn_s32(RoundToInt(vmulq_n_f32(vld1q_f32(in + i + 8),  S8_SCALE))),
+                                   vqmovn_s32(RoundToInt(vmulq_n_f32(vld1q_f32(in + i + 12), S8_SCALE))));
+        vst1q_s8(out + i, vcombine_s8(vqmovn_s16(a), vqmovn_s16(b)));
+    }
+    SCALAR_SAMPLE_KERNELS.FloatToS8(in + i, out + i, n - i);
+}
+
+void NeonFloatToS16(const float *in, int16_t *out, size_t n)
+{
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        int16x8_t v = vcombine_s16(vqmovn_s32(RoundToInt(vmulq_n_f32(vld1q_f32(in + i),     S16_SCALE))),
+                                   vqmovn_s32(RoundToInt(vmulq_n_f32(vld1q_f32(in + i + 4), S16_SCALE))));
+        vst1q_s16(out + i, v);
+    }
+    SCALAR_SAMPLE_KERNELS.FloatToS16(in + i, out + i, n - i);
+}
+
+void NeonFloatToS32(const float *in, int32_t *out, size_t n)
+{
+    size_t i = 0;
+    const float32x4_t hi = vdupq_n_f32(S32_MAX_FLOAT);
+    for(; i+4<=n; i+=4)
+        vst1q_s32(out + i, RoundToInt(vminq_f32(vmulq_n_f32(vld1q_f32(in + i), S32_SCALE), hi)));
+    SCALAR_SAMPLE_KERNELS.FloatToS32(in + i, out + i, n - i);
+}
+
+float NeonDot(const float *a, const float *b, size_t n)
+{
+    float32x4_t s0 = vdupq_n_f32(0);
+    float32x4_t s1 = vdupq_n_f32(0);
+    size_t i = 0;
+    for(; i+8<=n; i+=8){
+        s0 = vmlaq_f32(s0, vld1q_f32(a + i),     vld1q_f32(b + i));
+        s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    s0 = vaddq_f32(s0, s1);
+    float32x2_t s = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+    s = vpadd_f32(s, s);
+    return vget_lane_f32(s, 0) + SCALAR_SAMPLE_KERNELS.Dot(a + i, b + i, n - i);
+}
+
+// The scalar channel kernels, for the tails
+
+inline void ScalarDownmix(const float *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    SCALAR_SAMPLE_KERNELS.DownmixFloat(in, out, nframes, nchans, weights);
+}
+
+inline void ScalarDownmix(const int16_t *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    SCALAR_SAMPLE_KERNELS.DownmixS16(in, out, nframes, nchans, weights);
+}
+
+inline void ScalarExtract(const float *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    SCALAR_SAMPLE_KERNELS.ExtractFloat(in, out, nframes, nchans, chan);
+}
+
+inline void ScalarExtract(const int16_t *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    SCALAR_SAMPLE_KERNELS.ExtractS16(in, out, nframes, nchans, chan);
+}
+
+/// Load 4 samples as float
+inline float32x4_t NeonLoad4(const float *in)
+{
+    return vld1q_f32(in);
+}
+
+inline float32x4_t NeonLoad4(const int16_t *in)
+{
+    return vcvtq_f32_s32(vmovl_s16(vld1_s16(in)));
+}
+
+/// Load a channel of 4 frames as float
+template <class T>
+inline float32x4_t NeonGather4(const T *in, size_t stride)
+{
+    float v[4] = { float(in[0]), float(in[stride]), float(in[2*stride]), float(in[3*stride]) };
+    return vld1q_f32(v);
+}
+
+/// Load 4 frames of 2 channels, split into left and right
+inline void NeonLoadStereo(const float *in, float32x4_t &left, float32x4_t &right)
+{
+    float32x4x2_t v = vld2q_f32(in);
+    left  = v.val[0];
+    right = v.val[1];
+}
+
+inline void NeonLoadStereo(const int16_t *in, float32x4_t &left, float32x4_t &right)
+{
+    int16x4x2_t v = vld2_s16(in);
+    left  = vcvtq_f32_s32(vmovl_s16(v.val[0]));
+    right = vcvtq_f32_s32(vmovl_s16(v.val[1]));
+}
+
+/// Load channels c to c+3 of 4 frames, starting at in + c, transposed so that
+/// vk holds channel c+k. Past the last channel the loads run into the next
+/// frame, so there must be a frame after the 4 unless there are 4 channels.
+template <class T>
+inline void NeonLoadTransposed(const T *in, size_t nchans, float32x4_t &v0, float32x4_t &v1,
+                               float32x4_t &v2, float32x4_t &v3)
+{
+    float32x4x2_t t01 = vtrnq_f32(NeonLoad4(in), NeonLoad4(in + nchans));
+    float32x4x2_t t23 = vtrnq_f32(NeonLoad4(in + 2*nchans), NeonLoad4(in + 3*nchans));
+    v0 = vcombine_f32(vget_low_f32(t01.val[0]),  vget_low_f32(t23.val[0]));
+    v1 = vcombine_f32(vget_low_f32(t01.val[1]),  vget_low_f32(t23.val[1]));
+    v2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    v3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+template <class T>
+void NeonDownmix(const T *in, float *out, size_t nframes, size_t nchans, const float *weights)
+{
+    // Each iteration loads all of its frames before storing, so that the
+    // output can overwrite the input
+    const float norm = SampleNorm<T>();
+    size_t i = 0;
+    if(nchans == 1){
+       for(; i+4<=nframes; i+=4)
+           vst1q_f32(out + i, vmulq_n_f32(NeonLoad4(in + i), weights[0] * norm));
+    }
+    else if(nchans == 2){
+       const float wl = weights[0] * norm;
+       const float wr = weights[1] * norm;
+       for(; i+4<=nframes; i+=4){
+           float32x4_t l, r;
+           NeonLoadStereo(in + 2*i, l, r);
+           vst1q_f32(out + i, vmlaq_n_f32(vmulq_n_f32(l, wl), r, wr));
+       }
+    }
+    else{
+       for(; i+5<=nframes; i+=4){
+           const T *frames = in + i*nchans;
+           float32x4_t sum = vdupq_n_f32(0);
+           for(size_t c=0; c<nchans; c+=4){
+               float32x4_t v0, v1, v2, v3;
+               NeonLoadTransposed(frames + c, nchans, v0, v1, v2, v3);
+               switch(nchans - c){
+               default: sum = vmlaq_n_f32(sum, v3, weights[c+3]);  // fall through
+               case 3:  sum = vmlaq_n_f32(sum, v2, weights[c+2]);  // fall through
+               case 2:  sum = vmlaq_n_f32(sum, v1, weights[c+1]);  // fall through
+               case 1:  sum = vmlaq_n_f32(sum, v0, weights[c]);
+               }
+           }
+           vst1q_f32(out + i, vmulq_n_f32(sum, norm));
+       }
+    }
+    ScalarDownmix(in + i*nchans, out + i, nframes - i, nchans, weights);
+}
+
+template <class T>
+void NeonExtract(const T *in, float *out, size_t nframes, size_t nchans, size_t chan)
+{
+    const float norm = SampleNorm<T>();
+    size_t i = 0;
+    if(nchans == 2){
+       for(; i+4<=nframes; i+=4){
+           float32x4_t l, r;
+           NeonLoadStereo(in + 2*i, l, r);
+           vst1q_f32(out + i, vmulq_n_f32(chan ? r : l, norm));
+       }
+    }
+    else{
+       for(; i+4<=nframes; i+=4)
+           vst1q_f32(out + i, vmulq_n_f32(NeonGather4(in + i*nchans + chan, nchans), norm));
+    }
+    ScalarExtract(in + i*nchans, out + i, nframes - i, nchans, chan);
+}
+
+template <class T>
+void NeonDeinterleave(const T *in, float *const *out, size_t nframes, size_t nchans)
+{
+    const float norm = SampleNorm<T>();
+    size_t i = 0;
+    if(nchans == 1){
+       for(; i+4<=nframes; i+=4)
+           vst1q_f32(out[0] + i, vmulq_n_f32(NeonLoad4(in + i), norm));
+    }
+    else if(nchans == 2){
+       for(; i+4<=nframes; i+=4){
+           float32x4_t l, r;
+           NeonLoadStereo(in + 2*i, l, r);
+           vst1q_f32(out[0] + i, vmulq_n_f32(l, norm));
+           vst1q_f32(out[1] + i, vmulq_n_f32(r, norm));
+       }
+    }
+    else{
+       for(; i+5<=nframes; i+=4){
+           const T *frames = in + i*nchans;
+           for(size_t c=0; c<nchans; c+=4){
+               float32x4_t v0, v1, v2, v3;
+               NeonLoadTransposed(frames + c, nchans, v0, v1, v2, v3);
+               switch(nchans - c){
+               default: vst1q_f32(out[c+3] + i, vmulq_n_f32(v3, norm));  // fall through
+               case 3:  vst1q_f32(out[c+2] + i, vmulq_n_f32(v2, norm));  // fall through
+               case 2:  vst1q_f32(out[c+1] + i, vmulq_n_f32(v1, norm));  // fall through
+               case 1:  vst1q_f32(out[c]   + i, vmulq_n_f32(v0, norm));
+               }
+           }
+       }
+    }
+    for(; i<nframes; i++)
+        for(size_t c=0; c<nchans; c++)
+            out[c][i] = in[i*nchans + c] * norm;
+}
+
+const SampleKernels NEON_SAMPLE_KERNELS = {
+    "neon",
+    NeonS8ToFloat, NeonU8ToFloat, NeonS16ToFloat, NeonS32ToFloat,
+    NeonFloatToS8, NeonFloatToS16, NeonFloatToS32,
+    NeonDot,
+    NeonDownmix<float>, NeonDownmix<int16_t>,
+    NeonExtract<float>, NeonExtract<int16_t>,
+    NeonDeinterleave<float>, NeonDeinterleave<int16_t>
+};
+
+}
+
+const SampleKernels* GetNeonSampleKernels()
+{
+#if defined(__ANDROID__) && !defined(__aarch64__)
+    if(android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM ||
+       !(android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON))
+       return nullptr;
+#endif
+    return &NEON_SAMPLE_KERNELS;
+}
+
+#else
+
+const SampleKernels* GetNeonSampleKernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef SAMPLEKERNELS_H
+#define SAMPLEKERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+
+/// A set of sample conversion kernels for an instruction set (see SampleConvert.h)
+struct SampleKernels
+{
+    const char* ISA;
+
+    void (*S8ToFloat)  (const int8_t  *in, float *out, size_t n);
+    void (*U8ToFloat)  (const uint8_t *in, float *out, size_t n);
+    void (*S16ToFloat) (const int16_t *in, float *out, size_t n);
+    void (*S32ToFloat) (const int32_t *in, float *out, size_t n);
+
+    void (*FloatToS8)  (const float *in, int8_t  *out, size_t n);
+    void (*FloatToS16) (const float *in, int16_t *out, size_t n);
+    void (*FloatToS32) (const float *in, int32_t *out, size_t n);
+
+    float (*Dot) (const float *a, const float *b, size_t n);
+
+    // Channel kernels on interleaved frames. The weights are never null here.
+    void (*DownmixFloat) (const float   *in, float *out, size_t nframes, size_t nchans, const float *weights);
+    void (*DownmixS16)   (const int16_t *in, float *out, size_t nframes, size_t nchans, const float *weights);
+    void (*ExtractFloat) (const float   *in, float *out, size_t nframes, size_t nchans, size_t chan);
+    void (*ExtractS16)   (const int16_t *in, float *out, size_t nframes, size_t nchans, size_t chan);
+    void (*DeinterleaveFloat) (const float   *in, float *const *out, size_t nframes, size_t nchans);
+    void (*DeinterleaveS16)   (const int16_t *in, float *const *out, size_t nframes, size_t nchans);
+};
+
+/// Full scale of the integer formats, and its reciprocal
+const float S8_SCALE  = 128.f;
+const float S16_SCALE = 32768.f;
+const float S32_SCALE = 2147483648.f;
+
+const float S8_NORM  = 1.f / S8_SCALE;
+const float S16_NORM = 1.f / S16_SCALE;
+const float S32_NORM = 1.f / S32_SCALE;
+
+/// Normalization factor applied by the channel kernels
+template <class T> inline float SampleNorm();
+template <> inline float SampleNorm<float>()   { return 1.f; }
+template <> inline float SampleNorm<int16_t>() { return S16_NORM; }
+
+/// Largest float below 2^31
+const float S32_MAX_FLOAT = 2147483520.f;
+
+/// The scalar kernels, also used for the tails of the SIMD ones
+extern const SampleKernels SCALAR_SAMPLE_KERNELS;
+
+/// Get the NEON kernels, or nullptr if not built for ARM
+/// (see SampleConvertNeon.cpp)
+const SampleKernels* GetNeonSampleKernels();
+
+
+#endif
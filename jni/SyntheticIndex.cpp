@@ -0,0 +1,259 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include "SyntheticIndex.h"
+
+using namespace std;
+using namespace Audioneex;
+
+namespace {
+
+/// Size of the random bytes pool the postings and fingerprints are drawn from
+const size_t NOISE_SIZE = 1024 * 1024;
+
+}
+
+// ----------------------------------------------------------------------------
+
+SyntheticIndex::Params::Params() :
+    FIDs            (10000),
+    FirstFID        (1),
+    Lists           (65536),
+    Zipf            (0.9),
+    TermsPerFID     (300),
+    PostingSize     (6),
+    BlockSize       (4096),
+    FingerprintSize (40000),
+    FlushFIDs       (1000),
+    Seed            (1)
+{
+}
+
+// ----------------------------------------------------------------------------
+
+SyntheticIndex::SyntheticIndex(const Params &params) :
+    m_Params (params),
+    m_Rng    (params.Seed)
+{
+    if(m_Params.Lists == 0 || m_Params.BlockSize == 0 || m_Params.FlushFIDs == 0)
+       throw invalid_argument("SyntheticIndex: Lists, BlockSize and FlushFIDs must be non zero");
+
+    if(m_Params.FirstFID == 0)
+       throw invalid_argument("SyntheticIndex: FIDs start at 1");
+
+    // The most popular lists are scattered over the ID space
+    m_ListIDs.resize(m_Params.Lists);
+    for(size_t i=0; i<m_ListIDs.size(); i++)
+        m_ListIDs[i] = static_cast<int>(i);
+    std::shuffle(m_ListIDs.begin(), m_ListIDs.end(), m_Rng);
+
+    m_ListCDF.resize(m_Params.Lists);
+    double sum = 0;
+    for(size_t i=0; i<m_ListCDF.size(); i++){
+        sum += 1.0 / std::pow(static_cast<double>(i + 1), m_Params.Zipf);
+        m_ListCDF[i] = sum;
+    }
+
+    m_Noise.resize(NOISE_SIZE);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for(size_t i=0; i<m_Noise.size(); i++)
+        m_Noise[i] = static_cast<uint8_t>(byte(m_Rng));
+}
+
+// ----------------------------------------------------------------------------
+
+int SyntheticIndex::DrawList()
+{
+    std::uniform_real_distribution<double> u(0, m_ListCDF.back());
+    size_t rank = std::lower_bound(m_ListCDF.begin(), m_ListCDF.end(), u(m_Rng)) - m_ListCDF.begin();
+    return m_ListIDs[std::min(rank, m_ListIDs.size() - 1)];
+}
+
+// ----------------------------------------------------------------------------
+
+size_t SyntheticIndex::DrawSize(size_t mean)
+{
+    if(mean == 0)
+       return 0;
+    std::uniform_int_distribution<size_t> u(std::max<size_t>(mean / 2, 1), mean + mean / 2);
+    return u(m_Rng);
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* SyntheticIndex::DrawBytes(size_t size)
+{
+    if(size > m_Noise.size() / 2){
+       std::uniform_int_distribution<int> byte(0, 255);
+       size_t old = m_Noise.size();
+       m_Noise.resize(size * 2);
+       for(size_t i=old; i<m_Noise.size(); i++)
+           m_Noise[i] = static_cast<uint8_t>(byte(m_Rng));
+    }
+    std::uniform_int_distribution<size_t> off(0, m_Noise.size() - size);
+    return m_Noise.data() + off(m_Rng);
+}
+
+// ----------------------------------------------------------------------------
+
+SyntheticIndex::Stats SyntheticIndex::Generate(KVDataStore &dstore)
+{
+    Stats stats = Stats();
+    std::map<int, PendingList> pending;
+    std::vector<int> lists;
+
+    auto start = std::chrono::steady_clock::now();
+
+    dstore.OnIndexerStart();
+
+    for(size_t k=0; k<m_Params.FIDs; k++)
+    {
+        uint32_t FID = m_Params.FirstFID + static_cast<uint32_t>(k);
+
+        // Draw the lists hit by the fingerprint. A list hit several times
+        // gets one posting, as large as the hits.
+        size_t nterms = DrawSize(m_Params.TermsPerFID);
+        lists.resize(nterms);
+        for(size_t t=0; t<nterms; t++)
+            lists[t] = DrawList();
+        std::sort(lists.begin(), lists.end());
+
+        for(size_t t=0; t<nterms; )
+        {
+            PendingList &list = pending[lists[t]];
+            size_t size = 0;
+            size_t t0 = t;
+            for(; t<nterms && lists[t] == lists[t0]; t++)
+                size += DrawSize(m_Params.PostingSize);
+
+            const uint8_t *data = DrawBytes(size);
+            list.Data.insert(list.Data.end(), data, data + size);
+            list.Postings.push_back(std::make_pair(FID, list.Data.size()));
+
+            stats.Postings ++;
+            stats.IndexBytes += size;
+        }
+
+        size_t fpsize = DrawSize(m_Params.FingerprintSize);
+        if(fpsize){
+           const uint8_t *data = DrawBytes(fpsize);
+           m_Buffer.assign(data, data + fpsize);
+           dstore.OnIndexerFingerprint(FID, m_Buffer.data(), fpsize);
+           stats.FingerprintBytes += fpsize;
+        }
+
+        stats.FIDs ++;
+
+        if(stats.FIDs % m_Params.FlushFIDs == 0){
+           Flush(dstore, pending, stats);
+           stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+           if(m_Progress)
+              m_Progress(stats);
+        }
+    }
+
+    if(!pending.empty())
+       Flush(dstore, pending, stats);
+
+    dstore.OnIndexerEnd();
+
+    stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(m_Progress)
+       m_Progress(stats);
+
+    return stats;
+}
+
+// ----------------------------------------------------------------------------
+
+void SyntheticIndex::Flush(KVDataStore &dstore, std::map<int, PendingList> &pending, Stats &stats)
+{
+    // Lists are flushed in ID order, like the engine does
+    dstore.OnIndexerFlushStart();
+
+    std::map<int, PendingList>::iterator it = pending.begin();
+    for(; it != pending.end(); ++it)
+        WriteList(dstore, it->first, it->second, stats);
+
+    dstore.OnIndexerFlushEnd();
+
+    pending.clear();
+    stats.Flushes ++;
+}
+
+// ----------------------------------------------------------------------------
+
+void SyntheticIndex::WriteList(KVDataStore &dstore, int list_id, PendingList &list, Stats &stats)
+{
+    PListHeader lhdr = dstore.OnIndexerListHeader(list_id);
+    PListBlockHeader hdr = {};
+    bool new_block;
+
+    if(lhdr.BlockCount == 0){
+       lhdr.BlockCount = 1;
+       hdr.ID = 1;
+       new_block = true;
+       stats.Blocks ++;
+    }
+    else{
+       hdr = dstore.OnIndexerBlockHeader(list_id, lhdr.BlockCount);
+       new_block = false;
+    }
+
+    size_t start = 0;
+    size_t i = 0;
+
+    while(i < list.Postings.size())
+    {
+        // Take the postings fitting in the block. A new block takes at
+        // least one, however large.
+        size_t room = m_Params.BlockSize > hdr.BodySize ? m_Params.BlockSize - hdr.BodySize : 0;
+        size_t end = start;
+        uint32_t FIDmax = hdr.FIDmax;
+
+        while(i < list.Postings.size() &&
+              (list.Postings[i].second - start <= room || (new_block && end == start)))
+        {
+            end = list.Postings[i].second;
+            FIDmax = list.Postings[i].first;
+            i++;
+        }
+
+        if(end > start){
+           hdr.BodySize += static_cast<uint32_t>(end - start);
+           hdr.FIDmax = FIDmax;
+
+           if(new_block)
+              dstore.OnIndexerNewBlock(list_id, lhdr, hdr, list.Data.data() + start, end - start);
+           else
+              dstore.OnIndexerChunk(list_id, lhdr, hdr, list.Data.data() + start, end - start);
+
+           start = end;
+        }
+
+        // Spill over to a new block
+        if(i < list.Postings.size()){
+           lhdr.BlockCount ++;
+           hdr.ID = lhdr.BlockCount;
+           hdr.BodySize = 0;
+           hdr.FIDmax = 0;
+           new_block = true;
+           stats.Blocks ++;
+        }
+    }
+}
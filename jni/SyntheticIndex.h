@@ -0,0 +1,114 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef SYNTHETICINDEX_H
+#define SYNTHETICINDEX_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+
+#include "KVDataStore.h"
+
+/// Generates a synthetic catalog into a datastore by driving its indexer
+/// callbacks the way the engine's indexer does, so that storage changes can
+/// be benchmarked without the desktop tools and real recordings. Each
+/// fingerprint hits a number of index lists drawn from a Zipf distribution,
+/// giving the skewed list lengths of real catalogs. At every flush the
+/// postings of each list are appended to its last block and spill over to
+/// new blocks at the block size, with valid list and block headers (block
+/// count, block IDs, body sizes and max FIDs). The postings and fingerprints
+/// are random bytes, so the catalog can't be used for identification.
+/// The output is deterministic for a given seed.
+
+class SyntheticIndex
+{
+public:
+
+    struct Params
+    {
+        size_t    FIDs;             ///< Number of fingerprints to generate
+        uint32_t  FirstFID;         ///< FID of the first fingerprint
+        size_t    Lists;            ///< Number of index lists (terms)
+        double    Zipf;             ///< Exponent of the list popularity distribution
+        size_t    TermsPerFID;      ///< Mean number of lists hit by a fingerprint
+        size_t    PostingSize;      ///< Mean size of a posting in bytes
+        size_t    BlockSize;        ///< Max size of a block body in bytes
+        size_t    FingerprintSize;  ///< Mean size of a fingerprint in bytes
+        size_t    FlushFIDs;        ///< Fingerprints indexed between flushes
+        uint32_t  Seed;
+
+        Params();
+    };
+
+    struct Stats
+    {
+        size_t    FIDs;             ///< Fingerprints generated
+        uint64_t  Postings;
+        uint64_t  IndexBytes;       ///< Bytes of postings written
+        uint64_t  FingerprintBytes;
+        size_t    Blocks;           ///< New blocks created
+        size_t    Flushes;
+        double    Seconds;
+    };
+
+    typedef std::function<void(const Stats&)> ProgressCallback;
+
+private:
+
+    /// The postings of a list accumulated between flushes
+    struct PendingList
+    {
+        std::vector<uint8_t>                          Data;
+        std::vector< std::pair<uint32_t, size_t> >    Postings;  ///< FID, end offset in Data
+    };
+
+    Params                 m_Params;
+    std::vector<double>    m_ListCDF;     ///< Cumulative list popularity
+    std::vector<int>       m_ListIDs;     ///< List IDs by popularity rank
+    std::vector<uint8_t>   m_Noise;       ///< Random bytes the data is drawn from
+    std::vector<uint8_t>   m_Buffer;
+    std::mt19937           m_Rng;
+    ProgressCallback       m_Progress;
+
+    void Flush(KVDataStore &dstore, std::map<int, PendingList> &pending, Stats &stats);
+
+    void WriteList(KVDataStore &dstore, int list_id, PendingList &list, Stats &stats);
+
+    /// Draw a list ID from the popularity distribution
+    int DrawList();
+
+    /// Draw a size uniformly in [mean/2, 3*mean/2]
+    size_t DrawSize(size_t mean);
+
+    /// Get 'size' random bytes (valid until the next call)
+    const uint8_t* DrawBytes(size_t size);
+
+public:
+
+    explicit SyntheticIndex(const Params &params = Params());
+
+    const Params& GetParams() const { return m_Params; }
+
+    /// Set a function to be called after every flush
+    void SetProgressCallback(const ProgressCallback &callback) { m_Progress = callback; }
+
+    /// Generate the catalog into the given datastore, which must be open for
+    /// BUILD or BUILD_MERGE. When adding to an existing catalog, FirstFID must
+    /// be past its FIDs and the list count must be the same.
+    Stats Generate(KVDataStore &dstore);
+};
+
+
+#endif
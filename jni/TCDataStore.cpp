@@ -24,6 +24,11 @@
 #include <fstream>
 #include <iostream>
 #include <cstdio>
+#include <iterator>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
 
 #include "TCDataStore.h"
 
@@ -39,6 +44,46 @@ inline std::string ToString(const T &val)
     return out.str ();
 }
 
+namespace {
+
+/// Marker recording an index swap in progress. It holds the directory
+/// the databases are moved from.
+const char* SWAP_MARKER = "data.swp";
+
+/// The databases moved by a swap, in order
+const char* SWAP_FILES[] = { "data.inf", "data.idx" };
+
+/// Flush a file or directory to disk
+void SyncPath(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+       throw runtime_error("Couldn't open " + path);
+    int res = fsync(fd);
+    close(fd);
+    if(res != 0)
+       throw runtime_error("Couldn't sync " + path);
+}
+
+/// Move the swapped databases into place. Those already moved by a previous
+/// attempt are skipped.
+void CompleteSwap(const string &dburl, const string &from)
+{
+    for(size_t i=0; i<sizeof(SWAP_FILES)/sizeof(SWAP_FILES[0]); i++)
+        if(std::rename((from + SWAP_FILES[i]).c_str(), (dburl + SWAP_FILES[i]).c_str()) != 0 &&
+           errno != ENOENT)
+           throw runtime_error(string("Couldn't move ") + SWAP_FILES[i] + " into " + dburl);
+
+    SyncPath(dburl);
+
+    if(std::remove((dburl + SWAP_MARKER).c_str()) != 0 && errno != ENOENT)
+       throw runtime_error("Couldn't remove the swap marker in " + dburl);
+
+    SyncPath(dburl);
+}
+
+}
+
 // ----------------------------------------------------------------------------
 
 TCDataStore::TCDataStore(const string &url) :
@@ -48,16 +93,46 @@ TCDataStore::TCDataStore(const string &url) :
     m_DeltaIndex    (this),
     m_Metadata      (this),
     m_Info          (this),
+    m_Journal       (this),
+    m_Tombstones    (this),
     m_ReadBuffer    (32768),
     m_Op            (GET),
     m_Run           (0),
-    m_IsOpen        (false)
+    m_IsOpen        (false),
+    m_DeltaMemoryLimit (0),
+    m_Checkpoints   (false),
+    m_Checkpoint    (),
+    m_LastFID       (0),
+    m_FlushFID      (0),
+    m_JournalRun    (0),
+    m_JournalList   (-1),
+    m_JournalDirty  (false),
+    m_PipelineLimit (0),
+    m_WriteQueue    (4096),
+    m_QueuedBytes   (0),
+    m_Queued        (0),
+    m_Applied       (0),
+    m_WriterRunning (false),
+    m_WriterFailed  (false),
+    m_PurgeThreshold(0),
+    m_Purging       (false),
+    m_Indexing      (false)
 {
     m_MainIndex.SetName("data.idx");
     m_QFingerprints.SetName("data.qfp");
     m_Metadata.SetName("data.met");
     m_Info.SetName("data.inf");
     m_DeltaIndex.SetName("data.tmp");
+    m_Journal.SetName("data.jnl");
+    m_Tombstones.SetName("data.del");
+}
+
+// ----------------------------------------------------------------------------
+
+TCDataStore::~TCDataStore()
+{
+    StopPurge();
+    StopWriter();
 }
 
 // ----------------------------------------------------------------------------
@@ -76,6 +151,16 @@ void TCDataStore::Open(eOperation op, bool use_fing_db, bool use_meta_db, bool u
     m_QFingerprints.SetURL(m_DBURL);
     m_Metadata.SetURL(m_DBURL);
     m_Info.SetURL(m_DBURL);
+    m_Journal.SetURL(m_DBURL);
+    m_Tombstones.SetURL(m_DBURL);
+
+    // Finish an index swap interrupted by a crash before reading the index.
+    // Readers don't move the databases, as the swap may still be running in
+    // another process, and wait for a writer to complete it.
+    if(op != GET)
+       RecoverSwap(m_DBURL);
+    else if(access((m_DBURL + SWAP_MARKER).c_str(), F_OK) == 0)
+       throw runtime_error("Index swap pending in " + m_DBURL);
 
     // Open the main index
     m_MainIndex.Open(open_mode);
@@ -94,6 +179,9 @@ void TCDataStore::Open(eOperation op, bool use_fing_db, bool use_meta_db, bool u
     if(use_info_db)
        m_Info.Open(open_mode);
 
+    // The deleted fingerprints are always loaded, to filter the matches
+    m_Tombstones.Load(open_mode);
+
     m_Op = op;
     m_IsOpen = true;
 }
@@ -102,11 +190,16 @@ void TCDataStore::Open(eOperation op, bool use_fing_db, bool use_meta_db, bool u
 
 void TCDataStore::Close()
 {
+    StopPurge();
+    StopWriter();
+
     m_MainIndex.Close();
     m_DeltaIndex.Close();
     m_QFingerprints.Close();
     m_Metadata.Close();
     m_Info.Close();
+    m_Journal.Close();
+    m_Tombstones.Close();
 
     m_IsOpen=false;
 }
@@ -124,10 +217,61 @@ bool TCDataStore::Empty()
 
 void TCDataStore::Clear()
 {
+    // Clear the checkpoints as well
+    if(m_Checkpoints)
+       OpenCheckpoints();
+
     m_MainIndex.Drop();
     m_QFingerprints.Drop();
     m_Metadata.Drop();
     m_Info.Drop();
+    m_Journal.Drop();
+    m_Tombstones.Clear();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::SwapIndex(const string &dburl, const string &from)
+{
+    if(access((from + "data.idx").c_str(), F_OK) != 0)
+       throw runtime_error("No index in " + from);
+
+    // Record the swap before touching the live databases. The marker is
+    // written aside and renamed, so it's either complete or missing.
+    string marker = dburl + SWAP_MARKER;
+    string tmp = marker + ".tmp";
+    {
+        std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+        out << from;
+        if(!out.flush())
+           throw runtime_error("Couldn't write " + tmp);
+    }
+    SyncPath(tmp);
+
+    if(std::rename(tmp.c_str(), marker.c_str()) != 0)
+       throw runtime_error("Couldn't write " + marker);
+
+    SyncPath(dburl);
+
+    CompleteSwap(dburl, from);
+}
+
+// ----------------------------------------------------------------------------
+
+bool TCDataStore::RecoverSwap(const string &dburl)
+{
+    std::ifstream in((dburl + SWAP_MARKER).c_str(), std::ios::binary);
+    if(!in)
+       return false;
+
+    string from((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    if(from.empty())
+       throw runtime_error("Corrupted swap marker in " + dburl);
+
+    CompleteSwap(dburl, from);
+    return true;
 }
 
 // ----------------------------------------------------------------------------
@@ -140,6 +284,188 @@ void TCDataStore::SetOpMode(KVDataStore::eOperation mode)
 
 // ----------------------------------------------------------------------------
 
+void TCDataStore::SetBlockCacheLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_IndexMutex);
+    m_MainIndex.SetBlockCacheLimit(bytes);
+    m_DeltaIndex.SetBlockCacheLimit(bytes);
+}
+
+// ----------------------------------------------------------------------------
+
+size_t TCDataStore::GetCacheUsed()
+{
+    // In pipelined builds the caches are being filled by the writer thread
+    std::lock_guard<std::mutex> lock(m_IndexMutex);
+    return m_MainIndex.GetCacheUsed() + m_DeltaIndex.GetCacheUsed();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::SpillDelta()
+{
+    std::lock_guard<std::mutex> lock(m_IndexMutex);
+    m_DeltaIndex.Spill();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::DeleteFingerprint(uint32_t FID)
+{
+    if(m_Op == GET)
+       throw invalid_argument("DeleteFingerprint(): Invalid operation (GET)");
+
+    m_Tombstones.Add(FID);
+
+    if(m_PurgeThreshold && !m_Indexing &&
+       m_Tombstones.GetPending() >= m_PurgeThreshold)
+       StartPurge();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t TCDataStore::Purge()
+{
+    if(m_Op == GET)
+       throw invalid_argument("Purge(): Invalid operation (GET)");
+
+    if(m_Indexing)
+       throw logic_error("Purge(): Indexing session in progress");
+
+    // The deleted fingerprints can't be marked as purged unless their data
+    // is removed, and the live FIDs are those of the stored fingerprints
+    if(!m_QFingerprints.IsOpen() || !m_Metadata.IsOpen())
+       return 0;
+
+    // Deletions made from now on are left to the next purge
+    vector<uint32_t> deleted = m_Tombstones.GetFIDs();
+    vector<uint32_t> pending = m_Tombstones.GetPendingFIDs();
+
+    if(pending.empty())
+       return 0;
+
+    vector<uint32_t> live;
+    vector<uint8_t> key;
+
+    m_QFingerprints.IterInit();
+    while(m_QFingerprints.IterNext(key))
+        if(key.size() == sizeof(uint32_t)){
+           uint32_t fid = *reinterpret_cast<const uint32_t*>(key.data());
+           if(!std::binary_search(deleted.begin(), deleted.end(), fid))
+              live.push_back(fid);
+        }
+
+    std::sort(live.begin(), live.end());
+
+    // Find the lists (every list has a first block)
+    vector<int> lists;
+    {
+        std::lock_guard<std::mutex> lock(m_IndexMutex);
+        m_MainIndex.IterInit();
+        while(m_MainIndex.IterNext(key))
+            if(key.size() == sizeof(int)*2 &&
+               *reinterpret_cast<const int*>(key.data() + sizeof(int)) == 1)
+               lists.push_back(*reinterpret_cast<const int*>(key.data()));
+    }
+
+    size_t removed = 0;
+
+    for(size_t i=0; i<lists.size(); i++){
+        std::lock_guard<std::mutex> lock(m_IndexMutex);
+        removed += m_MainIndex.PurgeList(lists[i], live);
+    }
+
+    m_MainIndex.Sync();
+
+    for(size_t i=0; i<pending.size(); i++){
+        m_QFingerprints.DeleteFingerprint(pending[i]);
+        m_Metadata.Delete(pending[i]);
+    }
+
+    m_Tombstones.SetPurged(pending);
+
+    return removed;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::StartPurge()
+{
+    if(m_Purging.exchange(true))
+       return;
+
+    if(m_Purger.joinable())
+       m_Purger.join();
+
+    m_Purger = std::thread([this](){
+        try{
+           Purge();
+        }
+        catch(...){
+           std::lock_guard<std::mutex> lock(m_WaitMutex);
+           m_PurgeError = std::current_exception();
+        }
+        m_Purging = false;
+    });
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::CheckPurge()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_WaitMutex);
+        error.swap(m_PurgeError);
+    }
+    if(error)
+       std::rethrow_exception(error);
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::StopPurge()
+{
+    if(m_Purger.joinable())
+       m_Purger.join();
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t TCDataStore::Warm()
+{
+    uint64_t nbytes = 0;
+    vector<uint8_t> key, value;
+
+    m_MainIndex.IterInit();
+    while(m_MainIndex.IterNext(key, value))
+        nbytes += key.size() + value.size();
+
+    return nbytes;
+}
+
+// ----------------------------------------------------------------------------
+
+DataStoreStats TCDataStore::GetStats() const
+{
+    DataStoreStats stats;
+    stats.Index = m_MainIndex.GetStats();
+    stats.Fingerprints = m_QFingerprints.GetStats();
+    stats.Metadata = m_Metadata.GetStats();
+    return stats;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::ResetStats()
+{
+    m_MainIndex.ResetStats();
+    m_QFingerprints.ResetStats();
+    m_Metadata.ResetStats();
+}
+
+// ----------------------------------------------------------------------------
+
 size_t TCDataStore::GetFingerprintsCount()
 {
     return m_QFingerprints.GetRecordsCount();
@@ -162,11 +488,45 @@ void TCDataStore::OnIndexerStart()
     if(m_Op == GET)
        throw invalid_argument("OnIndexerStart(): Invalid operation (GET)");
 
-     if(m_Op == BUILD_MERGE)
-        m_DeltaIndex.Open(OPEN_READ_WRITE);
+     // Blocks may be removed by a purge
+     StopPurge();
+     CheckPurge();
+
+     // Set beforehand so that no purge is started during the setup, and
+     // cleared if the setup fails, as OnIndexerEnd() won't be called.
+     m_Indexing = true;
 
-     m_Run = 0;
+     try{
+        if(m_Op == BUILD_MERGE){
+           if(m_DeltaMemoryLimit)
+              m_DeltaIndex.OpenResident(m_DeltaMemoryLimit);
+           else
+              m_DeltaIndex.Open(OPEN_READ_WRITE);
+        }
 
+        m_Run = 0;
+
+        if(m_Checkpoints && m_Op == BUILD){
+           OpenCheckpoints();
+
+           // Indexing on top of the leftovers of a failed session would
+           // leave them in the index for good
+           if(m_Journal.GetRecordsCount() > 0)
+              throw runtime_error("OnIndexerStart(): Unfinished session found (Resume() or Clear() the datastore)");
+
+           m_Checkpoint = m_Info.ReadCheckpoint();
+           m_LastFID = m_FlushFID = m_Checkpoint.LastFID;
+        }
+        else
+           m_Journal.Close();
+
+        if(m_PipelineLimit)
+           StartWriter();
+     }
+     catch(...){
+        m_Indexing = false;
+        throw;
+     }
 }
 
 // ----------------------------------------------------------------------------
@@ -179,6 +539,15 @@ void TCDataStore::OnIndexerEnd()
     // NOTE: The merge operations should be performed in one single transaction
     //       across all data stores hosting the live index.
 
+    m_Indexing = false;
+
+    // Wait for the pending writes
+    if(m_Writer.joinable()){
+       Drain();
+       StopWriter();
+       CheckWriter();
+    }
+
     if(m_Op == BUILD_MERGE)
     {
        std::cout << "Merging..." << std::endl;
@@ -188,12 +557,22 @@ void TCDataStore::OnIndexerEnd()
        //std::cout << ("Clearing delta index...") << std::endl;
        //m_DeltaIndex.Drop();
 
-       std::cout << "Deleting delta index..." << std::endl;
+       bool on_disk = !m_DeltaIndex.IsResident();
 
        m_DeltaIndex.Close();
-       if(std::remove( m_DeltaIndex.GetName().c_str() ))
-          std::cout<<"Couldn't remove "<<m_DeltaIndex.GetName()<<std::endl;
+
+       if(on_disk){
+          std::cout << "Deleting delta index..." << std::endl;
+
+          string delta_url = m_DeltaIndex.GetURL() + m_DeltaIndex.GetName();
+          if(std::remove( delta_url.c_str() ))
+             std::cout<<"Couldn't remove "<<delta_url<<std::endl;
+       }
     }
+
+    // Deletions made during the session
+    if(m_PurgeThreshold && m_Tombstones.GetPending() >= m_PurgeThreshold)
+       StartPurge();
 }
 
 // ----------------------------------------------------------------------------
@@ -204,13 +583,51 @@ void TCDataStore::OnIndexerFlushStart()
 
     m_Run ++;
 
+    // All the fingerprints received so far go in this flush
+    m_FlushFID = m_LastFID;
+
+    if(m_Writer.joinable()){
+       WriteOp op;
+       op.Type = WriteOp::FLUSH_START;
+       Enqueue(op);
+    }
+    else
+       WriteFlushStart();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::OnIndexerFlushEnd()
+{
+    // The end of a flush is a barrier for the writer thread, as the
+    // headers read in the next flush must reflect all the writes.
+    if(m_Writer.joinable()){
+       WriteOp op;
+       op.Type = WriteOp::FLUSH_END;
+       Enqueue(op);
+       Drain();
+    }
+    else
+       WriteFlushEnd();
+
+    if(m_Journal.IsOpen())
+       WriteCheckpoint();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::WriteFlushStart()
+{
     m_MainIndex.ClearCache();
     m_DeltaIndex.ClearCache();
+
+    m_JournalRun = m_Checkpoint.Flushes + 1;
+    m_JournalList = -1;
 }
 
 // ----------------------------------------------------------------------------
 
-void TCDataStore::OnIndexerFlushEnd()
+void TCDataStore::WriteFlushEnd()
 {
     // Flush the block cache to the database
     if(m_Op == BUILD)
@@ -230,6 +647,9 @@ PListHeader TCDataStore::OnIndexerListHeader(int list_id)
     // NOTE: This rudimentary headers update mechanism can be more efficiently
     //       implemented using in-memory caching.
 
+    // In pipelined builds the writer thread may be writing other lists
+    std::lock_guard<std::mutex> lock(m_IndexMutex);
+
     if(m_Op == BUILD_MERGE){
        if(m_Run == 1)
           return m_MainIndex.GetPListHeader(list_id);
@@ -248,6 +668,8 @@ PListHeader TCDataStore::OnIndexerListHeader(int list_id)
 
 PListBlockHeader TCDataStore::OnIndexerBlockHeader(int list_id, int block)
 {
+    std::lock_guard<std::mutex> lock(m_IndexMutex);
+
     if(m_Op == BUILD_MERGE){
        if(m_Run == 1)
           return m_MainIndex.GetPListBlockHeader(list_id, block);
@@ -269,12 +691,20 @@ void TCDataStore::OnIndexerChunk(int list_id,
                                  PListBlockHeader &hdr,
                                  uint8_t* data, size_t data_size)
 {
-    if(m_Op == BUILD_MERGE)
-       m_DeltaIndex.AppendChunk(list_id, lhdr, hdr, data, data_size);
-    else if(m_Op == BUILD)
-       m_MainIndex.AppendChunk(list_id, lhdr, hdr, data, data_size);
-    else
+    if(m_Op == GET)
        throw invalid_argument("OnIndexerChunkAppend(): Invalid operation");
+
+    if(m_Writer.joinable()){
+       WriteOp op;
+       op.Type = WriteOp::CHUNK;
+       op.ListID = list_id;
+       op.ListHeader = lhdr;
+       op.Header = hdr;
+       op.Data.assign(data, data + data_size);
+       Enqueue(op);
+    }
+    else
+       WriteChunk(list_id, lhdr, hdr, data, data_size, false);
 }
 
 // ----------------------------------------------------------------------------
@@ -284,19 +714,376 @@ void TCDataStore::OnIndexerNewBlock(int list_id,
                                     PListBlockHeader &hdr,
                                     uint8_t* data, size_t data_size)
 {
-    if(m_Op == BUILD_MERGE)
-       m_DeltaIndex.AppendChunk(list_id, lhdr, hdr, data, data_size, true);
-    else if(m_Op == BUILD)
-       m_MainIndex.AppendChunk(list_id, lhdr, hdr, data, data_size, true);
-    else
+    if(m_Op == GET)
        throw invalid_argument("OnIndexerChunkNewBlock(): Invalid operation");
+
+    if(m_Writer.joinable()){
+       WriteOp op;
+       op.Type = WriteOp::NEW_BLOCK;
+       op.ListID = list_id;
+       op.ListHeader = lhdr;
+       op.Header = hdr;
+       op.Data.assign(data, data + data_size);
+       Enqueue(op);
+    }
+    else
+       WriteChunk(list_id, lhdr, hdr, data, data_size, true);
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::WriteChunk(int list_id,
+                             PListHeader &lhdr,
+                             PListBlockHeader &hdr,
+                             uint8_t* data, size_t data_size,
+                             bool new_block)
+{
+    if(m_Op == BUILD_MERGE)
+       m_DeltaIndex.AppendChunk(list_id, lhdr, hdr, data, data_size, new_block);
+    else{
+       if(m_Journal.IsOpen())
+          Journal(list_id, hdr, new_block);
+       m_MainIndex.AppendChunk(list_id, lhdr, hdr, data, data_size, new_block);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::OpenCheckpoints()
+{
+    if(!m_Info.IsOpen())
+       m_Info.Open(OPEN_READ_WRITE);
+
+    if(!m_Journal.IsOpen())
+       m_Journal.Open(OPEN_READ_WRITE);
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::Journal(int list_id, PListBlockHeader &hdr, bool new_block)
+{
+    // NOTE: The journal entries must be on disk before the blocks they
+    //       cover are written. These are held in the block cache, so the
+    //       entries are synced in one go before the cache is written out
+    //       (see SyncJournal()).
+
+    TCJournal::Entry &entry = m_JournalEntry;
+    bool changed = false;
+
+    if(list_id != m_JournalList){
+       // A list is saved the first time it's modified by a flush. The
+       // index still holds its state as of the last checkpoint.
+       if(!m_Journal.Read(list_id, entry) || entry.Run != m_JournalRun){
+          entry = TCJournal::Entry();
+          entry.Run = m_JournalRun;
+          entry.ListHeader = m_MainIndex.GetPListHeader(list_id);
+          if(entry.ListHeader.BlockCount){
+             entry.LastBlock = m_MainIndex.GetPListBlockHeader(list_id, entry.ListHeader.BlockCount);
+             entry.LastSize = m_MainIndex.GetBlockSize(list_id, entry.ListHeader.BlockCount);
+          }
+          entry.MaxBlockID = entry.ListHeader.BlockCount;
+          changed = true;
+       }
+       m_JournalList = list_id;
+    }
+
+    if(new_block && hdr.ID > entry.MaxBlockID){
+       entry.MaxBlockID = hdr.ID;
+       changed = true;
+    }
+
+    if(changed){
+       m_Journal.Write(list_id, entry);
+       m_JournalDirty = true;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::SyncJournal()
+{
+    if(!m_JournalDirty)
+       return;
+
+    m_Journal.Sync();
+    m_JournalDirty = false;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::WriteCheckpoint()
+{
+    // The index data must be on disk before the checkpoint is
+    m_MainIndex.Sync();
+
+    if(m_QFingerprints.IsOpen())
+       m_QFingerprints.Sync();
+
+    m_Checkpoint.LastFID = m_FlushFID;
+    m_Checkpoint.Flushes ++;
+
+    m_Info.WriteCheckpoint(m_Checkpoint);
+    m_Info.Sync();
+
+    // The journal entries are tagged with their flush, so they're
+    // harmless if we die before they are cleared.
+    m_Journal.Drop();
+    m_JournalDirty = false;
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t TCDataStore::Resume()
+{
+    if(m_Op != BUILD)
+       throw invalid_argument("Resume(): Invalid operation (BUILD only)");
+
+    OpenCheckpoints();
+
+    m_Checkpoint = m_Info.ReadCheckpoint();
+
+    vector<uint8_t> key, value;
+
+    m_Journal.IterInit();
+    while(m_Journal.IterNext(key, value))
+    {
+        if(key.size() != sizeof(int) || value.size() != sizeof(TCJournal::Entry))
+           continue;
+
+        const TCJournal::Entry &entry = *reinterpret_cast<const TCJournal::Entry*>(value.data());
+
+        // Lists modified by the unfinished flush
+        if(entry.Run > m_Checkpoint.Flushes)
+           Rollback(*reinterpret_cast<const int*>(key.data()), entry);
+    }
+
+    m_MainIndex.Sync();
+    m_Journal.Drop();
+    m_Journal.Close();
+
+    return m_Checkpoint.LastFID;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::Rollback(int list_id, const TCJournal::Entry &entry)
+{
+    uint32_t nblocks = entry.ListHeader.BlockCount;
+
+    // Remove the blocks created by the flush (all of them if the list is new)
+    for(uint32_t id = nblocks + 1; id <= entry.MaxBlockID; id++)
+        m_MainIndex.DeleteBlock(list_id, id);
+
+    if(nblocks == 0)
+       return;
+
+    // Truncate the last block to its previous size and restore its header
+    vector<uint8_t> block;
+    size_t size = m_MainIndex.ReadBlock(list_id, nblocks, block);
+    size = std::min<size_t>(size, entry.LastSize);
+
+    size_t hoff = nblocks==1 ? sizeof(PListHeader) : 0;
+
+    if(size < hoff + sizeof(PListBlockHeader))
+       return;
+
+    *reinterpret_cast<PListBlockHeader*>(block.data() + hoff) = entry.LastBlock;
+
+    if(nblocks == 1)
+       *reinterpret_cast<PListHeader*>(block.data()) = entry.ListHeader;
+
+    m_MainIndex.WriteBlock(list_id, nblocks, block, size);
+
+    // Restore the block count in the list header
+    if(nblocks > 1){
+       size = m_MainIndex.ReadBlock(list_id, 1, block);
+       if(size >= sizeof(PListHeader)){
+          *reinterpret_cast<PListHeader*>(block.data()) = entry.ListHeader;
+          m_MainIndex.WriteBlock(list_id, 1, block, size);
+       }
+    }
 }
 
 // ----------------------------------------------------------------------------
 
 void TCDataStore::OnIndexerFingerprint(uint32_t FID, uint8_t *data, size_t size)
 {
-    m_QFingerprints.WriteFingerprint(FID, data, size);
+    TrackFingerprint(FID);
+
+    if(m_Writer.joinable()){
+       WriteOp op;
+       op.Type = WriteOp::FINGERPRINT;
+       op.FID = FID;
+       op.Data.assign(data, data + size);
+       Enqueue(op);
+    }
+    else
+       m_QFingerprints.WriteFingerprint(FID, data, size);
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::Enqueue(WriteOp &op)
+{
+    CheckWriter();
+
+    size_t size = op.Data.size();
+
+    {
+        std::unique_lock<std::mutex> lock(m_WaitMutex);
+
+        // Back-pressure: wait for the writer to catch up if too much data is
+        // queued (a write larger than the limit is let through on its own).
+        m_DoneCond.wait(lock, [this, size](){
+            return m_WriterFailed ||
+                   ((m_QueuedBytes == 0 || m_QueuedBytes + size <= m_PipelineLimit) &&
+                     m_WriteQueue.Size() < m_WriteQueue.Capacity());
+        });
+
+        if(!m_WriterFailed){
+           m_QueuedBytes += size;
+           m_Queued ++;
+
+           bool pushed = m_WriteQueue.Push(op);
+           assert(pushed);
+        }
+    }
+
+    CheckWriter();
+
+    m_WorkCond.notify_one();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::Drain()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_WaitMutex);
+        m_DoneCond.wait(lock, [this](){ return m_WriterFailed || m_Applied == m_Queued; });
+    }
+    CheckWriter();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::Apply(WriteOp &op)
+{
+    switch(op.Type)
+    {
+       case WriteOp::CHUNK:
+       case WriteOp::NEW_BLOCK:
+            WriteChunk(op.ListID, op.ListHeader, op.Header,
+                       op.Data.data(), op.Data.size(),
+                       op.Type == WriteOp::NEW_BLOCK);
+            break;
+       case WriteOp::FINGERPRINT:
+            m_QFingerprints.WriteFingerprint(op.FID, op.Data.data(), op.Data.size());
+            break;
+       case WriteOp::FLUSH_START:
+            WriteFlushStart();
+            break;
+       case WriteOp::FLUSH_END:
+            WriteFlushEnd();
+            break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::WriterLoop()
+{
+    WriteOp op;
+
+    for(;;)
+    {
+        size_t nops = 0, nbytes = 0;
+
+        // Apply the queued writes in batches, releasing the index
+        // in between so that the indexer can read the headers.
+        try{
+           std::lock_guard<std::mutex> lock(m_IndexMutex);
+           while(nops < 256 && m_WriteQueue.Pop(op)){
+               nbytes += op.Data.size();
+               nops ++;
+               Apply(op);
+           }
+        }
+        catch(...){
+           std::lock_guard<std::mutex> lock(m_WaitMutex);
+           m_WriterError = std::current_exception();
+           m_WriterFailed = true;
+           m_DoneCond.notify_all();
+           return;
+        }
+
+        // The counters are updated under the lock, so that the threads
+        // checking them can't miss the notification.
+        if(nops){
+           {
+               std::lock_guard<std::mutex> lock(m_WaitMutex);
+               m_QueuedBytes -= nbytes;
+               m_Applied += nops;
+           }
+           m_DoneCond.notify_all();
+           continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_WaitMutex);
+
+        if(!m_WriterRunning && m_WriteQueue.Empty())
+           break;
+
+        m_WorkCond.wait(lock, [this](){ return !m_WriterRunning || !m_WriteQueue.Empty(); });
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::StartWriter()
+{
+    StopWriter();
+
+    // Discard the writes left over by a writer that failed, so they are
+    // not replayed into this session. The writer is stopped, so this
+    // thread can consume the queue.
+    WriteOp op;
+    while(m_WriteQueue.Pop(op));
+
+    m_QueuedBytes = 0;
+    m_Queued = 0;
+    m_Applied = 0;
+    m_WriterError = std::exception_ptr();
+    m_WriterFailed = false;
+    m_WriterRunning = true;
+
+    m_Writer = std::thread(&TCDataStore::WriterLoop, this);
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::StopWriter()
+{
+    if(!m_Writer.joinable())
+       return;
+
+    // The writer exits once the queue is empty
+    {
+        std::lock_guard<std::mutex> lock(m_WaitMutex);
+        m_WriterRunning = false;
+    }
+    m_WorkCond.notify_one();
+    m_Writer.join();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCDataStore::CheckWriter()
+{
+    if(m_WriterFailed){
+       std::lock_guard<std::mutex> lock(m_WaitMutex);
+       std::rethrow_exception(m_WriterError);
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -333,6 +1120,7 @@ TCCollection::TCCollection(TCDataStore *datastore) :
     m_DBHandle  (),
     m_Datastore (datastore),
     m_IsOpen    (false),
+    m_Concurrent(false),
     m_Buffer    (32768)
 {
 }
@@ -364,6 +1152,9 @@ void TCCollection::Open(int mode)
 
     m_DBHandle = tchdbnew();
 
+    if(m_Concurrent)
+       tchdbsetmutex(m_DBHandle);
+
     tchdbtune(m_DBHandle, 1000000, 4, 10, HDBTLARGE);
     tchdbsetcache(m_DBHandle, 1000000);
 
@@ -407,11 +1198,96 @@ void TCCollection::Drop()
 
 // ----------------------------------------------------------------------------
 
+void TCCollection::Sync()
+{
+    if(m_DBHandle && !tchdbsync(m_DBHandle)){
+       CHECK_OP(m_DBHandle)
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 uint64_t TCCollection::GetRecordsCount() const
 {
     return m_DBHandle ? tchdbrnum(m_DBHandle) : 0;
 }
 
+// ----------------------------------------------------------------------------
+
+void TCCollection::IterInit()
+{
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Database "+m_DBName+" not open");
+
+    if(!tchdbiterinit(m_DBHandle)){
+       CHECK_OP(m_DBHandle)
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+bool TCCollection::IterNext(vector<uint8_t> &key, vector<uint8_t> &value)
+{
+    int ksize, vsize;
+    void *pkey, *pval = nullptr;
+
+    // NOTE: Records deleted while iterating are skipped.
+    while((pkey = tchdbiternext(m_DBHandle, &ksize)))
+    {
+        pval = tchdbget(m_DBHandle, pkey, ksize, &vsize);
+        if(pval) break;
+        tcfree(pkey);
+    }
+
+    if(pkey == nullptr)
+       return false;
+
+    uint8_t *pk = static_cast<uint8_t*>(pkey);
+    uint8_t *pv = static_cast<uint8_t*>(pval);
+
+    key.assign(pk, pk + ksize);
+    value.assign(pv, pv + vsize);
+
+    tcfree(pval);
+    tcfree(pkey);
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+bool TCCollection::IterNext(vector<uint8_t> &key)
+{
+    int ksize;
+    void *pkey = tchdbiternext(m_DBHandle, &ksize);
+
+    if(pkey == nullptr)
+       return false;
+
+    uint8_t *pk = static_cast<uint8_t*>(pkey);
+    key.assign(pk, pk + ksize);
+    tcfree(pkey);
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t TCCollection::GetRecordSize(const vector<uint8_t> &key)
+{
+    int vsize = tchdbvsiz(m_DBHandle, key.data(), key.size());
+    return vsize > 0 ? static_cast<size_t>(vsize) : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t TCCollection::ReadRecord(const vector<uint8_t> &key, uint8_t *data, size_t size)
+{
+    assert(data);
+    int rsize = tchdbget3(m_DBHandle, key.data(), key.size(), data, size);
+    return rsize > 0 ? static_cast<size_t>(rsize) : 0;
+}
+
 
 
 //=============================================================================
@@ -421,12 +1297,61 @@ uint64_t TCCollection::GetRecordsCount() const
 
 
 TCIndex::TCIndex(TCDataStore *dstore) :
-    TCCollection (dstore)
+    TCCollection   (dstore),
+    m_RecordsSize  (0),
+    m_RecordsLimit (0),
+    m_Resident     (false),
+    m_BlocksCacheLimit (0)
 {
 }
 
 // ----------------------------------------------------------------------------
 
+void TCIndex::OpenResident(size_t limit)
+{
+    if(m_IsOpen)
+       Close();
+
+    m_RecordsLimit = limit;
+    m_Resident = true;
+    m_IsOpen = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCIndex::Spill()
+{
+    if(!m_Resident)
+       return;
+
+    m_Resident = false;
+    m_IsOpen = false;
+
+    Open(OPEN_READ_WRITE);
+
+    record_map::iterator it = m_Records.begin();
+    for(; it != m_Records.end(); ++it)
+        WriteBlock(static_cast<int>(it->first >> 32),
+                   static_cast<int>(it->first & 0xFFFFFFFF),
+                   it->second, it->second.size());
+
+    m_Records.clear();
+    m_RecordsSize = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCIndex::Close()
+{
+    m_Records.clear();
+    m_RecordsSize = 0;
+    m_Resident = false;
+
+    TCCollection::Close();
+}
+
+// ----------------------------------------------------------------------------
+
 PListHeader TCIndex::GetPListHeader(int list_id)
 {
     int res, bsize;
@@ -434,6 +1359,13 @@ PListHeader TCIndex::GetPListHeader(int list_id)
 
     PListHeader hdr = {};
 
+    if(m_Resident){
+       record_map::const_iterator it = m_Records.find(BlockKey(list_id, 1));
+       if(it != m_Records.end())
+          hdr = *reinterpret_cast<const PListHeader*>(it->second.data());
+       return hdr;
+    }
+
     char key[sizeof(int)*2];
 
     // Make the key to the block <listID|blockID>
@@ -444,8 +1376,9 @@ PListHeader TCIndex::GetPListHeader(int list_id)
     block = tchdbget(m_DBHandle, key, sizeof(key), &bsize);
 
     // Block found
+    // NOTE: First blocks in the delta index may hold the list header only.
     if(block){
-       assert(bsize > sizeof(PListHeader) + sizeof(PListBlockHeader));
+       assert(bsize >= sizeof(PListHeader));
        hdr = *reinterpret_cast<PListHeader*>(block);
        tcfree(block);
     }
@@ -462,6 +1395,15 @@ PListBlockHeader TCIndex::GetPListBlockHeader(int list_id, int block_id)
 
     PListBlockHeader hdr = {};
 
+    if(m_Resident){
+       // Skip list header if first block (first blocks may hold it only)
+       size_t hoff = block_id==1 ? sizeof(PListHeader) : 0;
+       record_map::const_iterator it = m_Records.find(BlockKey(list_id, block_id));
+       if(it != m_Records.end() && it->second.size() > hoff)
+          hdr = *reinterpret_cast<const PListBlockHeader*>(it->second.data() + hoff);
+       return hdr;
+    }
+
     char key[sizeof(int)*2];
 
     // Make the key to the block <listID|blockID>
@@ -474,14 +1416,14 @@ PListBlockHeader TCIndex::GetPListBlockHeader(int list_id, int block_id)
     if(block){
         int hoff = 0;
         // Skip list header if first block
-        if(block_id==1){
+        if(block_id==1)
            hoff = sizeof(PListHeader);
-           assert(bsize > sizeof(PListHeader) + sizeof(PListBlockHeader));
-        }else
-           assert(bsize > sizeof(PListBlockHeader));
 
-        uint8_t *pdata = reinterpret_cast<uint8_t*>(block);
-        hdr = *reinterpret_cast<PListBlockHeader*>(pdata + hoff);
+        // Header only first blocks (delta index) have no block header
+        if(bsize >= hoff + sizeof(PListBlockHeader)){
+           uint8_t *pdata = reinterpret_cast<uint8_t*>(block);
+           hdr = *reinterpret_cast<PListBlockHeader*>(pdata + hoff);
+        }
 
        tcfree(block);
     }
@@ -497,6 +1439,27 @@ size_t TCIndex::ReadBlock(int list_id, int block_id, vector<uint8_t> &buffer, bo
     void *block;
     size_t off=0;
 
+    uint64_t t0 = StatsCounters::Now();
+
+    if(m_Resident){
+       record_map::const_iterator it = m_Records.find(BlockKey(list_id, block_id));
+       if(it == m_Records.end()){
+          m_Stats.Record(0, 0, StatsCounters::Now() - t0, true, false);
+          return 0;
+       }
+       if(!headers)
+          off = block_id==1 ? sizeof(PListHeader) +
+                              sizeof(PListBlockHeader)
+                            :
+                              sizeof(PListBlockHeader);
+       size_t rbytes = it->second.size() > off ? it->second.size() - off : 0;
+       if(rbytes > buffer.size())
+          buffer.resize(rbytes);
+       std::copy(it->second.begin() + off, it->second.begin() + off + rbytes, buffer.begin());
+       m_Stats.Record(rbytes, 0, StatsCounters::Now() - t0, true, true);
+       return rbytes;
+    }
+
     char key[sizeof(int)*2];
 
     // Make the key to the block <list_id|blockID>
@@ -505,7 +1468,9 @@ size_t TCIndex::ReadBlock(int list_id, int block_id, vector<uint8_t> &buffer, bo
 
     block = tchdbget(m_DBHandle, key, sizeof(key), &bsize);
 
+    uint64_t t1 = StatsCounters::Now();
     size_t rbytes = 0;
+    bool found = block != nullptr;
 
     if(block){
         if(!headers)
@@ -524,6 +1489,8 @@ size_t TCIndex::ReadBlock(int list_id, int block_id, vector<uint8_t> &buffer, bo
        tcfree(block);
     }
 
+    m_Stats.Record(rbytes, t1 - t0, StatsCounters::Now() - t1, false, found);
+
     return rbytes;
 }
 
@@ -536,6 +1503,16 @@ void TCIndex::WriteBlock(int list_id, int block_id, std::vector<uint8_t> &buffer
     assert(!buffer.empty());
     assert(data_size <= buffer.size());
 
+    if(m_Resident){
+       vector<uint8_t> &record = m_Records[BlockKey(list_id, block_id)];
+       m_RecordsSize += data_size;
+       m_RecordsSize -= record.size();
+       record.assign(buffer.begin(), buffer.begin() + data_size);
+       if(m_RecordsSize > m_RecordsLimit)
+          Spill();
+       return;
+    }
+
     char key[sizeof(int)*2];
 
     // Make the key to the block <listID|blockID>
@@ -550,6 +1527,120 @@ void TCIndex::WriteBlock(int list_id, int block_id, std::vector<uint8_t> &buffer
 
 // ----------------------------------------------------------------------------
 
+size_t TCIndex::PurgeList(int list_id, const vector<uint32_t> &live)
+{
+    PListHeader lhdr = GetPListHeader(list_id);
+
+    if(lhdr.BlockCount == 0)
+       return 0;
+
+    // The blocks kept, with their original IDs and without the list header
+    vector< pair<uint32_t, vector<uint8_t> > > kept;
+    uint32_t fid_min = 0;
+
+    for(uint32_t id=1; id<=lhdr.BlockCount; id++)
+    {
+        vector<uint8_t> block;
+        size_t size = ReadBlock(list_id, id, block);
+        size_t hoff = id==1 ? sizeof(PListHeader) : 0;
+
+        // Leave inconsistent lists alone
+        if(size < hoff + sizeof(PListBlockHeader))
+           return 0;
+
+        block.resize(size);
+
+        // The block holds FIDs in (fid_min, FIDmax]. It's dead if none of
+        // them is live. FIDs need not be contiguous, so the range is checked
+        // against the live set rather than counting the deleted ones.
+        uint32_t fid_max = reinterpret_cast<const PListBlockHeader*>(block.data() + hoff)->FIDmax;
+
+        size_t nlive = std::upper_bound(live.begin(), live.end(), fid_max) -
+                       std::upper_bound(live.begin(), live.end(), fid_min);
+
+        if(fid_max <= fid_min || nlive > 0){
+           block.erase(block.begin(), block.begin() + hoff);
+           kept.push_back(std::make_pair(id, vector<uint8_t>()));
+           kept.back().second.swap(block);
+        }
+
+        fid_min = std::max(fid_min, fid_max);
+    }
+
+    size_t removed = lhdr.BlockCount - kept.size();
+
+    if(removed == 0)
+       return 0;
+
+    // Renumber the blocks kept. Those that don't move are only rewritten
+    // if they're the first (the block count changes).
+    for(size_t i=0; i<kept.size(); i++)
+    {
+        uint32_t id = static_cast<uint32_t>(i + 1);
+        vector<uint8_t> &block = kept[i].second;
+
+        if(kept[i].first == id && id != 1)
+           continue;
+
+        reinterpret_cast<PListBlockHeader*>(block.data())->ID = id;
+
+        if(id == 1){
+           PListHeader hdr = { static_cast<uint32_t>(kept.size()) };
+           const uint8_t *phdr = reinterpret_cast<const uint8_t*>(&hdr);
+           block.insert(block.begin(), phdr, phdr + sizeof(PListHeader));
+        }
+
+        WriteBlock(list_id, id, block, block.size());
+    }
+
+    for(uint32_t id = static_cast<uint32_t>(kept.size()) + 1; id <= lhdr.BlockCount; id++)
+        DeleteBlock(list_id, id);
+
+    return removed;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t TCIndex::GetBlockSize(int list_id, int block_id)
+{
+    if(m_Resident){
+       record_map::const_iterator it = m_Records.find(BlockKey(list_id, block_id));
+       return it != m_Records.end() ? it->second.size() : 0;
+    }
+
+    char key[sizeof(int)*2];
+
+    *reinterpret_cast<int*>(key) = list_id;
+    *reinterpret_cast<int*>(key + sizeof(int)) = block_id;
+
+    int bsize = tchdbvsiz(m_DBHandle, key, sizeof(key));
+    return bsize > 0 ? static_cast<size_t>(bsize) : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCIndex::DeleteBlock(int list_id, int block_id)
+{
+    if(m_Resident){
+       record_map::iterator it = m_Records.find(BlockKey(list_id, block_id));
+       if(it != m_Records.end()){
+          m_RecordsSize -= it->second.size();
+          m_Records.erase(it);
+       }
+       return;
+    }
+
+    char key[sizeof(int)*2];
+
+    *reinterpret_cast<int*>(key) = list_id;
+    *reinterpret_cast<int*>(key + sizeof(int)) = block_id;
+
+    // Missing blocks are fine (never written)
+    tchdbout(m_DBHandle, key, sizeof(key));
+}
+
+// ----------------------------------------------------------------------------
+
 void TCIndex::AppendChunk(int list_id,
                           PListHeader &lhdr,
                           PListBlockHeader &hdr,
@@ -565,18 +1656,18 @@ void TCIndex::AppendChunk(int list_id,
     if(list_id != m_BlocksCache.list_id){
 
        // Schedule blocks for batch write.
-       block_map::iterator iblock = m_BlocksCache.buffer.begin();
-       for (; iblock != m_BlocksCache.buffer.end(); ++iblock)
-           WriteBlock(m_BlocksCache.list_id, iblock->first, iblock->second, iblock->second.size());
+       WriteBlockCache();
 
        // Reset cache for current list
        m_BlocksCache.list_id = list_id;
-       m_BlocksCache.buffer.clear();
     }
 
     // Get block from cache (create new one if not found)
     vector<uint8_t> &block = m_BlocksCache.buffer[hdr.ID];
 
+    // The accumulator keeps track of the cached bytes
+    m_BlocksCache.accum -= block.size();
+
     // Read block from database if not in cache and not new
     if(block.empty() && !new_block)
        ReadBlock(list_id, hdr.ID, block);
@@ -601,11 +1692,34 @@ void TCIndex::AppendChunk(int list_id,
     // Append chunk
     block.insert(block.end(), chunk, chunk + chunk_size);
 
+    m_BlocksCache.accum += block.size();
+
     // If this is a new block we need to update the index list header
     // for the curent list_id, located in the first block (not necessary if
     // we're processing the first block as it's already updated above).
     if(new_block && hdr.ID!=1)
        UpdateListHeader(list_id, lhdr);
+
+    // Write the blocks out early if the cache is over its limit. They
+    // are read back from the database if appended to again.
+    if(m_BlocksCacheLimit && m_BlocksCache.accum > m_BlocksCacheLimit)
+       WriteBlockCache();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCIndex::WriteBlockCache()
+{
+    // The journal must be on disk before the blocks it covers
+    if(m_Datastore && !m_BlocksCache.buffer.empty())
+       m_Datastore->SyncJournal();
+
+    block_map::iterator iblock = m_BlocksCache.buffer.begin();
+    for (; iblock != m_BlocksCache.buffer.end(); ++iblock)
+        WriteBlock(m_BlocksCache.list_id, iblock->first, iblock->second, iblock->second.size());
+
+    m_BlocksCache.buffer.clear();
+    m_BlocksCache.accum = 0;
 }
 
 // ----------------------------------------------------------------------------
@@ -616,11 +1730,14 @@ void TCIndex::UpdateListHeader(int list_id, PListHeader &lhdr)
     vector<uint8_t> &block = m_BlocksCache.buffer[1];
 
     // Read from database if cache miss
-    if(block.empty())
+    if(block.empty()){
        ReadBlock(list_id, 1, block);
 
-    if(block.empty())
-       block.resize(sizeof(PListHeader));
+       if(block.empty())
+          block.resize(sizeof(PListHeader));
+
+       m_BlocksCache.accum += block.size();
+    }
 
     assert(block.size() >= sizeof(PListHeader));
 
@@ -637,14 +1754,23 @@ void TCIndex::Merge(TCCollection* plidx)
 
     TCIndex& lidx = *static_cast<TCIndex*>(plidx);
 
+    // Memory resident records are sorted by key, so the live index is
+    // updated in list order.
+    if(m_Resident){
+       record_map::iterator it = m_Records.begin();
+       for(; it != m_Records.end(); ++it)
+           MergeBlock(lidx,
+                      static_cast<int>(it->first >> 32),
+                      static_cast<int>(it->first & 0xFFFFFFFF),
+                      it->second.data(), it->second.size());
+       return;
+    }
+
     void *key, *val;
     int ksize, vsize;
 
     tchdbiterinit(m_DBHandle);
 
-    vector<uint8_t>& lblock = m_Buffer;
-
-
     while((key = tchdbiternext(m_DBHandle, &ksize)))
     {
         val = tchdbget(m_DBHandle, key, ksize, &vsize);
@@ -659,59 +1785,67 @@ void TCIndex::Merge(TCCollection* plidx)
 
         if(val)
         {
-            // Get the block from the live index, if any
-            size_t lbsize = lidx.ReadBlock(list_id, block_id, lblock);
+            MergeBlock(lidx, list_id, block_id, static_cast<uint8_t*>(val), vsize);
+            tcfree(val);
+        }
 
-            // Calculate block header size
-            size_t hsize = block_id==1 ? sizeof(PListHeader) +
-                                         sizeof(PListBlockHeader)
-                                       :
-                                         sizeof(PListBlockHeader);
+        tcfree(key);
+    }
+}
 
-            // If block doesn't exist in live index, create new one.
-            if(lbsize == 0)
-               lbsize = hsize;
+// ----------------------------------------------------------------------------
 
-            PListBlock lblk = RawBlockToBlock(lblock.data(),
-                                              lbsize,
-                                              block_id==1);
+void TCIndex::MergeBlock(TCIndex &lidx, int list_id, int block_id, uint8_t *data, size_t size)
+{
+    vector<uint8_t>& lblock = m_Buffer;
 
-            PListBlock dblk = RawBlockToBlock(static_cast<uint8_t*>(val),
-                                              vsize,
-                                              block_id==1);
+    // Get the block from the live index, if any
+    size_t lbsize = lidx.ReadBlock(list_id, block_id, lblock);
 
-            assert(block_id==1 && lblk.Body ? lblk.ListHeader->BlockCount : 1);
-            assert(!IsNull(dblk));
-            assert(lbsize >= sizeof(PListHeader));
+    // Calculate block header size
+    size_t hsize = block_id==1 ? sizeof(PListHeader) +
+                                 sizeof(PListBlockHeader)
+                               :
+                                 sizeof(PListBlockHeader);
 
-            if(lbsize + dblk.BodySize > lblock.size())
-               lblock.resize(lbsize + dblk.BodySize);
+    // If block doesn't exist in live index, create new one.
+    if(lbsize == 0)
+       lbsize = hsize;
 
-            // Update list header if first block
-            if(block_id==1)
-               *lblk.ListHeader = *dblk.ListHeader;
+    PListBlock lblk = RawBlockToBlock(lblock.data(),
+                                      lbsize,
+                                      block_id==1);
 
-            // NOTE: Delta blocks may contain only the list header
-            //       (this happens when we are appending a new block other
-            //       than the first and update the block's list header),
-            //       so we need to check whether a block is present.
-            if(dblk.Header && dblk.Body)
-            {
-               assert(dblk.Header->BodySize == lblk.BodySize + dblk.BodySize);
+    PListBlock dblk = RawBlockToBlock(data,
+                                      size,
+                                      block_id==1);
 
-               *lblk.Header = *dblk.Header;
+    assert(block_id==1 && lblk.Body ? lblk.ListHeader->BlockCount : 1);
+    assert(!IsNull(dblk));
+    assert(lbsize >= sizeof(PListHeader));
 
-               // Append delta body to live block
-               std::copy(dblk.Body, dblk.Body + dblk.BodySize, lblock.data() + lbsize);
-            }
+    if(lbsize + dblk.BodySize > lblock.size())
+       lblock.resize(lbsize + dblk.BodySize);
 
-            lidx.WriteBlock(list_id, block_id, lblock, lbsize + dblk.BodySize);
+    // Update list header if first block
+    if(block_id==1)
+       *lblk.ListHeader = *dblk.ListHeader;
 
-            tcfree(val);
-        }
+    // NOTE: Delta blocks may contain only the list header
+    //       (this happens when we are appending a new block other
+    //       than the first and update the block's list header),
+    //       so we need to check whether a block is present.
+    if(dblk.Header && dblk.Body)
+    {
+       assert(dblk.Header->BodySize == lblk.BodySize + dblk.BodySize);
 
-        tcfree(key);
+       *lblk.Header = *dblk.Header;
+
+       // Append delta body to live block
+       std::copy(dblk.Body, dblk.Body + dblk.BodySize, lblock.data() + lbsize);
     }
+
+    lidx.WriteBlock(list_id, block_id, lblock, lbsize + dblk.BodySize);
 }
 
 // ----------------------------------------------------------------------------
@@ -763,6 +1897,9 @@ void TCIndex::FlushBlockCache()
     if(m_BlocksCache.buffer.empty())
        return;
 
+    if(m_Datastore)
+       m_Datastore->SyncJournal();
+
     // Schedule any remaining blocks for batched insert.
     block_map::iterator block = m_BlocksCache.buffer.begin();
     for (; block != m_BlocksCache.buffer.end(); ++block)
@@ -805,8 +1942,12 @@ size_t TCFingerprints::ReadFingerprint(uint32_t FID, std::vector<uint8_t> &buffe
     int dsize;
     void *data;
 
+    uint64_t t0 = StatsCounters::Now();
+
     data = tchdbget(m_DBHandle, &FID, sizeof(uint32_t), &dsize);
 
+    uint64_t t1 = StatsCounters::Now();
+
     if(data){
        assert(0 <= bo && bo < dsize);
        size_t gsize = size ? size : dsize - bo;
@@ -819,8 +1960,10 @@ size_t TCFingerprints::ReadFingerprint(uint32_t FID, std::vector<uint8_t> &buffe
        std::copy(pdata, pdata + gsize, buffer.begin());
        tcfree(data);
 
+       m_Stats.Record(gsize, t1 - t0, StatsCounters::Now() - t1, false, true);
        return gsize;
     }
+    m_Stats.Record(0, t1 - t0, 0, false, false);
     return 0;
 }
 
@@ -840,6 +1983,17 @@ void TCFingerprints::WriteFingerprint(uint32_t FID, const uint8_t *data, size_t
     }
 }
 
+// ----------------------------------------------------------------------------
+
+void TCFingerprints::DeleteFingerprint(uint32_t FID)
+{
+    if(m_DBHandle==nullptr)
+       throw std::runtime_error("Fingerprints database not open.");
+
+    // Missing fingerprints are fine
+    tchdbout(m_DBHandle, &FID, sizeof(uint32_t));
+}
+
 
 //=============================================================================
 //                                TCMetadata
@@ -859,9 +2013,13 @@ string TCMetadata::Read(uint32_t FID)
     string str;
     if(m_DBHandle){
        str = ToString(FID);
+       uint64_t t0 = StatsCounters::Now();
        char* pstr = tchdbget2(m_DBHandle, str.c_str());
+       uint64_t t1 = StatsCounters::Now();
+       bool found = pstr != nullptr;
        str.assign( pstr ? pstr : "" );
        tcfree(pstr);
+       m_Stats.Record(str.size(), t1 - t0, StatsCounters::Now() - t1, false, found);
     }
     return str;
 }
@@ -879,6 +2037,17 @@ void TCMetadata::Write(uint32_t FID, const string &meta)
     }
 }
 
+// ----------------------------------------------------------------------------
+
+void TCMetadata::Delete(uint32_t FID)
+{
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Metadata database not open");
+
+    string str = ToString(FID);
+    tchdbout2(m_DBHandle, str.c_str());
+}
+
 
 
 //=============================================================================
@@ -926,3 +2095,237 @@ void TCInfo::Write(const DBInfo_t &info)
     }
 }
 
+// ----------------------------------------------------------------------------
+
+DBCheckpoint_t TCInfo::ReadCheckpoint()
+{
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Info database not open");
+
+    // The checkpoint is kept in its own record, so that the info record
+    // stays readable by other tools
+    int key = 1;
+    DBCheckpoint_t checkpoint = {0, 0};
+
+    int rsize = tchdbget3(m_DBHandle, &key, sizeof(int), &checkpoint, sizeof(DBCheckpoint_t));
+    if(rsize != sizeof(DBCheckpoint_t))
+       checkpoint = DBCheckpoint_t();
+
+    return checkpoint;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCInfo::WriteCheckpoint(const DBCheckpoint_t &checkpoint)
+{
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Info database not open");
+
+    int key = 1;
+    if(!tchdbput(m_DBHandle, &key, sizeof(int), &checkpoint, sizeof(DBCheckpoint_t))){
+        CHECK_OP(m_DBHandle);
+    }
+}
+
+
+
+//=============================================================================
+//                                TCJournal
+//=============================================================================
+
+
+
+TCJournal::TCJournal(TCDataStore *dstore) :
+    TCCollection (dstore)
+{
+}
+
+// ----------------------------------------------------------------------------
+
+bool TCJournal::Read(int list_id, Entry &entry)
+{
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Journal database not open");
+
+    int rsize = tchdbget3(m_DBHandle, &list_id, sizeof(int), &entry, sizeof(Entry));
+    return rsize == sizeof(Entry);
+}
+
+// ----------------------------------------------------------------------------
+
+void TCJournal::Write(int list_id, const Entry &entry)
+{
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Journal database not open");
+
+    if(!tchdbput(m_DBHandle, &list_id, sizeof(int), &entry, sizeof(Entry))){
+        CHECK_OP(m_DBHandle);
+    }
+}
+
+
+
+//=============================================================================
+//                               TCTombstones
+//=============================================================================
+
+
+
+TCTombstones::TCTombstones(TCDataStore *dstore) :
+    TCCollection (dstore),
+    m_Pending    (0)
+{
+}
+
+// ----------------------------------------------------------------------------
+
+void TCTombstones::Load(int mode)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_FIDs.clear();
+    m_Pending = 0;
+
+    TCCollection::Close();
+
+    if(mode == OPEN_READ && access((m_DBURL + m_DBName).c_str(), F_OK) != 0)
+       return;
+
+    Open(mode);
+
+    vector<uint8_t> key, value;
+
+    IterInit();
+    while(IterNext(key, value)){
+        if(key.size() != sizeof(uint32_t) || value.size() != 1)
+           continue;
+        bool purged = value[0] != 0;
+        m_FIDs[*reinterpret_cast<const uint32_t*>(key.data())] = purged;
+        if(!purged)
+           m_Pending ++;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void TCTombstones::Close()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_FIDs.clear();
+    m_Pending = 0;
+
+    TCCollection::Close();
+}
+
+// ----------------------------------------------------------------------------
+
+void TCTombstones::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Drop();
+    m_FIDs.clear();
+    m_Pending = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCTombstones::Add(uint32_t FID)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Tombstones database not open");
+
+    if(m_FIDs.count(FID))
+       return;
+
+    uint8_t purged = 0;
+    if(!tchdbput(m_DBHandle, &FID, sizeof(uint32_t), &purged, 1)){
+        CHECK_OP(m_DBHandle);
+    }
+
+    m_FIDs[FID] = false;
+    m_Pending ++;
+}
+
+// ----------------------------------------------------------------------------
+
+bool TCTombstones::Contains(uint32_t FID) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_FIDs.count(FID) > 0;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t TCTombstones::GetCount() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_FIDs.size();
+}
+
+// ----------------------------------------------------------------------------
+
+size_t TCTombstones::GetPending() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Pending;
+}
+
+// ----------------------------------------------------------------------------
+
+vector<uint32_t> TCTombstones::GetFIDs() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    vector<uint32_t> fids;
+    fids.reserve(m_FIDs.size());
+
+    std::map<uint32_t, bool>::const_iterator it = m_FIDs.begin();
+    for(; it != m_FIDs.end(); ++it)
+        fids.push_back(it->first);
+
+    return fids;
+}
+
+// ----------------------------------------------------------------------------
+
+vector<uint32_t> TCTombstones::GetPendingFIDs() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    vector<uint32_t> fids;
+    fids.reserve(m_Pending);
+
+    std::map<uint32_t, bool>::const_iterator it = m_FIDs.begin();
+    for(; it != m_FIDs.end(); ++it)
+        if(!it->second)
+           fids.push_back(it->first);
+
+    return fids;
+}
+
+// ----------------------------------------------------------------------------
+
+void TCTombstones::SetPurged(const vector<uint32_t> &fids)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if(m_DBHandle==nullptr)
+       throw runtime_error("Tombstones database not open");
+
+    uint8_t purged = 1;
+
+    for(size_t i=0; i<fids.size(); i++){
+        std::map<uint32_t, bool>::iterator it = m_FIDs.find(fids[i]);
+        if(it == m_FIDs.end() || it->second)
+           continue;
+        if(!tchdbput(m_DBHandle, &fids[i], sizeof(uint32_t), &purged, 1)){
+            CHECK_OP(m_DBHandle);
+        }
+        it->second = true;
+        m_Pending --;
+    }
+}
@@ -13,12 +13,28 @@
 #ifndef TCDATASTORE_H
 #define TCDATASTORE_H
 
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <condition_variable>
+
 #include <tcabinet/tchdb.h>
 
 #include "KVDataStore.h"
+#include "SPSCQueue.h"
+#include "DataStoreStats.h"
 
 class TCDataStore;
 
+/// Indexing checkpoint record, kept in the info database alongside DBInfo_t
+struct DBCheckpoint_t{
+    uint32_t LastFID;   ///< Last fingerprint whose index data is on disk
+    uint32_t Flushes;   ///< Number of completed flushes
+};
+
 /// Defines a key-value database/collection in the data store.
 /// This is represented by a file in the datastore directory.
 
@@ -31,10 +47,14 @@ protected:
     std::string    m_DBName;
     std::string    m_DBURL;
     bool           m_IsOpen;
+    bool           m_Concurrent;
 
     /// Internal buffer for read/write operations
     std::vector<uint8_t>   m_Buffer;
 
+    /// Read statistics
+    StatsCounters          m_Stats;
+
 public:
 
     TCCollection(TCDataStore *datastore);
@@ -52,24 +72,53 @@ public:
     /// Get the database URL
     std::string GetURL() const { return m_DBURL; }
 
+    /// Allow the database handle to be shared by multiple threads.
+    /// Must be set before opening the database.
+    void SetConcurrent(bool enable) { m_Concurrent = enable; }
+
     /// Open the databse
     void Open(int mode = OPEN_READ);
 
     /// Close the database
-    void Close();
+    virtual void Close();
 
     /// Drop the database (all contents cleared)
     void Drop();
 
+    /// Write any buffered records to the database file and sync it to disk
+    void Sync();
+
     /// Query open status
     bool IsOpen() const { return m_IsOpen; }
 
     /// Get the number of records in the database
     std::uint64_t GetRecordsCount() const;
 
+    /// Initialize the records iterator
+    void IterInit();
+
+    /// Read the next record in the database into 'key' and 'value'.
+    /// Return false when all the records have been visited.
+    bool IterNext(std::vector<uint8_t> &key, std::vector<uint8_t> &value);
+
+    /// Read the next key in the database (the record's value is not read).
+    bool IterNext(std::vector<uint8_t> &key);
+
+    /// Get the size of the record with the given key (0 if not found)
+    size_t GetRecordSize(const std::vector<uint8_t> &key);
+
+    /// Read the record with the given key into the given memory location
+    /// (at most 'size' bytes). Return the number of read bytes.
+    size_t ReadRecord(const std::vector<uint8_t> &key, uint8_t *data, size_t size);
+
     /// Merge this collection to the given one
     virtual void Merge(TCCollection*) {}
 
+    /// Get the read statistics
+    CollectionStats GetStats() const { return m_Stats.Snapshot(); }
+
+    void ResetStats() { m_Stats.Reset(); }
+
 };
 
 // ----------------------------------------------------------------------------
@@ -78,13 +127,40 @@ public:
 
 class TCIndex : public TCCollection
 {
+    typedef std::map< uint64_t, std::vector<uint8_t> > record_map;
+
     BlockCache          m_BlocksCache;
 
+    record_map          m_Records;        ///< Memory resident records, sorted by key
+    size_t              m_RecordsSize;
+    size_t              m_RecordsLimit;
+    bool                m_Resident;
+    size_t              m_BlocksCacheLimit;
+
+    /// Write the cached blocks and empty the cache
+    void WriteBlockCache();
+
+    /// Merge the given (delta) block into the given index
+    void MergeBlock(TCIndex &lidx, int list_id, int block_id, uint8_t *data, size_t size);
+
 public:
 
     TCIndex(TCDataStore *dstore);
     ~TCIndex(){}
 
+    /// Open the index keeping its records in memory, sorted by key, rather than
+    /// in the database file. Once their size exceeds 'limit' bytes the records
+    /// are moved to the file (opened for writing) and the index goes on from there.
+    void OpenResident(size_t limit);
+
+    /// Query whether the records are held in memory
+    bool IsResident() const { return m_Resident; }
+
+    /// Move the memory resident records to the database file
+    void Spill();
+
+    void Close();
+
     /// Get the header for the specified index list
     Audioneex::PListHeader GetPListHeader(int list_id);
 
@@ -100,6 +176,18 @@ public:
     /// A new block is created if the specified block does not exist.
     void WriteBlock(int list_id, int block_id, std::vector<uint8_t> &buffer, size_t data_size);
 
+    /// Remove the blocks of the given list that hold none of the live FIDs,
+    /// and renumber the remaining ones. 'live' holds the FIDs of the stored
+    /// fingerprints not deleted, in ascending order. Return the number of
+    /// removed blocks.
+    size_t PurgeList(int list_id, const std::vector<uint32_t> &live);
+
+    /// Get the size of the specified block, headers included (0 if not found)
+    size_t GetBlockSize(int list_id, int block_id);
+
+    /// Delete the specified block
+    void DeleteBlock(int list_id, int block_id);
+
     /// Append a chunk to the specified block. If the block does not exist,
     /// a new one is created.
     void AppendChunk(int list_id,
@@ -111,7 +199,8 @@ public:
     /// Update the specified list header
     void UpdateListHeader(int list_id, Audioneex::PListHeader &lhdr);
 
-    /// Merge this index with the given index.
+    /// Merge this index with the given index. Memory resident records are
+    /// merged in key order.
     void Merge(TCCollection *plidx);
 
     /// Turn a raw block byte stream into a block structure.
@@ -122,6 +211,17 @@ public:
 
     void ClearCache();
 
+    /// Write the cached blocks out as soon as their size exceeds the given
+    /// limit (in bytes), rather than when the next list is started. Zero
+    /// (the default) means no limit.
+    void SetBlockCacheLimit(size_t bytes) { m_BlocksCacheLimit = bytes; }
+
+    size_t GetBlockCacheLimit() const { return m_BlocksCacheLimit; }
+
+    /// Get the memory used by the block cache and the memory resident
+    /// records (in bytes)
+    size_t GetCacheUsed() const { return m_BlocksCache.accum + m_RecordsSize; }
+
 };
 
 // ----------------------------------------------------------------------------
@@ -144,6 +244,9 @@ public:
 
     /// Write the given fingerprint into the database
     void   WriteFingerprint(uint32_t FID, const uint8_t *data, size_t size);
+
+    /// Remove the given fingerprint from the database
+    void   DeleteFingerprint(uint32_t FID);
 };
 
 // ----------------------------------------------------------------------------
@@ -162,6 +265,56 @@ public:
 
     /// Write metadata for fingerprint FID
     void   Write(uint32_t FID, const std::string& meta);
+
+    /// Remove the metadata for fingerprint FID
+    void   Delete(uint32_t FID);
+};
+
+// ----------------------------------------------------------------------------
+
+/// Deleted fingerprints database (tombstones). The deleted FIDs are also held
+/// in memory, each with a flag telling whether its data has been purged.
+
+class TCTombstones : public TCCollection
+{
+    std::map<uint32_t, bool>  m_FIDs;      ///< Deleted FIDs -> purged flag
+    size_t                    m_Pending;   ///< Deleted FIDs not purged yet
+    mutable std::mutex        m_Mutex;
+
+public:
+
+    TCTombstones(TCDataStore *dstore);
+    ~TCTombstones(){}
+
+    /// Open the database and load the tombstones. When opening for reading
+    /// a missing database means there are none.
+    void Load(int mode);
+
+    void Close();
+
+    /// Remove all the tombstones
+    void Clear();
+
+    /// Add a tombstone for the given FID
+    void Add(uint32_t FID);
+
+    /// Check whether the given FID has been deleted
+    bool Contains(uint32_t FID) const;
+
+    /// Get the number of tombstones
+    size_t GetCount() const;
+
+    /// Get the number of tombstones not purged yet
+    size_t GetPending() const;
+
+    /// Get all the deleted FIDs in ascending order
+    std::vector<uint32_t> GetFIDs() const;
+
+    /// Get the deleted FIDs not purged yet, in ascending order
+    std::vector<uint32_t> GetPendingFIDs() const;
+
+    /// Mark the given FIDs as purged
+    void SetPurged(const std::vector<uint32_t> &fids);
 };
 
 // ----------------------------------------------------------------------------
@@ -177,6 +330,41 @@ public:
 
     DBInfo_t Read();
     void Write(const DBInfo_t &info);
+
+    /// Read the indexing checkpoint (all zeros if none)
+    DBCheckpoint_t ReadCheckpoint();
+
+    /// Write the indexing checkpoint
+    void WriteCheckpoint(const DBCheckpoint_t &checkpoint);
+};
+
+// ----------------------------------------------------------------------------
+
+/// Undo journal for checkpointed builds. It holds the state of every index
+/// list before it was first modified by a flush, so that the index can be
+/// rolled back to the last checkpoint if the flush is not completed.
+
+class TCJournal : public TCCollection
+{
+public:
+
+    struct Entry
+    {
+        uint32_t                     Run;         ///< The flush that modified the list
+        Audioneex::PListHeader       ListHeader;  ///< The list header before the flush
+        Audioneex::PListBlockHeader  LastBlock;   ///< The last block header before the flush
+        uint32_t                     LastSize;    ///< The last block size before the flush
+        uint32_t                     MaxBlockID;  ///< The highest block ID written by the flush
+    };
+
+    TCJournal(TCDataStore *dstore);
+    ~TCJournal(){}
+
+    /// Read the entry for the given list. Return false if not found.
+    bool Read(int list_id, Entry &entry);
+
+    /// Write the entry for the given list
+    void Write(int list_id, const Entry &entry);
 };
 
 // ----------------------------------------------------------------------------
@@ -189,14 +377,64 @@ public:
 
 class TCDataStore : public KVDataStore
 {
+    friend class TCIndex;
+
+    /// A write queued by the indexer callbacks in pipelined builds
+    struct WriteOp
+    {
+        enum { CHUNK, NEW_BLOCK, FINGERPRINT, FLUSH_START, FLUSH_END };
+
+        int                          Type;
+        int                          ListID;
+        uint32_t                     FID;
+        Audioneex::PListHeader       ListHeader;
+        Audioneex::PListBlockHeader  Header;
+        std::vector<uint8_t>         Data;
+    };
+
     std::string               m_DBURL;          ///< URL to all database
     TCIndex                   m_MainIndex;      ///< The index database
     TCIndex                   m_DeltaIndex;     ///< The delta index database
     TCFingerprints            m_QFingerprints;  ///< The fingerprints database
     TCMetadata                m_Metadata;       ///< The metadata database
     TCInfo                    m_Info;           ///< Datastore info
+    TCJournal                 m_Journal;        ///< Undo journal for checkpoints
+    TCTombstones              m_Tombstones;     ///< Deleted fingerprints
 
     bool                      m_IsOpen;
+    size_t                    m_DeltaMemoryLimit;
+
+    // Checkpointed builds
+    bool                      m_Checkpoints;
+    DBCheckpoint_t            m_Checkpoint;     ///< The last checkpoint written
+    uint32_t                  m_LastFID;        ///< Last fingerprint received
+    uint32_t                  m_FlushFID;       ///< Last fingerprint before the current flush
+    uint32_t                  m_JournalRun;     ///< The flush being journaled
+    int                       m_JournalList;    ///< The list being journaled
+    TCJournal::Entry          m_JournalEntry;   ///< Its journal entry
+    bool                      m_JournalDirty;   ///< Journal entries not synced yet
+
+    // Pipelined builds
+    size_t                    m_PipelineLimit;  ///< Max bytes queued for the writer thread
+    SPSCQueue<WriteOp>        m_WriteQueue;
+    std::thread               m_Writer;
+    std::mutex                m_IndexMutex;     ///< Serializes the index access by the two threads
+    std::mutex                m_WaitMutex;
+    std::condition_variable   m_WorkCond;       ///< Signals the writer new writes are queued
+    std::condition_variable   m_DoneCond;       ///< Signals the indexer writes have been applied
+    std::atomic<size_t>       m_QueuedBytes;
+    std::atomic<uint64_t>     m_Queued;
+    std::atomic<uint64_t>     m_Applied;
+    std::atomic<bool>         m_WriterRunning;
+    std::atomic<bool>         m_WriterFailed;
+    std::exception_ptr        m_WriterError;    ///< Guarded by m_WaitMutex
+
+    // Deleted fingerprints
+    size_t                    m_PurgeThreshold;
+    std::thread               m_Purger;
+    std::atomic<bool>         m_Purging;
+    std::atomic<bool>         m_Indexing;       ///< Read by the purge thread
+    std::exception_ptr        m_PurgeError;     ///< Guarded by m_WaitMutex
 
     /// Buffer used to cache all data accessed by the ID instance
     /// using this connection.
@@ -205,7 +443,7 @@ class TCDataStore : public KVDataStore
 public:
 
     explicit TCDataStore(const std::string &url = std::string());
-    ~TCDataStore(){}
+    ~TCDataStore();
 
     void Open(eOperation op = GET,
               bool use_fing_db=true,
@@ -228,6 +466,67 @@ public:
 
     void SetOpMode(eOperation mode);
 
+    /// Keep the BUILD_MERGE delta index in memory until it grows past the given
+    /// size (in bytes), and only then move it to a file. Zero (the default)
+    /// always uses a file.
+    void SetDeltaMemoryLimit(size_t bytes) { m_DeltaMemoryLimit = bytes; }
+
+    size_t GetDeltaMemoryLimit() const { return m_DeltaMemoryLimit; }
+
+    /// Apply the writes issued by the indexer in a dedicated thread, so that
+    /// fingerprinting and storage I/O overlap. The indexer callbacks queue a
+    /// copy of the data and only block when more than 'max_queued_bytes' are
+    /// waiting to be written. The end of a flush and the end of the indexing
+    /// session wait for all the queued writes. Zero (the default) disables
+    /// pipelining. Takes effect at the next OnIndexerStart().
+    void SetPipelined(size_t max_queued_bytes) { m_PipelineLimit = max_queued_bytes; }
+
+    size_t GetPipelined() const { return m_PipelineLimit; }
+
+    /// Limit the size of the index block caches (see TCIndex::SetBlockCacheLimit())
+    void SetBlockCacheLimit(size_t bytes);
+
+    size_t GetBlockCacheLimit() const { return m_MainIndex.GetBlockCacheLimit(); }
+
+    /// Get the memory used by the index block caches and the memory resident
+    /// delta index (in bytes)
+    size_t GetCacheUsed();
+
+    /// Get the amount of data waiting to be written in pipelined builds (in bytes)
+    size_t GetQueuedBytes() const { return m_QueuedBytes; }
+
+    /// Move the memory resident delta index, if any, to its file
+    void SpillDelta();
+
+    /// Query whether the delta index is held in memory
+    bool IsDeltaResident() const { return m_DeltaIndex.IsResident(); }
+
+    /// Write a checkpoint to the info database at the end of every flush in
+    /// BUILD sessions, recording the last fingerprint whose index data is on
+    /// disk. The state of the index lists modified by a flush is journaled
+    /// and synced before their blocks are written out of the block cache (one
+    /// sync per write-out), so that a session that dies in the middle of a
+    /// flush can be resumed with Resume(). This assumes
+    /// that the indexer flushes between fingerprints, which is the case for
+    /// Indexer::Flush() and the automatic flushes at the cache limit. Takes
+    /// effect at the next OnIndexerStart().
+    void SetCheckpoints(bool enable) { m_Checkpoints = enable; }
+
+    bool GetCheckpoints() const { return m_Checkpoints; }
+
+    /// Roll the index back to the last checkpoint, discarding any data written
+    /// by an unfinished flush, and return the last indexed FID (0 if there
+    /// is no checkpoint). The session is then resumed by indexing the FIDs
+    /// after the returned one. The datastore must be open for BUILD.
+    uint32_t Resume();
+
+    /// Get the last checkpoint
+    DBCheckpoint_t GetCheckpoint() { OpenCheckpoints(); return m_Info.ReadCheckpoint(); }
+
+    /// Read the whole index sequentially to bring it into the caches.
+    /// Return the number of bytes read.
+    uint64_t Warm();
+
     void PutFingerprint(uint32_t FID, const uint8_t* data, size_t size){
         m_QFingerprints.WriteFingerprint(FID, data, size);
     }
@@ -238,10 +537,63 @@ public:
 
     std::string GetMetadata(uint32_t FID) { return m_Metadata.Read(FID); }
 
+    void DeleteFingerprint(uint32_t FID);
+
+    bool IsDeleted(uint32_t FID) { return m_Tombstones.Contains(FID); }
+
+    /// Get the number of deleted fingerprints whose data hasn't been purged
+    size_t GetGarbageCount() const { return m_Tombstones.GetPending(); }
+
+    /// Start a background purge whenever the deleted fingerprints not purged
+    /// yet reach the given number. Zero (the default) disables it.
+    void SetPurgeThreshold(size_t count) { m_PurgeThreshold = count; }
+
+    size_t GetPurgeThreshold() const { return m_PurgeThreshold; }
+
+    /// Reclaim the space used by the deleted fingerprints. The index blocks
+    /// holding no live FIDs (those in the fingerprints database that have
+    /// not been deleted) are removed from their lists, and the
+    /// fingerprints and metadata of the deleted FIDs are removed. Blocks that
+    /// also hold live FIDs are kept, as the postings format is private to the
+    /// engine, so their deleted FIDs keep being filtered at read time. Return
+    /// the number of removed blocks. Does nothing unless the fingerprints and
+    /// metadata databases are open. Not allowed during indexing sessions.
+    size_t Purge();
+
+    /// Run Purge() in a background thread. Does nothing if a purge is already
+    /// running. Indexing sessions wait for the purge to complete, and fail
+    /// if it failed (see CheckPurge()).
+    void StartPurge();
+
+    bool IsPurging() const { return m_Purging; }
+
+    /// Rethrow the error of the last background purge, if it failed, and
+    /// clear it
+    void CheckPurge();
+
     DBInfo_t GetInfo() { return m_Info.Read(); }
 
+    /// Get the read statistics of the index, fingerprints and metadata
+    /// databases. They can be taken at any time from any thread.
+    DataStoreStats GetStats() const;
+
+    void ResetStats();
+
     void PutInfo(const DBInfo_t& info) { m_Info.Write(info); }
 
+    /// Replace the index and info databases of the datastore at 'dburl' with
+    /// the ones in the directory 'from'. The swap is recorded in a marker file
+    /// before any database is moved, so if it's interrupted midway it is
+    /// completed by the next Open() for writing rather than leaving the new
+    /// index paired with the old info. Opens in GET mode fail while a swap is
+    /// pending. Processes that have the datastore open keep reading
+    /// the old index until they reopen it.
+    static void SwapIndex(const std::string &dburl, const std::string &from);
+
+    /// Complete a swap interrupted by a crash (see SwapIndex()). Return true
+    /// if there was one. Called by Open() for writing and by the Reindexer.
+    static bool RecoverSwap(const std::string &dburl);
+
     // API Interface
 
     const uint8_t* GetPListBlock(int list_id, int block, size_t& data_size, bool headers=true);
@@ -267,10 +619,54 @@ public:
 
     void OnIndexerFingerprint(uint32_t FID, uint8_t* data, size_t size);
 
+protected:
+
+    /// Record the FID of a fingerprint emitted by the indexer, for the
+    /// checkpoints. Called by OnIndexerFingerprint().
+    void TrackFingerprint(uint32_t FID) { m_LastFID = FID; }
+
 private:
 
     eOperation m_Op;
     int        m_Run;
+
+    void WriteChunk(int list_id,
+                    Audioneex::PListHeader &lhdr,
+                    Audioneex::PListBlockHeader &hdr,
+                    uint8_t* data, size_t data_size,
+                    bool new_block);
+
+    void WriteFlushStart();
+    void WriteFlushEnd();
+
+    /// Open the info database and the journal if not already open
+    void OpenCheckpoints();
+
+    /// Save the state of the given list before it's modified by a flush
+    void Journal(int list_id, Audioneex::PListBlockHeader &hdr, bool new_block);
+
+    /// Sync the journal entries written since the last sync, if any. Called
+    /// by the index before the cached blocks are written out.
+    void SyncJournal();
+
+    void WriteCheckpoint();
+
+    /// Restore the state of the given list saved in the journal
+    void Rollback(int list_id, const TCJournal::Entry &entry);
+
+    /// Queue a write for the writer thread, waiting if too much data is queued
+    void Enqueue(WriteOp &op);
+
+    /// Wait for all the queued writes to be applied
+    void Drain();
+
+    void Apply(WriteOp &op);
+    void WriterLoop();
+    void StartWriter();
+    void StopWriter();
+    void CheckWriter();
+
+    void StopPurge();
 };
 
 
@@ -0,0 +1,212 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "TracingDataStore.h"
+
+using namespace std;
+using namespace Audioneex;
+
+namespace {
+
+const char     TRACE_MAGIC[8] = { 'A','X','T','R','A','C','E','\0' };
+const uint32_t TRACE_VERSION  = 1;
+
+}
+
+// ----------------------------------------------------------------------------
+
+TracingDataStore::TracingDataStore(KVDataStore::Ptr dstore, const string &trace_path) :
+    m_DataStore (std::move(dstore)),
+    m_TracePath (trace_path),
+    m_File      (nullptr),
+    m_Start     (std::chrono::steady_clock::now())
+{
+    if(!m_DataStore)
+       throw invalid_argument("TracingDataStore: No datastore given");
+
+    m_File = std::fopen(m_TracePath.c_str(), "wb");
+
+    if(m_File == nullptr)
+       throw runtime_error("Couldn't create trace file " + m_TracePath);
+
+    TraceHeader hdr;
+    std::memcpy(hdr.Magic, TRACE_MAGIC, sizeof(hdr.Magic));
+    hdr.Version = TRACE_VERSION;
+    hdr.RecordSize = sizeof(TraceRecord);
+
+    if(std::fwrite(&hdr, sizeof(hdr), 1, m_File) != 1){
+       std::fclose(m_File);
+       throw runtime_error("Couldn't write trace file " + m_TracePath);
+    }
+
+    m_Buffer.reserve(BUFFER_RECORDS);
+}
+
+// ----------------------------------------------------------------------------
+
+TracingDataStore::~TracingDataStore()
+{
+    try{
+       Flush();
+    }
+    catch(...){}
+
+    std::fclose(m_File);
+}
+
+// ----------------------------------------------------------------------------
+
+uint64_t TracingDataStore::Now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now() - m_Start).count();
+}
+
+// ----------------------------------------------------------------------------
+
+void TracingDataStore::Record(TraceRecord &rec, uint64_t start)
+{
+    uint64_t end = Now();
+
+    rec.Time = start;
+    rec.Latency = static_cast<uint32_t>(std::min<uint64_t>(end - start, UINT32_MAX));
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    // Threads are numbered in order of appearance
+    std::map<std::thread::id, int>::iterator it = m_Threads.find(std::this_thread::get_id());
+    if(it == m_Threads.end())
+       it = m_Threads.insert(std::make_pair(std::this_thread::get_id(),
+                                            static_cast<int>(m_Threads.size()))).first;
+
+    rec.Thread = static_cast<uint16_t>(it->second);
+
+    m_Buffer.push_back(rec);
+
+    if(m_Buffer.size() >= BUFFER_RECORDS)
+       WriteBuffer();
+}
+
+// ----------------------------------------------------------------------------
+
+void TracingDataStore::WriteBuffer()
+{
+    if(m_Buffer.empty())
+       return;
+
+    size_t count = m_Buffer.size();
+    size_t n = std::fwrite(m_Buffer.data(), sizeof(TraceRecord), count, m_File);
+    m_Buffer.clear();
+
+    if(n != count)
+       throw runtime_error("Couldn't write trace file " + m_TracePath);
+}
+
+// ----------------------------------------------------------------------------
+
+void TracingDataStore::Flush()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    WriteBuffer();
+    std::fflush(m_File);
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* TracingDataStore::GetPListBlock(int list_id, int block, size_t& data_size, bool headers)
+{
+    uint64_t start = Now();
+
+    const uint8_t* data = m_DataStore->GetPListBlock(list_id, block, data_size, headers);
+
+    TraceRecord rec = {};
+    rec.Op = TraceRecord::PLIST_BLOCK;
+    rec.Headers = headers;
+    rec.Key = static_cast<uint32_t>(list_id);
+    rec.Arg1 = static_cast<uint32_t>(block);
+    rec.Size = static_cast<uint32_t>(data_size);
+    Record(rec, start);
+
+    return data;
+}
+
+// ----------------------------------------------------------------------------
+
+const uint8_t* TracingDataStore::GetFingerprint(uint32_t FID, size_t &read, size_t nbytes, uint32_t bo)
+{
+    uint64_t start = Now();
+
+    const uint8_t* data = m_DataStore->GetFingerprint(FID, read, nbytes, bo);
+
+    TraceRecord rec = {};
+    rec.Op = TraceRecord::FINGERPRINT;
+    rec.Key = FID;
+    rec.Arg1 = bo;
+    rec.Arg2 = static_cast<uint32_t>(nbytes);
+    rec.Size = static_cast<uint32_t>(read);
+    Record(rec, start);
+
+    return data;
+}
+
+// ----------------------------------------------------------------------------
+
+string TracingDataStore::GetMetadata(uint32_t FID)
+{
+    uint64_t start = Now();
+
+    string meta = m_DataStore->GetMetadata(FID);
+
+    TraceRecord rec = {};
+    rec.Op = TraceRecord::METADATA;
+    rec.Key = FID;
+    rec.Size = static_cast<uint32_t>(meta.size());
+    Record(rec, start);
+
+    return meta;
+}
+
+// ----------------------------------------------------------------------------
+
+void TracingDataStore::ReadTrace(const string &path, vector<TraceRecord> &records)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+
+    if(file == nullptr)
+       throw runtime_error("Couldn't open trace file " + path);
+
+    TraceHeader hdr;
+
+    if(std::fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+       std::memcmp(hdr.Magic, TRACE_MAGIC, sizeof(hdr.Magic)) != 0 ||
+       hdr.Version != TRACE_VERSION ||
+       hdr.RecordSize != sizeof(TraceRecord))
+    {
+       std::fclose(file);
+       throw runtime_error("Invalid trace file " + path);
+    }
+
+    records.clear();
+
+    TraceRecord buffer[1024];
+    size_t n;
+
+    // A truncated last record (e.g. a crashed tracer) is dropped
+    while((n = std::fread(buffer, sizeof(TraceRecord), 1024, file)) > 0)
+        records.insert(records.end(), buffer, buffer + n);
+
+    std::fclose(file);
+}
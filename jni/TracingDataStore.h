@@ -0,0 +1,178 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef TRACINGDATASTORE_H
+#define TRACINGDATASTORE_H
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "KVDataStore.h"
+
+/// Header of a trace file. It's followed by the trace records.
+struct TraceHeader
+{
+    char     Magic[8];      ///< Trace signature
+    uint32_t Version;       ///< Layout version
+    uint32_t RecordSize;    ///< Size of a record in bytes
+};
+
+/// A traced datastore access
+struct TraceRecord
+{
+    enum { PLIST_BLOCK, FINGERPRINT, METADATA };
+
+    uint8_t  Op;            ///< The traced method
+    uint8_t  Headers;       ///< 'headers' argument of GetPListBlock()
+    uint16_t Thread;        ///< Sequential ID of the calling thread
+    uint32_t Key;           ///< List ID or FID
+    uint32_t Arg1;          ///< Block ID or byte offset (GetFingerprint())
+    uint32_t Arg2;          ///< Bytes requested (GetFingerprint())
+    uint32_t Size;          ///< Bytes returned
+    uint32_t Latency;       ///< Duration of the call in ns
+    uint64_t Time;          ///< Start of the call in ns since the trace start
+};
+
+// ----------------------------------------------------------------------------
+
+/// Decorator recording the read accesses to a datastore, i.e. the calls to
+/// GetPListBlock(), GetFingerprint() and GetMetadata(), into a binary trace
+/// file. All the other calls are just forwarded. The records are buffered
+/// and written in batches, so the tracing overhead is mostly that of the
+/// time measurement. Instances can be shared by several threads if the
+/// traced datastore can.
+
+class TracingDataStore : public KVDataStore
+{
+    KVDataStore::Ptr   m_DataStore;
+    std::string        m_TracePath;
+    FILE*              m_File;
+
+    std::mutex                       m_Mutex;     ///< Guards the following
+    std::vector<TraceRecord>         m_Buffer;
+    std::map<std::thread::id, int>   m_Threads;
+
+    std::chrono::steady_clock::time_point  m_Start;
+
+    /// Time elapsed since the start of the trace in ns
+    uint64_t Now() const;
+
+    void Record(TraceRecord &rec, uint64_t start);
+
+    /// Write the buffered records (m_Mutex held)
+    void WriteBuffer();
+
+public:
+
+    /// Number of records buffered before writing to the file
+    static const size_t BUFFER_RECORDS = 4096;
+
+    /// Trace the given datastore into the given file, which is overwritten.
+    /// The datastore is owned by the decorator.
+    TracingDataStore(KVDataStore::Ptr dstore, const std::string &trace_path);
+    ~TracingDataStore();
+
+    /// Get the traced datastore
+    KVDataStore* GetDataStore() const { return m_DataStore.get(); }
+
+    /// Write the buffered records to the trace file
+    void Flush();
+
+    /// Read a trace file into 'records'. Throw if it's not a valid trace.
+    static void ReadTrace(const std::string &path, std::vector<TraceRecord> &records);
+
+    // KVDataStore interface
+
+    void Open(eOperation op = GET,
+              bool use_fing_db=true,
+              bool use_meta_db=false,
+              bool use_info_db=false) { m_DataStore->Open(op, use_fing_db, use_meta_db, use_info_db); }
+
+    void Close() { Flush(); m_DataStore->Close(); }
+
+    void SetDatabaseURL(const std::string &url) { m_DataStore->SetDatabaseURL(url); }
+
+    std::string GetDatabaseURL() { return m_DataStore->GetDatabaseURL(); }
+
+    bool Empty() { return m_DataStore->Empty(); }
+
+    void Clear() { m_DataStore->Clear(); }
+
+    bool IsOpen() { return m_DataStore->IsOpen(); }
+
+    size_t GetFingerprintsCount() { return m_DataStore->GetFingerprintsCount(); }
+
+    void PutFingerprint(uint32_t FID, const uint8_t* data, size_t size) { m_DataStore->PutFingerprint(FID, data, size); }
+
+    void PutMetadata(uint32_t FID, const std::string& meta) { m_DataStore->PutMetadata(FID, meta); }
+
+    std::string GetMetadata(uint32_t FID);
+
+    void DeleteFingerprint(uint32_t FID) { m_DataStore->DeleteFingerprint(FID); }
+
+    bool IsDeleted(uint32_t FID) { return m_DataStore->IsDeleted(FID); }
+
+    void PutInfo(const DBInfo_t& info) { m_DataStore->PutInfo(info); }
+
+    DBInfo_t GetInfo() { return m_DataStore->GetInfo(); }
+
+    eOperation GetOpMode() { return m_DataStore->GetOpMode(); }
+
+    void SetOpMode(eOperation mode) { m_DataStore->SetOpMode(mode); }
+
+    // API Interface
+
+    const uint8_t* GetPListBlock(int list_id, int block, size_t& data_size, bool headers=true);
+
+    size_t GetFingerprintSize(uint32_t FID) { return m_DataStore->GetFingerprintSize(FID); }
+
+    const uint8_t* GetFingerprint(uint32_t FID, size_t &read, size_t nbytes = 0, uint32_t bo = 0);
+
+    void OnIndexerStart() { m_DataStore->OnIndexerStart(); }
+    void OnIndexerEnd() { m_DataStore->OnIndexerEnd(); }
+    void OnIndexerFlushStart() { m_DataStore->OnIndexerFlushStart(); }
+    void OnIndexerFlushEnd() { m_DataStore->OnIndexerFlushEnd(); }
+
+    Audioneex::PListHeader OnIndexerListHeader(int list_id) {
+        return m_DataStore->OnIndexerListHeader(list_id);
+    }
+
+    Audioneex::PListBlockHeader OnIndexerBlockHeader(int list_id, int block) {
+        return m_DataStore->OnIndexerBlockHeader(list_id, block);
+    }
+
+    void OnIndexerChunk(int list_id,
+                        Audioneex::PListHeader &lhdr,
+                        Audioneex::PListBlockHeader &hdr,
+                        uint8_t* data, size_t data_size) {
+        m_DataStore->OnIndexerChunk(list_id, lhdr, hdr, data, data_size);
+    }
+
+    void OnIndexerNewBlock (int list_id,
+                            Audioneex::PListHeader &lhdr,
+                            Audioneex::PListBlockHeader &hdr,
+                            uint8_t* data, size_t data_size) {
+        m_DataStore->OnIndexerNewBlock(list_id, lhdr, hdr, data, data_size);
+    }
+
+    void OnIndexerFingerprint(uint32_t FID, uint8_t* data, size_t size) {
+        m_DataStore->OnIndexerFingerprint(FID, data, size);
+    }
+};
+
+
+#endif
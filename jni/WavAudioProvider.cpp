@@ -0,0 +1,251 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include "WavAudioProvider.h"
+#include "MappedWavSource.h"
+
+using namespace std;
+using namespace Audioneex;
+
+// ----------------------------------------------------------------------------
+
+WavAudioProvider::WavAudioProvider(const PathResolver &resolver, size_t nthreads) :
+    m_Resolver   (resolver),
+    m_Threads    (nthreads),
+    m_Lookahead  (0),
+    m_NextSeq    (0),
+    m_Stop       (false),
+    m_CurrentFID (0),
+    m_Position   (0)
+{
+    if(m_Threads == 0)
+       m_Threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    m_Lookahead = 2 * m_Threads;
+}
+
+// ----------------------------------------------------------------------------
+
+WavAudioProvider::~WavAudioProvider()
+{
+    StopWorkers();
+}
+
+// ----------------------------------------------------------------------------
+
+void WavAudioProvider::StartWorkers()
+{
+    if(!m_Workers.empty())
+       return;
+
+    m_Stop = false;
+
+    for(size_t i=0; i<m_Threads; i++)
+        m_Workers.push_back(std::thread(&WavAudioProvider::WorkerLoop, this));
+}
+
+// ----------------------------------------------------------------------------
+
+void WavAudioProvider::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_WorkCond.notify_all();
+
+    for(size_t i=0; i<m_Workers.size(); i++)
+        m_Workers[i].join();
+
+    m_Workers.clear();
+}
+
+// ----------------------------------------------------------------------------
+
+void WavAudioProvider::Schedule(const vector<uint32_t> &fids)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for(size_t i=0; i<fids.size(); i++)
+            m_Pending.push_back(std::make_pair(fids[i], m_NextSeq++));
+    }
+
+    StartWorkers();
+    m_WorkCond.notify_all();
+}
+
+// ----------------------------------------------------------------------------
+
+void WavAudioProvider::Reset()
+{
+    StopWorkers();
+
+    m_Pending.clear();
+    m_Ready.clear();
+    m_InFlight.clear();
+    m_Current.reset();
+    m_CurrentFID = 0;
+    m_Position = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void WavAudioProvider::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    for(;;)
+    {
+        m_WorkCond.wait(lock, [this](){
+            return m_Stop ||
+                   (!m_Pending.empty() &&
+                     m_Ready.size() + m_InFlight.size() < m_Lookahead);
+        });
+
+        if(m_Stop)
+           return;
+
+        uint32_t FID = m_Pending.front().first;
+        uint64_t seq = m_Pending.front().second;
+        m_Pending.pop_front();
+        m_InFlight[FID] = seq;
+
+        lock.unlock();
+        RecordingPtr rec = DecodeRecording(FID, seq);
+        lock.lock();
+
+        m_InFlight.erase(FID);
+        m_Ready[FID] = rec;
+        m_ReadyCond.notify_all();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+WavAudioProvider::RecordingPtr WavAudioProvider::DecodeRecording(uint32_t FID, uint64_t seq)
+{
+    RecordingPtr rec = std::make_shared<Recording>();
+    rec->Seq = seq;
+
+    try{
+       Decode(m_Resolver(FID), rec->Audio);
+    }
+    catch(const std::exception &ex){
+       rec->Audio.clear();
+       rec->Error = ex.what();
+    }
+    return rec;
+}
+
+// ----------------------------------------------------------------------------
+
+WavAudioProvider::RecordingPtr WavAudioProvider::Acquire(uint32_t FID)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    // Not decoded nor being decoded. If scheduled, drop it and the recordings
+    // scheduled before it (skipped by the indexer), then decode it here. If
+    // not scheduled, decode it here leaving the lookahead alone, as the
+    // scheduled recordings may still be requested.
+    if(!m_Ready.count(FID) && !m_InFlight.count(FID))
+    {
+        bool scheduled = false;
+        uint64_t seq = m_NextSeq;
+
+        for(size_t i=0; i<m_Pending.size(); i++){
+            if(m_Pending[i].first == FID){
+               seq = m_Pending[i].second;
+               m_Pending.erase(m_Pending.begin(), m_Pending.begin() + i + 1);
+               scheduled = true;
+               break;
+            }
+        }
+
+        if(scheduled)
+           DiscardReady(seq);
+
+        lock.unlock();
+
+        if(scheduled)
+           m_WorkCond.notify_all();
+
+        return DecodeRecording(FID, seq);
+    }
+
+    m_ReadyCond.wait(lock, [this, FID](){ return m_Ready.count(FID) > 0; });
+
+    RecordingPtr rec = m_Ready[FID];
+
+    DiscardReady(rec->Seq + 1);
+
+    lock.unlock();
+    m_WorkCond.notify_all();
+
+    return rec;
+}
+
+// ----------------------------------------------------------------------------
+
+void WavAudioProvider::DiscardReady(uint64_t seq)
+{
+    for(auto it=m_Ready.begin(); it!=m_Ready.end(); ){
+        if(it->second->Seq < seq)
+           it = m_Ready.erase(it);
+        else
+           ++it;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+int WavAudioProvider::OnAudioData(uint32_t FID, float* buffer, size_t nsamples)
+{
+    if(!m_Current || FID != m_CurrentFID){
+       m_Current = Acquire(FID);
+       m_CurrentFID = FID;
+       m_Position = 0;
+    }
+
+    if(!m_Current->Error.empty())
+       return -1;
+
+    size_t n = std::min(nsamples, m_Current->Audio.size() - m_Position);
+
+    std::copy(m_Current->Audio.begin() + m_Position,
+              m_Current->Audio.begin() + m_Position + n,
+              buffer);
+
+    m_Position += n;
+
+    // Release the audio as soon as it's all been consumed
+    if(n == 0){
+       m_Current->Audio = vector<float>();
+       m_Position = 0;
+    }
+
+    return static_cast<int>(n);
+}
+
+// ----------------------------------------------------------------------------
+
+void WavAudioProvider::Decode(const string &path, vector<float> &audio)
+{
+    MappedWavSource source;
+    source.Open(path);
+
+    audio.resize(source.GetOutputLength());
+    audio.resize(source.Read(audio.data(), audio.size()));
+}
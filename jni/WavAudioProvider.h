@@ -0,0 +1,118 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef WAVAUDIOPROVIDER_H
+#define WAVAUDIOPROVIDER_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+#include "audioneex.h"
+
+/// An audio provider streaming the recordings to be indexed from WAV files.
+/// The recordings are decoded, downmixed to mono and resampled to 11025 Hz
+/// ahead of time by a pool of worker threads, in the order given to Schedule(),
+/// so the indexer doesn't wait on disk reads and conversions while fingerprinting.
+/// The number of recordings decoded ahead of the one being indexed is bounded
+/// (see SetLookahead()). Recordings requested by the indexer that were not
+/// scheduled are decoded on the calling thread.
+
+class WavAudioProvider : public Audioneex::AudioProvider
+{
+public:
+
+    /// Maps a fingerprint ID to the path of its WAV file
+    typedef std::function<std::string(uint32_t FID)> PathResolver;
+
+private:
+
+    /// A decoded recording
+    struct Recording
+    {
+        uint64_t            Seq;       ///< Position in the schedule
+        std::vector<float>  Audio;     ///< 11025 Hz mono, normalized in [-1,1]
+        std::string         Error;     ///< Set if decoding failed
+    };
+
+    typedef std::shared_ptr<Recording> RecordingPtr;
+
+    PathResolver                      m_Resolver;
+    size_t                            m_Threads;
+    size_t                            m_Lookahead;
+
+    std::mutex                        m_Mutex;
+    std::condition_variable           m_WorkCond;     ///< Signals the workers
+    std::condition_variable           m_ReadyCond;    ///< Signals the consumer
+    std::deque< std::pair<uint32_t, uint64_t> >  m_Pending;  ///< <FID, Seq> to decode
+    std::map<uint32_t, RecordingPtr>  m_Ready;        ///< Decoded recordings
+    std::map<uint32_t, uint64_t>      m_InFlight;     ///< Recordings being decoded
+    uint64_t                          m_NextSeq;
+    bool                              m_Stop;
+    std::vector<std::thread>          m_Workers;
+
+    // Consumer state (indexer thread)
+    uint32_t                          m_CurrentFID;
+    RecordingPtr                      m_Current;
+    size_t                            m_Position;
+
+    void WorkerLoop();
+
+    /// Get the decoded recording for the given FID, waiting for it if needed
+    RecordingPtr Acquire(uint32_t FID);
+
+    RecordingPtr DecodeRecording(uint32_t FID, uint64_t seq);
+
+    /// Discard the decoded recordings scheduled before 'seq', which the
+    /// indexer has consumed or skipped, to free their lookahead slots
+    /// (m_Mutex held)
+    void DiscardReady(uint64_t seq);
+
+    void StartWorkers();
+    void StopWorkers();
+
+    WavAudioProvider(const WavAudioProvider&);
+    WavAudioProvider& operator=(const WavAudioProvider&);
+
+public:
+
+    /// Create a provider decoding on 'nthreads' threads (0 = number of cores)
+    explicit WavAudioProvider(const PathResolver &resolver, size_t nthreads=0);
+    ~WavAudioProvider();
+
+    /// Set the maximum number of recordings decoded ahead. Defaults to twice
+    /// the number of worker threads.
+    void SetLookahead(size_t n) { m_Lookahead = n > 0 ? n : 1; }
+
+    size_t GetLookahead() const { return m_Lookahead; }
+
+    /// Queue the given recordings for decoding, in the order they will be indexed.
+    /// Scheduled recordings that are skipped by the indexer are discarded.
+    void Schedule(const std::vector<uint32_t> &fids);
+
+    /// Discard all the scheduled and decoded recordings
+    void Reset();
+
+    /// Decode the given WAV file into 11025 Hz mono float samples
+    static void Decode(const std::string &path, std::vector<float> &audio);
+
+    int OnAudioData(uint32_t FID, float* buffer, size_t nsamples);
+};
+
+
+#endif
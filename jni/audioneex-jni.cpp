@@ -46,11 +46,16 @@ OF SUCH DAMAGE.
 #define  LOG_E(...)  __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__);
 
 #include "audioneex-jni.h"
+#include "AudioBlockPool.h"
+#include "AudioBlockView.h"
+#include "Resampler.h"
+#include "AudioFrameQueue.h"
 
 // JNI interface
 
 extern "C" {
     JNIEXPORT jboolean JNICALL Java_com_audioneex_recognition_RecognitionService_Initialize(JNIEnv *env, jclass clazz, jstring datastoreDir);
+    JNIEXPORT jboolean JNICALL Java_com_audioneex_recognition_RecognitionService_Reload(JNIEnv *env, jclass clazz, jstring datastoreDir);
     JNIEXPORT jboolean JNICALL Java_com_audioneex_recognition_Recognizer_Identify(JNIEnv *env, jclass clazz, jfloatArray audio, jint audiolen);
     JNIEXPORT jstring JNICALL Java_com_audioneex_recognition_Recognizer_GetResults(JNIEnv *env, jclass clazz);
     JNIEXPORT void JNICALL Java_com_audioneex_recognition_Recognizer_Reset(JNIEnv *env, jclass clazz);
@@ -64,12 +69,51 @@ extern "C" {
     JNIEXPORT jint JNICALL Java_com_audioneex_recognition_Recognizer_GetIdentificationMode(JNIEnv *env, jclass clazz);
     JNIEXPORT void JNICALL Java_com_audioneex_recognition_Recognizer_SetBinaryIdThreshold(JNIEnv *env, jclass clazz, jfloat value);
     JNIEXPORT jfloat JNICALL Java_com_audioneex_recognition_Recognizer_GetBinaryIdThreshold(JNIEnv *env, jclass clazz);
+    JNIEXPORT jstring JNICALL Java_com_audioneex_recognition_Recognizer_GetEngineStats(JNIEnv *env, jclass clazz);
+    JNIEXPORT void JNICALL Java_com_audioneex_recognition_Recognizer_ResetEngineStats(JNIEnv *env, jclass clazz);
+    JNIEXPORT jboolean JNICALL Java_com_audioneex_recognition_RecognitionService_StartNativeSession(JNIEnv *env, jobject thiz, jint sampleRate, jint frameSize, jint nframes, jboolean dropOldest, jboolean continuous);
+    JNIEXPORT void JNICALL Java_com_audioneex_recognition_RecognitionService_StopNativeSession(JNIEnv *env, jobject thiz);
+    JNIEXPORT jstring JNICALL Java_com_audioneex_recognition_RecognitionService_GetCaptureStats(JNIEnv *env, jobject thiz);
+    JNIEXPORT jint JNICALL Java_com_audioneex_audio_NativeAudioQueue_Write(JNIEnv *env, jclass clazz, jobject samples, jint nsamples);
 
 }
 
 // Internal helpers
 
-std::string ResultsToJSON(const Audioneex::IdMatch* results);
+/// Buffers for the clips converted by the native sessions
+AudioBlockPool<Sfloat> g_ClipPool(11025, 1);
+
+typedef AudioFrameQueue<S16bit> CaptureQueue;
+
+/// A native identification session. The captured audio is written into the
+/// queue by the Java audio thread, and identified by the consumer thread, which
+/// passes the results to the RecognitionService. Audio captured at rates other
+/// than 11025 Hz is resampled by the consumer thread.
+struct NativeSession
+{
+    std::unique_ptr<CaptureQueue>  Queue;
+    std::unique_ptr<Resampler>     Converter;    ///< Null if capturing at 11025 Hz
+    std::thread                    Consumer;
+    JavaVM                        *VM;
+    jobject                        Service;      ///< Global reference
+    jmethodID                      OnResults;
+    jmethodID                      OnError;
+    bool                           Continuous;   ///< Go on after the first results
+};
+
+std::mutex                     g_SessionMutex;
+std::shared_ptr<NativeSession> g_Session;        ///< Current native session, if any
+CaptureQueue::Stats            g_LastCaptureStats; ///< Of the last session. Guarded by g_SessionMutex
+
+void IdentifyClip(Audioneex::Recognizer *recognizer, const AudioBlockView<S16bit> &audio,
+                  Resampler *resampler = nullptr);
+void RunNativeSession(NativeSession *session);
+void StopNativeSession(JNIEnv *env);
+std::string CaptureStatsToJSON(const CaptureQueue::Stats &stats);
+
+std::string ResultsToJSON(const Audioneex::IdMatch* results, KVDataStore* dstore);
+std::string StatsToJSON(const DataStoreStats &stats);
+TCDataStore* GetTCDataStore(ACIEngine::SnapshotPtr &snap);
 
 // Implementation
 
@@ -95,6 +139,40 @@ jboolean Java_com_audioneex_recognition_RecognitionService_Initialize(JNIEnv *en
 	return true;
 }
 
+jboolean Java_com_audioneex_recognition_RecognitionService_Reload(JNIEnv *env,
+		                                                          jclass clazz,
+		                                                          jstring datastoreDir)
+{
+    try{
+	   const char *ddir_c = env->GetStringUTFChars(datastoreDir, NULL);
+	   if (NULL == ddir_c)
+		   throw std::runtime_error("Couldn't get C string from JNI");
+	   std::string dstoreDir = ddir_c;
+	   env->ReleaseStringUTFChars(datastoreDir, ddir_c);
+	   LOG_D("JNI Reload: Datastore dir: %s", dstoreDir.c_str())
+
+	   // The new catalog is loaded in the background and swapped in
+	   // at the start of the next identification session.
+	   bool started = ACIEngine::instance().reload(dstoreDir,
+	       [dstoreDir](const std::string &error){
+	           if(error.empty()){
+	              LOG_D("JNI Reload: Catalog %s ready", dstoreDir.c_str())
+	           }
+	           else{
+	              LOG_E("NATIVE EXCEPTION [RecognitionService.Reload()]: %s", error.c_str())
+	           }
+	       });
+
+	   if(!started)
+	      throw std::runtime_error("A reload is already in progress");
+    }
+	catch(const std::exception &ex){
+	   LOG_E("NATIVE EXCEPTION [RecognitionService.Reload()]: %s", ex.what())
+       return false;
+	}
+	return true;
+}
+
 jboolean Java_com_audioneex_recognition_Recognizer_Identify(JNIEnv *env,
 		                                                    jclass clazz,
 		                                                    jfloatArray audio,
@@ -110,7 +188,8 @@ jboolean Java_com_audioneex_recognition_Recognizer_Identify(JNIEnv *env,
 		   throw std::runtime_error("Invalid audio clip length");
 
 	   LOG_D("JNI Identify: Identifying clip of %d samples", audiolen)
-       ACIEngine::instance().recognizer()->Identify(audio_c, audiolen);
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+       snap->Recognizer->Identify(audio_c, audiolen);
 	   env->ReleaseFloatArrayElements(audio, audio_c, 0);
     }
 	catch(const std::exception &ex){
@@ -124,10 +203,11 @@ jstring Java_com_audioneex_recognition_Recognizer_GetResults(JNIEnv *env,
 		                                                     jclass clazz)
 {
 	try{
-	   const Audioneex::IdMatch* results = ACIEngine::instance().recognizer()->GetResults();
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   const Audioneex::IdMatch* results = snap->Recognizer->GetResults();
 
 	   if(results){
-		  std::string json = ResultsToJSON(results);
+		  std::string json = ResultsToJSON(results, snap->DataStore.get());
 		  jstring ret = env->NewStringUTF(json.c_str());
 		  LOG_D("ID RESULTS: %s", json.c_str())
 		  return ret;
@@ -145,7 +225,10 @@ jstring Java_com_audioneex_recognition_Recognizer_GetResults(JNIEnv *env,
 void Java_com_audioneex_recognition_Recognizer_Reset(JNIEnv *env, jclass clazz)
 {
 	try{
-	   ACIEngine::instance().recognizer()->Reset();
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   snap->Recognizer->Reset();
+	   // Start the next session on the latest catalog
+	   ACIEngine::instance().endSession();
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.GetResults()]: %s", ex.what())
@@ -155,7 +238,8 @@ void Java_com_audioneex_recognition_Recognizer_Reset(JNIEnv *env, jclass clazz)
 void Java_com_audioneex_recognition_Recognizer_SetMatchType(JNIEnv *env, jclass clazz, jint mtype)
 {
 	try{
-	   ACIEngine::instance().recognizer()->SetMatchType(static_cast<Audioneex::eMatchType>(mtype));
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   snap->Recognizer->SetMatchType(static_cast<Audioneex::eMatchType>(mtype));
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.SetMatchType()]: %s", ex.what())
@@ -165,7 +249,8 @@ void Java_com_audioneex_recognition_Recognizer_SetMatchType(JNIEnv *env, jclass
 jint Java_com_audioneex_recognition_Recognizer_GetMatchType(JNIEnv *env, jclass clazz)
 {
 	try{
-	   return ACIEngine::instance().recognizer()->GetMatchType();
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   return snap->Recognizer->GetMatchType();
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.GetMatchType()]: %s", ex.what())
@@ -176,7 +261,8 @@ jint Java_com_audioneex_recognition_Recognizer_GetMatchType(JNIEnv *env, jclass
 void Java_com_audioneex_recognition_Recognizer_SetMMS(JNIEnv *env, jclass clazz, jfloat value)
 {
 	try{
-	   ACIEngine::instance().recognizer()->SetMMS(value);
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   snap->Recognizer->SetMMS(value);
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.SetMMS()]: %s", ex.what())
@@ -186,7 +272,8 @@ void Java_com_audioneex_recognition_Recognizer_SetMMS(JNIEnv *env, jclass clazz,
 jfloat Java_com_audioneex_recognition_Recognizer_GetMMS(JNIEnv *env, jclass clazz)
 {
 	try{
-	   return ACIEngine::instance().recognizer()->GetMMS();
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   return snap->Recognizer->GetMMS();
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.GetMMS()]: %s", ex.what())
@@ -197,7 +284,8 @@ jfloat Java_com_audioneex_recognition_Recognizer_GetMMS(JNIEnv *env, jclass claz
 void Java_com_audioneex_recognition_Recognizer_SetIdentificationType(JNIEnv *env, jclass clazz, jint idtype)
 {
 	try{
-	   ACIEngine::instance().recognizer()->SetIdentificationType(static_cast<Audioneex::eIdentificationType>(idtype));
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   snap->Recognizer->SetIdentificationType(static_cast<Audioneex::eIdentificationType>(idtype));
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.SetIdentificationType()]: %s", ex.what())
@@ -207,7 +295,8 @@ void Java_com_audioneex_recognition_Recognizer_SetIdentificationType(JNIEnv *env
 jint Java_com_audioneex_recognition_Recognizer_GetIdentificationType(JNIEnv *env, jclass clazz)
 {
 	try{
-	   return ACIEngine::instance().recognizer()->GetIdentificationType();
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   return snap->Recognizer->GetIdentificationType();
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.GetIdentificationType()]: %s", ex.what())
@@ -218,7 +307,8 @@ jint Java_com_audioneex_recognition_Recognizer_GetIdentificationType(JNIEnv *env
 void Java_com_audioneex_recognition_Recognizer_SetIdentificationMode(JNIEnv *env, jclass clazz, jint idmode)
 {
 	try{
-	   ACIEngine::instance().recognizer()->SetIdentificationMode(static_cast<Audioneex::eIdentificationMode>(idmode));
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   snap->Recognizer->SetIdentificationMode(static_cast<Audioneex::eIdentificationMode>(idmode));
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.SetIdentificationMode()]: %s", ex.what())
@@ -228,7 +318,8 @@ void Java_com_audioneex_recognition_Recognizer_SetIdentificationMode(JNIEnv *env
 jint Java_com_audioneex_recognition_Recognizer_GetIdentificationMode(JNIEnv *env, jclass clazz)
 {
 	try{
-	   return ACIEngine::instance().recognizer()->GetIdentificationMode();
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   return snap->Recognizer->GetIdentificationMode();
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.GetIdentificationMode()]: %s", ex.what())
@@ -239,7 +330,8 @@ jint Java_com_audioneex_recognition_Recognizer_GetIdentificationMode(JNIEnv *env
 void Java_com_audioneex_recognition_Recognizer_SetBinaryIdThreshold(JNIEnv *env, jclass clazz, jfloat value)
 {
 	try{
-	   ACIEngine::instance().recognizer()->SetBinaryIdThreshold(value);
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   snap->Recognizer->SetBinaryIdThreshold(value);
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.SetBinaryIdThreshold()]: %s", ex.what())
@@ -249,7 +341,8 @@ void Java_com_audioneex_recognition_Recognizer_SetBinaryIdThreshold(JNIEnv *env,
 jfloat Java_com_audioneex_recognition_Recognizer_GetBinaryIdThreshold(JNIEnv *env, jclass clazz)
 {
 	try{
-	   return ACIEngine::instance().recognizer()->GetBinaryIdThreshold();
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   return snap->Recognizer->GetBinaryIdThreshold();
     }
 	catch(const std::exception &ex){
 	   LOG_E("EXCEPTION [Recognizer.GetBinaryIdThreshold()]: %s", ex.what())
@@ -257,8 +350,151 @@ jfloat Java_com_audioneex_recognition_Recognizer_GetBinaryIdThreshold(JNIEnv *en
 	return UNSPECIFIED_ERROR;
 }
 
+jstring Java_com_audioneex_recognition_Recognizer_GetEngineStats(JNIEnv *env, jclass clazz)
+{
+	try{
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   std::string json = StatsToJSON(GetTCDataStore(snap)->GetStats());
+	   return env->NewStringUTF(json.c_str());
+    }
+	catch(const std::exception &ex){
+	   LOG_E("EXCEPTION [Recognizer.GetEngineStats()]: %s", ex.what())
+       std::string error = "{ \"status\":\"ERROR\",\"message\":\""+std::string(ex.what())+"\"}";
+       return env->NewStringUTF(error.c_str());
+	}
+}
+
+void Java_com_audioneex_recognition_Recognizer_ResetEngineStats(JNIEnv *env, jclass clazz)
+{
+	try{
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   GetTCDataStore(snap)->ResetStats();
+    }
+	catch(const std::exception &ex){
+	   LOG_E("EXCEPTION [Recognizer.ResetEngineStats()]: %s", ex.what())
+	}
+}
+
+jboolean Java_com_audioneex_recognition_RecognitionService_StartNativeSession(JNIEnv *env,
+		                                                                      jobject thiz,
+		                                                                      jint sampleRate,
+		                                                                      jint frameSize,
+		                                                                      jint nframes,
+		                                                                      jboolean dropOldest,
+		                                                                      jboolean continuous)
+{
+	try{
+	   if(frameSize <= 0 || nframes <= 0)
+		   throw std::invalid_argument("Invalid capture queue size");
+	   if(sampleRate <= 0)
+		   throw std::invalid_argument("Invalid sample rate");
+
+	   StopNativeSession(env);
+
+	   // Start afresh, as the audio source used to do on start
+	   ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+	   snap->Recognizer->Reset();
+	   ACIEngine::instance().endSession();
+
+	   std::shared_ptr<NativeSession> session = std::make_shared<NativeSession>();
+	   session->Queue.reset(new CaptureQueue(nframes, frameSize, sampleRate, 1,
+	                        dropOldest ? CaptureQueue::DROP_OLDEST : CaptureQueue::BLOCK));
+	   if(sampleRate != 11025)
+	      session->Converter.reset(new Resampler(sampleRate, 11025));
+	   session->Continuous = continuous;
+
+	   jclass clazz = env->GetObjectClass(thiz);
+	   session->OnResults = env->GetMethodID(clazz, "SignalNativeResults", "(Ljava/lang/String;)V");
+	   session->OnError = env->GetMethodID(clazz, "SignalAudioSourceError", "(Ljava/lang/String;)V");
+	   env->DeleteLocalRef(clazz);
+
+	   if(NULL == session->OnResults || NULL == session->OnError)
+		   throw std::runtime_error("Couldn't find the RecognitionService callbacks");
+	   if(env->GetJavaVM(&session->VM) != JNI_OK)
+		   throw std::runtime_error("Couldn't get the Java VM");
+
+	   session->Service = env->NewGlobalRef(thiz);
+	   session->Consumer = std::thread(RunNativeSession, session.get());
+
+	   std::lock_guard<std::mutex> lock(g_SessionMutex);
+	   g_Session = session;
+	   LOG_D("JNI StartNativeSession: %d frames of %d samples at %d Hz", nframes, frameSize, sampleRate)
+    }
+	catch(const std::exception &ex){
+	   LOG_E("EXCEPTION [RecognitionService.StartNativeSession()]: %s", ex.what())
+	   return false;
+	}
+	return true;
+}
+
+void Java_com_audioneex_recognition_RecognitionService_StopNativeSession(JNIEnv *env, jobject thiz)
+{
+	try{
+	   StopNativeSession(env);
+    }
+	catch(const std::exception &ex){
+	   LOG_E("EXCEPTION [RecognitionService.StopNativeSession()]: %s", ex.what())
+	}
+}
+
+jstring Java_com_audioneex_recognition_RecognitionService_GetCaptureStats(JNIEnv *env, jobject thiz)
+{
+	try{
+	   CaptureQueue::Stats stats;
+	   {
+	      std::lock_guard<std::mutex> lock(g_SessionMutex);
+	      stats = g_Session ? g_Session->Queue->GetStats() : g_LastCaptureStats;
+	   }
+	   return env->NewStringUTF(CaptureStatsToJSON(stats).c_str());
+    }
+	catch(const std::exception &ex){
+	   LOG_E("EXCEPTION [RecognitionService.GetCaptureStats()]: %s", ex.what())
+       std::string error = "{ \"status\":\"ERROR\",\"message\":\""+std::string(ex.what())+"\"}";
+       return env->NewStringUTF(error.c_str());
+	}
+}
+
+jint Java_com_audioneex_audio_NativeAudioQueue_Write(JNIEnv *env,
+		                                             jclass clazz,
+		                                             jobject samples,
+		                                             jint nsamples)
+{
+	try{
+	   std::shared_ptr<NativeSession> session;
+	   {
+	      std::lock_guard<std::mutex> lock(g_SessionMutex);
+	      session = g_Session;
+	   }
+	   if(!session)
+	      return 0;
+
+	   const S16bit *data = static_cast<const S16bit*>(env->GetDirectBufferAddress(samples));
+	   jlong capacity = env->GetDirectBufferCapacity(samples);
+
+	   if (NULL == data)
+		   throw std::runtime_error("Not a direct buffer");
+	   if(nsamples < 0 || nsamples * sizeof(S16bit) > static_cast<size_t>(capacity))
+		   throw std::runtime_error("Invalid number of samples");
+
+	   return static_cast<jint>(session->Queue->Write(data, nsamples));
+    }
+	catch(const std::exception &ex){
+	   LOG_E("EXCEPTION [NativeAudioQueue.Write()]: %s", ex.what())
+	}
+	return UNSPECIFIED_ERROR;
+}
+
 
-std::string ResultsToJSON(const Audioneex::IdMatch* results)
+TCDataStore* GetTCDataStore(ACIEngine::SnapshotPtr &snap)
+{
+    TCDataStore *dstore = dynamic_cast<TCDataStore*>(snap->DataStore.get());
+    if(!dstore)
+       throw std::runtime_error("The datastore does not keep statistics");
+    return dstore;
+}
+
+
+std::string ResultsToJSON(const Audioneex::IdMatch* results, KVDataStore* dstore)
 {
     std::stringstream ss;
     std::map<int, std::string> idclass;
@@ -269,9 +505,12 @@ std::string ResultsToJSON(const Audioneex::IdMatch* results)
 
     ss << "{ \"status\":\"OK\", \"Matches\":[";
 
-    for(int i=0; !Audioneex::IsNull(results[i]); i++){
-    	std::string meta = ACIEngine::instance().datastore()->GetMetadata(results[i].FID);
-    	ss << (i>0?",":"")
+    for(int i=0, n=0; !Audioneex::IsNull(results[i]); i++){
+    	// Suppress the matches for deleted fingerprints
+    	if(dstore->IsDeleted(results[i].FID))
+    	   continue;
+    	std::string meta = dstore->GetMetadata(results[i].FID);
+    	ss << (n++>0?",":"")
     	   << "{"
            << "\"FID\":" << results[i].FID << ","
            << "\"Score\":" << results[i].Score << ","
@@ -284,3 +523,142 @@ std::string ResultsToJSON(const Audioneex::IdMatch* results)
     return ss.str();
 }
 
+
+std::string StatsToJSON(const DataStoreStats &stats)
+{
+    std::stringstream ss;
+
+    const char* names[] = { "Index", "Fingerprints", "Metadata" };
+    const CollectionStats* colls[] = { &stats.Index, &stats.Fingerprints, &stats.Metadata };
+
+    // Times are in us. The latency histogram buckets are described in
+    // CollectionStats.
+    ss << "{ \"status\":\"OK\"";
+
+    for(int i=0; i<3; i++){
+        const CollectionStats &c = *colls[i];
+        ss << ",\"" << names[i] << "\":{"
+           << "\"Calls\":" << c.Calls << ","
+           << "\"Bytes\":" << c.Bytes << ","
+           << "\"Hits\":" << c.Hits << ","
+           << "\"Misses\":" << c.Misses << ","
+           << "\"DBTime\":" << c.DBTime / 1000 << ","
+           << "\"CopyTime\":" << c.CopyTime / 1000 << ","
+           << "\"P50\":" << c.GetPercentile(0.5) << ","
+           << "\"P99\":" << c.GetPercentile(0.99) << ","
+           << "\"Latency\":[";
+        for(int b=0; b<CollectionStats::LATENCY_BUCKETS; b++)
+            ss << (b>0?",":"") << c.Latency[b];
+        ss << "]}";
+    }
+    ss << "}";
+    return ss.str();
+}
+
+
+void IdentifyClip(Audioneex::Recognizer *recognizer, const AudioBlockView<S16bit> &audio,
+                  Resampler *resampler)
+{
+    AudioBlockPool<Sfloat>::Handle clip = g_ClipPool.Acquire(audio.Size());
+    audio.Normalize(clip->Data());
+
+    if(resampler){
+       AudioBlockPool<Sfloat>::Handle out = g_ClipPool.Acquire(resampler->GetMaxOutput(audio.Size()));
+       out->Resize(resampler->Process(clip->Data(), audio.Size(), out->Data()));
+       clip = std::move(out);
+    }
+
+    recognizer->Identify(clip->Data(), clip->Size());
+}
+
+void RunNativeSession(NativeSession *session)
+{
+    JNIEnv *env = NULL;
+    if(session->VM->AttachCurrentThread(&env, NULL) != JNI_OK){
+       LOG_E("NATIVE EXCEPTION [RunNativeSession()]: Couldn't attach to the Java VM")
+       // Nobody will read the queue, don't let the audio thread wait on it
+       session->Queue->Close();
+       return;
+    }
+
+    AudioBlock<S16bit> frame;
+    bool done = false;
+
+    while(!done && session->Queue->Wait())
+    {
+        try{
+           while(!done && session->Queue->Pull(frame))
+           {
+              ACIEngine::SnapshotPtr snap = ACIEngine::instance().session();
+              IdentifyClip(snap->Recognizer.get(), frame, session->Converter.get());
+              const Audioneex::IdMatch* results = snap->Recognizer->GetResults();
+
+              if(results){
+                 std::string json = ResultsToJSON(results, snap->DataStore.get());
+                 LOG_D("ID RESULTS: %s", json.c_str())
+                 snap->Recognizer->Reset();
+                 ACIEngine::instance().endSession();
+
+                 jstring jres = env->NewStringUTF(json.c_str());
+                 env->CallVoidMethod(session->Service, session->OnResults, jres);
+                 env->DeleteLocalRef(jres);
+                 done = !session->Continuous;
+              }
+           }
+        }
+        catch(const std::exception &ex){
+           LOG_E("NATIVE EXCEPTION [RunNativeSession()]: %s", ex.what())
+           jstring jerr = env->NewStringUTF(ex.what());
+           env->CallVoidMethod(session->Service, session->OnError, jerr);
+           env->DeleteLocalRef(jerr);
+           done = true;
+        }
+
+        if(env->ExceptionCheck())
+           env->ExceptionClear();
+    }
+
+    // Don't let the audio thread wait on a queue nobody reads anymore
+    session->Queue->Close();
+    session->VM->DetachCurrentThread();
+}
+
+
+void StopNativeSession(JNIEnv *env)
+{
+    std::shared_ptr<NativeSession> session;
+    {
+        std::lock_guard<std::mutex> lock(g_SessionMutex);
+        session.swap(g_Session);
+    }
+    if(!session)
+       return;
+
+    // The audio thread may still be writing through its own reference
+    session->Queue->Close();
+    if(session->Consumer.joinable())
+       session->Consumer.join();
+    env->DeleteGlobalRef(session->Service);
+
+    CaptureQueue::Stats stats = session->Queue->GetStats();
+    {
+        std::lock_guard<std::mutex> lock(g_SessionMutex);
+        g_LastCaptureStats = stats;
+    }
+    LOG_D("JNI StopNativeSession: %s", CaptureStatsToJSON(stats).c_str())
+}
+
+
+std::string CaptureStatsToJSON(const CaptureQueue::Stats &stats)
+{
+    std::stringstream ss;
+    ss << "{ \"status\":\"OK\","
+       << "\"Frames\":" << stats.Frames << ","
+       << "\"Pulled\":" << stats.Pulled << ","
+       << "\"Dropped\":" << stats.Dropped << ","
+       << "\"Discarded\":" << stats.Discarded << ","
+       << "\"Overflows\":" << stats.Overflows << ","
+       << "\"BlockedTime\":" << stats.BlockedUs
+       << "}";
+    return ss.str();
+}
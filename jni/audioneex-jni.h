@@ -33,6 +33,12 @@ OF SUCH DAMAGE.
 #define AUDIOINEEX_ACI_H
 
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include <unistd.h>
 
 #include "TCDataStore.h"
 #include "audioneex.h"
@@ -48,41 +54,161 @@ enum {
 
 class ACIEngine
 {
+public:
+
+	/// An opened datastore along with the recognizer using it. The calls into
+	/// the engine hold a reference to the snapshot they started on, so that a
+	/// reloaded catalog can be swapped in while identifications are running.
+	struct Snapshot
+	{
+	    std::unique_ptr<KVDataStore>           DataStore;
+	    std::unique_ptr<Audioneex::Recognizer> Recognizer;
+	    int                                    MatchType;  ///< Match type of the index (-1 if unknown)
+	};
+
+	typedef std::shared_ptr<Snapshot> SnapshotPtr;
+
+	typedef std::function<void(const std::string &error)> ReloadCallback;
+
+private:
+
 	static ACIEngine mInstance;
 
-	std::unique_ptr<Audioneex::Recognizer> mRecognizer;
-	std::unique_ptr<KVDataStore>           mDataStore;
-	bool mInitialized;
+	std::mutex        mMutex;
+	SnapshotPtr       mSession;      ///< Snapshot used by the current identification session
+	SnapshotPtr       mLatest;       ///< Most recently loaded snapshot
+	std::thread       mLoader;
+	std::atomic<bool> mReloading;
+	std::atomic<bool> mInitialized;
+
+	static SnapshotPtr load(const std::string &dataDir, bool warm)
+	{
+	   SnapshotPtr snap = std::make_shared<Snapshot>();
+
+	   // The info database, if any, records the match type of the index
+	   bool has_info = access((dataDir + "/data.inf").c_str(), F_OK) == 0;
+
+	   TCDataStore *dstore = new TCDataStore (dataDir);
+	   snap->DataStore.reset( dstore );
+	   dstore->Open( KVDataStore::GET, true, true, has_info );
+
+	   snap->MatchType = has_info ? dstore->GetInfo().MatchType : -1;
+
+	   // Read the index in so that the first identifications on the
+	   // new catalog don't have to wait for the disk.
+	   if(warm)
+	      dstore->Warm();
+
+	   snap->Recognizer.reset( Audioneex::Recognizer::Create() );
+	   snap->Recognizer->SetDataStore( dstore );
+
+	   // A recognizer using a match type other than the one the index was
+	   // built with returns wrong matches
+	   if(snap->MatchType >= 0)
+	      snap->Recognizer->SetMatchType( static_cast<Audioneex::eMatchType>(snap->MatchType) );
+
+	   return snap;
+	}
 
 public:
 
 	ACIEngine() :
+	   mReloading(false),
 	   mInitialized(false)
 	{}
 
+	~ACIEngine()
+	{
+	   if(mLoader.joinable())
+	      mLoader.join();
+	}
+
 	static ACIEngine& instance() { return mInstance; }
 
 	void init(std::string dataDir)
 	{
-	   mDataStore.reset( new TCDataStore (dataDir) );
-	   mDataStore->Open( KVDataStore::GET, true, true );
+	   SnapshotPtr snap = load(dataDir, false);
 
-       mRecognizer.reset( Audioneex::Recognizer::Create() );
-       mRecognizer->SetDataStore( mDataStore.get() );
+	   std::lock_guard<std::mutex> lock(mMutex);
+	   mSession = mLatest = snap;
+	   mInitialized = true;
+	}
 
-       mInitialized = true;
+	/// Open and warm the datastore in the given directory in a background
+	/// thread. The new catalog is used starting from the next identification
+	/// session (see endSession()), while the current one goes on with the old
+	/// catalog. The callback, if any, is called by the loading thread when done,
+	/// with an empty string on success. Return false if a reload is in progress.
+	bool reload(std::string dataDir, ReloadCallback done = ReloadCallback())
+	{
+	   if(!mInitialized)
+	      throw std::runtime_error("ACI engine not initialized");
+
+	   if(mReloading.exchange(true))
+	      return false;
+
+	   if(mLoader.joinable())
+	      mLoader.join();
+
+	   mLoader = std::thread([this, dataDir, done](){
+	       std::string error;
+	       try{
+	          SnapshotPtr snap = load(dataDir, true);
+	          std::lock_guard<std::mutex> lock(mMutex);
+	          mLatest = snap;
+	       }
+	       catch(const std::exception &ex){
+	          error = ex.what();
+	          if(error.empty())
+	             error = "Unknown error";
+	       }
+	       mReloading = false;
+	       if(done)
+	          done(error);
+	   });
+
+	   return true;
 	}
 
-	Audioneex::Recognizer* recognizer() {
-		if(!mInitialized)
-		   throw std::runtime_error("ACI engine not initialized");
-		return mRecognizer.get();
+	bool isReloading() const { return mReloading; }
+
+	/// Get the snapshot used by the current identification session. Callers
+	/// keep the snapshot alive for as long as they hold the reference.
+	SnapshotPtr session()
+	{
+	   std::lock_guard<std::mutex> lock(mMutex);
+	   if(!mInitialized)
+	      throw std::runtime_error("ACI engine not initialized");
+	   return mSession;
 	}
 
-	KVDataStore* datastore() {
-		if(!mInitialized)
-		   throw std::runtime_error("ACI engine not initialized");
-		return mDataStore.get();
+	/// Mark the end of the current identification session. If a new catalog
+	/// has been loaded in the meantime it's swapped in, with the recognizer
+	/// settings carried over. The match type is only carried over if the new
+	/// index doesn't record its own. The old snapshot is released once the
+	/// calls still using it are done.
+	void endSession()
+	{
+	   SnapshotPtr old;
+	   {
+	      std::lock_guard<std::mutex> lock(mMutex);
+
+	      if(!mInitialized || mLatest == mSession)
+	         return;
+
+	      Audioneex::Recognizer *from = mSession->Recognizer.get();
+	      Audioneex::Recognizer *to = mLatest->Recognizer.get();
+
+	      if(mLatest->MatchType < 0)
+	         to->SetMatchType( from->GetMatchType() );
+	      to->SetMMS( from->GetMMS() );
+	      to->SetIdentificationType( from->GetIdentificationType() );
+	      to->SetIdentificationMode( from->GetIdentificationMode() );
+	      to->SetBinaryIdThreshold( from->GetBinaryIdThreshold() );
+
+	      old.swap(mSession);
+	      mSession = mLatest;
+	   }
 	}
 
 };
@@ -37,10 +37,16 @@ OF SUCH DAMAGE.
 #include <cstring>
 #include <cmath>
 #include <cassert>
+#include <new>
 #include <vector>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
 #include <iostream>
 #include <sstream>
 
+#include "SampleConvert.h"
+
 typedef int8_t   S8bit;
 typedef int16_t  S16bit;
 typedef int32_t  S32bit;
@@ -52,6 +58,118 @@ typedef float    Sfloat;
 
 template <class T> class AudioBlock;
 
+/// Alignment of the audio buffers (a cache line)
+const size_t AUDIOBLOCK_ALIGNMENT = 64;
+
+
+/// Convert samples to float by multiplying by the reciprocal of the given
+/// normalization factor. The signed formats and 8 bit unsigned (offset binary)
+/// samples use the SIMD kernels in SampleConvert.h.
+template <class T>
+inline void NormalizeSamples(const T *in, Sfloat *out, size_t n, float normFactor)
+{
+    const float scale = 1.f / normFactor;
+    for(size_t i=0; i<n; i++)
+        out[i] = in[i] * scale;
+}
+
+inline void NormalizeSamples(const S8bit *in, Sfloat *out, size_t n, float)  { SamplesToFloat(in, out, n); }
+inline void NormalizeSamples(const U8bit *in, Sfloat *out, size_t n, float)  { SamplesToFloat(in, out, n); }
+inline void NormalizeSamples(const S16bit *in, Sfloat *out, size_t n, float) { SamplesToFloat(in, out, n); }
+inline void NormalizeSamples(const S32bit *in, Sfloat *out, size_t n, float) { SamplesToFloat(in, out, n); }
+
+
+/// Channel operations on interleaved frames, normalizing the samples as
+/// NormalizeSamples. Float and 16 bit samples are converted and mixed in one
+/// pass by the kernels in SampleConvert.h, the other formats go through a
+/// chunk on the stack.
+
+/// Size of the chunks, in samples
+const size_t NORMALIZE_CHUNK_SAMPLES = 1024;
+
+/// Mix the channels of each frame to mono with the given weights (one per
+/// channel), or average them if null.
+template <class T>
+inline void NormalizeDownmix(const T *in, Sfloat *out, size_t nframes, size_t nchans,
+                             const float *weights, float normFactor)
+{
+    Sfloat chunk[NORMALIZE_CHUNK_SAMPLES];
+    std::vector<Sfloat> frame;
+    Sfloat *buf = chunk;
+    size_t chunk_frames = NORMALIZE_CHUNK_SAMPLES / nchans;
+    if(chunk_frames == 0){
+       // More channels than fit in the chunk
+       frame.resize(nchans);
+       buf = frame.data();
+       chunk_frames = 1;
+    }
+
+    for(size_t f=0; f<nframes; f+=chunk_frames){
+        size_t n = std::min(chunk_frames, nframes - f);
+        NormalizeSamples(in + f * nchans, buf, n * nchans, normFactor);
+        DownmixSamples(buf, out + f, n, nchans, weights);
+    }
+}
+
+inline void NormalizeDownmix(const S16bit *in, Sfloat *out, size_t nframes, size_t nchans,
+                             const float *weights, float)
+{
+    DownmixSamples(in, out, nframes, nchans, weights);
+}
+
+inline void NormalizeDownmix(const Sfloat *in, Sfloat *out, size_t nframes, size_t nchans,
+                             const float *weights, float)
+{
+    DownmixSamples(in, out, nframes, nchans, weights);
+}
+
+/// Copy one channel of each frame.
+template <class T>
+inline void NormalizeChannel(const T *in, Sfloat *out, size_t nframes, size_t nchans,
+                             size_t chan, float normFactor)
+{
+    T chunk[NORMALIZE_CHUNK_SAMPLES];
+    for(size_t f=0; f<nframes; f+=NORMALIZE_CHUNK_SAMPLES){
+        size_t n = std::min(NORMALIZE_CHUNK_SAMPLES, nframes - f);
+        for(size_t i=0; i<n; i++)
+            chunk[i] = in[(f + i) * nchans + chan];
+        NormalizeSamples(chunk, out + f, n, normFactor);
+    }
+}
+
+inline void NormalizeChannel(const S16bit *in, Sfloat *out, size_t nframes, size_t nchans,
+                             size_t chan, float)
+{
+    ExtractChannel(in, out, nframes, nchans, chan);
+}
+
+inline void NormalizeChannel(const Sfloat *in, Sfloat *out, size_t nframes, size_t nchans,
+                             size_t chan, float)
+{
+    ExtractChannel(in, out, nframes, nchans, chan);
+}
+
+/// Split the frames into one buffer per channel.
+template <class T>
+inline void NormalizeDeinterleave(const T *in, Sfloat *const *out, size_t nframes, size_t nchans,
+                                  float normFactor)
+{
+    for(size_t c=0; c<nchans; c++)
+        NormalizeChannel(in, out[c], nframes, nchans, c, normFactor);
+}
+
+inline void NormalizeDeinterleave(const S16bit *in, Sfloat *const *out, size_t nframes, size_t nchans,
+                                  float)
+{
+    DeinterleaveSamples(in, out, nframes, nchans);
+}
+
+inline void NormalizeDeinterleave(const Sfloat *in, Sfloat *const *out, size_t nframes, size_t nchans,
+                                  float)
+{
+    DeinterleaveSamples(in, out, nframes, nchans);
+}
+
 
 /// A no-frills class for manipulating audio buffers. It is intended to be
 /// used in contexts where audio buffers are mostly fixed size and dynamic
@@ -71,17 +189,26 @@ class AudioBlock
     /// @param nchans Number of audio channels.
     /// @param initSize Set the initial size of the block. A negative value means
     /// the block has an initial size equal to the value of the nsamples parameter.
-    /// The block's audio data is initialized to zero (samples).
-    AudioBlock(size_t nsamples, float sampleRate, size_t nchans, int initSize=-1);
+    /// @param clear Initialize the block's audio data to zero (samples). Pass false
+    /// if the data is going to be overwritten anyway.
+    AudioBlock(size_t nsamples, float sampleRate, size_t nchans, int initSize=-1, bool clear=true);
 
-    /// Copy constructor.
+    /// Copy constructor. The copy has the same capacity, but only the
+    /// available data is copied.
     AudioBlock(const AudioBlock<T> &block);
 
+    /// Move constructor. The given block is left null.
+    AudioBlock(AudioBlock<T> &&block) noexcept;
+
     /// D-tor.
     ~AudioBlock();
 
-    /// Assignment operator.
-    AudioBlock<T>& operator=(const AudioBlock<T> block);
+    /// Assignment operator. The buffer of this block is reused if it has
+    /// the same capacity, so no allocation takes place.
+    AudioBlock<T>& operator=(const AudioBlock<T> &block);
+
+    /// Move assignment operator. The given block is left null.
+    AudioBlock<T>& operator=(AudioBlock<T> &&block) noexcept;
 
     /// Sample access.
     T& operator[](size_t i);
@@ -91,7 +218,8 @@ class AudioBlock
     /// @param sampleRate Sampling frequency of the audio.
     /// @param nchans Number of audio channels.
     /// @param initSize Initial size of the block (default is nsamples)
-    void Create(size_t nsamples, float sampleRate, size_t nchans, int initSize=-1);
+    /// @param clear Initialize the audio data to zero
+    void Create(size_t nsamples, float sampleRate, size_t nchans, int initSize=-1, bool clear=true);
 
     /// Return the maximum size (capacity) of the audio block in samples (all channels)
     size_t  Capacity() const;
@@ -128,7 +256,7 @@ class AudioBlock
     /// TODO: check whether 'newsize' is an integer multiple of the number of channels.
     void    Resize(size_t newsize);
 
-    /// Pointer to audio data
+    /// Pointer to audio data. The buffer is aligned to AUDIOBLOCK_ALIGNMENT bytes.
     T*       Data();
     const T* Data() const;
 
@@ -152,6 +280,26 @@ class AudioBlock
     /// block, the pointer should be checked against this block's pointer.
     AudioBlock<Sfloat>* Normalize();
 
+    /// Mix the channels to mono with the given weights (one per channel), or
+    /// average them if null, normalizing the samples in [-1,1]. The mono block
+    /// must have the same sample rate and room for the frames of this block.
+    /// It is set to one channel and resized to the number of frames.
+    void Downmix(AudioBlock<Sfloat> &mono, const float *weights=nullptr) const;
+
+    /// Mix the channels to mono in place (float blocks only).
+    void Downmix(const float *weights=nullptr);
+
+    /// Copy a channel into the given mono block, normalized in [-1,1]. The mono
+    /// block is set up as by Downmix.
+    void GetChannel(size_t chan, AudioBlock<Sfloat> &mono) const;
+
+    /// Keep only the given channel, in place (float blocks only).
+    void SelectChannel(size_t chan);
+
+    /// Split the channels into the given mono blocks, normalized in [-1,1].
+    /// There must be a block per channel, each set up as by Downmix.
+    void Deinterleave(std::vector<AudioBlock<Sfloat>> &channels) const;
+
     /// This method appends the (available) data of the given block to this block's available
     /// data. It does not reallocate this block's buffer if there is not enough space
     /// to append all the data, in which case a truncation occurs.
@@ -181,7 +329,9 @@ class AudioBlock
     /// block is created.
     void ComputeNormalizationFactor();
     void DoAppend(const T* data, size_t nsamples);
-    void Swap(AudioBlock<T> &b1, AudioBlock<T> &b2);
+    static T* AllocData(size_t nsamples);
+    static void FreeData(T* data);
+    void Swap(AudioBlock<T> &b1, AudioBlock<T> &b2) noexcept;
 
 };
 
@@ -208,7 +358,7 @@ AudioBlock<T>::AudioBlock() :
 
 
 template <class T>
-AudioBlock<T>::AudioBlock(size_t nsamples, float sampleRate, size_t nchans, int initSize) :
+AudioBlock<T>::AudioBlock(size_t nsamples, float sampleRate, size_t nchans, int initSize, bool clear) :
     mCapacity(0),
     mDuration(0),
     mSize(0),
@@ -219,7 +369,7 @@ AudioBlock<T>::AudioBlock(size_t nsamples, float sampleRate, size_t nchans, int
     mTimestamp(0),
     mNormFactor(1.f)
 {
-    Create(nsamples,sampleRate,nchans,initSize);
+    Create(nsamples,sampleRate,nchans,initSize,clear);
     ComputeNormalizationFactor();
 }
 
@@ -231,25 +381,44 @@ AudioBlock<T>::AudioBlock(const AudioBlock<T> &block) :
     mSize       (block.mSize),
     mSampleRate (block.mSampleRate),
     mChannels   (block.mChannels),
-    mData       (block.mCapacity ? new T[block.mCapacity] : nullptr),
-    mID         (0),
+    mData       (block.mCapacity ? AllocData(block.mCapacity) : nullptr),
+    mID         (block.mID),
+    mTimestamp  (block.mTimestamp),
+    mNormFactor (block.mNormFactor)
+{
+    std::copy(block.mData, block.mData + mSize, mData);
+}
+
+
+template <class T>
+AudioBlock<T>::AudioBlock(AudioBlock<T> &&block) noexcept :
+    mCapacity   (block.mCapacity),
+    mDuration   (block.mDuration),
+    mSize       (block.mSize),
+    mSampleRate (block.mSampleRate),
+    mChannels   (block.mChannels),
+    mData       (block.mData),
+    mID         (block.mID),
     mTimestamp  (block.mTimestamp),
     mNormFactor (block.mNormFactor)
 {
-    std::copy(block.mData, block.mData + mCapacity, mData);
+    block.mCapacity = 0;
+    block.mDuration = 0;
+    block.mSize = 0;
+    block.mData = nullptr;
 }
 
 
 template <class T>
 AudioBlock<T>::~AudioBlock()
 {
-    delete[] mData;
+    FreeData(mData);
     mData = nullptr;
 }
 
 
 template <class T>
-inline void AudioBlock<T>::Create(size_t nsamples, float sampleRate, size_t nchans, int initSize)
+inline void AudioBlock<T>::Create(size_t nsamples, float sampleRate, size_t nchans, int initSize, bool clear)
 {
     assert(nsamples > 0);
     assert(sampleRate > 0);
@@ -276,13 +445,37 @@ inline void AudioBlock<T>::Create(size_t nsamples, float sampleRate, size_t ncha
        mSize = mCapacity;
 
     mDuration = mSize / (nchans * sampleRate);
-    mData = new T[mCapacity];
-    memset(mData, 0, mCapacity * sizeof(T));
+    mData = AllocData(mCapacity);
+
+    if(clear)
+       memset(mData, 0, mCapacity * sizeof(T));
 }
 
 
 template <class T>
-inline void AudioBlock<T>::Swap(AudioBlock<T> &b1, AudioBlock<T> &b2)
+inline T* AudioBlock<T>::AllocData(size_t nsamples)
+{
+    // Over-allocate and align by hand, storing the allocated pointer right
+    // before the aligned buffer
+    char *raw = static_cast<char*>(::operator new(nsamples * sizeof(T) +
+                                                  AUDIOBLOCK_ALIGNMENT + sizeof(void*)));
+    uintptr_t data = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + AUDIOBLOCK_ALIGNMENT - 1)
+                     & ~static_cast<uintptr_t>(AUDIOBLOCK_ALIGNMENT - 1);
+    reinterpret_cast<void**>(data)[-1] = raw;
+    return reinterpret_cast<T*>(data);
+}
+
+
+template <class T>
+inline void AudioBlock<T>::FreeData(T* data)
+{
+    if(data)
+       ::operator delete(reinterpret_cast<void**>(data)[-1]);
+}
+
+
+template <class T>
+inline void AudioBlock<T>::Swap(AudioBlock<T> &b1, AudioBlock<T> &b2) noexcept
 {
     std::swap(b1.mCapacity, b2.mCapacity);
     std::swap(b1.mDuration, b2.mDuration);
@@ -290,14 +483,40 @@ inline void AudioBlock<T>::Swap(AudioBlock<T> &b1, AudioBlock<T> &b2)
     std::swap(b1.mSampleRate, b2.mSampleRate);
     std::swap(b1.mChannels, b2.mChannels);
     std::swap(b1.mData, b2.mData);
+    std::swap(b1.mID, b2.mID);
     std::swap(b1.mTimestamp, b2.mTimestamp);
     std::swap(b1.mNormFactor, b2.mNormFactor);
 }
 
 template <class T>
-inline AudioBlock<T>& AudioBlock<T>::operator=(AudioBlock<T> block)
+inline AudioBlock<T>& AudioBlock<T>::operator=(const AudioBlock<T> &block)
+{
+    if(this == &block)
+       return (*this);
+
+    if(mCapacity != block.mCapacity){
+       AudioBlock<T> copy(block);
+       Swap(*this, copy);
+       return (*this);
+    }
+
+    // Same capacity: just copy the available data into our buffer
+    mDuration   = block.mDuration;
+    mSize       = block.mSize;
+    mSampleRate = block.mSampleRate;
+    mChannels   = block.mChannels;
+    mID         = block.mID;
+    mTimestamp  = block.mTimestamp;
+    mNormFactor = block.mNormFactor;
+    std::copy(block.mData, block.mData + mSize, mData);
+    return (*this);
+}
+
+template <class T>
+inline AudioBlock<T>& AudioBlock<T>::operator=(AudioBlock<T> &&block) noexcept
 {
-    Swap(*this, block);
+    AudioBlock<T> tmp(std::move(block));
+    Swap(*this, tmp);
     return (*this);
 }
 
@@ -399,8 +618,7 @@ inline void AudioBlock<T>::Normalize(AudioBlock<Sfloat> &nblock)
     if(nblock.Size() != this->mSize)
        nblock.Resize( this->mSize );
 
-    for(size_t i=0; i<mSize; i++)
-        nblock[i] = mData[i] / mNormFactor;
+    NormalizeSamples(mData, nblock.Data(), nblock.Size(), mNormFactor);
 }
 
 
@@ -411,8 +629,7 @@ inline AudioBlock<Sfloat>* AudioBlock<T>::Normalize()
 
     AudioBlock<Sfloat> *nblock = new AudioBlock<Sfloat>(mSize, mSampleRate, mChannels);
 
-    for(size_t i=0; i<mSize; i++)
-        nblock->Data()[i] = mData[i] / mNormFactor;
+    NormalizeSamples(mData, nblock->Data(), mSize, mNormFactor);
 
     return nblock;
 }
@@ -432,10 +649,80 @@ inline AudioBlock<Sfloat>* AudioBlock<Sfloat>::Normalize()
 }
 
 
+template <class T>
+inline void AudioBlock<T>::Downmix(AudioBlock<Sfloat> &mono, const float *weights) const
+{
+    assert(!IsNull() && !mono.IsNull());
+    assert(mono.Capacity() >= mSize / mChannels);
+
+    mono.SetChannels(1);
+    mono.Resize(mSize / mChannels);
+    mono.SetTimestamp(mTimestamp);
+    NormalizeDownmix(mData, mono.Data(), mono.Size(), mChannels, weights, mNormFactor);
+}
+
+
+template <class T>
+inline void AudioBlock<T>::Downmix(const float *weights)
+{
+    static_assert(std::is_same<T, Sfloat>::value, "In place downmix requires float samples");
+    assert(!IsNull());
+
+    size_t nframes = mSize / mChannels;
+    DownmixSamples(mData, mData, nframes, mChannels, weights);
+    mChannels = 1;
+    Resize(nframes);
+}
+
+
+template <class T>
+inline void AudioBlock<T>::GetChannel(size_t chan, AudioBlock<Sfloat> &mono) const
+{
+    assert(!IsNull() && !mono.IsNull());
+    assert(chan < mChannels && mono.Capacity() >= mSize / mChannels);
+
+    mono.SetChannels(1);
+    mono.Resize(mSize / mChannels);
+    mono.SetTimestamp(mTimestamp);
+    NormalizeChannel(mData, mono.Data(), mono.Size(), mChannels, chan, mNormFactor);
+}
+
+
+template <class T>
+inline void AudioBlock<T>::SelectChannel(size_t chan)
+{
+    static_assert(std::is_same<T, Sfloat>::value, "In place channel selection requires float samples");
+    assert(!IsNull() && chan < mChannels);
+
+    size_t nframes = mSize / mChannels;
+    ExtractChannel(mData, mData, nframes, mChannels, chan);
+    mChannels = 1;
+    Resize(nframes);
+}
+
+
+template <class T>
+inline void AudioBlock<T>::Deinterleave(std::vector<AudioBlock<Sfloat>> &channels) const
+{
+    assert(!IsNull() && channels.size() == mChannels);
+
+    size_t nframes = mSize / mChannels;
+    std::vector<Sfloat*> out(mChannels);
+    for(size_t c=0; c<mChannels; c++){
+        assert(!channels[c].IsNull() && channels[c].Capacity() >= nframes);
+        channels[c].SetChannels(1);
+        channels[c].Resize(nframes);
+        channels[c].SetTimestamp(mTimestamp);
+        out[c] = channels[c].Data();
+    }
+    NormalizeDeinterleave(mData, out.data(), nframes, mChannels, mNormFactor);
+}
+
+
 template <class T>
 inline void AudioBlock<T>::ComputeNormalizationFactor()
 {
-    mNormFactor = pow(2.0f, static_cast<int>(sizeof(T)*8-1));
+    mNormFactor = static_cast<float>(static_cast<uint64_t>(1) << (sizeof(T)*8-1));
 }
 
 
@@ -0,0 +1,368 @@
+/*
+
+Copyright (c) 2014, Audioneex.com.
+Copyright (c) 2014, Alberto Gramaglia.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list
+   of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this
+   list of conditions and the following disclaimer in the documentation and/or other
+   materials provided with the distribution.
+
+3. The name of the author(s) may not be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef AUDIOBLOCKPOOL_H
+#define AUDIOBLOCKPOOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <pthread.h>
+
+#include "AudioBlock.h"
+
+
+/// A pool of recycled audio blocks, for streaming paths that would otherwise
+/// allocate and free a block for every chunk of audio. All the blocks have the
+/// pool's sample rate and number of channels, and are kept in free lists by
+/// capacity. Each thread has a small cache of free blocks per capacity, so that
+/// acquiring and releasing blocks doesn't take a lock in the steady state; the
+/// caches are refilled from, and spilled into, the shared free lists. Blocks are
+/// handed out through handles that return them to the pool when destroyed, also
+/// from threads other than the one that acquired them. The pool must outlive its
+/// handles and the threads using it.
+
+template <class T>
+class AudioBlockPool
+{
+ public:
+
+    typedef AudioBlock<T> Block;
+
+    /// Returns the blocks to their pool. A null pool deletes them.
+    struct Recycler
+    {
+        AudioBlockPool<T> *Pool;
+
+        Recycler(AudioBlockPool<T> *pool = nullptr) : Pool(pool) {}
+
+        void operator()(Block *block) const {
+            if(Pool) Pool->Release(block);
+            else delete block;
+        }
+    };
+
+    typedef std::unique_ptr<Block, Recycler> Handle;
+
+    struct Stats
+    {
+        uint64_t  Acquired;    ///< Blocks handed out
+        uint64_t  Allocated;   ///< Blocks created because none was free
+        uint64_t  CacheHits;   ///< Blocks taken from the thread caches
+        uint64_t  Free;        ///< Blocks in the shared free lists
+    };
+
+    /// Constructor.
+    /// @param sampleRate Sampling frequency of the blocks.
+    /// @param nchans Number of audio channels of the blocks.
+    /// @param cacheSize Maximum number of free blocks per capacity kept by
+    /// each thread.
+    AudioBlockPool(float sampleRate, size_t nchans, size_t cacheSize=8);
+
+    ~AudioBlockPool();
+
+    /// Get a block of the given capacity (rounded up to a multiple of the
+    /// number of channels). Its size is equal to the capacity, and its ID and
+    /// timestamp are zero.
+    /// @param clear Zero the block's audio data. Recycled blocks hold the
+    /// audio they were last used for, so only pass true if the block isn't
+    /// going to be overwritten.
+    Handle Acquire(size_t nsamples, bool clear=false);
+
+    /// Allocate blocks of the given capacity in the shared free lists, so
+    /// that the first acquisitions don't allocate.
+    void   Reserve(size_t nsamples, size_t count);
+
+    /// Delete the blocks in the shared free lists.
+    void   Trim();
+
+    Stats  GetStats() const;
+    float  SampleRate() const { return m_SampleRate; }
+    size_t Channels() const { return m_Channels; }
+
+
+ private:
+
+    typedef std::vector<Block*>                   FreeList;
+    typedef std::vector< std::pair<size_t,FreeList> > CacheLists;
+
+    /// The free blocks cached by a thread, by capacity
+    struct ThreadCache
+    {
+        AudioBlockPool<T>  *Pool;
+        CacheLists          Lists;
+    };
+
+    float                         m_SampleRate;
+    size_t                        m_Channels;
+    size_t                        m_CacheSize;
+    pthread_key_t                 m_CacheKey;
+
+    mutable std::mutex            m_Mutex;        ///< Protects the members below
+    std::map<size_t,FreeList>     m_FreeLists;
+    std::vector<ThreadCache*>     m_Caches;
+
+    std::atomic<uint64_t>         m_Acquired;
+    std::atomic<uint64_t>         m_Allocated;
+    std::atomic<uint64_t>         m_CacheHits;
+
+    AudioBlockPool(const AudioBlockPool&);
+    AudioBlockPool& operator=(const AudioBlockPool&);
+
+    size_t       RoundCapacity(size_t nsamples) const;
+    ThreadCache* GetCache();
+    FreeList&    GetCacheList(ThreadCache *cache, size_t capacity);
+    void         Release(Block *block);
+    static void  OnThreadExit(void *cache);
+};
+
+
+// -----------------------------------------------------------------------------
+//                              Implementation
+// -----------------------------------------------------------------------------
+
+
+template <class T>
+AudioBlockPool<T>::AudioBlockPool(float sampleRate, size_t nchans, size_t cacheSize) :
+    m_SampleRate (sampleRate),
+    m_Channels   (nchans),
+    m_CacheSize  (cacheSize ? cacheSize : 1),
+    m_Acquired   (0),
+    m_Allocated  (0),
+    m_CacheHits  (0)
+{
+    assert(sampleRate > 0);
+    assert(nchans > 0);
+
+    if(pthread_key_create(&m_CacheKey, &AudioBlockPool<T>::OnThreadExit) != 0)
+       throw std::runtime_error("Couldn't create the block pool thread key");
+}
+
+
+template <class T>
+AudioBlockPool<T>::~AudioBlockPool()
+{
+    // No more thread exit callbacks from here on
+    pthread_key_delete(m_CacheKey);
+
+    for(size_t i=0; i<m_Caches.size(); i++){
+        CacheLists &lists = m_Caches[i]->Lists;
+        for(size_t l=0; l<lists.size(); l++)
+            for(size_t b=0; b<lists[l].second.size(); b++)
+                delete lists[l].second[b];
+        delete m_Caches[i];
+    }
+    Trim();
+}
+
+
+template <class T>
+inline size_t AudioBlockPool<T>::RoundCapacity(size_t nsamples) const
+{
+    // As done by AudioBlock::Create()
+    size_t dn = nsamples % m_Channels;
+    return dn ? nsamples - dn + m_Channels : nsamples;
+}
+
+
+template <class T>
+inline typename AudioBlockPool<T>::ThreadCache* AudioBlockPool<T>::GetCache()
+{
+    ThreadCache *cache = static_cast<ThreadCache*>(pthread_getspecific(m_CacheKey));
+
+    if(cache == nullptr){
+       cache = new ThreadCache;
+       cache->Pool = this;
+       {
+           std::lock_guard<std::mutex> lock(m_Mutex);
+           m_Caches.push_back(cache);
+       }
+       pthread_setspecific(m_CacheKey, cache);
+    }
+    return cache;
+}
+
+
+template <class T>
+inline typename AudioBlockPool<T>::FreeList&
+AudioBlockPool<T>::GetCacheList(ThreadCache *cache, size_t capacity)
+{
+    // There are only a few capacities in use, so a linear search will do
+    CacheLists &lists = cache->Lists;
+    for(size_t i=0; i<lists.size(); i++)
+        if(lists[i].first == capacity)
+           return lists[i].second;
+
+    lists.push_back(std::make_pair(capacity, FreeList()));
+    lists.back().second.reserve(m_CacheSize);
+    return lists.back().second;
+}
+
+
+template <class T>
+typename AudioBlockPool<T>::Handle AudioBlockPool<T>::Acquire(size_t nsamples, bool clear)
+{
+    assert(nsamples > 0);
+
+    size_t capacity = RoundCapacity(nsamples);
+    FreeList &cached = GetCacheList(GetCache(), capacity);
+
+    m_Acquired.fetch_add(1, std::memory_order_relaxed);
+
+    if(!cached.empty()){
+       m_CacheHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else{
+       // Refill half of the cache from the shared list
+       std::lock_guard<std::mutex> lock(m_Mutex);
+       typename std::map<size_t,FreeList>::iterator it = m_FreeLists.find(capacity);
+       if(it != m_FreeLists.end()){
+          FreeList &shared = it->second;
+          size_t n = std::min(shared.size(), std::max<size_t>(m_CacheSize / 2, 1));
+          cached.insert(cached.end(), shared.end() - n, shared.end());
+          shared.resize(shared.size() - n);
+       }
+    }
+
+    if(cached.empty()){
+       m_Allocated.fetch_add(1, std::memory_order_relaxed);
+       return Handle(new Block(capacity, m_SampleRate, m_Channels, -1, clear), Recycler(this));
+    }
+
+    Block *block = cached.back();
+    cached.pop_back();
+
+    block->Resize(capacity);
+    block->SetID(0);
+    block->SetTimestamp(0);
+
+    if(clear)
+       memset(block->Data(), 0, capacity * sizeof(T));
+
+    return Handle(block, Recycler(this));
+}
+
+
+template <class T>
+void AudioBlockPool<T>::Release(Block *block)
+{
+    assert(block && block->SampleRate() == m_SampleRate && block->Channels() == m_Channels);
+
+    FreeList &cached = GetCacheList(GetCache(), block->Capacity());
+
+    if(cached.size() >= m_CacheSize){
+       // Spill half of the cache into the shared list
+       size_t n = std::max<size_t>(m_CacheSize / 2, 1);
+       std::lock_guard<std::mutex> lock(m_Mutex);
+       FreeList &shared = m_FreeLists[block->Capacity()];
+       shared.insert(shared.end(), cached.end() - n, cached.end());
+       cached.resize(cached.size() - n);
+    }
+    cached.push_back(block);
+}
+
+
+template <class T>
+void AudioBlockPool<T>::Reserve(size_t nsamples, size_t count)
+{
+    size_t capacity = RoundCapacity(nsamples);
+    FreeList blocks;
+    blocks.reserve(count);
+
+    for(size_t i=0; i<count; i++){
+        blocks.push_back(new Block(capacity, m_SampleRate, m_Channels, -1, false));
+        m_Allocated.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    FreeList &shared = m_FreeLists[capacity];
+    shared.insert(shared.end(), blocks.begin(), blocks.end());
+}
+
+
+template <class T>
+void AudioBlockPool<T>::Trim()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    typename std::map<size_t,FreeList>::iterator it = m_FreeLists.begin();
+    for(; it!=m_FreeLists.end(); ++it)
+        for(size_t b=0; b<it->second.size(); b++)
+            delete it->second[b];
+    m_FreeLists.clear();
+}
+
+
+template <class T>
+typename AudioBlockPool<T>::Stats AudioBlockPool<T>::GetStats() const
+{
+    Stats stats;
+    stats.Acquired  = m_Acquired.load(std::memory_order_relaxed);
+    stats.Allocated = m_Allocated.load(std::memory_order_relaxed);
+    stats.CacheHits = m_CacheHits.load(std::memory_order_relaxed);
+    stats.Free      = 0;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    typename std::map<size_t,FreeList>::const_iterator it = m_FreeLists.begin();
+    for(; it!=m_FreeLists.end(); ++it)
+        stats.Free += it->second.size();
+    return stats;
+}
+
+
+template <class T>
+void AudioBlockPool<T>::OnThreadExit(void *data)
+{
+    // Give the cached blocks back to the shared lists
+    ThreadCache *cache = static_cast<ThreadCache*>(data);
+    AudioBlockPool<T> *pool = cache->Pool;
+
+    std::lock_guard<std::mutex> lock(pool->m_Mutex);
+
+    for(size_t l=0; l<cache->Lists.size(); l++){
+        FreeList &cached = cache->Lists[l].second;
+        FreeList &shared = pool->m_FreeLists[cache->Lists[l].first];
+        shared.insert(shared.end(), cached.begin(), cached.end());
+    }
+
+    pool->m_Caches.erase(std::find(pool->m_Caches.begin(), pool->m_Caches.end(), cache));
+    delete cache;
+}
+
+
+#endif
@@ -0,0 +1,229 @@
+/*
+
+Copyright (c) 2014, Audioneex.com.
+Copyright (c) 2014, Alberto Gramaglia.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list
+   of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this
+   list of conditions and the following disclaimer in the documentation and/or other
+   materials provided with the distribution.
+
+3. The name of the author(s) may not be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef AUDIOBLOCKVIEW_H
+#define AUDIOBLOCKVIEW_H
+
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+#include "AudioBlock.h"
+
+
+/// A non-owning, read-only view of interleaved audio samples. It carries the
+/// same description of the audio as an AudioBlock (sample rate, channels and
+/// timestamp) but none of its storage, so it can be made over audio blocks,
+/// windows of an AudioRingBlock, memory-mapped files or JNI buffers at no cost.
+/// Views are meant for the pipeline stages that only read the audio: the
+/// referenced samples must outlive the view.
+
+template <class T>
+class AudioBlockView
+{
+ public:
+
+    /// Construct an empty view.
+    AudioBlockView();
+
+    /// Constructor.
+    /// @param data Interleaved samples.
+    /// @param nsamples Number of samples (all channels).
+    /// @param sampleRate Sampling frequency of the audio.
+    /// @param nchans Number of audio channels.
+    /// @param tstamp Timestamp [ms] of the first sample.
+    AudioBlockView(const T *data, size_t nsamples, float sampleRate, size_t nchans, int64_t tstamp=0);
+
+    /// View of the available data of the given block.
+    AudioBlockView(const AudioBlock<T> &block);
+
+    /// Sample access.
+    const T& operator[](size_t i) const { assert(i < mSize); return mData[i]; }
+
+    const T* Data() const { return mData; }
+    /// Number of samples (all channels)
+    size_t   Size() const { return mSize; }
+    /// Number of frames (samples per channel)
+    size_t   Frames() const { return mSize / mChannels; }
+    size_t   SizeInBytes() const { return mSize * sizeof(T); }
+    float    SampleRate() const { return mSampleRate; }
+    size_t   Channels() const { return mChannels; }
+    /// Duration of the audio (in seconds)
+    float    Duration() const { return mSize / (mChannels * mSampleRate); }
+    bool     Empty() const { return mSize == 0; }
+    int64_t  Timestamp() const { return mTimestamp; }
+    /// Get normalization factor
+    float    NormFactor() const;
+
+    /// Get a view of 'size' samples starting at sample 'start', clipped to this
+    /// view. The timestamp is moved to the first sample of the sub-view.
+    AudioBlockView<T> SubView(size_t start, size_t size) const;
+
+    /// Normalize the samples in [-1,1] into the given buffer, which must hold
+    /// Size() samples.
+    void Normalize(Sfloat *out) const;
+
+    /// Normalize the samples in [-1,1] into the given block, which is resized
+    /// to the size of this view. It must have enough capacity.
+    void Normalize(AudioBlock<Sfloat> &nblock) const;
+
+    /// Normalize the samples in [-1,1] and downmix them to mono with the given
+    /// weights (one per channel), or by averaging the channels if null. The
+    /// given buffer must hold Frames() samples.
+    void Downmix(Sfloat *out, const float *weights=nullptr) const;
+
+    /// Normalize a channel in [-1,1] into the given buffer, which must hold
+    /// Frames() samples.
+    void ExtractChannel(size_t chan, Sfloat *out) const;
+
+    /// Normalize the samples in [-1,1] into a buffer per channel, each holding
+    /// Frames() samples.
+    void Deinterleave(Sfloat *const *out) const;
+
+
+ private:
+
+    const T*  mData;
+    size_t    mSize;
+    float     mSampleRate;
+    size_t    mChannels;
+    int64_t   mTimestamp;   ///< Timestamp [ms] of the first sample
+};
+
+
+// -----------------------------------------------------------------------------
+//                              Implementation
+// -----------------------------------------------------------------------------
+
+
+template <class T>
+AudioBlockView<T>::AudioBlockView() :
+    mData       (nullptr),
+    mSize       (0),
+    mSampleRate (0),
+    mChannels   (1),
+    mTimestamp  (0)
+{
+}
+
+
+template <class T>
+AudioBlockView<T>::AudioBlockView(const T *data, size_t nsamples, float sampleRate,
+                                  size_t nchans, int64_t tstamp) :
+    mData       (data),
+    mSize       (nsamples),
+    mSampleRate (sampleRate),
+    mChannels   (nchans),
+    mTimestamp  (tstamp)
+{
+    assert(nchans > 0);
+    assert(data != nullptr || nsamples == 0);
+}
+
+
+template <class T>
+AudioBlockView<T>::AudioBlockView(const AudioBlock<T> &block) :
+    mData       (block.Data()),
+    mSize       (block.Size()),
+    mSampleRate (block.SampleRate()),
+    mChannels   (block.IsNull() ? 1 : block.Channels()),
+    mTimestamp  (block.Timestamp())
+{
+}
+
+
+template <class T>
+inline float AudioBlockView<T>::NormFactor() const
+{
+    return static_cast<float>(static_cast<uint64_t>(1) << (sizeof(T)*8-1));
+}
+
+
+template <>
+inline float AudioBlockView<Sfloat>::NormFactor() const
+{
+    return 1.f;
+}
+
+
+template <class T>
+inline AudioBlockView<T> AudioBlockView<T>::SubView(size_t start, size_t size) const
+{
+    start = std::min(start, mSize);
+    size = std::min(size, mSize - start);
+
+    int64_t dt = static_cast<int64_t>(start * 1000.0 / (mChannels * mSampleRate));
+    return AudioBlockView<T>(mData + start, size, mSampleRate, mChannels, mTimestamp + dt);
+}
+
+
+template <class T>
+inline void AudioBlockView<T>::Normalize(Sfloat *out) const
+{
+    NormalizeSamples(mData, out, mSize, NormFactor());
+}
+
+
+template <class T>
+inline void AudioBlockView<T>::Normalize(AudioBlock<Sfloat> &nblock) const
+{
+    assert(!nblock.IsNull() && nblock.Capacity() >= mSize);
+
+    nblock.Resize(mSize);
+    nblock.SetTimestamp(mTimestamp);
+    NormalizeSamples(mData, nblock.Data(), nblock.Size(), NormFactor());
+}
+
+
+template <class T>
+inline void AudioBlockView<T>::Downmix(Sfloat *out, const float *weights) const
+{
+    NormalizeDownmix(mData, out, Frames(), mChannels, weights, NormFactor());
+}
+
+
+template <class T>
+inline void AudioBlockView<T>::ExtractChannel(size_t chan, Sfloat *out) const
+{
+    assert(chan < mChannels);
+    NormalizeChannel(mData, out, Frames(), mChannels, chan, NormFactor());
+}
+
+
+template <class T>
+inline void AudioBlockView<T>::Deinterleave(Sfloat *const *out) const
+{
+    NormalizeDeinterleave(mData, out, Frames(), mChannels, NormFactor());
+}
+
+
+#endif
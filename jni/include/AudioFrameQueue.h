@@ -0,0 +1,455 @@
+/*
+
+Copyright (c) 2014, Audioneex.com.
+Copyright (c) 2014, Alberto Gramaglia.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list
+   of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this
+   list of conditions and the following disclaimer in the documentation and/or other
+   materials provided with the distribution.
+
+3. The name of the author(s) may not be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef AUDIOFRAMEQUEUE_H
+#define AUDIOFRAMEQUEUE_H
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <algorithm>
+
+#include "AudioBlock.h"
+
+
+/// A bounded queue of fixed-size audio frames between one producer (e.g. the
+/// audio capture) and one consumer (e.g. the recognition thread). The producer
+/// writes samples of any length, which are gathered into frames in place, and
+/// the consumer pulls whole frames by swapping them with its own block, so no
+/// audio is copied after it's written and nothing is allocated. Frames get the
+/// stream position of their first sample as the timestamp (in ms) and their
+/// sequence number as the ID.
+///
+/// When the queue is full the producer either drops the oldest frame (DROP_OLDEST)
+/// or waits for the consumer to pull one (BLOCK). Apart from the waits of the
+/// BLOCK policy and Wait(), writing and pulling never block. If the consumer is
+/// in the middle of pulling the very frame the producer wants to drop, the new
+/// samples are discarded instead. All the losses are counted in the stats.
+
+template <class T>
+class AudioFrameQueue
+{
+ public:
+
+    enum Policy
+    {
+        DROP_OLDEST,
+        BLOCK
+    };
+
+    struct Stats
+    {
+        uint64_t  Frames;      ///< Frames completed by the producer
+        uint64_t  Pulled;      ///< Frames pulled by the consumer
+        uint64_t  Dropped;     ///< Frames dropped to make room for new ones
+        uint64_t  Discarded;   ///< Samples discarded because the queue was full
+        uint64_t  Overflows;   ///< Times the producer found the queue full
+        uint64_t  BlockedUs;   ///< Time the producer waited for room (BLOCK)
+    };
+
+    /// Constructor.
+    /// @param nframes Capacity of the queue, in frames.
+    /// @param frameSize Size of the frames in samples (all channels).
+    AudioFrameQueue(size_t nframes, size_t frameSize, float sampleRate, size_t nchans,
+                    Policy policy=DROP_OLDEST);
+
+    /// Write the given samples, completing frames as they fill up. Only the
+    /// producer thread may call this method.
+    /// @return The number of samples queued, which is less than nsamples if
+    /// some were discarded or the queue was closed.
+    size_t Write(const T *data, size_t nsamples);
+
+    /// Queue the partially filled frame, if any. Producer only.
+    /// @return false if there was no partial frame or it was discarded.
+    bool   Flush();
+
+    /// Get the oldest frame, swapping it with the given block, which is
+    /// recreated with the queue's frame size if needed. Consumer only.
+    /// @return false if the queue is empty.
+    bool   Pull(AudioBlock<T> &frame);
+
+    /// Wait until a frame is available or the queue is closed. A negative
+    /// timeout waits indefinitely. Consumer only.
+    /// @return true if a frame is available.
+    bool   Wait(int timeoutMs=-1);
+
+    /// Close the queue, waking up both sides. Writes are ignored from now on,
+    /// while the frames in the queue can still be pulled.
+    void   Close();
+
+    /// Empty the queue, reopen it and reset the stream position and the stats.
+    /// Neither side must be using the queue.
+    void   Reset();
+
+    bool   IsClosed() const { return m_Closed.load(); }
+    size_t Available() const;
+    size_t Capacity() const { return m_Size; }
+    size_t FrameSize() const { return m_FrameSize; }
+    Stats  GetStats() const;
+
+
+ private:
+
+    /// A frame, and its sequence number. A slot whose sequence number is
+    /// equal to a position of the producer can be written; one equal to a
+    /// position of the consumer plus one holds a frame to be pulled.
+    struct Slot
+    {
+        std::atomic<size_t>  Seq;
+        AudioBlock<T>        Frame;
+    };
+
+    std::unique_ptr<Slot[]>  m_Slots;
+    size_t                   m_Size;
+    size_t                   m_FrameSize;
+    float                    m_SampleRate;
+    size_t                   m_Channels;
+    Policy                   m_Policy;
+
+    char                     m_Pad0[64];
+    std::atomic<size_t>      m_Head;        ///< Next frame to be pulled
+    char                     m_Pad1[64];
+
+    // Producer state
+    std::atomic<size_t>      m_Tail;        ///< Frame being written
+    size_t                   m_Fill;        ///< Samples in the frame being written
+    bool                     m_Writing;     ///< Whether the producer owns the tail slot
+    uint64_t                 m_Position;    ///< Samples written since the start
+    uint64_t                 m_FrameStart;  ///< Position of the first sample in the frame
+    char                     m_Pad2[64];
+
+    std::atomic<bool>        m_Closed;
+    std::mutex               m_Mutex;
+    std::condition_variable  m_DataCond;
+    std::condition_variable  m_SpaceCond;
+    std::atomic<bool>        m_ConsumerWaiting;
+    std::atomic<bool>        m_ProducerWaiting;
+
+    std::atomic<uint64_t>    m_Pulled;
+    std::atomic<uint64_t>    m_Dropped;
+    std::atomic<uint64_t>    m_Discarded;
+    std::atomic<uint64_t>    m_Overflows;
+    std::atomic<uint64_t>    m_BlockedUs;
+
+    AudioFrameQueue(const AudioFrameQueue&);
+    AudioFrameQueue& operator=(const AudioFrameQueue&);
+
+    Slot& GetSlot(size_t pos) { return m_Slots[pos % m_Size]; }
+    bool  AcquireTail();
+    bool  PopHead(AudioBlock<T> &frame);
+    void  Publish();
+    void  Notify(std::atomic<bool> &waiting, std::condition_variable &cond);
+};
+
+
+// -----------------------------------------------------------------------------
+//                              Implementation
+// -----------------------------------------------------------------------------
+
+
+template <class T>
+AudioFrameQueue<T>::AudioFrameQueue(size_t nframes, size_t frameSize, float sampleRate,
+                                    size_t nchans, Policy policy) :
+    m_Slots           (new Slot[nframes]),
+    m_Size            (nframes),
+    m_FrameSize       (frameSize),
+    m_SampleRate      (sampleRate),
+    m_Channels        (nchans),
+    m_Policy          (policy),
+    m_Head            (0),
+    m_Tail            (0),
+    m_Fill            (0),
+    m_Writing         (false),
+    m_Position        (0),
+    m_FrameStart      (0),
+    m_Closed          (false),
+    m_ConsumerWaiting (false),
+    m_ProducerWaiting (false),
+    m_Pulled          (0),
+    m_Dropped         (0),
+    m_Discarded       (0),
+    m_Overflows       (0),
+    m_BlockedUs       (0)
+{
+    assert(nframes > 0);
+    assert(frameSize > 0 && frameSize % nchans == 0);
+
+    for(size_t i=0; i<m_Size; i++){
+        m_Slots[i].Seq.store(i, std::memory_order_relaxed);
+        m_Slots[i].Frame.Create(m_FrameSize, m_SampleRate, m_Channels, 0);
+    }
+}
+
+
+template <class T>
+bool AudioFrameQueue<T>::AcquireTail()
+{
+    size_t tail = m_Tail.load(std::memory_order_relaxed);
+    Slot &slot = GetSlot(tail);
+
+    if(slot.Seq.load(std::memory_order_acquire) == tail)
+       return true;
+
+    // The slot holds the oldest frame, which hasn't been pulled yet
+    m_Overflows.fetch_add(1, std::memory_order_relaxed);
+
+    if(m_Policy == BLOCK){
+       std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+       {
+           std::unique_lock<std::mutex> lock(m_Mutex);
+           m_ProducerWaiting = true;
+           while(slot.Seq.load() != tail && !m_Closed)
+               m_SpaceCond.wait(lock);
+           m_ProducerWaiting = false;
+       }
+       m_BlockedUs.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - t0).count(),
+                             std::memory_order_relaxed);
+       return !m_Closed;
+    }
+
+    // Drop the oldest frame, the one in this slot, unless the consumer has
+    // already taken it and is still reading it. The new samples are then
+    // discarded instead, so that no other frame is lost.
+    size_t head = tail - m_Size;
+    if(!m_Head.compare_exchange_strong(head, head + 1))
+       return false;
+
+    slot.Seq.store(tail);
+    m_Dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+
+template <class T>
+bool AudioFrameQueue<T>::PopHead(AudioBlock<T> &frame)
+{
+    size_t head = m_Head.load(std::memory_order_relaxed);
+
+    for(;;){
+        Slot &slot = GetSlot(head);
+        size_t seq = slot.Seq.load(std::memory_order_acquire);
+
+        if(seq != head + 1)
+           return false;
+
+        // The producer may be dropping this frame at the same time
+        if(m_Head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)){
+           std::swap(frame, slot.Frame);
+           slot.Seq.store(head + m_Size);
+           return true;
+        }
+    }
+}
+
+
+template <class T>
+void AudioFrameQueue<T>::Publish()
+{
+    size_t tail = m_Tail.load(std::memory_order_relaxed);
+    Slot &slot = GetSlot(tail);
+    slot.Frame.Resize(m_Fill);
+    slot.Frame.SetID(static_cast<int32_t>(tail));
+    slot.Frame.SetTimestamp(static_cast<int64_t>(m_FrameStart * 1000 / (m_SampleRate * m_Channels)));
+
+    slot.Seq.store(tail + 1);
+    m_Tail.store(tail + 1);
+    m_Writing = false;
+    m_Fill = 0;
+
+    Notify(m_ConsumerWaiting, m_DataCond);
+}
+
+
+template <class T>
+void AudioFrameQueue<T>::Notify(std::atomic<bool> &waiting, std::condition_variable &cond)
+{
+    // The sequence numbers are stored before checking the flag and the
+    // waiters set the flag before checking the sequence numbers, so that
+    // one side always sees the other.
+    if(waiting.load()){
+       std::lock_guard<std::mutex> lock(m_Mutex);
+       cond.notify_one();
+    }
+}
+
+
+template <class T>
+size_t AudioFrameQueue<T>::Write(const T *data, size_t nsamples)
+{
+    size_t written = 0;
+
+    while(written < nsamples && !m_Closed.load(std::memory_order_relaxed))
+    {
+        if(!m_Writing && !(m_Writing = AcquireTail())){
+           // No room, drop the rest. The stream position still advances
+           // so that the timestamps of the next frames are right.
+           m_Discarded.fetch_add(nsamples - written, std::memory_order_relaxed);
+           m_Position += nsamples - written;
+           break;
+        }
+
+        if(m_Fill == 0)
+           m_FrameStart = m_Position;
+
+        size_t n = std::min(nsamples - written, m_FrameSize - m_Fill);
+        Slot &slot = GetSlot(m_Tail.load(std::memory_order_relaxed));
+        std::memcpy(slot.Frame.Data() + m_Fill, data + written, n * sizeof(T));
+
+        m_Fill += n;
+        m_Position += n;
+        written += n;
+
+        if(m_Fill == m_FrameSize)
+           Publish();
+    }
+    return written;
+}
+
+
+template <class T>
+bool AudioFrameQueue<T>::Flush()
+{
+    if(!m_Writing || m_Fill == 0)
+       return false;
+    Publish();
+    return true;
+}
+
+
+template <class T>
+bool AudioFrameQueue<T>::Pull(AudioBlock<T> &frame)
+{
+    if(frame.Capacity() != m_FrameSize)
+       frame = AudioBlock<T>(m_FrameSize, m_SampleRate, m_Channels, 0, false);
+
+    if(!PopHead(frame))
+       return false;
+
+    m_Pulled.fetch_add(1, std::memory_order_relaxed);
+
+    if(m_Policy == BLOCK)
+       Notify(m_ProducerWaiting, m_SpaceCond);
+    return true;
+}
+
+
+template <class T>
+bool AudioFrameQueue<T>::Wait(int timeoutMs)
+{
+    if(Available() > 0)
+       return true;
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_ConsumerWaiting = true;
+
+    if(timeoutMs < 0){
+       while(Available() == 0 && !m_Closed)
+           m_DataCond.wait(lock);
+    }
+    else{
+       std::chrono::steady_clock::time_point deadline =
+           std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+       while(Available() == 0 && !m_Closed)
+           if(m_DataCond.wait_until(lock, deadline) == std::cv_status::timeout)
+              break;
+    }
+
+    m_ConsumerWaiting = false;
+    return Available() > 0;
+}
+
+
+template <class T>
+void AudioFrameQueue<T>::Close()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Closed = true;
+    m_DataCond.notify_all();
+    m_SpaceCond.notify_all();
+}
+
+
+template <class T>
+void AudioFrameQueue<T>::Reset()
+{
+    for(size_t i=0; i<m_Size; i++){
+        m_Slots[i].Seq.store(i, std::memory_order_relaxed);
+        m_Slots[i].Frame.Resize(0);
+    }
+
+    m_Head = 0;
+    m_Tail = 0;
+    m_Fill = 0;
+    m_Writing = false;
+    m_Position = 0;
+    m_FrameStart = 0;
+    m_Closed = false;
+
+    m_Pulled = 0;
+    m_Dropped = 0;
+    m_Discarded = 0;
+    m_Overflows = 0;
+    m_BlockedUs = 0;
+}
+
+
+template <class T>
+size_t AudioFrameQueue<T>::Available() const
+{
+    // The frames published and not pulled or dropped yet. Reading the head
+    // first, as it never passes the tail.
+    size_t head = m_Head.load();
+    size_t tail = m_Tail.load();
+    return tail - head;
+}
+
+
+template <class T>
+typename AudioFrameQueue<T>::Stats AudioFrameQueue<T>::GetStats() const
+{
+    Stats stats;
+    stats.Frames    = m_Tail.load(std::memory_order_relaxed);
+    stats.Pulled    = m_Pulled.load(std::memory_order_relaxed);
+    stats.Dropped   = m_Dropped.load(std::memory_order_relaxed);
+    stats.Discarded = m_Discarded.load(std::memory_order_relaxed);
+    stats.Overflows = m_Overflows.load(std::memory_order_relaxed);
+    stats.BlockedUs = m_BlockedUs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+#endif
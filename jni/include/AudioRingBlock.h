@@ -0,0 +1,283 @@
+/*
+
+Copyright (c) 2014, Audioneex.com.
+Copyright (c) 2014, Alberto Gramaglia.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list
+   of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this
+   list of conditions and the following disclaimer in the documentation and/or other
+   materials provided with the distribution.
+
+3. The name of the author(s) may not be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef AUDIORINGBLOCK_H
+#define AUDIORINGBLOCK_H
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "AudioBlock.h"
+#include "AudioBlockView.h"
+
+
+/// A read-only view of a window of samples of an AudioRingBlock. The window
+/// is made of two spans if it wraps around the end of the ring's storage (the
+/// second one is empty otherwise), each with its own timestamp. Views point into
+/// the ring, so they are only valid until the next append.
+template <class T>
+class AudioRingView
+{
+ public:
+
+    AudioBlockView<T>  First;
+    AudioBlockView<T>  Second;
+
+    AudioRingView() : mPosition(0) {}
+
+    /// Number of samples in the window (all channels)
+    size_t   Size() const { return First.Size() + Second.Size(); }
+    bool     Empty() const { return Size() == 0; }
+
+    /// Stream position of the first sample of the window
+    uint64_t Position() const { return mPosition; }
+
+    /// Timestamp [ms] of the first sample of the window
+    int64_t  Timestamp() const { return First.Timestamp(); }
+
+    /// Sample access
+    const T& operator[](size_t i) const {
+        return i < First.Size() ? First[i] : Second[i - First.Size()];
+    }
+
+    /// Copy the window into the given buffer, which must hold Size() samples
+    void CopyTo(T *out) const {
+        std::copy(First.Data(), First.Data() + First.Size(), out);
+        std::copy(Second.Data(), Second.Data() + Second.Size(), out + First.Size());
+    }
+
+    /// Normalize the window in [-1,1] into the given buffer, which must hold
+    /// Size() samples. This is the only pass over the audio needed to feed
+    /// the window to the recognizer.
+    void Normalize(Sfloat *out) const {
+        First.Normalize(out);
+        Second.Normalize(out + First.Size());
+    }
+
+    /// Normalize the window in [-1,1] and downmix it to mono, with the given
+    /// channel weights or averaging the channels. The given buffer must hold
+    /// Size() / channels samples.
+    void Downmix(Sfloat *out, const float *weights=nullptr) const {
+        First.Downmix(out, weights);
+        Second.Downmix(out + First.Frames(), weights);
+    }
+
+    /// Normalize a channel of the window in [-1,1]. The given buffer must hold
+    /// Size() / channels samples.
+    void ExtractChannel(size_t chan, Sfloat *out) const {
+        First.ExtractChannel(chan, out);
+        Second.ExtractChannel(chan, out + First.Frames());
+    }
+
+ private:
+
+    template <class U> friend class AudioRingBlock;
+
+    uint64_t  mPosition;
+};
+
+
+/// An audio block with circular storage, for streams that are processed in
+/// (possibly overlapping) windows, like in continuous monitoring. Appending
+/// never truncates the new data: once the ring is full the oldest samples are
+/// overwritten. Samples are addressed by their stream position, i.e. the number
+/// of samples appended before them since the ring was created or cleared, and
+/// windows are read through views pointing into the ring, so no audio is moved
+/// or copied. The timestamp of each sample is derived from the timestamp of the
+/// last block appended, as given by AudioBlock::Timestamp(), and the sample rate.
+/// Not thread safe: use an AudioFrameQueue to get the audio from other threads.
+
+template <class T>
+class AudioRingBlock
+{
+ public:
+
+    /// Constructor.
+    /// @param nsamples Capacity of the ring (rounded up to a multiple of the
+    /// number of channels).
+    AudioRingBlock(size_t nsamples, float sampleRate, size_t nchans);
+
+    /// Append the given samples, overwriting the oldest ones if needed. If more
+    /// samples than the capacity are given, only the last ones are kept.
+    void Append(const T *data, size_t nsamples);
+
+    /// Append the available data of the given block, whose timestamp becomes
+    /// the reference for the timestamps of the samples.
+    void Append(const AudioBlock<T> &block);
+
+    /// Get a window of the given size starting at the given stream position.
+    /// The window is clipped to the samples in the ring.
+    AudioRingView<T> GetView(uint64_t start, size_t nsamples) const;
+
+    /// Get the most recent samples.
+    AudioRingView<T> GetLast(size_t nsamples) const;
+
+    /// Timestamp [ms] of the sample at the given stream position
+    int64_t  SampleTimestamp(uint64_t pos) const;
+
+    /// Set the timestamp [ms] of the next sample to be appended
+    void     SetTimestamp(int64_t tstamp);
+
+    /// Stream position of the oldest sample in the ring
+    uint64_t Start() const { return mEnd - mSize; }
+    /// Stream position of the next sample to be appended
+    uint64_t End() const { return mEnd; }
+
+    /// Number of samples in the ring (all channels)
+    size_t   Size() const { return mSize; }
+    size_t   Capacity() const { return mBuffer.Capacity(); }
+    float    SampleRate() const { return mBuffer.SampleRate(); }
+    size_t   Channels() const { return mBuffer.Channels(); }
+    /// Duration of the samples in the ring (in seconds)
+    float    Duration() const { return mSize / (Channels() * SampleRate()); }
+
+    /// Empty the ring and restart the stream positions from 0
+    void     Clear();
+
+
+ private:
+
+    AudioBlock<T>  mBuffer;       ///< Storage
+    size_t         mSize;         ///< Samples in the ring
+    uint64_t       mEnd;          ///< Stream position of the next sample
+    uint64_t       mRefPosition;  ///< Position of the sample with the reference timestamp
+    int64_t        mRefTimestamp; ///< Reference timestamp [ms]
+};
+
+
+// -----------------------------------------------------------------------------
+//                              Implementation
+// -----------------------------------------------------------------------------
+
+
+template <class T>
+AudioRingBlock<T>::AudioRingBlock(size_t nsamples, float sampleRate, size_t nchans) :
+    mBuffer       (nsamples, sampleRate, nchans, -1, false),
+    mSize         (0),
+    mEnd          (0),
+    mRefPosition  (0),
+    mRefTimestamp (0)
+{
+}
+
+
+template <class T>
+void AudioRingBlock<T>::Append(const T *data, size_t nsamples)
+{
+    size_t capacity = Capacity();
+
+    // Only the last samples would survive anyway
+    if(nsamples > capacity){
+       data += nsamples - capacity;
+       mEnd += nsamples - capacity;
+       nsamples = capacity;
+    }
+
+    size_t pos = static_cast<size_t>(mEnd % capacity);
+    size_t n = std::min(nsamples, capacity - pos);
+
+    memcpy(mBuffer.Data() + pos, data, n * sizeof(T));
+    memcpy(mBuffer.Data(), data + n, (nsamples - n) * sizeof(T));
+
+    mEnd += nsamples;
+    mSize = std::min<size_t>(mSize + nsamples, capacity);
+}
+
+
+template <class T>
+void AudioRingBlock<T>::Append(const AudioBlock<T> &block)
+{
+    SetTimestamp(block.Timestamp());
+    Append(block.Data(), block.Size());
+}
+
+
+template <class T>
+AudioRingView<T> AudioRingBlock<T>::GetView(uint64_t start, size_t nsamples) const
+{
+    AudioRingView<T> view;
+    uint64_t end = std::min<uint64_t>(start + nsamples, mEnd);
+
+    start = std::max(start, Start());
+
+    view.mPosition = start;
+
+    size_t capacity = Capacity();
+    size_t pos = static_cast<size_t>(start % capacity);
+    size_t n = start < end ? static_cast<size_t>(end - start) : 0;
+    size_t n1 = std::min(n, capacity - pos);
+
+    view.First = AudioBlockView<T>(mBuffer.Data() + pos, n1, SampleRate(), Channels(),
+                                   SampleTimestamp(start));
+    view.Second = AudioBlockView<T>(mBuffer.Data(), n - n1, SampleRate(), Channels(),
+                                    SampleTimestamp(start + n1));
+    return view;
+}
+
+
+template <class T>
+AudioRingView<T> AudioRingBlock<T>::GetLast(size_t nsamples) const
+{
+    nsamples = std::min(nsamples, mSize);
+    return GetView(mEnd - nsamples, nsamples);
+}
+
+
+template <class T>
+int64_t AudioRingBlock<T>::SampleTimestamp(uint64_t pos) const
+{
+    double dt = (static_cast<double>(pos) - static_cast<double>(mRefPosition)) * 1000.0
+                / (Channels() * SampleRate());
+    return mRefTimestamp + static_cast<int64_t>(dt);
+}
+
+
+template <class T>
+void AudioRingBlock<T>::SetTimestamp(int64_t tstamp)
+{
+    mRefPosition = mEnd;
+    mRefTimestamp = tstamp;
+}
+
+
+template <class T>
+void AudioRingBlock<T>::Clear()
+{
+    mSize = 0;
+    mEnd = 0;
+    mRefPosition = 0;
+    mRefTimestamp = 0;
+}
+
+
+#endif
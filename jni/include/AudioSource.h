@@ -29,84 +29,57 @@ OF SUCH DAMAGE.
 
 */
 
-/// A simple audio source class to stream audio from WAV files
+/// A simple audio source class to stream audio from WAV files. The samples
+/// are read as they are stored in the file (see GetSampleResolution() and
+/// GetSampleFormat()). RIFF, RF64 and BWF files are supported (see WavFormat.h).
 
 #include <iostream>
 #include <fstream>
 #include <cstdint>
+#include <string>
+#include <stdexcept>
 
 #include "AudioBlock.h"
-
-struct WavHeader {
-
-    struct RIFF {
-        char      ID[4];
-        uint32_t  Size;
-        char      Format[4];
-    }
-    RIFF;
-
-    struct FMT {
-        char     ID[4];
-        uint32_t Size;
-        uint16_t AudioFormat;
-        uint16_t Channels;
-        uint32_t SampleRate;
-        uint32_t ByteRate;
-        uint16_t BlockAlign;
-        uint16_t BitsPerSample;
-    }
-    FMT;
-
-    struct DATA {
-        char     ID[4];
-        uint32_t Size;
-    }
-    DATA;
-};
+#include "WavFormat.h"
 
 class AudioSourceWavFile
 {
     std::ifstream m_File;
-    WavHeader     m_Header;
-    size_t        m_AvailableData;
-    size_t        m_Nsamples;
+    WavFormat     m_Format;
+    uint64_t      m_AvailableData;
+    uint64_t      m_Nsamples;
     float         m_Duration;
     float         m_Position;
 
-    bool IsTag(char* tag, char t1, char t2, char t3, char t4){
-        return tag[0] == t1 &&
-               tag[1] == t2 &&
-               tag[2] == t3 &&
-               tag[3] == t4;
-    }
-
-    bool IsValidWav(){
-        bool isvalid = true;
-        m_File.read(reinterpret_cast<char*>(&m_Header), sizeof(WavHeader));
-        isvalid &= m_File.gcount() == sizeof(WavHeader);
-        isvalid &= IsTag(m_Header.RIFF.ID,'R','I','F','F');
-        isvalid &= IsTag(m_Header.RIFF.Format,'W','A','V','E');
-        isvalid &= IsTag(m_Header.FMT.ID,'f','m','t',' ');
-        isvalid &= m_Header.FMT.Size == 16;
-        isvalid &= m_Header.FMT.AudioFormat == 1;
-        isvalid &= m_Header.FMT.ByteRate == m_Header.FMT.SampleRate *
-                                            m_Header.FMT.Channels *
-                                            m_Header.FMT.BitsPerSample/8;
-        isvalid &= m_Header.FMT.BlockAlign == m_Header.FMT.Channels *
-                                              m_Header.FMT.BitsPerSample/8;
-        isvalid &= IsTag(m_Header.DATA.ID,'d','a','t','a');
-
-        return isvalid;
+    void ReadFormat(const std::string &filename){
+        m_File.seekg(0, std::ios::end);
+        uint64_t filesize = static_cast<uint64_t>(m_File.tellg());
+
+        std::ifstream &file = m_File;
+        auto read = [&file](uint64_t offset, uint8_t *buf, size_t n) -> size_t {
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(reinterpret_cast<char*>(buf), n);
+            return static_cast<size_t>(file.gcount());
+        };
+
+        try{
+            m_Format = ParseWavFormat(read, filesize);
+        }
+        catch(const std::runtime_error &ex){
+            throw std::runtime_error(std::string(ex.what())+" in "+filename);
+        }
+        m_File.clear();
     }
 
  public:
 
     AudioSourceWavFile() :
+         m_Format        (WavFormat()),
          m_AvailableData (0),
-         m_Position      (0),
+         m_Nsamples      (0),
          m_Duration      (0),
-         m_Nsamples      (0)
+         m_Position      (0)
     {}
 
     ~AudioSourceWavFile(){
@@ -118,18 +91,19 @@ class AudioSourceWavFile
          m_File.open(filename, std::ios::in|std::ios::binary);
          if(!m_File.is_open())
             throw std::runtime_error("Couldn't open "+filename);
-         if(!IsValidWav())
-            throw std::runtime_error("Invalid WAV file "+filename);
-         m_AvailableData = m_Header.DATA.Size;
-         m_Nsamples = m_AvailableData / (m_Header.FMT.BitsPerSample/8);
-         m_Duration = static_cast<float>(m_Nsamples / m_Header.FMT.Channels) /
-                                         m_Header.FMT.SampleRate;
+         ReadFormat(filename);
+         m_File.seekg(static_cast<std::streamoff>(m_Format.DataOffset));
+         m_AvailableData = m_Format.DataSize;
+         m_Nsamples = m_AvailableData / (m_Format.BitsPerSample/8);
+         m_Duration = static_cast<float>(m_Nsamples / m_Format.Channels) /
+                                         m_Format.SampleRate;
          m_Position = 0;
     }
 
     void Close(){
          if(m_File.is_open())
             m_File.close();
+         m_Format = WavFormat();
          m_AvailableData = 0;
          m_Position = 0;
          m_Duration = 0;
@@ -137,13 +111,13 @@ class AudioSourceWavFile
     }
 
     void SetPosition(float time){
-         size_t offset = static_cast<size_t>(time * m_Header.FMT.SampleRate) *
-                                                   (m_Header.FMT.BitsPerSample/8) *
-                                                    m_Header.FMT.Channels;
-         offset = std::min<size_t>(offset, m_Header.DATA.Size);
-         m_File.seekg (sizeof(WavHeader) + offset);
-         m_AvailableData = m_Header.DATA.Size - offset;
-         m_Position = offset < m_Header.DATA.Size ? time : m_Duration;
+         uint64_t offset = static_cast<uint64_t>(time * m_Format.SampleRate) *
+                           m_Format.BlockAlign;
+         offset = std::min(offset, m_Format.DataSize);
+         m_File.clear();
+         m_File.seekg(static_cast<std::streamoff>(m_Format.DataOffset + offset));
+         m_AvailableData = m_Format.DataSize - offset;
+         m_Position = offset < m_Format.DataSize ? time : m_Duration;
     }
 
     float GetPosition() const { return m_Position; }
@@ -151,14 +125,13 @@ class AudioSourceWavFile
     template <typename T>
     size_t Read(T* buffer, size_t nsamples){
          if(buffer && m_AvailableData && nsamples>0){
-            size_t nbytes = std::min(m_AvailableData, nsamples * sizeof(T));
+            size_t nbytes = static_cast<size_t>(std::min<uint64_t>(m_AvailableData, nsamples * sizeof(T)));
             m_File.read(reinterpret_cast<char*>(buffer), nbytes);
-            assert(m_File.gcount() == nbytes);
-            m_AvailableData -= nbytes;
-            m_Position = static_cast<float>( (m_Header.DATA.Size-m_AvailableData) /
-                                             (m_Header.FMT.BitsPerSample/8) /
-                                              m_Header.FMT.Channels) /
-                                              m_Header.FMT.SampleRate;
+            nbytes = static_cast<size_t>(m_File.gcount());
+            m_AvailableData = nbytes ? m_AvailableData - nbytes : 0;
+            m_Position = static_cast<float>( (m_Format.DataSize-m_AvailableData) /
+                                              m_Format.BlockAlign) /
+                                              m_Format.SampleRate;
             return nbytes / sizeof(T);
          }
          return 0;
@@ -169,11 +142,15 @@ class AudioSourceWavFile
          block.Resize( Read(block.Data(), block.Size()) );
     }
 
-    int GetSampleRate() const { return m_Header.FMT.SampleRate; }
-    int GetChannels()   const { return m_Header.FMT.Channels; }
-    int GetSampleResolution() const { return m_Header.FMT.BitsPerSample; }
+    int GetSampleRate() const { return m_Format.SampleRate; }
+    int GetChannels()   const { return m_Format.Channels; }
+    int GetSampleResolution() const { return m_Format.BitsPerSample; }
+    /// WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT
+    int GetSampleFormat() const { return m_Format.FormatTag; }
+    /// Offset of the audio data in the file
+    uint64_t GetDataOffset() const { return m_Format.DataOffset; }
     float GetLenSeconds() const { return m_Duration; }
-    size_t GetLenSamples() const { return m_Nsamples; }
+    uint64_t GetLenSamples() const { return m_Nsamples; }
 
 };
 
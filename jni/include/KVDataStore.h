@@ -84,6 +84,13 @@ public:
     /// Get metadata associated to a fingerprint
     virtual std::string GetMetadata(uint32_t FID) = 0;
 
+    /// Delete a fingerprint. Its index data is left in place, but matches
+    /// for it shall be suppressed (see IsDeleted()).
+    virtual void DeleteFingerprint(uint32_t FID) = 0;
+
+    /// Check whether a fingerprint has been deleted
+    virtual bool IsDeleted(uint32_t FID) = 0;
+
     /// Save datastore info
     virtual void PutInfo(const DBInfo_t& info) = 0;
 
@@ -140,6 +147,12 @@ inline bool IsNull(const PListBlock& hdr){
            hdr.Body==nullptr;
 }
 
+/// Make a key sorting the index blocks by list and block identifiers
+inline uint64_t BlockKey(int list_id, int block_id){
+    return (static_cast<uint64_t>(static_cast<uint32_t>(list_id)) << 32) |
+            static_cast<uint32_t>(block_id);
+}
+
 
 #endif
 
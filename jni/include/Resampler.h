@@ -0,0 +1,127 @@
+/*
+
+Copyright (c) 2014, Audioneex.com.
+Copyright (c) 2014, Alberto Gramaglia.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list
+   of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this
+   list of conditions and the following disclaimer in the documentation and/or other
+   materials provided with the distribution.
+
+3. The name of the author(s) may not be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "AudioBlock.h"
+#include "AudioBlockView.h"
+
+
+/// A streaming polyphase resampler for mono float audio, used to bring the
+/// audio to the 11025 Hz the engine works at. The ratio of the output to the
+/// input rate is reduced to an exact fraction L/M (1/4 for 44100 Hz, 147/640
+/// for 48000 Hz), and the anti-aliasing filter, a Kaiser windowed sinc designed
+/// at L times the input rate, is split into L phases, of which only the one
+/// that falls on each output sample is run. The filter attenuates by at least
+/// 80 dB (about 85 dB measured) from the lower of the two Nyquist frequencies,
+/// with the pass band up to 80% of it.
+/// The filter banks are computed once per ratio and shared by all resamplers,
+/// and the filters run in the SIMD dot product kernel (see SampleConvert.h).
+///
+/// The state is carried across calls, so a stream can be processed in blocks
+/// of any size. The filter delay is compensated: the first output sample falls
+/// on the first input sample, and Flush() returns the tail of the stream, which
+/// is then made of ceil(N * L / M) samples for N input samples.
+
+class Resampler
+{
+public:
+
+    /// Create a resampler from 'inRate' to 'outRate' Hz.
+    Resampler(int inRate, int outRate=11025);
+
+    /// Resample the given input samples.
+    /// @param out Buffer for the output, which must hold GetMaxOutput(nin) samples.
+    /// @return the number of output samples.
+    size_t Process(const float *in, size_t nin, float *out);
+
+    /// Resample the given (mono) input block into 'out', which is resized to the
+    /// output. It must have a capacity of at least GetMaxOutput(in.Size()) samples.
+    size_t Process(const AudioBlockView<Sfloat> &in, AudioBlock<Sfloat> &out);
+
+    /// Output the tail of the stream, still in the filter.
+    /// @param out Buffer for the output, which must hold GetMaxOutput(GetFilterLength())
+    /// samples.
+    /// @return the number of output samples.
+    size_t Flush(float *out);
+
+    /// Restart with a new stream
+    void Reset();
+
+    /// Maximum number of output samples for the given number of input samples
+    size_t GetMaxOutput(size_t nin) const;
+
+    int    GetInputRate() const { return m_InRate; }
+    int    GetOutputRate() const { return m_OutRate; }
+    /// Interpolation factor (L)
+    size_t GetInterpolation() const { return m_L; }
+    /// Decimation factor (M)
+    size_t GetDecimation() const { return m_M; }
+    /// Number of taps per phase, i.e. input samples per output sample
+    size_t GetFilterLength() const { return m_Taps; }
+
+private:
+
+    struct FilterBank;
+
+    std::shared_ptr<const FilterBank>  m_Bank;
+
+    int                 m_InRate;
+    int                 m_OutRate;
+    size_t              m_L;
+    size_t              m_M;
+    size_t              m_Taps;
+
+    std::vector<float>  m_History;   ///< Input samples, with the filter's history first
+    size_t              m_Fill;      ///< Samples in m_History
+    size_t              m_Pos;       ///< Position in m_History of the newest sample of the next output
+    size_t              m_Phase;     ///< Filter phase of the next output
+    uint64_t            m_Inputs;    ///< Input samples since Reset()
+    uint64_t            m_Outputs;   ///< Output samples since Reset()
+
+    /// Run the filters over the buffered input, up to 'limit' total outputs
+    size_t Run(float *out, uint64_t limit);
+
+    /// Drop the input samples no longer needed
+    void Compact();
+
+    static std::shared_ptr<const FilterBank> GetFilterBank(size_t L, size_t M);
+};
+
+
+#endif
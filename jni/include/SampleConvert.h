@@ -0,0 +1,67 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+#ifndef SAMPLECONVERT_H
+#define SAMPLECONVERT_H
+
+#include <cstdint>
+#include <cstddef>
+
+/// Sample format conversion kernels. Integer samples are converted to float
+/// in [-1,1) by multiplying by the reciprocal of their full scale (2^(bits-1)),
+/// and back by scaling, rounding to nearest and saturating. 8 bit unsigned
+/// samples are offset binary, as in WAV files. The kernels use the widest
+/// SIMD instruction set available at run time (AVX2 or SSE2 on x86, NEON on
+/// ARM) and fall back to scalar code. The buffers need not be aligned, but
+/// must not overlap.
+
+void SamplesToFloat(const int8_t  *in, float *out, size_t n);
+void SamplesToFloat(const uint8_t *in, float *out, size_t n);
+void SamplesToFloat(const int16_t *in, float *out, size_t n);
+void SamplesToFloat(const int32_t *in, float *out, size_t n);
+
+void FloatToSamples(const float *in, int8_t  *out, size_t n);
+void FloatToSamples(const float *in, int16_t *out, size_t n);
+void FloatToSamples(const float *in, int32_t *out, size_t n);
+
+/// Dot product of two float vectors, used by the FIR filters (see Resampler.h).
+/// It runs in the same SIMD instruction set as the conversion kernels.
+float DotProduct(const float *a, const float *b, size_t n);
+
+/// Channel kernels for interleaved frames of nchans samples. 16 bit samples
+/// are normalized as by SamplesToFloat while they are mixed or copied, so
+/// the input is read only once.
+
+/// Mix the channels of each frame to mono, out[i] = sum of weights[c] * in[i*nchans+c].
+/// If no weights are given the channels are averaged. The output may be the
+/// input buffer (in place downmix).
+void DownmixSamples(const float   *in, float *out, size_t nframes, size_t nchans, const float *weights=nullptr);
+void DownmixSamples(const int16_t *in, float *out, size_t nframes, size_t nchans, const float *weights=nullptr);
+
+/// Copy one channel of each frame, out[i] = in[i*nchans+chan]. The output may
+/// be the input buffer.
+void ExtractChannel(const float   *in, float *out, size_t nframes, size_t nchans, size_t chan);
+void ExtractChannel(const int16_t *in, float *out, size_t nframes, size_t nchans, size_t chan);
+
+/// Split the frames into one buffer per channel, out[c][i] = in[i*nchans+c]
+void DeinterleaveSamples(const float   *in, float *const *out, size_t nframes, size_t nchans);
+void DeinterleaveSamples(const int16_t *in, float *const *out, size_t nframes, size_t nchans);
+
+/// Get the instruction set used by the kernels ("avx2", "sse2", "neon" or "scalar")
+const char* GetSampleConvertISA();
+
+/// Force the kernels for the given instruction set, e.g. to compare them
+/// with the scalar ones. Return false if it's not available on this CPU.
+bool SetSampleConvertISA(const char *isa);
+
+
+#endif
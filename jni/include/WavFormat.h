@@ -0,0 +1,172 @@
+/*
+
+Copyright (c) 2014, Audioneex.com.
+Copyright (c) 2014, Alberto Gramaglia.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list
+   of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this
+   list of conditions and the following disclaimer in the documentation and/or other
+   materials provided with the distribution.
+
+3. The name of the author(s) may not be used to endorse or promote products derived
+   from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef WAVFORMAT_H
+#define WAVFORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+const uint16_t WAVE_FORMAT_PCM        = 0x0001;
+const uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+const uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+/// Format and location of the audio in a WAV file
+struct WavFormat
+{
+    uint16_t  FormatTag;      ///< WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT
+    uint16_t  Channels;
+    uint32_t  SampleRate;
+    uint16_t  BlockAlign;     ///< Bytes per frame
+    uint16_t  BitsPerSample;
+    uint64_t  DataOffset;     ///< Offset of the audio data in the file
+    uint64_t  DataSize;       ///< Size of the audio data in bytes
+};
+
+namespace WavDetail {
+
+// WAV files are little endian, and so are the targets
+
+inline uint16_t Get16(const uint8_t *p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline uint32_t Get32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline uint64_t Get64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+inline bool IsTag(const uint8_t *p, const char *tag) { return memcmp(p, tag, 4) == 0; }
+
+}
+
+/// Parse the header of a WAV file. The RIFF chunks are walked to locate the
+/// 'fmt ' and 'data' chunks wherever they are, skipping any other chunk (LIST,
+/// fact, bext, ...). WAVE_FORMAT_EXTENSIBLE files are resolved to their sub-format,
+/// and RF64/BW64 files, whose sizes don't fit in the RIFF fields, get the size of
+/// the audio data from their 'ds64' chunk. Truncated files are described up to
+/// where they end. Supported formats are 8/16/24/32 bit PCM and 32 bit float.
+///
+/// @param read A function reading 'n' bytes at 'offset' in the file into 'buf':
+/// size_t read(uint64_t offset, uint8_t *buf, size_t n), returning the number
+/// of bytes read.
+/// @param fileSize Size of the file.
+/// @throw std::runtime_error if the file is invalid or not supported.
+
+template <class ReadFn>
+WavFormat ParseWavFormat(ReadFn read, uint64_t fileSize)
+{
+    using namespace WavDetail;
+
+    WavFormat fmt = WavFormat();
+    uint8_t buf[40];
+
+    if(read(0, buf, 12) != 12 ||
+       !(IsTag(buf, "RIFF") || IsTag(buf, "RF64") || IsTag(buf, "BW64")) ||
+       !IsTag(buf + 8, "WAVE"))
+       throw std::runtime_error("Invalid WAV header");
+
+    bool rf64 = !IsTag(buf, "RIFF");
+    bool has_fmt = false;
+    bool has_ds64 = false;
+    uint64_t ds64_data_size = 0;
+    uint64_t pos = 12;
+
+    while(pos + 8 <= fileSize)
+    {
+        if(read(pos, buf, 8) != 8)
+           break;
+
+        uint64_t size = Get32(buf + 4);
+        uint64_t avail = fileSize - pos - 8;
+
+        if(IsTag(buf, "ds64")){
+           if(size < 24 || size > avail || read(pos + 8, buf, 24) != 24)
+              throw std::runtime_error("Invalid ds64 chunk");
+           // RIFF size, then data size and sample count
+           ds64_data_size = Get64(buf + 8);
+           has_ds64 = true;
+        }
+        else if(IsTag(buf, "fmt ")){
+           size_t n = static_cast<size_t>(std::min<uint64_t>(size, sizeof(buf)));
+           if(size < 16 || size > avail || read(pos + 8, buf, n) != n)
+              throw std::runtime_error("Invalid format chunk");
+           fmt.FormatTag = Get16(buf);
+           fmt.Channels = Get16(buf + 2);
+           fmt.SampleRate = Get32(buf + 4);
+           fmt.BlockAlign = Get16(buf + 12);
+           fmt.BitsPerSample = Get16(buf + 14);
+           // The actual format is in the first two bytes of the sub-format GUID
+           if(fmt.FormatTag == WAVE_FORMAT_EXTENSIBLE){
+              if(size < 40)
+                 throw std::runtime_error("Invalid format chunk");
+              fmt.FormatTag = Get16(buf + 24);
+           }
+           has_fmt = true;
+        }
+        else if(IsTag(buf, "data")){
+           if(!has_fmt)
+              throw std::runtime_error("Missing format chunk");
+           if(rf64 && size == 0xFFFFFFFF){
+              if(!has_ds64)
+                 throw std::runtime_error("Missing ds64 chunk");
+              size = ds64_data_size;
+           }
+           fmt.DataOffset = pos + 8;
+           fmt.DataSize = std::min(size, avail);
+           break;
+        }
+
+        if(size > avail)
+           break;
+        pos += 8 + size + (size & 1);
+    }
+
+    if(!has_fmt)
+       throw std::runtime_error("Missing format chunk");
+    if(fmt.DataOffset == 0)
+       throw std::runtime_error("Missing data chunk");
+
+    bool supported = (fmt.FormatTag == WAVE_FORMAT_PCM && (fmt.BitsPerSample == 8  ||
+                                                           fmt.BitsPerSample == 16 ||
+                                                           fmt.BitsPerSample == 24 ||
+                                                           fmt.BitsPerSample == 32)) ||
+                     (fmt.FormatTag == WAVE_FORMAT_IEEE_FLOAT && fmt.BitsPerSample == 32);
+    if(!supported)
+       throw std::runtime_error("Unsupported sample format");
+
+    if(fmt.Channels == 0 || fmt.SampleRate == 0 ||
+       fmt.BlockAlign != fmt.Channels * (fmt.BitsPerSample / 8))
+       throw std::runtime_error("Invalid format chunk");
+
+    return fmt;
+}
+
+
+#endif
@@ -0,0 +1,79 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Helpers shared by the storage benchmarking tools
+
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "TCDataStore.h"
+#include "LSMDataStore.h"
+#include "SHMDataStore.h"
+#include "RemoteDataStore.h"
+
+#define DATASTORE_SPECS "tc:<dir>, lsm:<dir>, shm:<segment>, unix:<socket>, tcp:<host>:<port>"
+
+/// Create a datastore from a "<backend>:<url>" string (see DATASTORE_SPECS).
+/// The datastore is not opened.
+inline KVDataStore::Ptr CreateDataStore(const std::string &spec)
+{
+    size_t sep = spec.find(':');
+    std::string backend = spec.substr(0, sep);
+    std::string url = sep != std::string::npos ? spec.substr(sep + 1) : std::string();
+
+    KVDataStore::Ptr dstore;
+
+    if(backend == "tc")
+       dstore.reset(new TCDataStore(url));
+    else if(backend == "lsm")
+       dstore.reset(new LSMDataStore(url));
+    else if(backend == "shm")
+       dstore.reset(new SHMDataStore(url));
+    else if(backend == "unix" || backend == "tcp")
+       dstore.reset(new RemoteDataStore(spec));
+    else
+       throw std::invalid_argument("Unknown datastore backend " + backend);
+
+    return dstore;
+}
+
+/// Get the given percentile (0-1) of the sorted latencies (ns) in us
+inline double Percentile(const std::vector<uint32_t> &sorted, double p)
+{
+    if(sorted.empty())
+       return 0;
+    size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[i] / 1000.0;
+}
+
+/// Print the percentiles of the given latencies (ns), which are sorted
+inline void PrintLatencies(const char *label, std::vector<uint32_t> &lat)
+{
+    std::sort(lat.begin(), lat.end());
+    std::cout << "    " << std::left << std::setw(8) << label << std::right
+              << std::fixed << std::setprecision(1)
+              << " p50 "   << std::setw(9) << Percentile(lat, 0.50)
+              << " p90 "   << std::setw(9) << Percentile(lat, 0.90)
+              << " p99 "   << std::setw(9) << Percentile(lat, 0.99)
+              << " p99.9 " << std::setw(9) << Percentile(lat, 0.999)
+              << " max "   << std::setw(9) << Percentile(lat, 1.0) << " us" << std::endl;
+}
+
+
+#endif
@@ -0,0 +1,329 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Audio block pipeline benchmark. A capture thread produces 16 bit blocks
+/// of synthetic audio and hands them to a recognition thread through a
+/// queue, which normalizes them and identifies them. The pipeline is run
+/// three times: passing copies of the blocks and normalizing into new blocks
+/// (as the capture path used to), moving the blocks through the queue and
+/// recycling them and the normalized block by hand, and taking the blocks from
+/// an AudioBlockPool. The heap allocations made by each run are counted. If a datastore is given the blocks are identified against
+/// it, otherwise identification is replaced by a pass over the samples.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+#include "AudioBlock.h"
+#include "AudioBlockPool.h"
+#include "SPSCQueue.h"
+#include "BenchUtil.h"
+
+namespace {
+
+std::atomic<uint64_t> g_Allocs(0);
+std::atomic<uint64_t> g_AllocBytes(0);
+
+}
+
+// Count all the heap allocations of the process
+
+void* operator new(size_t size)
+{
+    g_Allocs.fetch_add(1, std::memory_order_relaxed);
+    g_AllocBytes.fetch_add(size, std::memory_order_relaxed);
+    if(void *p = std::malloc(size ? size : 1))
+       return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+typedef AudioBlock<S16bit> CaptureBlock;
+
+const float  SAMPLE_RATE = 11025;
+const size_t QUEUE_SIZE  = 8;
+
+struct PipelineParams
+{
+    size_t  Blocks;
+    size_t  BlockSize;
+    bool    Move;
+};
+
+struct PipelineStats
+{
+    uint64_t  Allocs;
+    uint64_t  AllocBytes;
+    double    Seconds;
+    double    Checksum;
+};
+
+/// The recognition stage, either a real recognizer or a stand-in
+class Identifier
+{
+    KVDataStore::Ptr                      m_DataStore;
+    std::unique_ptr<Audioneex::Recognizer> m_Recognizer;
+
+public:
+
+    double Checksum;
+
+    explicit Identifier(const std::string &spec) : Checksum(0)
+    {
+        if(spec.empty())
+           return;
+        m_DataStore = CreateDataStore(spec);
+        m_DataStore->Open(KVDataStore::GET, true, false);
+        m_Recognizer.reset( Audioneex::Recognizer::Create() );
+        m_Recognizer->SetDataStore( m_DataStore.get() );
+    }
+
+    void Identify(const AudioBlock<Sfloat> &block)
+    {
+        if(m_Recognizer){
+           m_Recognizer->Identify(block.Data(), block.Size());
+           if(m_Recognizer->GetResults())
+              m_Recognizer->Reset();
+           return;
+        }
+        for(size_t i=0; i<block.Size(); i++)
+            Checksum += block.Data()[i] * block.Data()[i];
+    }
+};
+
+/// Fill the block with a tone in noise, as the capture would
+void Capture(CaptureBlock &block, size_t n, std::mt19937 &rng)
+{
+    std::normal_distribution<float> noise(0.f, 1000.f);
+    for(size_t i=0; i<block.Size(); i++){
+        float t = (n * block.Size() + i) / SAMPLE_RATE;
+        float s = 8000.f * std::sin(2 * 3.14159265f * 440.f * t) + noise(rng);
+        block.Data()[i] = static_cast<S16bit>(std::max(-32768.f, std::min(32767.f, s)));
+    }
+    block.SetID(static_cast<int32_t>(n));
+}
+
+PipelineStats RunPipeline(const PipelineParams &params, Identifier &identifier)
+{
+    // Full blocks go to the recognition thread through 'queue'. In move mode
+    // the spent blocks come back to the capture thread through 'spare'.
+    SPSCQueue<CaptureBlock> queue(QUEUE_SIZE);
+    SPSCQueue<CaptureBlock> spare(QUEUE_SIZE);
+    std::atomic<bool> done(false);
+
+    // The buffers that are reused in both modes are allocated upfront
+    CaptureBlock capture(params.BlockSize, SAMPLE_RATE, 1);
+    AudioBlock<Sfloat> clip(params.BlockSize, SAMPLE_RATE, 1);
+    if(params.Move)
+       for(size_t i=0; i<spare.Capacity(); i++){
+           CaptureBlock block(params.BlockSize, SAMPLE_RATE, 1);
+           spare.Push(block);
+       }
+
+    uint64_t allocs0 = g_Allocs.load();
+    uint64_t bytes0 = g_AllocBytes.load();
+    double checksum0 = identifier.Checksum;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    std::thread producer([&](){
+        std::mt19937 rng(1);
+        for(size_t n=0; n<params.Blocks; n++){
+            CaptureBlock item;
+            if(params.Move){
+               // Reuse a spent block
+               while(!spare.Pop(item))
+                   std::this_thread::yield();
+               Capture(item, n, rng);
+            }
+            else{
+               Capture(capture, n, rng);
+               item = capture;
+            }
+            while(!queue.Push(item))
+                std::this_thread::yield();
+        }
+        done = true;
+    });
+
+    CaptureBlock item;
+    for(;;){
+        if(!queue.Pop(item)){
+           if(done && queue.Empty())
+              break;
+           std::this_thread::yield();
+           continue;
+        }
+        if(params.Move){
+           item.Normalize(clip);
+           identifier.Identify(clip);
+           spare.Push(item);
+        }
+        else{
+           AudioBlock<Sfloat> *nblock = item.Normalize();
+           identifier.Identify(*nblock);
+           delete nblock;
+        }
+    }
+    producer.join();
+
+    PipelineStats stats;
+    stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    stats.Allocs = g_Allocs.load() - allocs0;
+    stats.AllocBytes = g_AllocBytes.load() - bytes0;
+    stats.Checksum = identifier.Checksum - checksum0;
+    return stats;
+}
+
+PipelineStats RunPooledPipeline(const PipelineParams &params, Identifier &identifier)
+{
+    typedef AudioBlockPool<S16bit>::Handle CaptureHandle;
+
+    // The blocks are released by the recognition thread and find their
+    // way back to the capture thread through the pool's shared lists
+    AudioBlockPool<S16bit> pool(SAMPLE_RATE, 1);
+    AudioBlockPool<Sfloat> clip_pool(SAMPLE_RATE, 1);
+    SPSCQueue<CaptureHandle> queue(QUEUE_SIZE);
+    std::atomic<bool> done(false);
+
+    pool.Reserve(params.BlockSize, 2 * QUEUE_SIZE);
+    clip_pool.Reserve(params.BlockSize, 1);
+
+    uint64_t allocs0 = g_Allocs.load();
+    uint64_t bytes0 = g_AllocBytes.load();
+    double checksum0 = identifier.Checksum;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    std::thread producer([&](){
+        std::mt19937 rng(1);
+        for(size_t n=0; n<params.Blocks; n++){
+            CaptureHandle item = pool.Acquire(params.BlockSize);
+            Capture(*item, n, rng);
+            while(!queue.Push(item))
+                std::this_thread::yield();
+        }
+        done = true;
+    });
+
+    CaptureHandle item;
+    for(;;){
+        if(!queue.Pop(item)){
+           if(done && queue.Empty())
+              break;
+           std::this_thread::yield();
+           continue;
+        }
+        AudioBlockPool<Sfloat>::Handle clip = clip_pool.Acquire(item->Size());
+        item->Normalize(*clip);
+        identifier.Identify(*clip);
+        item.reset();
+    }
+    producer.join();
+
+    PipelineStats stats;
+    stats.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    stats.Allocs = g_Allocs.load() - allocs0;
+    stats.AllocBytes = g_AllocBytes.load() - bytes0;
+    stats.Checksum = identifier.Checksum - checksum0;
+
+    AudioBlockPool<S16bit>::Stats pstats = pool.GetStats();
+    std::cout << "Pool: " << pstats.Acquired << " blocks acquired, " << pstats.Allocated
+              << " allocated, " << pstats.CacheHits << " from the thread cache" << std::endl;
+    return stats;
+}
+
+void Report(const char *name, const PipelineParams &params, const PipelineStats &stats)
+{
+    std::cout << name << ": " << params.Blocks << " blocks in "
+              << std::fixed << std::setprecision(3) << stats.Seconds << " s, "
+              << stats.Allocs << " allocations ("
+              << std::setprecision(2) << double(stats.Allocs) / params.Blocks << " per block, "
+              << stats.AllocBytes / (1024.0*1024) << " MB)" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    PipelineParams params;
+    params.Blocks = 1000;
+    params.BlockSize = 5512;
+    int i = 1;
+
+    for(; i+1<argc; i+=2){
+        std::string arg = argv[i];
+        if(arg == "-n")
+           params.Blocks = std::strtoul(argv[i+1], 0, 10);
+        else if(arg == "-b")
+           params.BlockSize = std::strtoul(argv[i+1], 0, 10);
+        else
+           break;
+    }
+
+    if(i < argc-1 || params.Blocks == 0 || params.BlockSize == 0){
+       std::cout << "Usage: audioblock-bench [-n <blocks>] [-b <samples>] [datastore]\n"
+                 << "   -n  number of captured blocks (" << params.Blocks << ")\n"
+                 << "   -b  samples per block, at 11025 Hz mono (" << params.BlockSize << ")\n"
+                 << "Datastores: " DATASTORE_SPECS << std::endl;
+       return 1;
+    }
+
+    try{
+       Identifier identifier(i < argc ? argv[i] : "");
+       std::cout << "Sample conversion: " << GetSampleConvertISA() << std::endl;
+
+       params.Move = false;
+       PipelineStats copy_stats = RunPipeline(params, identifier);
+       Report("Copy", params, copy_stats);
+
+       params.Move = true;
+       PipelineStats move_stats = RunPipeline(params, identifier);
+       Report("Move", params, move_stats);
+
+       PipelineStats pool_stats = RunPooledPipeline(params, identifier);
+       Report("Pooled", params, pool_stats);
+
+       if(std::abs(copy_stats.Checksum - move_stats.Checksum) > 1e-6 * std::abs(copy_stats.Checksum) ||
+          std::abs(copy_stats.Checksum - pool_stats.Checksum) > 1e-6 * std::abs(copy_stats.Checksum))
+          throw std::runtime_error("The pipelines produced different audio");
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
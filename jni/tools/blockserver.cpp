@@ -0,0 +1,74 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Block server daemon. It opens the datastore in the given directory and
+/// serves it to RemoteDataStore clients until terminated (SIGINT/SIGTERM).
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <stdexcept>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "TCDataStore.h"
+#include "BlockServer.h"
+
+int main(int argc, char** argv)
+{
+    if(argc < 3){
+       std::cout << "Usage: blockserver <datastore dir> <address>\n"
+                 << "       address: unix:<socket path> | tcp:<host>:<port>" << std::endl;
+       return 1;
+    }
+
+    try{
+       // Handle the termination signals synchronously in the main thread
+       sigset_t sigs;
+       sigemptyset(&sigs);
+       sigaddset(&sigs, SIGINT);
+       sigaddset(&sigs, SIGTERM);
+       pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+
+       TCDataStore dstore(argv[1]);
+       dstore.Open(KVDataStore::GET, true, true, true);
+
+       BlockServer server(&dstore, argv[2]);
+
+       std::thread serving([&server](){
+           try{
+              server.Run();
+           }
+           catch(const std::exception &ex){
+              std::cerr << "ERROR: " << ex.what() << std::endl;
+              kill(getpid(), SIGTERM);
+           }
+       });
+
+       std::cout << "Serving " << argv[1] << " on " << argv[2] << std::endl;
+
+       int sig;
+       sigwait(&sigs, &sig);
+
+       std::cout << "Shutting down..." << std::endl;
+
+       server.Stop();
+       serving.join();
+       dstore.Close();
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Channel kernel benchmark. Interleaved 16 bit and float frames are
+/// downmixed to mono, split into channels and a channel is extracted, with
+/// each instruction set available and with the plain loop that normalizes
+/// and averages each frame, reporting millions of frames per second.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+
+#include "SampleConvert.h"
+
+namespace {
+
+const size_t FRAMES = 1 << 16;
+
+typedef std::chrono::steady_clock Clock;
+
+template <class T> float Norm();
+template <> float Norm<float>()   { return 1.f; }
+template <> float Norm<int16_t>() { return 1.f / 32768; }
+
+template <class T>
+std::vector<T> Noise(size_t n)
+{
+    std::vector<T> x(n);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    for(size_t i=0; i<n; i++)
+        x[i] = static_cast<T>(noise(rng) / Norm<T>());
+    return x;
+}
+
+/// Run f 'repeats' times, returning millions of frames per second
+template <class F>
+double Rate(F f, int repeats)
+{
+    Clock::time_point t0 = Clock::now();
+    for(int i=0; i<repeats; i++)
+        f();
+    double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    return double(FRAMES) * repeats / secs / 1e6;
+}
+
+template <class T>
+void Bench(const char *format, size_t nchans, int repeats)
+{
+    std::vector<T> in = Noise<T>(FRAMES * nchans);
+    std::vector<float> out(FRAMES);
+    std::vector<std::vector<float> > channels(nchans, std::vector<float>(FRAMES));
+    std::vector<float*> outs(nchans);
+    for(size_t c=0; c<nchans; c++)
+        outs[c] = channels[c].data();
+
+    double loop = Rate([&](){
+        const float scale = Norm<T>() / nchans;
+        for(size_t i=0; i<FRAMES; i++){
+            float sum = 0;
+            for(size_t c=0; c<nchans; c++)
+                sum += in[i*nchans + c];
+            out[i] = sum * scale;
+        }
+    }, repeats);
+
+    std::cout << std::setw(6) << format << std::setw(4) << nchans << std::fixed << std::setprecision(0)
+              << std::setw(10) << loop;
+
+    const char* isas[] = { "scalar", "sse2", "avx2", "neon" };
+    for(size_t k=0; k<sizeof(isas)/sizeof(isas[0]); k++){
+        if(!SetSampleConvertISA(isas[k]))
+           continue;
+        double mix = Rate([&](){ DownmixSamples(in.data(), out.data(), FRAMES, nchans); }, repeats);
+        double split = Rate([&](){ DeinterleaveSamples(in.data(), outs.data(), FRAMES, nchans); }, repeats);
+        double extract = Rate([&](){ ExtractChannel(in.data(), out.data(), FRAMES, nchans, nchans-1); }, repeats);
+        std::cout << "  " << isas[k] << " " << mix << "/" << split << "/" << extract;
+    }
+    std::cout << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int repeats = 200;
+
+    if(argc > 1 && (argc != 3 || std::string(argv[1]) != "-r" || (repeats = std::atoi(argv[2])) <= 0)){
+       std::cout << "Usage: channelmix-bench [-r <repeats>]" << std::endl;
+       return 1;
+    }
+
+    try{
+       std::cout << "Mframes/s, downmix/deinterleave/extract, " << FRAMES << " frames\n"
+                 << "format  ch      loop" << std::endl;
+
+       size_t nchans[] = { 2, 6 };
+       for(size_t i=0; i<sizeof(nchans)/sizeof(nchans[0]); i++){
+           Bench<int16_t>("s16", nchans[i], repeats);
+           Bench<float>("float", nchans[i], repeats);
+       }
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
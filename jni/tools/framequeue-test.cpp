@@ -0,0 +1,161 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// AudioFrameQueue stress test. A producer thread writes a counting sequence
+/// of samples in chunks of random length while a consumer thread pulls the
+/// frames at an irregular pace, so that the queue keeps overflowing. Each
+/// policy is run on a small queue and the frames pulled are checked: their
+/// samples must follow each other and their IDs must only skip the frames
+/// dropped. Under DROP_OLDEST every overflow must lose either the oldest
+/// frame or the new samples, never both, and under BLOCK nothing may be lost.
+/// Meant to be run under ThreadSanitizer or AddressSanitizer too.
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+#include "AudioFrameQueue.h"
+
+namespace {
+
+typedef AudioFrameQueue<S32bit> FrameQueue;
+
+const size_t QUEUE_FRAMES = 4;
+const size_t FRAME_SIZE   = 64;
+
+void Check(bool cond, const std::string &what)
+{
+    if(!cond)
+       throw std::runtime_error(what);
+}
+
+template <class V>
+std::string Str(V value)
+{
+    std::ostringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+void Run(FrameQueue::Policy policy, size_t nframes)
+{
+    FrameQueue queue(QUEUE_FRAMES, FRAME_SIZE, 11025, 1, policy);
+
+    const uint64_t total = nframes * FRAME_SIZE;
+    uint64_t written = 0, shortWrites = 0;
+
+    std::thread producer([&](){
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<size_t> chunk(1, FRAME_SIZE * 3);
+        std::vector<S32bit> data(FRAME_SIZE * 3);
+        uint64_t pos = 0;
+
+        while(pos < total){
+            size_t n = static_cast<size_t>(std::min<uint64_t>(chunk(rng), total - pos));
+            for(size_t i=0; i<n; i++)
+                data[i] = static_cast<S32bit>(pos + i);
+            size_t done = queue.Write(data.data(), n);
+            written += done;
+            if(done < n)
+               shortWrites++;
+            pos += n;
+        }
+        queue.Flush();
+        queue.Close();
+    });
+
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<int> pause(0, 7);
+    AudioBlock<S32bit> frame;
+    uint64_t pulled = 0, samples = 0, gaps = 0;
+    int64_t lastID = -1, lastSample = -1;
+
+    for(;;){
+        if(!queue.Pull(frame)){
+           if(queue.IsClosed() && queue.Available() == 0)
+              break;
+           queue.Wait(10);
+           continue;
+        }
+
+        const S32bit *x = frame.Data();
+        Check(frame.Size() > 0 && frame.Size() <= FRAME_SIZE, "Bad frame size " + Str(frame.Size()));
+        Check(frame.ID() > lastID, "Frame " + Str(frame.ID()) + " after " + Str(lastID));
+        Check(x[0] > lastSample, "Frame " + Str(frame.ID()) + " repeats samples");
+        for(size_t i=1; i<frame.Size(); i++)
+            Check(x[i] == x[0] + static_cast<S32bit>(i), "Frame " + Str(frame.ID()) + " is torn");
+
+        gaps += frame.ID() - lastID - 1;
+        lastID = frame.ID();
+        lastSample = x[frame.Size() - 1];
+        samples += frame.Size();
+        pulled++;
+
+        // Fall behind now and then
+        if(pause(rng) == 0)
+           std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    producer.join();
+
+    FrameQueue::Stats stats = queue.GetStats();
+
+    std::cout << (policy == FrameQueue::BLOCK ? "BLOCK      " : "DROP_OLDEST")
+              << "  frames " << stats.Frames << ", pulled " << stats.Pulled
+              << ", dropped " << stats.Dropped << ", discarded " << stats.Discarded
+              << " samples, overflows " << stats.Overflows << std::endl;
+
+    Check(stats.Pulled == pulled, "Pulled count mismatch");
+    Check(stats.Frames == pulled + stats.Dropped, "Frames not pulled nor dropped");
+    Check(gaps == stats.Dropped, "Frames lost without being counted as dropped");
+    Check(written + stats.Discarded == total, "Samples lost without being counted");
+    Check(samples + stats.Dropped * FRAME_SIZE == written, "Samples missing from the frames");
+
+    if(policy == FrameQueue::BLOCK){
+       Check(stats.Dropped == 0 && stats.Discarded == 0, "Audio lost under BLOCK");
+    }
+    else{
+       // Each overflow either drops the oldest frame or discards the rest of
+       // the write that hit it
+       Check(stats.Overflows == stats.Dropped + shortWrites,
+             "Overflows losing both a frame and the new samples");
+    }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t nframes = 200000;
+
+    if(argc > 1 && (argc != 3 || std::string(argv[1]) != "-n" || (nframes = std::strtoul(argv[2], 0, 10)) == 0)){
+       std::cout << "Usage: framequeue-test [-n <frames>]" << std::endl;
+       return 1;
+    }
+
+    try{
+       Run(FrameQueue::DROP_OLDEST, nframes);
+       Run(FrameQueue::BLOCK, nframes);
+    }
+    catch(const std::exception &ex){
+       std::cerr << "FAILED: " << ex.what() << std::endl;
+       return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
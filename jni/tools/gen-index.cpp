@@ -0,0 +1,121 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Generates a synthetic catalog (index and fingerprints) into a datastore,
+/// for benchmarking storage changes (see SyntheticIndex). The datastore is
+/// cleared first, unless -a is given, in which case the fingerprints are
+/// added to it with a build-merge.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <stdexcept>
+
+#include "SyntheticIndex.h"
+#include "BenchUtil.h"
+
+static void PrintProgress(const SyntheticIndex::Stats &s)
+{
+    double secs = s.Seconds > 0 ? s.Seconds : 1e-9;
+
+    std::cout << "\r" << s.FIDs << " fingerprints, " << s.Blocks << " blocks, "
+              << std::fixed << std::setprecision(1)
+              << s.FIDs / secs << " fp/s, "
+              << (s.IndexBytes + s.FingerprintBytes) / secs / (1024*1024) << " MB/s   "
+              << std::flush;
+}
+
+int main(int argc, char** argv)
+{
+    SyntheticIndex::Params params;
+    bool add = false;
+    int i = 1;
+
+    for(; i<argc-1; i++){
+        std::string arg = argv[i];
+        if(arg == "-a")
+           add = true;
+        else if(i+1 >= argc-1)
+           break;
+        else if(arg == "-n")
+           params.FIDs = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-f")
+           params.FirstFID = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-l")
+           params.Lists = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-z")
+           params.Zipf = std::atof(argv[++i]);
+        else if(arg == "-t")
+           params.TermsPerFID = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-p")
+           params.PostingSize = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-b")
+           params.BlockSize = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-q")
+           params.FingerprintSize = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-k")
+           params.FlushFIDs = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-s")
+           params.Seed = std::strtoul(argv[++i], 0, 10);
+        else
+           break;
+    }
+
+    if(i != argc-1){
+       SyntheticIndex::Params def;
+       std::cout << "Usage: gen-index [options] <datastore>\n"
+                 << "   -n  number of fingerprints (" << def.FIDs << ")\n"
+                 << "   -f  first FID (" << def.FirstFID << ")\n"
+                 << "   -l  number of index lists (" << def.Lists << ")\n"
+                 << "   -z  Zipf exponent of the list popularity (" << def.Zipf << ")\n"
+                 << "   -t  mean lists per fingerprint (" << def.TermsPerFID << ")\n"
+                 << "   -p  mean posting size in bytes (" << def.PostingSize << ")\n"
+                 << "   -b  block body size in bytes (" << def.BlockSize << ")\n"
+                 << "   -q  mean fingerprint size in bytes (" << def.FingerprintSize << ")\n"
+                 << "   -k  fingerprints between flushes (" << def.FlushFIDs << ")\n"
+                 << "   -s  random seed (" << def.Seed << ")\n"
+                 << "   -a  add to the datastore (build-merge) rather than replace its contents\n"
+                 << "Datastores: " DATASTORE_SPECS << std::endl;
+       return 1;
+    }
+
+    try{
+       KVDataStore::Ptr dstore = CreateDataStore(argv[i]);
+
+       if(add)
+          dstore->Open(KVDataStore::BUILD_MERGE, true, false, true);
+       else{
+          dstore->Open(KVDataStore::BUILD, true, false, true);
+          dstore->Clear();
+       }
+
+       SyntheticIndex generator(params);
+       generator.SetProgressCallback(PrintProgress);
+
+       SyntheticIndex::Stats stats = generator.Generate(*dstore);
+
+       dstore->Close();
+
+       std::cout << std::endl
+                 << stats.FIDs << " fingerprints, " << stats.Postings << " postings, "
+                 << stats.Blocks << " new blocks, " << stats.Flushes << " flushes\n"
+                 << stats.IndexBytes << " index bytes, " << stats.FingerprintBytes
+                 << " fingerprint bytes in " << std::fixed << std::setprecision(2)
+                 << stats.Seconds << " s" << std::endl;
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
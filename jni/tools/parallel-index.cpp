@@ -0,0 +1,115 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Builds a datastore from a list of WAV files using several indexers in
+/// parallel (see ParallelIndexBuilder). The list holds one path per line,
+/// and the recording on line N gets FID N. With -v the result is checked
+/// against a serial build of the same recordings, which is worth doing
+/// whenever the engine is updated, as the merge relies on the index blocks
+/// being self-contained.
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+
+#include "ParallelIndexBuilder.h"
+#include "WavAudioProvider.h"
+
+int main(int argc, char** argv)
+{
+    Audioneex::eMatchType mtype = Audioneex::MSCALE_MATCH;
+    size_t partitions = 0;
+    size_t cache = 0;
+    size_t verify = 0;
+    int i = 1;
+
+    for(; i<argc-2; i++){
+        std::string arg = argv[i];
+        if(arg == "-x")
+           mtype = Audioneex::XSCALE_MATCH;
+        else if(arg == "-j" && i+1 < argc-2)
+           partitions = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-c" && i+1 < argc-2)
+           cache = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-v" && i+1 < argc-2)
+           verify = std::strtoul(argv[++i], 0, 10);
+        else
+           break;
+    }
+
+    if(i != argc-2){
+       std::cout << "Usage: parallel-index [-x] [-j <partitions>] [-c <cache MB>] [-v <secs>] <wav list> <datastore dir>\n"
+                 << "   -x  use XSCALE matching (default is MSCALE)\n"
+                 << "   -j  number of partitions (default is the number of cores)\n"
+                 << "   -c  indexer cache limit in MB\n"
+                 << "   -v  compare the identification results of the first <secs>\n"
+                 << "       seconds of every recording against a serial build" << std::endl;
+       return 1;
+    }
+
+    try{
+       std::vector<std::string> paths;
+       std::ifstream list(argv[i]);
+       if(!list)
+          throw std::runtime_error(std::string("Couldn't open ") + argv[i]);
+
+       std::string line;
+       while(std::getline(list, line))
+           paths.push_back(line);
+
+       std::vector<uint32_t> fids;
+       for(size_t n=0; n<paths.size(); n++)
+           if(!paths[n].empty())
+              fids.push_back(static_cast<uint32_t>(n + 1));
+
+       WavAudioProvider::PathResolver resolver = [&paths](uint32_t FID){
+           return paths.at(FID - 1);
+       };
+
+       ParallelIndexBuilder builder(argv[i+1]);
+       builder.SetMatchType(mtype);
+       if(partitions)
+          builder.SetPartitions(partitions);
+       if(cache)
+          builder.SetCacheLimit(cache);
+
+       // The recordings aren't scheduled, so each partition decodes them
+       // on its own indexer thread
+       builder.SetProviderFactory([&resolver](size_t){
+           return std::unique_ptr<Audioneex::AudioProvider>(new WavAudioProvider(resolver, 1));
+       });
+
+       auto start = std::chrono::steady_clock::now();
+       builder.Build(fids);
+       double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+       std::cout << "Indexed " << fids.size() << " recordings in " << secs << " s using "
+                 << builder.GetPartitions() << " partitions" << std::endl;
+
+       if(verify){
+          size_t mismatches = builder.Verify(fids, verify);
+          std::cout << "Verify: " << mismatches << " of " << fids.size()
+                    << " recordings identified differently by the serial build" << std::endl;
+          if(mismatches)
+             return 2;
+       }
+    }
+    catch(const std::exception &ex){
+       std::cerr << "\nERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
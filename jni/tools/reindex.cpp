@@ -0,0 +1,97 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Rebuilds the index of a datastore from its fingerprints database, e.g. to
+/// change the match type. The new index replaces the live one once complete,
+/// unless -n is given, in which case it is left in the staging directory.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <stdexcept>
+
+#include "Reindexer.h"
+
+static void PrintProgress(const Reindexer::Progress &p)
+{
+    double secs = p.Seconds > 0 ? p.Seconds : 1e-9;
+
+    std::cout << "\r" << p.Done << "/" << p.Total << " fingerprints, "
+              << std::fixed << std::setprecision(1)
+              << p.Done / secs << " fp/s, "
+              << p.Bytes / secs / (1024*1024) << " MB/s   " << std::flush;
+}
+
+int main(int argc, char** argv)
+{
+    Audioneex::eMatchType mtype = Audioneex::MSCALE_MATCH;
+    size_t cache = 0;
+    long budget = -1;
+    bool swap = true;
+    bool resume = false;
+    int i = 1;
+
+    for(; i<argc-1; i++){
+        std::string arg = argv[i];
+        if(arg == "-x")
+           mtype = Audioneex::XSCALE_MATCH;
+        else if(arg == "-n")
+           swap = false;
+        else if(arg == "-r")
+           resume = true;
+        else if(arg == "-c" && i+1 < argc-1)
+           cache = std::atoi(argv[++i]);
+        else if(arg == "-m" && i+1 < argc-1)
+           budget = std::atol(argv[++i]);
+        else
+           break;
+    }
+
+    if(i != argc-1){
+       std::cout << "Usage: reindex [-x] [-c <cache MB> | -m <budget MB>] [-n] [-r] <datastore dir>\n"
+                 << "   -x  use XSCALE matching (default is MSCALE)\n"
+                 << "   -c  indexer cache limit in MB\n"
+                 << "   -m  keep the memory used under the given budget in MB\n"
+                 << "       (0 for the largest safe budget)\n"
+                 << "   -n  don't replace the live index\n"
+                 << "   -r  resume an interrupted run" << std::endl;
+       return 1;
+    }
+
+    try{
+       Reindexer reindexer(argv[i]);
+       reindexer.SetMatchType(mtype);
+       if(cache)
+          reindexer.SetCacheLimit(cache);
+       if(budget >= 0)
+          reindexer.SetMemoryBudget(static_cast<size_t>(budget) * 1024 * 1024);
+       reindexer.SetResume(resume);
+       reindexer.SetProgressCallback(PrintProgress);
+
+       Reindexer::Progress p = reindexer.Run();
+       std::cout << std::endl;
+
+       if(swap){
+          reindexer.Swap();
+          std::cout << "Reindexed " << p.Total << " fingerprints in "
+                    << p.Seconds << " s" << std::endl;
+       }
+       else
+          std::cout << "New index built in " << reindexer.GetStagingURL() << std::endl;
+    }
+    catch(const std::exception &ex){
+       std::cerr << "\nERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
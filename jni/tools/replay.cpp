@@ -0,0 +1,214 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Replays a trace recorded by TracingDataStore against a datastore, to compare
+/// storage backends and cache settings on a realistic workload without running
+/// the engine. Every replay thread uses its own datastore instance. The traced
+/// threads are spread over the replay threads, or the records themselves if
+/// there are fewer traced threads than replay threads. The calls are issued
+/// at their traced times (scaled by the speed factor), or back to back if the
+/// speed is zero. The latencies are reported per method along with those in
+/// the trace.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+#include "TracingDataStore.h"
+#include "BenchUtil.h"
+
+namespace {
+
+const char* OP_NAMES[] = { "GetPListBlock", "GetFingerprint", "GetMetadata" };
+const int   NUM_OPS = 3;
+
+/// Per replay thread results
+struct Results
+{
+    std::vector<uint32_t>  Latency[NUM_OPS];   ///< In ns
+    uint64_t               Bytes[NUM_OPS];
+    size_t                 Mismatches;         ///< Sizes differing from the trace
+    size_t                 Errors;
+};
+
+void Replay(const std::string &spec,
+            const std::vector<TraceRecord> &trace,
+            const std::vector<size_t> &records,
+            double speed,
+            std::chrono::steady_clock::time_point start,
+            Results &res)
+{
+    KVDataStore::Ptr dstore = CreateDataStore(spec);
+    dstore->Open(KVDataStore::GET, true, true);
+
+    for(size_t i=0; i<records.size(); i++)
+    {
+        const TraceRecord &rec = trace[records[i]];
+
+        if(rec.Op >= NUM_OPS)
+           continue;
+
+        if(speed > 0)
+           std::this_thread::sleep_until(start + std::chrono::nanoseconds(
+                                         static_cast<uint64_t>(rec.Time / speed)));
+
+        size_t size = 0;
+        auto t0 = std::chrono::steady_clock::now();
+
+        try{
+           if(rec.Op == TraceRecord::PLIST_BLOCK)
+              dstore->GetPListBlock(rec.Key, rec.Arg1, size, rec.Headers != 0);
+           else if(rec.Op == TraceRecord::FINGERPRINT)
+              dstore->GetFingerprint(rec.Key, size, rec.Arg2, rec.Arg1);
+           else
+              size = dstore->GetMetadata(rec.Key).size();
+        }
+        catch(const std::exception &){
+           res.Errors ++;
+           continue;
+        }
+
+        auto t1 = std::chrono::steady_clock::now();
+
+        res.Latency[rec.Op].push_back(static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+        res.Bytes[rec.Op] += size;
+
+        if(size != rec.Size)
+           res.Mismatches ++;
+    }
+
+    dstore->Close();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t nthreads = 1;
+    double speed = 0;
+    int i = 1;
+
+    for(; i<argc-2; i++){
+        std::string arg = argv[i];
+        if(arg == "-t" && i+1 < argc-2)
+           nthreads = std::max(1, std::atoi(argv[++i]));
+        else if(arg == "-s" && i+1 < argc-2)
+           speed = std::atof(argv[++i]);
+        else
+           break;
+    }
+
+    if(i != argc-2){
+       std::cout << "Usage: replay [-t <threads>] [-s <speed>] <trace file> <datastore>\n"
+                 << "   -t  number of replay threads (default 1)\n"
+                 << "   -s  timing fidelity: 1 replays the calls at their traced times,\n"
+                 << "       2 twice as fast, etc. 0 (default) issues them back to back\n"
+                 << "Datastores: " DATASTORE_SPECS
+                 << std::endl;
+       return 1;
+    }
+
+    try{
+       std::vector<TraceRecord> trace;
+       TracingDataStore::ReadTrace(argv[i], trace);
+
+       std::string spec = argv[i+1];
+
+       std::set<uint16_t> threads;
+       for(size_t k=0; k<trace.size(); k++)
+           threads.insert(trace[k].Thread);
+
+       // Spread the traced threads, or the records, over the replay threads
+       std::vector< std::vector<size_t> > records(nthreads);
+       bool by_thread = threads.size() >= nthreads;
+
+       for(size_t k=0; k<trace.size(); k++)
+           records[by_thread ? trace[k].Thread % nthreads : k % nthreads].push_back(k);
+
+       std::cout << "Replaying " << trace.size() << " calls from " << threads.size()
+                 << " threads on " << nthreads << " threads" << std::endl;
+
+       std::vector<Results> results(nthreads, Results());
+       std::vector<std::thread> workers;
+
+       auto start = std::chrono::steady_clock::now();
+
+       for(size_t w=0; w<nthreads; w++)
+           workers.push_back(std::thread([&, w](){
+               try{
+                  Replay(spec, trace, records[w], speed, start, results[w]);
+               }
+               catch(const std::exception &ex){
+                  std::cerr << "ERROR: " << ex.what() << std::endl;
+                  results[w].Errors += records[w].size();
+               }
+           }));
+
+       for(size_t w=0; w<workers.size(); w++)
+           workers[w].join();
+
+       double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+       // Merge and report
+       size_t ncalls = 0, mismatches = 0, errors = 0;
+       uint64_t total_bytes = 0;
+
+       for(int op=0; op<NUM_OPS; op++)
+       {
+           std::vector<uint32_t> lat, traced;
+           uint64_t bytes = 0;
+
+           for(size_t w=0; w<nthreads; w++){
+               lat.insert(lat.end(), results[w].Latency[op].begin(), results[w].Latency[op].end());
+               bytes += results[w].Bytes[op];
+           }
+
+           for(size_t k=0; k<trace.size(); k++)
+               if(trace[k].Op == op)
+                  traced.push_back(trace[k].Latency);
+
+           if(traced.empty())
+              continue;
+
+           std::cout << OP_NAMES[op] << ": " << lat.size() << " calls, "
+                     << bytes << " bytes" << std::endl;
+           PrintLatencies("replay", lat);
+           PrintLatencies("trace", traced);
+
+           ncalls += lat.size();
+           total_bytes += bytes;
+       }
+
+       for(size_t w=0; w<nthreads; w++){
+           mismatches += results[w].Mismatches;
+           errors += results[w].Errors;
+       }
+
+       std::cout << std::fixed << std::setprecision(2)
+                 << ncalls << " calls in " << secs << " s, "
+                 << ncalls / secs << " calls/s, "
+                 << total_bytes / secs / (1024*1024) << " MB/s, "
+                 << errors << " errors, " << mismatches << " size mismatches" << std::endl;
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
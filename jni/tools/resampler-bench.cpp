@@ -0,0 +1,162 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Resampler benchmark. For each input rate the polyphase resampler and a
+/// linear interpolator are compared on the error on a 1 kHz tone and on the
+/// level of the alias of a 7 kHz tone (which 11025 Hz can't represent), and
+/// the resampler's throughput is reported as the number of real time streams
+/// a core can resample to 11025 Hz.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+
+#include "Resampler.h"
+#include "SampleConvert.h"
+
+namespace {
+
+const int    OUTPUT_RATE = 11025;
+const double PI = 3.14159265358979323846;
+
+/// Input block size, as delivered by a capture or a file reader
+const size_t BLOCK_SAMPLES = 1024;
+
+std::vector<float> Tone(int rate, double freq, size_t n)
+{
+    std::vector<float> x(n);
+    for(size_t i=0; i<n; i++)
+        x[i] = static_cast<float>(0.5 * std::sin(2 * PI * freq * i / rate));
+    return x;
+}
+
+std::vector<float> Polyphase(int rate, const std::vector<float> &x)
+{
+    Resampler resampler(rate, OUTPUT_RATE);
+    std::vector<float> y(resampler.GetMaxOutput(x.size()) + resampler.GetMaxOutput(resampler.GetFilterLength()));
+    size_t n = 0;
+    for(size_t i=0; i<x.size(); i+=BLOCK_SAMPLES)
+        n += resampler.Process(&x[i], std::min(BLOCK_SAMPLES, x.size() - i), &y[n]);
+    n += resampler.Flush(&y[n]);
+    y.resize(n);
+    return y;
+}
+
+std::vector<float> Linear(int rate, const std::vector<float> &x)
+{
+    std::vector<float> y;
+    double step = double(rate) / OUTPUT_RATE;
+    for(double t=0; t+1<x.size(); t+=step){
+        size_t i = static_cast<size_t>(t);
+        y.push_back(static_cast<float>(x[i] + (t - i) * (x[i+1] - x[i])));
+    }
+    return y;
+}
+
+/// RMS difference from a tone at the output rate, in dB relative to the tone
+/// (or its level if freq is 0), skipping the edges
+double ErrorDB(const std::vector<float> &y, double freq)
+{
+    size_t edge = 1000;
+    double err = 0;
+    for(size_t i=edge; i+edge<y.size(); i++){
+        double e = y[i] - (freq ? 0.5 * std::sin(2 * PI * freq * i / OUTPUT_RATE) : 0);
+        err += e * e;
+    }
+    err = std::sqrt(err / (y.size() - 2 * edge));
+    return 20 * std::log10(err / (0.5 / std::sqrt(2.0)) + 1e-12);
+}
+
+/// Resample 'seconds' of noise, returning the processing time
+double Throughput(int rate, double seconds)
+{
+    Resampler resampler(rate, OUTPUT_RATE);
+    std::vector<float> x(static_cast<size_t>(rate * seconds));
+    std::vector<float> y(resampler.GetMaxOutput(BLOCK_SAMPLES));
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0.f, 0.2f);
+    for(size_t i=0; i<x.size(); i++)
+        x[i] = noise(rng);
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for(size_t i=0; i<x.size(); i+=BLOCK_SAMPLES)
+        resampler.Process(&x[i], std::min(BLOCK_SAMPLES, x.size() - i), y.data());
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> rates;
+    double seconds = 60;
+
+    for(int i=1; i<argc; i++){
+        int rate = std::atoi(argv[i]);
+        if(rate <= 0){
+           std::cout << "Usage: resampler-bench [input rate ...]\n"
+                     << "Default rates: 8000 16000 22050 44100 48000" << std::endl;
+           return 1;
+        }
+        rates.push_back(rate);
+    }
+
+    if(rates.empty()){
+       int defaults[] = { 8000, 16000, 22050, 44100, 48000 };
+       rates.assign(defaults, defaults + sizeof(defaults)/sizeof(defaults[0]));
+    }
+
+    try{
+       std::cout << "Dot product: " << GetSampleConvertISA() << "\n"
+                 << "    rate    L/M        taps  1 kHz error (dB)   7 kHz alias (dB)   streams/core\n"
+                 << "                             poly    linear     poly    linear" << std::endl;
+
+       for(size_t i=0; i<rates.size(); i++)
+       {
+           int rate = rates[i];
+           Resampler resampler(rate, OUTPUT_RATE);
+           std::vector<float> tone = Tone(rate, 1000, rate * 2);
+
+           double poly_err = ErrorDB(Polyphase(rate, tone), 1000);
+           double lin_err = ErrorDB(Linear(rate, tone), 1000);
+
+           std::cout << std::setw(8) << rate << "  "
+                     << std::setw(4) << resampler.GetInterpolation() << "/" << std::left
+                     << std::setw(6) << resampler.GetDecimation() << std::right
+                     << std::setw(6) << resampler.GetFilterLength()
+                     << std::fixed << std::setprecision(1)
+                     << std::setw(9) << poly_err << std::setw(9) << lin_err;
+
+           if(rate > 2 * 7000){
+              std::vector<float> high = Tone(rate, 7000, rate * 2);
+              std::cout << std::setw(10) << ErrorDB(Polyphase(rate, high), 0)
+                        << std::setw(9) << ErrorDB(Linear(rate, high), 0);
+           }
+           else
+              std::cout << std::setw(10) << "-" << std::setw(9) << "-";
+
+           std::cout << std::setw(14) << std::setprecision(0)
+                     << seconds / Throughput(rate, seconds) << std::endl;
+       }
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Sample kernel equivalence test. The kernels of every instruction set
+/// available on this CPU (SSE2 and AVX2 on x86, NEON on ARM) are run on the
+/// same input as the scalar ones, over lengths covering the vector loops and
+/// their tails. The conversions, channel extraction and deinterleaving must
+/// give identical results, including the rounding of ties to even and the
+/// saturation at full scale. The dot product and the downmix, which add in a
+/// different order, must agree to within float rounding.
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "SampleConvert.h"
+
+namespace {
+
+const size_t MAX_CHANNELS = 8;
+
+std::mt19937 g_Rng(1);
+
+void Check(bool cond, const std::string &what)
+{
+    if(!cond)
+       throw std::runtime_error(what);
+}
+
+std::string Where(const char *kernel, size_t n, size_t nchans=0)
+{
+    std::ostringstream ss;
+    ss << kernel << " (n=" << n;
+    if(nchans)
+       ss << ", " << nchans << " channels";
+    ss << ")";
+    return ss.str();
+}
+
+template <class T>
+std::vector<T> RandomInts(size_t n)
+{
+    std::uniform_int_distribution<int64_t> dist(std::numeric_limits<T>::min(), std::numeric_limits<T>::max());
+    std::vector<T> x(n);
+    for(size_t i=0; i<n; i++)
+        x[i] = static_cast<T>(dist(g_Rng));
+    return x;
+}
+
+/// Floats to be converted to the integer format of the given full scale:
+/// random values, values landing on ties once scaled, and values beyond
+/// full scale
+std::vector<float> RandomFloats(size_t n, float scale)
+{
+    std::uniform_real_distribution<float> value(-1.1f, 1.1f);
+    std::uniform_int_distribution<int> kind(0, 3);
+    std::vector<float> x(n);
+    for(size_t i=0; i<n; i++){
+        float v = value(g_Rng);
+        switch(kind(g_Rng)){
+        case 0:  x[i] = v; break;
+        case 1:  x[i] = (std::floor(v * std::min(scale, 4096.f)) + 0.5f) / scale; break;
+        case 2:  x[i] = v < 0 ? -1.f : 1.f; break;
+        default: x[i] = v * 2; break;
+        }
+    }
+    return x;
+}
+
+template <class T>
+void CheckToFloat(const char *kernel, size_t n)
+{
+    std::vector<T> in = RandomInts<T>(n);
+    std::vector<float> ref(n), out(n);
+
+    SetSampleConvertISA("scalar");
+    SamplesToFloat(in.data(), ref.data(), n);
+    SetSampleConvertISA(kernel);
+    SamplesToFloat(in.data(), out.data(), n);
+
+    Check(out == ref, Where("SamplesToFloat", n) + " differs");
+}
+
+template <class T>
+void CheckFromFloat(const char *kernel, size_t n, float scale)
+{
+    std::vector<float> in = RandomFloats(n, scale);
+    std::vector<T> ref(n), out(n);
+
+    SetSampleConvertISA("scalar");
+    FloatToSamples(in.data(), ref.data(), n);
+    SetSampleConvertISA(kernel);
+    FloatToSamples(in.data(), out.data(), n);
+
+    for(size_t i=0; i<n; i++)
+        if(out[i] != ref[i]){
+           std::ostringstream ss;
+           ss << Where("FloatToSamples", n) << " differs at " << in[i] << ": "
+              << int64_t(out[i]) << " instead of " << int64_t(ref[i]);
+           throw std::runtime_error(ss.str());
+        }
+}
+
+void CheckDot(const char *kernel, size_t n)
+{
+    std::vector<float> a = RandomFloats(n, 1), b = RandomFloats(n, 1);
+
+    double mag = 0;
+    for(size_t i=0; i<n; i++)
+        mag += std::fabs(double(a[i]) * b[i]);
+
+    SetSampleConvertISA("scalar");
+    float ref = DotProduct(a.data(), b.data(), n);
+    SetSampleConvertISA(kernel);
+    float out = DotProduct(a.data(), b.data(), n);
+
+    Check(std::fabs(out - ref) <= 1e-5 * mag, Where("DotProduct", n) + " differs");
+}
+
+template <class T>
+std::vector<T> RandomFrames(size_t n);
+
+template <>
+std::vector<int16_t> RandomFrames<int16_t>(size_t n) { return RandomInts<int16_t>(n); }
+
+template <>
+std::vector<float> RandomFrames<float>(size_t n) { return RandomFloats(n, 1); }
+
+template <class T>
+void CheckChannels(const char *kernel, size_t nframes, size_t nchans)
+{
+    std::vector<T> in = RandomFrames<T>(nframes * nchans);
+    std::vector<float> weights = RandomFloats(nchans, 1);
+
+    std::vector<float> ref(nframes), out(nframes);
+    std::vector< std::vector<float> > refs(nchans, std::vector<float>(nframes));
+    std::vector< std::vector<float> > outs(nchans, std::vector<float>(nframes));
+    std::vector<float*> prefs(nchans), pouts(nchans);
+    for(size_t c=0; c<nchans; c++){
+        prefs[c] = refs[c].data();
+        pouts[c] = outs[c].data();
+    }
+
+    // Downmix, averaged and weighted
+    for(int w=0; w<2; w++){
+        const float *pw = w ? weights.data() : nullptr;
+        SetSampleConvertISA("scalar");
+        DownmixSamples(in.data(), ref.data(), nframes, nchans, pw);
+        SetSampleConvertISA(kernel);
+        DownmixSamples(in.data(), out.data(), nframes, nchans, pw);
+        for(size_t i=0; i<nframes; i++)
+            Check(std::fabs(out[i] - ref[i]) <= 1e-5f, Where("DownmixSamples", nframes, nchans) + " differs");
+    }
+
+    // Extract, from the first and last channels
+    for(size_t chan=0; chan<nchans; chan+=std::max<size_t>(nchans-1, 1)){
+        SetSampleConvertISA("scalar");
+        ExtractChannel(in.data(), ref.data(), nframes, nchans, chan);
+        SetSampleConvertISA(kernel);
+        ExtractChannel(in.data(), out.data(), nframes, nchans, chan);
+        Check(out == ref, Where("ExtractChannel", nframes, nchans) + " differs");
+    }
+
+    SetSampleConvertISA("scalar");
+    DeinterleaveSamples(in.data(), prefs.data(), nframes, nchans);
+    SetSampleConvertISA(kernel);
+    DeinterleaveSamples(in.data(), pouts.data(), nframes, nchans);
+    Check(outs == refs, Where("DeinterleaveSamples", nframes, nchans) + " differs");
+}
+
+void CheckKernels(const char *kernel)
+{
+    // Lengths around the vector widths, for the tails, and a longer one
+    std::vector<size_t> lengths;
+    for(size_t n=0; n<=40; n++)
+        lengths.push_back(n);
+    lengths.push_back(1000);
+    lengths.push_back(4099);
+
+    for(size_t k=0; k<lengths.size(); k++){
+        size_t n = lengths[k];
+        CheckToFloat<int8_t>(kernel, n);
+        CheckToFloat<uint8_t>(kernel, n);
+        CheckToFloat<int16_t>(kernel, n);
+        CheckToFloat<int32_t>(kernel, n);
+        CheckFromFloat<int8_t>(kernel, n, 128.f);
+        CheckFromFloat<int16_t>(kernel, n, 32768.f);
+        CheckFromFloat<int32_t>(kernel, n, 2147483648.f);
+        CheckDot(kernel, n);
+        for(size_t nchans=1; nchans<=MAX_CHANNELS; nchans++){
+            CheckChannels<float>(kernel, n, nchans);
+            CheckChannels<int16_t>(kernel, n, nchans);
+        }
+    }
+}
+
+}
+
+int main()
+{
+    const char* isas[] = { "sse2", "avx2", "neon" };
+    size_t tested = 0;
+
+    try{
+       for(size_t k=0; k<sizeof(isas)/sizeof(isas[0]); k++){
+           if(!SetSampleConvertISA(isas[k]))
+              continue;
+           CheckKernels(isas[k]);
+           std::cout << isas[k] << ": OK" << std::endl;
+           tested++;
+       }
+    }
+    catch(const std::exception &ex){
+       std::cerr << "FAILED: " << ex.what() << std::endl;
+       return 1;
+    }
+
+    if(tested == 0)
+       std::cout << "No SIMD kernels available, nothing to compare" << std::endl;
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Loader for shared memory datastores. It copies the datastore found in the
+/// given directory into a shared memory segment that recognizer processes can
+/// then attach to using SHMDataStore. The segment outlives this process, so
+/// the loader only needs to be run once per catalog update.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include "SHMDataStore.h"
+
+int main(int argc, char** argv)
+{
+    if(argc < 3){
+       std::cout << "Usage: shm-publish <datastore dir> <segment name>\n"
+                 << "       shm-publish -u <segment name>" << std::endl;
+       return 1;
+    }
+
+    try{
+       std::string arg1 = argv[1];
+
+       if(arg1 == "-u"){
+          SHMDataStore::Unpublish(argv[2]);
+          std::cout << "Removed " << argv[2] << std::endl;
+       }
+       else{
+          size_t size = SHMDataStore::Publish(arg1, argv[2]);
+          std::cout << "Published " << arg1 << " to " << argv[2]
+                    << " (" << size / (1024*1024) << " MB)" << std::endl;
+       }
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
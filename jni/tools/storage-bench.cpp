@@ -0,0 +1,244 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// Storage benchmark suite. With -g a synthetic catalog is first built into
+/// the datastore and then extended by a tenth with a build-merge, timing
+/// both. The read benchmarks are then run on the datastore: a scan of the
+/// list headers, random block reads, sequential reads of whole lists, and
+/// reads of random fingerprint ranges. The read benchmarks work on any
+/// datastore, including real catalogs, assuming FIDs numbered from 1.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include "SyntheticIndex.h"
+#include "BenchUtil.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchResult
+{
+    std::vector<uint32_t>  Latency;   ///< Per call, in ns
+    uint64_t               Bytes;
+    double                 Seconds;
+
+    BenchResult() : Bytes(0), Seconds(0) {}
+};
+
+/// Time a call, recording its latency
+template <typename F>
+void Measure(BenchResult &res, F call)
+{
+    Clock::time_point t0 = Clock::now();
+    res.Bytes += call();
+    res.Latency.push_back(static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count()));
+}
+
+void Report(const char *name, BenchResult &res)
+{
+    double secs = res.Seconds > 0 ? res.Seconds : 1e-9;
+
+    std::cout << name << ": " << res.Latency.size() << " reads, "
+              << std::fixed << std::setprecision(2)
+              << res.Bytes / (1024.0*1024) << " MB in " << res.Seconds << " s, "
+              << res.Latency.size() / secs << " reads/s, "
+              << res.Bytes / secs / (1024*1024) << " MB/s" << std::endl;
+    PrintLatencies("", res.Latency);
+}
+
+void ReportBuild(const char *name, const SyntheticIndex::Stats &s)
+{
+    double secs = s.Seconds > 0 ? s.Seconds : 1e-9;
+
+    std::cout << name << ": " << s.FIDs << " fingerprints, " << s.Blocks << " new blocks in "
+              << std::fixed << std::setprecision(2) << s.Seconds << " s, "
+              << s.FIDs / secs << " fp/s, "
+              << (s.IndexBytes + s.FingerprintBytes) / secs / (1024*1024) << " MB/s" << std::endl;
+}
+
+/// A list and its block count
+typedef std::pair<int, uint32_t> ListInfo;
+
+}
+
+int main(int argc, char** argv)
+{
+    SyntheticIndex::Params params;
+    size_t reads = 100000;
+    size_t window = 4096;
+    bool generate = false;
+    int i = 1;
+
+    params.FIDs = 100000;
+
+    for(; i<argc-1; i++){
+        std::string arg = argv[i];
+        if(arg == "-g")
+           generate = true;
+        else if(i+1 >= argc-1)
+           break;
+        else if(arg == "-n")
+           params.FIDs = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-l")
+           params.Lists = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-r")
+           reads = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-w")
+           window = std::strtoul(argv[++i], 0, 10);
+        else if(arg == "-s")
+           params.Seed = std::strtoul(argv[++i], 0, 10);
+        else
+           break;
+    }
+
+    if(i != argc-1 || params.FIDs == 0 || params.Lists == 0){
+       std::cout << "Usage: storage-bench [-g] [-n <FIDs>] [-l <lists>] [-r <reads>] [-w <bytes>] [-s <seed>] <datastore>\n"
+                 << "   -g  build a synthetic catalog into the datastore first (its contents are lost)\n"
+                 << "   -n  fingerprints in the synthetic catalog (" << params.FIDs << ")\n"
+                 << "   -l  number of index lists (" << params.Lists << ")\n"
+                 << "   -r  reads per read benchmark (" << reads << ")\n"
+                 << "   -w  size of the fingerprint ranges read (" << window << ")\n"
+                 << "   -s  random seed (" << params.Seed << ")\n"
+                 << "Datastores: " DATASTORE_SPECS << std::endl;
+       return 1;
+    }
+
+    try{
+       std::string spec = argv[i];
+       KVDataStore::Ptr dstore = CreateDataStore(spec);
+
+       if(generate){
+          dstore->Open(KVDataStore::BUILD, true, false, true);
+          dstore->Clear();
+          ReportBuild("Build", SyntheticIndex(params).Generate(*dstore));
+          dstore->Close();
+
+          SyntheticIndex::Params delta = params;
+          delta.FirstFID = params.FirstFID + static_cast<uint32_t>(params.FIDs);
+          delta.FIDs = std::max<size_t>(params.FIDs / 10, 1);
+          delta.Seed = params.Seed + 1;
+
+          dstore->Open(KVDataStore::BUILD_MERGE, true, false, true);
+          ReportBuild("Merge", SyntheticIndex(delta).Generate(*dstore));
+          dstore->Close();
+       }
+
+       dstore->Open(KVDataStore::GET, true, false);
+
+       std::mt19937 rng(params.Seed);
+       size_t size;
+
+       // List headers
+       std::vector<ListInfo> lists;
+       BenchResult hdr_res;
+       Clock::time_point t0 = Clock::now();
+
+       for(size_t l=0; l<params.Lists; l++){
+           int list_id = static_cast<int>(l);
+           const uint8_t *data = 0;
+           Measure(hdr_res, [&]() -> size_t {
+               data = dstore->GetPListBlock(list_id, 1, size, true);
+               return size;
+           });
+           if(size >= sizeof(Audioneex::PListHeader)){
+              Audioneex::PListHeader lhdr;
+              std::memcpy(&lhdr, data, sizeof(lhdr));
+              if(lhdr.BlockCount)
+                 lists.push_back(ListInfo(list_id, lhdr.BlockCount));
+           }
+       }
+       hdr_res.Seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+       Report("List headers", hdr_res);
+
+       if(lists.empty())
+          throw std::runtime_error("The index is empty");
+
+       uint64_t nblocks = 0;
+       for(size_t l=0; l<lists.size(); l++)
+           nblocks += lists[l].second;
+
+       std::cout << lists.size() << " lists, " << nblocks << " blocks" << std::endl;
+
+       // Random blocks
+       BenchResult rnd_res;
+       std::uniform_int_distribution<size_t> pick_list(0, lists.size() - 1);
+       t0 = Clock::now();
+
+       for(size_t r=0; r<reads; r++){
+           const ListInfo &list = lists[pick_list(rng)];
+           int block = std::uniform_int_distribution<int>(1, list.second)(rng);
+           Measure(rnd_res, [&]() -> size_t {
+               dstore->GetPListBlock(list.first, block, size, false);
+               return size;
+           });
+       }
+       rnd_res.Seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+       Report("Random blocks", rnd_res);
+
+       // Whole lists, in random order
+       std::vector<ListInfo> order = lists;
+       std::shuffle(order.begin(), order.end(), rng);
+       BenchResult seq_res;
+       t0 = Clock::now();
+
+       for(size_t l=0; l<order.size() && seq_res.Latency.size()<reads; l++)
+           for(uint32_t b=1; b<=order[l].second; b++)
+               Measure(seq_res, [&]() -> size_t {
+                   dstore->GetPListBlock(order[l].first, b, size, false);
+                   return size;
+               });
+
+       seq_res.Seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+       Report("Sequential blocks", seq_res);
+
+       // Fingerprint ranges
+       size_t nfids = dstore->GetFingerprintsCount();
+       if(nfids){
+          BenchResult fp_res;
+          std::uniform_int_distribution<uint32_t> pick_fid(1, static_cast<uint32_t>(nfids));
+          t0 = Clock::now();
+
+          for(size_t r=0; r<reads; r++){
+              uint32_t FID = pick_fid(rng);
+              Measure(fp_res, [&]() -> size_t {
+                  size_t fpsize = dstore->GetFingerprintSize(FID);
+                  if(fpsize == 0)
+                     return 0;
+                  uint32_t bo = fpsize > window ?
+                      std::uniform_int_distribution<uint32_t>(0, static_cast<uint32_t>(fpsize - window))(rng) : 0;
+                  dstore->GetFingerprint(FID, size, std::min(window, fpsize), bo);
+                  return size;
+              });
+          }
+          fp_res.Seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+          Report("Fingerprint ranges", fp_res);
+       }
+
+       dstore->Close();
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
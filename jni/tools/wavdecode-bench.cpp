@@ -0,0 +1,108 @@
+/*
+    Copyright (c) 2014 Audioneex.com.
+    Copyright (c) 2014 Alberto Gramaglia.
+    All rights reserved.
+
+	This source code is part of the Audioneex Software Development Kit and is
+	subject to the terms and conditions stated in the accompanying license.
+	Please refer to the Audioneex license document provided with the package
+	at www.audioneex.com for more information.
+
+*/
+
+/// WAV decoding benchmark. The given files are decoded to 11025 Hz mono float
+/// as for indexing, a number of times each, and the decoding throughput is
+/// reported in MB/s of WAV data and as a multiple of real time. Run it twice
+/// to measure with the files in the page cache.
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+
+#include "MappedWavSource.h"
+#include "SampleConvert.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/// Output buffer size, about a second of audio
+const size_t READ_SAMPLES = 11025;
+
+struct DecodeStats
+{
+    double  Bytes;
+    double  AudioSeconds;
+    double  Seconds;
+    size_t  Samples;
+
+    DecodeStats() : Bytes(0), AudioSeconds(0), Seconds(0), Samples(0) {}
+};
+
+void Decode(const std::string &path, size_t repeats, std::vector<float> &buffer, DecodeStats &stats)
+{
+    MappedWavSource source;
+    source.Open(path);
+
+    for(size_t r=0; r<repeats; r++)
+    {
+        source.Rewind();
+        Clock::time_point t0 = Clock::now();
+        while(size_t n = source.Read(buffer.data(), buffer.size()))
+            stats.Samples += n;
+        stats.Seconds += std::chrono::duration<double>(Clock::now() - t0).count();
+    }
+
+    stats.Bytes += double(repeats) * source.GetLenFrames() *
+                   source.GetChannels() * (source.GetSampleResolution() / 8);
+    stats.AudioSeconds += double(repeats) * source.GetLenSeconds();
+
+    std::cout << path << ": " << source.GetSampleRate() << " Hz, "
+              << source.GetChannels() << " channels, " << source.GetSampleResolution()
+              << (source.GetSampleFormat() == MappedWavSource::IEEE_FLOAT ? " bit float, " : " bit PCM, ")
+              << std::fixed << std::setprecision(1) << source.GetLenSeconds() << " s" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t repeats = 10;
+    int i = 1;
+
+    if(i+1 < argc && std::string(argv[i]) == "-r"){
+       repeats = std::strtoul(argv[i+1], 0, 10);
+       i += 2;
+    }
+
+    if(i >= argc || repeats == 0){
+       std::cout << "Usage: wavdecode-bench [-r <repeats>] <file.wav> [...]\n"
+                 << "   -r  number of times each file is decoded (" << repeats << ")" << std::endl;
+       return 1;
+    }
+
+    try{
+       std::vector<float> buffer(READ_SAMPLES);
+       DecodeStats stats;
+
+       std::cout << "Sample conversion: " << GetSampleConvertISA() << std::endl;
+
+       for(; i<argc; i++)
+           Decode(argv[i], repeats, buffer, stats);
+
+       double secs = stats.Seconds > 0 ? stats.Seconds : 1e-9;
+       std::cout << "Decoded " << std::setprecision(1) << stats.AudioSeconds << " s of audio into "
+                 << stats.Samples << " samples in " << std::setprecision(3) << stats.Seconds << " s: "
+                 << std::setprecision(1) << stats.Bytes / (1024*1024) / secs << " MB/s, "
+                 << std::setprecision(0) << stats.AudioSeconds / secs << "x real time" << std::endl;
+    }
+    catch(const std::exception &ex){
+       std::cerr << "ERROR: " << ex.what() << std::endl;
+       return 1;
+    }
+    return 0;
+}
@@ -32,6 +32,8 @@ OF SUCH DAMAGE.
 package com.audioneex.audio;
 
 import java.lang.Thread.UncaughtExceptionHandler;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 
 import android.media.AudioRecord;
 import android.media.MediaRecorder;
@@ -45,10 +47,12 @@ public class AudioSourceService implements Runnable {
 	private int mSampleFormat = android.media.AudioFormat.ENCODING_PCM_16BIT;
 	private boolean mServiceRunning = false;
 	private BufferQueue mBufferQueue = null;
+	private boolean mNativeQueue = false;
 	private AudioSourceServiceListener mAudioSourceServiceListener = null;
 	
 	
 	public void SetSampleRate(int srate) { mSampleRate = srate; }
+	public int GetSampleRate() { return mSampleRate; }
 	public void SetChannels(int channels) { mChannels = channels; }
 	public void SetSampleFormat(int format) { mSampleFormat = format; }
 
@@ -78,7 +82,7 @@ public class AudioSourceService implements Runnable {
 			if(mAudioSourceServiceListener == null)
 			   throw new Exception("No audio source listener registered");
 			
-			if(mBufferQueue==null)
+			if(mBufferQueue==null && !mNativeQueue)
 			   throw new Exception("No buffer queue set");
 			
 			mAudioSourceServiceListener.SignalAudioSourceStart();
@@ -88,9 +92,10 @@ public class AudioSourceService implements Runnable {
 			// Give it some more room
 			int buffSize = minBuffSize * 4;
 			
-			// Note that this example code does not deal with audio resampling,
-			// so if the required sampling rate of 11025 Hz is not supported
-			// by the recording device we'll just let it fail.
+			// Audio captured into the native queue is resampled to the 11025 Hz
+			// the engine requires. With the Java buffer queue there's no resampling,
+			// so if 11025 Hz is not supported by the recording device we'll just
+			// let it fail.
 			AudioRecord audioSource = new AudioRecord(mInputDevice,
 					                                  mSampleRate, 
 					                                  mChannels, 
@@ -99,26 +104,12 @@ public class AudioSourceService implements Runnable {
 			// Number of samples to be read
 			int nsamples = buffSize / 2;
 			
-			short[] tempBuf = new short[nsamples];
-			
 			audioSource.startRecording();
 
-			while(mServiceRunning)
-			{
-				int readSamples = audioSource.read(tempBuf, 0, nsamples);
-
-				AudioBuffer buffer = mBufferQueue.GetHead();
-
-				if(buffer!=null){
-				   buffer.Append(tempBuf, readSamples);
-				   if(buffer.Duration() >= 1.3){
-					  if(mBufferQueue.Push() != null)
-						 mAudioSourceServiceListener.SignalAudioBufferReady();
-				   }
-				}else{
-				   Log.w("example", "AudioSourceService: Buffer overflow. Dropping audio ...");
-				}
-			}
+			if(mNativeQueue)
+			   ReadToNativeQueue(audioSource, buffSize);
+			else
+			   ReadToBufferQueue(audioSource, nsamples);
 			
 			audioSource.stop();
 			audioSource.release();
@@ -135,6 +126,42 @@ public class AudioSourceService implements Runnable {
 		}
 	}
 
+	private void ReadToBufferQueue(AudioRecord audioSource, int nsamples)
+	{
+		short[] tempBuf = new short[nsamples];
+		
+		while(mServiceRunning)
+		{
+			int readSamples = audioSource.read(tempBuf, 0, nsamples);
+
+			AudioBuffer buffer = mBufferQueue.GetHead();
+
+			if(buffer!=null){
+			   buffer.Append(tempBuf, readSamples);
+			   if(buffer.Duration() >= 1.3){
+				  if(mBufferQueue.Push() != null)
+					 mAudioSourceServiceListener.SignalAudioBufferReady();
+			   }
+			}else{
+			   Log.w("example", "AudioSourceService: Buffer overflow. Dropping audio ...");
+			}
+		}
+	}
+	
+	// Read straight into a direct buffer and hand it to the native queue.
+	// The native side gathers the audio into frames and counts the overflows.
+	private void ReadToNativeQueue(AudioRecord audioSource, int nbytes) throws Exception
+	{
+		ByteBuffer directBuf = ByteBuffer.allocateDirect(nbytes).order(ByteOrder.nativeOrder());
+		
+		while(mServiceRunning)
+		{
+			int readBytes = audioSource.read(directBuf, nbytes);
+			if(readBytes > 0 && NativeAudioQueue.Write(directBuf, readBytes / 2) < 0)
+			   throw new Exception("Couldn't write to the native audio queue");
+		}
+	}
+
 	public boolean isRunning() {
 		return mServiceRunning;
 	}
@@ -173,6 +200,14 @@ public class AudioSourceService implements Runnable {
 		mBufferQueue = bqueue;
 	}	
 
+	/**
+	 * Send the audio to the native queue of the current native session
+	 * (see NativeAudioQueue) instead of the buffer queue.
+	 */
+	public void setNativeQueue(boolean enabled) {
+		mNativeQueue = enabled;
+	}
+
 	public void Signal(AudioSourceServiceListener listener){
 		mAudioSourceServiceListener = listener;
 	}
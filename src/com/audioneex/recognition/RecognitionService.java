@@ -38,13 +38,8 @@ import android.os.Looper;
 import android.os.Message;
 import android.util.Log;
 
-import com.audioneex.audio.AudioBuffer;
-import com.audioneex.audio.AudioBuffer16Bit;
-import com.audioneex.audio.AudioBufferFloat;
-import com.audioneex.audio.AudioFactory;
 import com.audioneex.audio.AudioSourceService;
 import com.audioneex.audio.AudioSourceServiceListener;
-import com.audioneex.audio.BufferQueue;
 
 
 enum MatchType {
@@ -81,14 +76,20 @@ enum IdentificationMode {
 
 public class RecognitionService implements Runnable, AudioSourceServiceListener {
 
+	// The captured audio is identified in frames of 1.3 seconds, mono, and up
+	// to 5 frames are queued before the oldest are dropped. The audio is captured
+	// at 44100Hz, which all devices support, and resampled to 11025Hz natively.
+	private static final int CAPTURE_RATE = 44100;
+	private static final int FRAME_SAMPLES = 14336 * (CAPTURE_RATE / 11025);
+	private static final int QUEUE_FRAMES = 5;
+	
 	private boolean mSessionComplete = true;
 	private boolean mServiceRunning = false;
 	private boolean mAutodiscovery = false;
 	
 	private AudioSourceService mAudioSourceService = null;
-	private BufferQueue mBufferQueue = null;
 	
-	private Handler OnAudioBufferReady = null;
+	private Handler OnIdentificationResults = null;
 	private Handler OnAudioSourceError = null;
 	private Handler OnAudioSourceStart = null;
 	private Handler OnAudioSourceStop  = null;
@@ -96,7 +97,6 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
 	
 	private AudioIdentificationListener mAudioIdentificationListener = null;
     
-	private AudioBufferFloat mAudioClip = null;
 	private Recognizer mRecognizer = null;
 	private Thread mAudioThread = null;
 	
@@ -124,13 +124,11 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
         //mRecognizer.SetIdentificationMode( IdentificationType.FUZZY.toInt() );
 	    mRecognizer.SetBinaryIdThreshold( 0.7f );
 
-		// Create a queue of 2-second long buffers, 11025Hz, mono
-		AudioBuffer captureBuffer = new AudioBuffer16Bit( 11025 * 2, 11025, 1, 0);
-        mBufferQueue = AudioFactory.CreateRingBuffer(5, captureBuffer);
-        
-		// Create the audio provider
+		// Create the audio provider. The audio goes to the native queue of
+		// the identification session, which is run by a native thread.
 		mAudioSourceService = new AudioSourceService();
-		mAudioSourceService.setBufferQueue(mBufferQueue);
+		mAudioSourceService.SetSampleRate(CAPTURE_RATE);
+		mAudioSourceService.setNativeQueue(true);
 		mAudioSourceService.Signal(this);		
 	}
 	
@@ -143,46 +141,26 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
 		
 		try
 		{
-		mAudioClip = new AudioBufferFloat(11025*2, 11025, 1);
-		
         Looper.prepare();
         
-        OnAudioBufferReady = new Handler() {
+        OnIdentificationResults = new Handler() {
     	    @Override
     		public void handleMessage(Message msg) {
     	    	
-    	    	// Do not process any pending audio if the identification session
-    	    	// has been completed.
+    	    	// Results of a session that has been stopped in the meantime
     	    	if(mSessionComplete) return;
     	    	
-    	    	AudioBuffer16Bit buffer = (AudioBuffer16Bit) mBufferQueue.Pull();
+    	    	String res = (String) msg.obj;
     	    	
-    	        if(buffer != null)
-    	        {
-    	           buffer.Normalize(mAudioClip);
-    	        
-    	           mRecognizer.Identify(mAudioClip.Data(), mAudioClip.Size());
-    	           String res = mRecognizer.GetResults();
-    	        
-    	           if(res!=null){
-    	              if(mAudioIdentificationListener!=null)
-    	        	     mAudioIdentificationListener.SignalIdentificationResults(res);
-    	              mRecognizer.Reset();
-    	              
-    	              // Mark the current identification session as completed.
-    	              // This causes any pending audio buffer to be discarded.
-    	              // This flag should be cleared when the audio thread is
-    	              // restarted for a new identification.
-    	              // If continuous identification is needed (for example
-    	              // to implement autodiscovery services) then disable
-    	              // session completion until explicitly stopped.
-    	              if(!mAutodiscovery){
-    	                  mSessionComplete = true;
-    	                  mAudioSourceService.Stop();
-    	              }
-    	           }
-
-    	           buffer.Resize(0);
+    	    	if(mAudioIdentificationListener!=null)
+    	    	   mAudioIdentificationListener.SignalIdentificationResults(res);
+    	    	
+    	        // Mark the current identification session as completed.
+    	        // The native session stops identifying after the first
+    	        // results unless in autodiscovery mode.
+    	        if(!mAutodiscovery){
+    	           mSessionComplete = true;
+    	           mAudioSourceService.Stop();
     	        }
     	    }
         };
@@ -190,14 +168,15 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
         OnAudioSourceStart = new Handler() {
     	    @Override
     		public void handleMessage(Message msg) {
-    	    	mRecognizer.Reset();
-    	    	mBufferQueue.Reset();
+    	    	// The recognizer is reset by StartNativeSession()
     	    }
         };
 
         OnAudioSourceStop = new Handler() {
     	    @Override
     		public void handleMessage(Message msg) {
+    	    	// The native session is stopped by the next StartSession()
+    	    	// or by Stop(), as a new one may have been started already
     	    	mSessionComplete = true;
     	    }
         };        
@@ -264,6 +243,7 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
 	    	if(mAudioIdentificationListener!=null)
  	    	   mAudioIdentificationListener.SignalIdentificationError(e.getMessage());
 		}
+		StopNativeSession();
 		// Send QUIT signal
 		if(OnQuit!=null)
 		   OnQuit.sendEmptyMessage(0);
@@ -271,6 +251,10 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
 	
 	public void StartSession() {
 		if(mSessionComplete){
+		   if(!StartNativeSession(mAudioSourceService.GetSampleRate(), FRAME_SAMPLES, QUEUE_FRAMES, true, mAutodiscovery)){
+		      SignalAudioSourceError("Couldn't start the identification session");
+		      return;
+		   }
 		   mSessionComplete = false;
 		   mAudioThread = mAudioSourceService.Start();
 		}
@@ -292,14 +276,58 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
 		return mAutodiscovery;
 	}
 	
+	/**
+	 * Load the catalog in the given directory in the background. The current
+	 * identification session, if any, goes on with the old catalog, while the
+	 * following sessions use the new one. Returns false if the reload could
+	 * not be started (e.g. another reload is in progress).
+	 */
+	public boolean ReloadCatalog(String IdDatastoreDir) {
+		if(IdDatastoreDir==null)
+			return false;
+		if(!Reload(IdDatastoreDir))
+			return false;
+		mIdDataStoreDir = IdDatastoreDir;
+		return true;
+	}
+	
+	/**
+	 * Get the datastore read statistics (calls, bytes, database and copy
+	 * times, cache hits, latency histogram) for the index, fingerprints and
+	 * metadata databases of the current catalog, as a JSON string. The
+	 * counters accumulate until ResetEngineStats() is called or a new
+	 * catalog is loaded.
+	 */
+	public String GetEngineStats() {
+		return mRecognizer.GetEngineStats();
+	}
+	
+	public void ResetEngineStats() {
+		mRecognizer.ResetEngineStats();
+	}
+	
+	/**
+	 * Get the statistics of the native audio queue of the current (or last)
+	 * identification session as a JSON string: frames captured, identified
+	 * and dropped, samples discarded and overflows.
+	 */
+	public native String GetCaptureStats();
+	
 	public void Signal(AudioIdentificationListener listener){
 		mAudioIdentificationListener = listener;
 	}	
 	
 	@Override
 	public void SignalAudioBufferReady() {
-		if(OnAudioBufferReady!=null);
-		   OnAudioBufferReady.sendEmptyMessage(0);
+		// The audio goes to the native queue
+	}
+
+	// Called by the native session thread
+	private void SignalNativeResults(String results) {
+		if(OnIdentificationResults!=null){
+		   OnIdentificationResults.sendMessage
+		   (Message.obtain(OnIdentificationResults, 0, results));
+		}
 	}
 
 	@Override
@@ -323,5 +351,8 @@ public class RecognitionService implements Runnable, AudioSourceServiceListener
 	}
 
 	private native boolean Initialize(String datastoreDir);
+	private native boolean Reload(String datastoreDir);
+	private native boolean StartNativeSession(int sampleRate, int frameSize, int nframes, boolean dropOldest, boolean continuous);
+	private native void StopNativeSession();
 	
 }
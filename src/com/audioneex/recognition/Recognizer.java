@@ -46,5 +46,7 @@ class Recognizer {
 	native boolean Identify(float[] audioclip, int nsamples);
 	native String GetResults();
 	native void   Reset();
+	native String GetEngineStats();
+	native void   ResetEngineStats();
 	
 }